@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Stops the compiler from throwing away work whose result is never read.
+template <typename T>
+inline void keep(T const& value) {
+#if defined(_MSC_VER)
+    volatile const void* sink = &value;
+    (void)sink;
+#else
+    asm volatile("" : : "r"(&value) : "memory");
+#endif
+}
+
+inline std::vector<float> noise(size_t count, float amplitude, uint32_t seed = 1) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-amplitude, amplitude);
+    std::vector<float> out(count);
+    for (auto& sample : out) sample = dist(rng);
+    return out;
+}
+
+struct BenchResult {
+    std::string kernel;
+    size_t frames = 0;
+    int channels = 0;
+    size_t iterations = 0;
+    double ns_per_buffer = 0.0;
+    double ns_per_sample = 0.0;
+};
+
+struct BenchOptions {
+    double target_ms = 20.0;
+    int batches = 5;
+    std::string filter;
+    std::string out;
+};
+
+// Times fn() in batches sized to roughly target_ms each and keeps the median batch, which
+// is steadier than the mean on a shared build host.
+template <typename F>
+BenchResult measure(const BenchOptions& options, const std::string& kernel, size_t frames, int channels, F&& fn) {
+    using clock = std::chrono::steady_clock;
+
+    for (int i = 0; i < 3; ++i) fn();
+
+    size_t iterations = 1;
+    while (true) {
+        auto start = clock::now();
+        for (size_t i = 0; i < iterations; ++i) fn();
+        double ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        if (ms >= options.target_ms / 4.0 || iterations >= (size_t(1) << 24)) break;
+        iterations *= 2;
+    }
+
+    std::vector<double> per_call;
+    for (int b = 0; b < options.batches; ++b) {
+        auto start = clock::now();
+        for (size_t i = 0; i < iterations; ++i) fn();
+        double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        per_call.push_back(ns / static_cast<double>(iterations));
+    }
+    std::sort(per_call.begin(), per_call.end());
+
+    BenchResult result;
+    result.kernel = kernel;
+    result.frames = frames;
+    result.channels = channels;
+    result.iterations = iterations * options.batches;
+    result.ns_per_buffer = per_call[per_call.size() / 2];
+    result.ns_per_sample = frames > 0 && channels > 0 ? result.ns_per_buffer / static_cast<double>(frames * channels) : 0.0;
+    return result;
+}
+
+inline bool parse_options(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            options.target_ms = 2.0;
+            options.batches = 3;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            options.out = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--quick] [--filter text] [--out file.json]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool matches(const BenchOptions& options, const std::string& kernel) {
+    return options.filter.empty() || kernel.find(options.filter) != std::string::npos;
+}
+
+inline std::string json_escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+// Results are written as one JSON document so runs can be diffed between releases.
+inline bool write_json(const BenchOptions& options, const std::string& suite, const std::vector<BenchResult>& results,
+                       const std::string& extra = "") {
+    FILE* f = options.out.empty() ? stdout : std::fopen(options.out.c_str(), "w");
+    if (!f) {
+        std::fprintf(stderr, "Failed to open \"%s\"\n", options.out.c_str());
+        return false;
+    }
+
+    std::fprintf(f, "{\n  \"suite\": \"%s\",\n", json_escape(suite).c_str());
+#if defined(__clang__)
+    std::fprintf(f, "  \"compiler\": \"clang %d.%d\",\n", __clang_major__, __clang_minor__);
+#elif defined(__GNUC__)
+    std::fprintf(f, "  \"compiler\": \"gcc %d.%d\",\n", __GNUC__, __GNUC_MINOR__);
+#elif defined(_MSC_VER)
+    std::fprintf(f, "  \"compiler\": \"msvc %d\",\n", _MSC_VER);
+#endif
+    if (!extra.empty()) std::fprintf(f, "%s", extra.c_str());
+    std::fprintf(f, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        std::fprintf(f, "    {\"kernel\": \"%s\", \"frames\": %zu, \"channels\": %d, \"iterations\": %zu, \"ns_per_buffer\": %.1f, \"ns_per_sample\": %.3f}%s\n",
+            json_escape(r.kernel).c_str(), r.frames, r.channels, r.iterations, r.ns_per_buffer, r.ns_per_sample,
+            i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+
+    if (f != stdout) std::fclose(f);
+    return true;
+}
@@ -0,0 +1,142 @@
+// Memory and decode cost of keeping soundboard clips as ADPCM blocks instead of float frames.
+// Reports the size ratio and SNR of each clip, the worst single block decode, and the cost of
+// one voice reading a device buffer from either form.
+
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <adpcm.hpp>
+#include <sound_cache.hpp>
+#include <voice_mixer.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr double CLIP_SECONDS = 30.0;
+
+// A few partials with a slow tremolo over quiet noise, closer to real clips than plain noise,
+// which ADPCM handles worst.
+std::vector<float> test_clip(size_t frames, int channels) {
+    std::vector<float> samples = noise(frames * channels, 0.02f, 7);
+    const double partials[] = {220.0, 554.4, 1318.5, 4186.0};
+    for (size_t f = 0; f < frames; ++f) {
+        double t = static_cast<double>(f) / SAMPLE_RATE;
+        double envelope = 0.6 + 0.4 * std::sin(2.0 * M_PI * 0.5 * t);
+        for (int c = 0; c < channels; ++c) {
+            double sample = 0.0;
+            for (size_t p = 0; p < 4; ++p) sample += std::sin(2.0 * M_PI * partials[p] * t + c) * (0.25 / (p + 1));
+            samples[f * channels + c] += static_cast<float>(sample * envelope);
+        }
+    }
+    return samples;
+}
+
+std::shared_ptr<const RenderedSound> make_sound(const std::vector<float>& samples, int channels, bool compress) {
+    auto sound = std::make_shared<RenderedSound>();
+    sound->channels = channels;
+    sound->frames = samples.size() / channels;
+    if (compress) {
+        sound->compressed = AdpcmClip::Encode(samples.data(), sound->frames, channels);
+    } else {
+        sound->samples = samples;
+    }
+    return sound;
+}
+
+double snr_db(const std::vector<float>& reference, const AdpcmClip& clip) {
+    std::vector<float> block(AdpcmClip::BLOCK_FRAMES * clip.Channels());
+    double signal = 0.0;
+    double error = 0.0;
+    size_t offset = 0;
+    for (size_t b = 0; b < clip.BlockCount(); ++b) {
+        size_t count = clip.DecodeBlock(b, block.data()) * clip.Channels();
+        for (size_t i = 0; i < count; ++i) {
+            double s = reference[offset + i];
+            double d = s - block[i];
+            signal += s * s;
+            error += d * d;
+        }
+        offset += count;
+    }
+    return error > 0.0 ? 10.0 * std::log10(signal / error) : 999.0;
+}
+
+// Slowest block in the clip. Each block keeps its best of 3 runs so a preempted run doesn't
+// count as a slow block.
+double worst_block_ns(const AdpcmClip& clip) {
+    using clock = std::chrono::steady_clock;
+    std::vector<float> block(AdpcmClip::BLOCK_FRAMES * clip.Channels());
+    double worst = 0.0;
+    for (size_t b = 0; b < clip.BlockCount(); ++b) {
+        double best = 1e18;
+        for (int run = 0; run < 3; ++run) {
+            auto start = clock::now();
+            clip.DecodeBlock(b, block.data());
+            keep(block[0]);
+            best = std::min(best, std::chrono::duration<double, std::nano>(clock::now() - start).count());
+        }
+        worst = std::max(worst, best);
+    }
+    return worst;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    std::vector<BenchResult> results;
+    std::string clips = "  \"clips\": [\n";
+
+    for (int channels : {1, 2}) {
+        const size_t frames = static_cast<size_t>(CLIP_SECONDS * SAMPLE_RATE);
+        const std::vector<float> samples = test_clip(frames, channels);
+
+        auto start = std::chrono::steady_clock::now();
+        std::shared_ptr<const RenderedSound> compressed = make_sound(samples, channels, true);
+        double encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::shared_ptr<const RenderedSound> pcm = make_sound(samples, channels, false);
+
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "    {\"channels\": %d, \"seconds\": %.0f, \"pcm_bytes\": %zu, \"compressed_bytes\": %zu, \"ratio\": %.2f, \"snr_db\": %.1f, \"encode_ms\": %.1f, \"worst_block_ns\": %.0f}%s\n",
+            channels, CLIP_SECONDS, pcm->Bytes(), compressed->Bytes(), static_cast<double>(pcm->Bytes()) / compressed->Bytes(),
+            snr_db(samples, compressed->compressed), encodeMs, worst_block_ns(compressed->compressed), channels == 2 ? "" : ",");
+        clips += line;
+
+        if (matches(options, "clip/decode_block")) {
+            std::vector<float> block(AdpcmClip::BLOCK_FRAMES * channels);
+            size_t next = 0;
+            results.push_back(measure(options, "clip/decode_block", AdpcmClip::BLOCK_FRAMES, channels, [&] {
+                compressed->compressed.DecodeBlock(next, block.data());
+                next = (next + 1) % compressed->compressed.BlockCount();
+                keep(block[0]);
+            }));
+        }
+
+        // One voice reading a device buffer, started over whenever it runs out.
+        for (size_t period : {128, 480, 1024}) {
+            std::vector<float> out(period * channels);
+            for (auto sound : {pcm, compressed}) {
+                std::string kernel = sound->IsCompressed() ? "clip/voice_adpcm" : "clip/voice_float";
+                if (!matches(options, kernel)) continue;
+
+                std::unique_ptr<VoiceSource> voice = make_sound_voice(sound);
+                results.push_back(measure(options, kernel, period, channels, [&] {
+                    if (voice->Finished()) voice = make_sound_voice(sound);
+                    keep(voice->Read(out.data(), period));
+                }));
+            }
+        }
+    }
+    clips += "  ],\n";
+
+    std::string extra = "  \"sample_rate\": " + std::to_string(SAMPLE_RATE) + ",\n" + clips;
+    return write_json(options, "clip", results, extra) ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+// Decode throughput of the built in decoders (decoders.hpp) per format. Writes a 60 second
+// stereo clip as WAV and FLAC at a few bit depths, checks the decoders give back exactly what
+// was written, then times reading 4096 frame chunks. On Windows the same files are also run
+// through Media Foundation's source reader the way MFSoundSource reads them, for comparison.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <decoders.hpp>
+
+#include "bench.hpp"
+#include "flac_writer.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+#endif
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t CHUNK_FRAMES = 4096;
+
+struct TestFile {
+    std::string name;
+    std::string path;
+    int bits = 16;
+    bool flac = false;
+    bool isFloat = false;
+    // FLAC frames numbered by sample, as a variable blocksize stream's are.
+    bool sampleNumbers = false;
+};
+
+// Same kind of signal as clip_bench, partials and a little noise, quantized to bits.
+std::vector<int32_t> test_signal(double seconds, int bits) {
+    size_t frames = static_cast<size_t>(seconds * SAMPLE_RATE);
+    std::vector<float> hiss = noise(frames * CHANNELS, 0.01f, 3);
+    std::vector<int32_t> out(frames * CHANNELS);
+    const double partials[] = {110.0, 440.0, 1046.5, 3520.0};
+    double full = static_cast<double>(1 << (bits - 1)) - 1.0;
+    for (size_t f = 0; f < frames; ++f) {
+        double t = static_cast<double>(f) / SAMPLE_RATE;
+        for (int c = 0; c < CHANNELS; ++c) {
+            double sample = hiss[f * CHANNELS + c];
+            for (size_t p = 0; p < 4; ++p) sample += std::sin(2.0 * M_PI * partials[p] * t + 0.3 * c) * (0.2 / (p + 1));
+            out[f * CHANNELS + c] = static_cast<int32_t>(std::lround(sample * full));
+        }
+    }
+    return out;
+}
+
+bool write_wav(const std::string& path, const std::vector<int32_t>& samples, int bits, bool isFloat) {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+
+    const uint32_t bytes = bits / 8;
+    const uint32_t dataSize = static_cast<uint32_t>(samples.size() * bytes);
+    const uint32_t riffSize = 36 + dataSize, fmtSize = 16, rate = SAMPLE_RATE, byteRate = rate * CHANNELS * bytes;
+    const uint16_t tag = isFloat ? 3 : 1, channels = CHANNELS, blockAlign = static_cast<uint16_t>(CHANNELS * bytes), bitsPerSample = static_cast<uint16_t>(bits);
+
+    std::fwrite("RIFF", 1, 4, f); std::fwrite(&riffSize, 4, 1, f); std::fwrite("WAVE", 1, 4, f);
+    std::fwrite("fmt ", 1, 4, f); std::fwrite(&fmtSize, 4, 1, f);
+    std::fwrite(&tag, 2, 1, f); std::fwrite(&channels, 2, 1, f); std::fwrite(&rate, 4, 1, f);
+    std::fwrite(&byteRate, 4, 1, f); std::fwrite(&blockAlign, 2, 1, f); std::fwrite(&bitsPerSample, 2, 1, f);
+    std::fwrite("data", 1, 4, f); std::fwrite(&dataSize, 4, 1, f);
+
+    std::vector<uint8_t> data(dataSize);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        uint8_t* p = data.data() + i * bytes;
+        if (isFloat) {
+            float v = samples[i] / 8388608.0f;
+            std::memcpy(p, &v, 4);
+        } else {
+            for (uint32_t b = 0; b < bytes; ++b) p[b] = static_cast<uint8_t>(static_cast<uint32_t>(samples[i]) >> (8 * b));
+        }
+    }
+    bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+    return std::fclose(f) == 0 && ok;
+}
+
+// Decodes the whole file and compares it against what was written.
+bool exact(const TestFile& file, const std::vector<int32_t>& expected) {
+    std::unique_ptr<SoundSource> source = open_native_source(file.path.c_str());
+    if (!source) return false;
+
+    float scale = file.isFloat ? 8388608.0f : static_cast<float>(1 << (file.bits - 1));
+    std::vector<float> chunk(CHUNK_FRAMES * CHANNELS);
+    size_t offset = 0;
+    while (size_t frames = source->Read(chunk.data(), CHUNK_FRAMES)) {
+        for (size_t i = 0; i < frames * CHANNELS; ++i) {
+            if (offset + i >= expected.size() || std::lround(chunk[i] * scale) != expected[offset + i]) return false;
+        }
+        offset += frames * CHANNELS;
+    }
+    return offset == expected.size();
+}
+
+#ifdef _WIN32
+// Whole file through an IMFSourceReader to float, ReadSample, ConvertToContiguousBuffer and
+// a copy per sample, returns milliseconds or a negative number if MF can't open it.
+double mf_decode_ms(const std::string& path) {
+    std::wstring wide(path.begin(), path.end());
+    auto start = std::chrono::steady_clock::now();
+
+    IMFSourceReader* reader = nullptr;
+    if (FAILED(MFCreateSourceReaderFromURL(wide.c_str(), nullptr, &reader)) || !reader) return -1.0;
+
+    IMFMediaType* type = nullptr;
+    MFCreateMediaType(&type);
+    type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+    type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+    type->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, 32);
+    HRESULT hr = reader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, type);
+    type->Release();
+    if (FAILED(hr)) {
+        reader->Release();
+        return -1.0;
+    }
+
+    std::vector<float> pending;
+    while (true) {
+        DWORD streamIndex, flags;
+        LONGLONG timestamp;
+        IMFSample* sample = nullptr;
+        hr = reader->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &streamIndex, &flags, &timestamp, &sample);
+        if (FAILED(hr) || (flags & MF_SOURCE_READERF_ENDOFSTREAM)) {
+            if (sample) sample->Release();
+            break;
+        }
+        if (!sample) continue;
+
+        IMFMediaBuffer* buffer = nullptr;
+        if (SUCCEEDED(sample->ConvertToContiguousBuffer(&buffer)) && buffer) {
+            BYTE* data = nullptr;
+            DWORD length = 0;
+            buffer->Lock(&data, nullptr, &length);
+            const float* samples = reinterpret_cast<const float*>(data);
+            pending.assign(samples, samples + length / sizeof(float));
+            buffer->Unlock();
+            buffer->Release();
+        }
+        sample->Release();
+        keep(pending.data());
+    }
+    reader->Release();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+#endif
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+#ifdef _WIN32
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    MFStartup(MF_VERSION);
+#endif
+
+    const double seconds = options.batches < 5 ? 10.0 : 60.0;
+    const std::string dir = std::filesystem::temp_directory_path().string();
+
+    std::vector<TestFile> files = {
+        {"wav_s16", dir + "/vice_decode_s16.wav", 16, false, false},
+        {"wav_s24", dir + "/vice_decode_s24.wav", 24, false, false},
+        {"wav_f32", dir + "/vice_decode_f32.wav", 32, false, true},
+        {"flac_s16", dir + "/vice_decode_s16.flac", 16, true, false},
+        {"flac_s24", dir + "/vice_decode_s24.flac", 24, true, false},
+        {"flac_s16_variable", dir + "/vice_decode_s16_variable.flac", 16, true, false, true},
+    };
+
+    std::vector<BenchResult> results;
+    std::string formats = "  \"formats\": [\n";
+    bool allExact = true;
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const TestFile& file = files[i];
+        std::string kernel = "decode/" + file.name;
+        if (!matches(options, kernel)) continue;
+
+        std::vector<int32_t> samples = test_signal(seconds, file.isFloat ? 24 : file.bits);
+        bool written = file.flac ? FlacWriter::Write(file.path, samples, CHANNELS, SAMPLE_RATE, file.bits, file.sampleNumbers)
+                                 : write_wav(file.path, samples, file.bits, file.isFloat);
+        if (!written) {
+            std::fprintf(stderr, "Failed to write \"%s\"\n", file.path.c_str());
+            return 1;
+        }
+
+        bool ok = exact(file, samples);
+        allExact = allExact && ok;
+
+        std::unique_ptr<SoundSource> source = open_native_source(file.path.c_str());
+        std::vector<float> chunk(CHUNK_FRAMES * CHANNELS);
+        BenchResult result = measure(options, kernel, CHUNK_FRAMES, CHANNELS, [&] {
+            size_t frames = source->Read(chunk.data(), CHUNK_FRAMES);
+            if (frames < CHUNK_FRAMES) source = open_native_source(file.path.c_str());
+            keep(chunk[0]);
+        });
+        results.push_back(result);
+        source.reset();
+
+        double realtime = (CHUNK_FRAMES * 1e9 / SAMPLE_RATE) / result.ns_per_buffer;
+        double mfRealtime = 0.0;
+#ifdef _WIN32
+        double mfMs = mf_decode_ms(file.path);
+        if (mfMs > 0.0) mfRealtime = seconds * 1000.0 / mfMs;
+#endif
+
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "    {\"format\": \"%s\", \"bytes\": %llu, \"exact\": %s, \"x_realtime\": %.0f, \"mf_x_realtime\": %.0f}%s\n",
+            file.name.c_str(), static_cast<unsigned long long>(std::filesystem::file_size(file.path)), ok ? "true" : "false",
+            realtime, mfRealtime, i + 1 < files.size() ? "," : "");
+        formats += line;
+        std::remove(file.path.c_str());
+    }
+    if (formats.size() > 2 && formats[formats.size() - 2] == ',') formats.erase(formats.size() - 2, 1);
+    formats += "  ],\n";
+
+#ifdef _WIN32
+    MFShutdown();
+#endif
+
+    std::string extra = "  \"sample_rate\": " + std::to_string(SAMPLE_RATE) + ",\n  \"seconds\": " + std::to_string(static_cast<int>(seconds)) + ",\n" + formats;
+    if (!write_json(options, "decode", results, extra)) return 1;
+    return allExact ? 0 : 1;
+}
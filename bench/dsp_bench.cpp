@@ -0,0 +1,314 @@
+// Microbenchmarks for the per-buffer kernels the audio loops run. Builds on Linux without
+// the Windows headers, see docs/Contributing.md for how to build and run it.
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <blocks.hpp>
+#include <dsp.hpp>
+#include <spectrum.hpp>
+#include <telemetry.hpp>
+#include <voice_mixer.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+const size_t FRAME_SIZES[] = {32, 64, 128, 256, 512, 1024, 2048, 4096};
+const int CHANNEL_COUNTS[] = {1, 2, 8};
+
+struct BlockFactory {
+    const char* name;
+    const char* line;
+    std::function<std::unique_ptr<Block>()> make;
+};
+
+std::vector<BlockFactory> block_factories() {
+    return {
+        {"delay", "delay time=50", [] { return std::make_unique<DelayBlock>(50, SAMPLE_RATE); }},
+        {"distortion", "distortion intensity=40", [] { return std::make_unique<DistortionBlock>(40); }},
+        {"compression", "compression amount=60", [] { return std::make_unique<CompressionBlock>(60); }},
+        {"gain", "gain amount=2", [] { return std::make_unique<GainBlock>(2.0); }},
+        {"gating", "gating threshold=10", [] { return std::make_unique<GatingBlock>(10); }},
+        {"reverb", "reverb intensity=80", [] { return std::make_unique<ReverbBlock>(80, SAMPLE_RATE); }},
+    };
+}
+
+std::string full_chain() {
+    std::string text;
+    for (auto& factory : block_factories()) {
+        text += factory.line;
+        text += "\n";
+    }
+    return text;
+}
+
+void bench_blocks(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    const size_t count = frames * channels;
+    const std::vector<float> input = noise(count, 0.5f);
+    std::vector<float> buffer(count);
+
+    for (auto& factory : block_factories()) {
+        std::string kernel = std::string("block/") + factory.name;
+        if (!matches(options, kernel)) continue;
+
+        std::unique_ptr<Block> block = factory.make();
+        results.push_back(measure(options, kernel, frames, channels, [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            for (size_t i = 0; i < count; ++i) buffer[i] = block->Render(&buffer[i]);
+            keep(buffer[0]);
+        }));
+    }
+
+    if (matches(options, "chain/render")) {
+        BlocksManager manager;
+        manager.Initialize(full_chain(), SAMPLE_RATE);
+        results.push_back(measure(options, "chain/render", frames, channels, [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            for (size_t i = 0; i < count; ++i) buffer[i] = manager.Render(&buffer[i]);
+            keep(buffer[0]);
+        }));
+    }
+
+    if (matches(options, "chain/process")) {
+        BlocksManager manager;
+        manager.Initialize(full_chain(), SAMPLE_RATE);
+        results.push_back(measure(options, "chain/process", frames, channels, [&] {
+            std::copy(input.begin(), input.end(), buffer.begin());
+            manager.Process(buffer.data(), count);
+            keep(buffer[0]);
+        }));
+    }
+}
+
+void bench_resample(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    const std::vector<float> input = noise(frames * channels, 0.5f);
+
+    if (matches(options, "resample/linear_interleaved")) {
+        results.push_back(measure(options, "resample/linear_interleaved", frames, channels, [&] {
+            size_t outFrames = 0;
+            float* out = linear_resample_interleaved(input.data(), frames, channels, 44100, SAMPLE_RATE, &outFrames);
+            keep(out[0]);
+            delete[] out;
+        }));
+    }
+
+    if (matches(options, "resample/linear_stream")) {
+        LinearResampler resampler;
+        resampler.Configure(channels, 44100, SAMPLE_RATE);
+        std::vector<float> out;
+        out.reserve(resampler.MaxOutput(frames) * channels);
+        results.push_back(measure(options, "resample/linear_stream", frames, channels, [&] {
+            size_t written = resampler.Process(input.data(), frames, out);
+            keep(written);
+            keep(out[0]);
+        }));
+    }
+}
+
+void bench_remap(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    // Stereo in, as most capture devices are, to the benchmarked channel count.
+    const std::vector<float> input = noise(frames * 2, 0.5f);
+
+    if (matches(options, "remap/interleaved")) {
+        results.push_back(measure(options, "remap/interleaved", frames, channels, [&] {
+            float* out = remap_channels_interleaved(input.data(), frames, 2, channels);
+            keep(out[0]);
+            delete[] out;
+        }));
+    }
+
+    if (matches(options, "remap/into")) {
+        std::vector<float> out(frames * channels);
+        results.push_back(measure(options, "remap/into", frames, channels, [&] {
+            remap_channels_into(input.data(), frames, 2, channels, out.data());
+            keep(out[0]);
+        }));
+    }
+}
+
+void bench_convert(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    const size_t count = frames * channels;
+    const std::vector<float> input = noise(count, 0.9f);
+    std::vector<int16_t> pcm16(count);
+    std::vector<int32_t> pcm32(count);
+    std::vector<float> out(count);
+    float_to_int16_gain(input.data(), pcm16.data(), count, 1.0f);
+    float_to_int32_gain(input.data(), pcm32.data(), count, 1.0f);
+
+    if (matches(options, "convert/float_in")) {
+        results.push_back(measure(options, "convert/float_in", frames, channels, [&] {
+            float_to_float_gain(input.data(), out.data(), count, 0.8f);
+            keep(out[0]);
+        }));
+    }
+    if (matches(options, "convert/int16_in")) {
+        results.push_back(measure(options, "convert/int16_in", frames, channels, [&] {
+            int16_to_float_gain(pcm16.data(), out.data(), count, 0.8f);
+            keep(out[0]);
+        }));
+    }
+    if (matches(options, "convert/int32_in")) {
+        results.push_back(measure(options, "convert/int32_in", frames, channels, [&] {
+            int32_to_float_gain(pcm32.data(), out.data(), count, 0.8f);
+            keep(out[0]);
+        }));
+    }
+    if (matches(options, "convert/int16_out")) {
+        results.push_back(measure(options, "convert/int16_out", frames, channels, [&] {
+            float_to_int16_gain(input.data(), pcm16.data(), count, 0.8f);
+            keep(pcm16[0]);
+        }));
+    }
+    if (matches(options, "convert/int32_out")) {
+        results.push_back(measure(options, "convert/int32_out", frames, channels, [&] {
+            float_to_int32_gain(input.data(), pcm32.data(), count, 0.8f);
+            keep(pcm32[0]);
+        }));
+    }
+    // File sample formats as WavSource reads them out of a mapping, offset by one byte so they're unaligned.
+    const struct { const char* kernel; SampleEncoding encoding; } decodes[] = {
+        {"decode/u8", SampleEncoding::U8}, {"decode/s16", SampleEncoding::S16}, {"decode/s24", SampleEncoding::S24},
+        {"decode/s32", SampleEncoding::S32}, {"decode/f32", SampleEncoding::F32}, {"decode/f64", SampleEncoding::F64},
+    };
+    for (auto& decode : decodes) {
+        if (!matches(options, decode.kernel)) continue;
+        std::vector<uint8_t> file(count * encoding_bytes(decode.encoding) + 1, 0x40);
+        results.push_back(measure(options, decode.kernel, frames, channels, [&] {
+            decode_samples(file.data() + 1, decode.encoding, out.data(), count);
+            keep(out[0]);
+        }));
+    }
+
+    if (matches(options, "convert/int16_soundboard")) {
+        results.push_back(measure(options, "convert/int16_soundboard", frames, channels, [&] {
+            float* converted = int16_to_float(pcm16.data(), frames, channels);
+            keep(converted[0]);
+            delete[] converted;
+        }));
+    }
+}
+
+// Never runs out, so the mixer benchmark keeps every voice busy.
+class LoopVoiceSource : public VoiceSource {
+public:
+    LoopVoiceSource(const std::vector<float>& samples, int channels) : samples(samples), channels(channels) {}
+
+    size_t Read(float* out, size_t frames) override {
+        size_t total = samples.size() / channels;
+        for (size_t f = 0; f < frames; ++f) {
+            std::copy_n(samples.data() + position * channels, channels, out + f * channels);
+            position = (position + 1) % total;
+        }
+        return frames;
+    }
+
+    bool Finished() const override {
+        return false;
+    }
+
+private:
+    const std::vector<float>& samples;
+    int channels;
+    size_t position = 0;
+};
+
+void bench_mixer(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    const std::vector<float> loop = noise(4096 * channels, 0.1f);
+    std::vector<float> out(frames * channels);
+
+    for (size_t voices : {1, 8, 32}) {
+        std::string kernel = "mixer/voices" + std::to_string(voices);
+        if (!matches(options, kernel)) continue;
+
+        VoiceMixer mixer(voices);
+        mixer.Configure(SAMPLE_RATE, channels, frames);
+        for (size_t v = 0; v < voices; ++v) mixer.Play(std::make_unique<LoopVoiceSource>(loop, channels), {0.5f, 0, 0, 0});
+        results.push_back(measure(options, kernel, frames, channels, [&] {
+            mixer.Mix(out.data(), frames);
+            keep(out[0]);
+        }));
+    }
+}
+
+// What each channel loop adds per buffer for its level meter, and what one UI poll costs.
+void bench_meter(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    const std::vector<float> input = noise(frames * channels, 0.3f);
+
+    if (matches(options, "meter/process")) {
+        LevelMeter meter;
+        meter.Configure(SAMPLE_RATE, channels);
+        LevelSnapshot snapshot;
+        results.push_back(measure(options, "meter/process", frames, channels, [&] {
+            meter.Process(input.data(), frames, 0.8f, 0, snapshot);
+            keep(snapshot.Read().peak);
+        }));
+    }
+
+    // 16 running channels read in one go, independent of buffer size so only measured once.
+    if (frames == FRAME_SIZES[0] && channels == CHANNEL_COUNTS[0] && matches(options, "meter/read16")) {
+        StatsRegistry registry;
+        for (int c = 0; c < 16; ++c) registry.Register(("channel " + std::to_string(c)).c_str());
+        ChannelLevelSnapshot out[16];
+        results.push_back(measure(options, "meter/read16", 16, 1, [&] {
+            keep(registry.Levels(out, 16, UINT64_MAX));
+        }));
+    }
+}
+
+// Spectrum cost per buffer (the tap write plus its share of the analyzer ticks), and one tick
+// on its own: a 60th of a second of audio drained and transformed.
+void bench_spectrum(const BenchOptions& options, std::vector<BenchResult>& results, size_t frames, int channels) {
+    const std::vector<float> input = noise(frames * channels, 0.3f);
+    std::atomic<bool> enabled{true};
+    SpectrumProcessor processor;
+
+    if (matches(options, "spectrum/per_buffer")) {
+        SpectrumTap tap("bench", SAMPLE_RATE, channels, enabled);
+        SpectrumProcessor::Prepare(tap);
+        // Analyzed at the analyzer's rate, as if it ran on the same core.
+        size_t perTick = std::max<size_t>(1, SAMPLE_RATE / SpectrumAnalyzer::RATE_HZ / frames);
+        size_t written = 0;
+        results.push_back(measure(options, "spectrum/per_buffer", frames, channels, [&] {
+            tap.Write(input.data(), frames);
+            if (++written % perTick == 0) processor.Analyze(tap, 1.0f / SpectrumAnalyzer::RATE_HZ);
+        }));
+    }
+
+    if (frames == FRAME_SIZES[0] && matches(options, "spectrum/analyze")) {
+        SpectrumTap tap("bench", SAMPLE_RATE, channels, enabled);
+        SpectrumProcessor::Prepare(tap);
+        size_t tick = SAMPLE_RATE / SpectrumAnalyzer::RATE_HZ;
+        const std::vector<float> audio = noise(tick * channels, 0.3f);
+        results.push_back(measure(options, "spectrum/analyze", tick, channels, [&] {
+            tap.Write(audio.data(), tick);
+            processor.Analyze(tap, 1.0f / SpectrumAnalyzer::RATE_HZ);
+        }));
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    std::vector<BenchResult> results;
+    for (int channels : CHANNEL_COUNTS) {
+        for (size_t frames : FRAME_SIZES) {
+            bench_blocks(options, results, frames, channels);
+            bench_resample(options, results, frames, channels);
+            bench_remap(options, results, frames, channels);
+            bench_convert(options, results, frames, channels);
+            bench_mixer(options, results, frames, channels);
+            bench_meter(options, results, frames, channels);
+            bench_spectrum(options, results, frames, channels);
+        }
+    }
+
+    std::string extra = "  \"sample_rate\": " + std::to_string(SAMPLE_RATE) + ",\n";
+    return write_json(options, "dsp", results, extra) ? 0 : 1;
+}
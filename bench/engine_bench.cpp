@@ -0,0 +1,325 @@
+// Channel engine (channel_engine.hpp). Runs three channels on a stub host whose loops take a
+// 10 ms packet at a time and take a while to open their devices, then adds, changes, re-routes,
+// re-inputs and removes them through the engine's commands. Checks that commands return at once,
+// that chain, output and volume changes reach the running loop within a couple of packets without
+// restarting it, that a new input restarts only that channel, that the others keep taking packets
+// without a gap all along, that a change replacing one still queued keeps what that one changed,
+// that removing a channel stops it without waiting for a packet, that a channel whose input fails
+// is reported as failed and recovers when given a working one, and that every update is freed.
+// The exit code is 1 if a check failed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <channel_engine.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+constexpr auto PERIOD = std::chrono::milliseconds(10);
+constexpr auto OPEN = std::chrono::milliseconds(30);
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+double ms(Clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+std::atomic<int> updatesAlive{0};
+
+struct StubUpdate : ChannelUpdate {
+    std::string chain;
+    size_t outputs = 0;
+
+    StubUpdate() {
+        updatesAlive.fetch_add(1);
+    }
+
+    ~StubUpdate() override {
+        updatesAlive.fetch_sub(1);
+    }
+};
+
+// What one channel's loop has seen, kept by name across restarts.
+struct Seen {
+    std::atomic<int> runs{0};
+    std::atomic<uint64_t> packets{0};
+    std::atomic<int64_t> lastPacket{0};
+    // Largest gap between packets, once the loop was running.
+    std::atomic<int64_t> maxGapUs{0};
+    std::atomic<int64_t> appliedUs{0};
+    std::atomic<int64_t> stoppedUs{0};
+    // Leaves updates pending, as a loop busy with a long packet would.
+    std::atomic<bool> hold{false};
+    std::mutex mutex;
+    std::string chain;
+    size_t outputs = 0;
+    float volume = 0.0f;
+};
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+}
+
+struct Waker {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool woken = false;
+};
+
+class StubHost : public ChannelHost {
+public:
+    Seen& Get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<Seen>& seen = seens[name];
+        if (!seen) seen = std::make_unique<Seen>();
+        return *seen;
+    }
+
+    void Attach(ChannelControl& control) override {
+        control.event = new Waker();
+    }
+
+    void Detach(ChannelControl& control) override {
+        delete static_cast<Waker*>(control.event);
+        control.event = nullptr;
+    }
+
+    void Wake(ChannelControl& control) override {
+        Waker& waker = *static_cast<Waker*>(control.event);
+        {
+            std::lock_guard<std::mutex> lock(waker.mutex);
+            waker.woken = true;
+        }
+        waker.cv.notify_all();
+    }
+
+    bool Run(ChannelControl& control) override {
+        Seen& seen = Get(control.spec.name);
+        seen.runs.fetch_add(1);
+        std::this_thread::sleep_for(OPEN);
+        if (control.spec.input == "missing") return false;
+
+        {
+            std::lock_guard<std::mutex> lock(seen.mutex);
+            seen.chain = control.spec.chain;
+            seen.outputs = control.spec.outputs.size();
+        }
+        control.sampleRate.store(48000);
+        control.channels.store(2);
+        control.state.store(ChannelState::Running);
+        seen.lastPacket.store(0);
+
+        Waker& waker = *static_cast<Waker*>(control.event);
+        Clock::time_point next = Clock::now() + PERIOD;
+        while (!control.stop.load()) {
+            {
+                std::unique_lock<std::mutex> lock(waker.mutex);
+                waker.cv.wait_until(lock, next, [&] { return waker.woken; });
+                waker.woken = false;
+            }
+            if (control.stop.load()) break;
+
+            // The top of a packet: swap in a change, hand back what it replaced.
+            ChannelUpdate* update = seen.hold.load() ? nullptr : control.Take();
+            if (update) {
+                StubUpdate* stub = static_cast<StubUpdate*>(update);
+                std::lock_guard<std::mutex> lock(seen.mutex);
+                if (update->changes & ChannelChange::CHAIN) std::swap(seen.chain, stub->chain);
+                if (update->changes & ChannelChange::OUTPUTS) std::swap(seen.outputs, stub->outputs);
+                control.Done(update);
+                seen.appliedUs.store(now_us());
+            }
+            if (Clock::now() < next) continue;
+
+            next += PERIOD;
+            int64_t t = now_us(), last = seen.lastPacket.exchange(t);
+            if (last) seen.maxGapUs.store(std::max(seen.maxGapUs.load(), t - last));
+            seen.packets.fetch_add(1);
+            {
+                std::lock_guard<std::mutex> lock(seen.mutex);
+                seen.volume = control.volume.load();
+            }
+        }
+        seen.stoppedUs.store(now_us());
+        return true;
+    }
+
+    std::unique_ptr<ChannelUpdate> Prepare(ChannelControl& control, const ChannelSpec& spec, unsigned changes) override {
+        if (control.sampleRate.load() == 0) return nullptr;
+        auto update = std::make_unique<StubUpdate>();
+        update->chain = spec.chain;
+        update->outputs = spec.outputs.size();
+        return update;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<Seen>> seens;
+};
+
+ChannelSpec spec(const char* name, const char* input, const char* chain) {
+    ChannelSpec s;
+    s.name = name;
+    s.input = input;
+    s.chain = chain;
+    s.outputs = {{"Speakers", 1.0f}};
+    return s;
+}
+
+ChannelState state(ChannelEngine& engine, const std::string& name) {
+    for (const ChannelStatus& status : engine.Status()) {
+        if (status.name == name) return status.state;
+    }
+    return ChannelState::Stopped;
+}
+
+bool wait_for(ChannelEngine& engine, const std::string& name, ChannelState wanted) {
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(2);
+    while (Clock::now() < deadline) {
+        if (state(engine, name) == wanted) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+// Waits for a loop to take the change, returning how long it took from when it was queued.
+double applied_after(Seen& seen, int64_t queued) {
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(2);
+    while (Clock::now() < deadline && seen.appliedUs.load() < queued) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    return (seen.appliedUs.load() - queued) / 1000.0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    StubHost host;
+    ChannelEngine engine(host);
+    Seen& mic = host.Get("mic");
+    Seen& game = host.Get("game");
+    Seen& music = host.Get("music");
+
+    Clock::time_point start = Clock::now();
+    engine.Update(spec("mic", "Microphone", "gain amount=1"));
+    engine.Update(spec("game", "Line In", ""));
+    engine.Update(spec("music", "Stereo Mix", "reverb intensity=20"));
+    double queueMs = ms(Clock::now() - start);
+    check(queueMs < 5.0, "commands return without waiting for devices to open");
+    check(wait_for(engine, "mic", ChannelState::Running) && wait_for(engine, "game", ChannelState::Running) && wait_for(engine, "music", ChannelState::Running),
+          "every channel starts and reports running");
+    std::this_thread::sleep_for(PERIOD * 5);
+    game.maxGapUs.store(0);
+    music.maxGapUs.store(0);
+
+    // A new chain is swapped into the running loop.
+    int64_t queued = now_us();
+    engine.Update(spec("mic", "Microphone", "gain amount=0.5"));
+    double chainMs = applied_after(mic, queued);
+    {
+        std::lock_guard<std::mutex> lock(mic.mutex);
+        check(mic.chain == "gain amount=0.5" && mic.runs.load() == 1, "a chain change reaches the running loop without a restart");
+    }
+    check(chainMs <= ms(PERIOD) * 2.5, "and within a packet or so");
+
+    queued = now_us();
+    engine.SetOutputs("game", {{"Speakers", 1.0f}, {"Headphones", 0.5f}});
+    double outputsMs = applied_after(game, queued);
+    {
+        std::lock_guard<std::mutex> lock(game.mutex);
+        check(game.outputs == 2 && game.runs.load() == 1, "re-routing a channel happens while it streams");
+    }
+
+    engine.SetVolume("music", 0.25f);
+    engine.Flush();
+    std::this_thread::sleep_for(PERIOD * 3);
+    {
+        std::lock_guard<std::mutex> lock(music.mutex);
+        check(music.volume == 0.25f && music.runs.load() == 1, "volume changes apply without an update or a restart");
+    }
+
+    // A new input restarts just that channel.
+    engine.SetInput("mic", "Headset", true);
+    engine.Flush();
+    check(wait_for(engine, "mic", ChannelState::Running) && mic.runs.load() == 2, "a new input restarts the channel");
+    check(game.runs.load() == 1 && music.runs.load() == 1, "and only that channel");
+
+    // Lots of changes in a row, the last one wins and nothing leaks.
+    for (int i = 0; i < 50; ++i) engine.Update(spec("mic", "Headset", i % 2 ? "delay time=10" : "delay time=20"));
+    engine.Update(spec("mic", "Headset", "delay time=30"));
+    check(engine.Flush(), "a burst of changes is all applied");
+    {
+        std::lock_guard<std::mutex> lock(mic.mutex);
+        check(mic.chain == "delay time=30" && mic.runs.load() == 2, "the last of a burst of changes is what runs");
+    }
+
+    // A change replacing one still waiting behind another keeps what the replaced one changed.
+    mic.hold.store(true);
+    engine.Update(spec("mic", "Headset", "gain amount=2"));
+    engine.Update(spec("mic", "Headset", "gain amount=3"));
+    ChannelSpec rerouted = spec("mic", "Headset", "gain amount=3");
+    rerouted.outputs.push_back({"Headphones", 0.5f});
+    engine.Update(rerouted);
+    std::this_thread::sleep_for(PERIOD * 2);
+    mic.hold.store(false);
+    engine.Flush();
+    {
+        std::lock_guard<std::mutex> lock(mic.mutex);
+        check(mic.chain == "gain amount=3" && mic.outputs == 2 && mic.runs.load() == 2, "a re-route queued behind a chain change keeps the chain");
+    }
+
+    // Removing a channel doesn't wait for its next packet.
+    queued = now_us();
+    engine.Remove("music");
+    engine.Flush();
+    double removeMs = (music.stoppedUs.load() - queued) / 1000.0;
+    check(state(engine, "music") == ChannelState::Stopped && removeMs < ms(PERIOD), "removing a channel stops it before its next packet");
+
+    int64_t gameGap = game.maxGapUs.load();
+    check(game.runs.load() == 1 && gameGap < std::chrono::duration_cast<std::chrono::microseconds>(PERIOD).count() * 4,
+          "an untouched channel kept taking packets throughout");
+
+    // An input that won't open fails, a working one brings it back.
+    engine.Update(spec("broken", "missing", ""));
+    check(wait_for(engine, "broken", ChannelState::Failed), "a channel whose input can't open is reported failed");
+    engine.SetInput("broken", "Microphone", true);
+    check(wait_for(engine, "broken", ChannelState::Running), "and runs once it's given one that can");
+
+    // Sync keeps what's listed and removes the rest.
+    engine.Sync({spec("game", "Line In", ""), spec("aux", "Aux", "")});
+    engine.Flush();
+    std::vector<ChannelStatus> status = engine.Status();
+    check(status.size() == 2 && wait_for(engine, "aux", ChannelState::Running) && game.runs.load() == 1, "syncing to a list removes, adds and leaves alone");
+
+    engine.RestartAll();
+    engine.Flush();
+    check(wait_for(engine, "game", ChannelState::Running) && game.runs.load() == 2, "restarting everything starts each channel again");
+
+    engine.Shutdown();
+    check(engine.Status().empty() && updatesAlive.load() == 0, "shutting down stops every channel and frees every update");
+
+    char extra[256];
+    std::snprintf(extra, sizeof(extra),
+        "  \"engine\": {\"queue_ms\": %.3f, \"chain_change_ms\": %.2f, \"outputs_change_ms\": %.2f, \"remove_ms\": %.2f, \"untouched_max_gap_ms\": %.2f, \"period_ms\": %.1f},\n",
+        queueMs, chainMs, outputsMs, removeMs, gameGap / 1000.0, ms(PERIOD));
+
+    if (!write_json(options, "engine", {}, extra)) return 1;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+// Capture-once fan-out (fanout.hpp). Sends one 48 kHz stereo channel to four outputs, two in its
+// own format and two at 44.1 kHz, and checks the first two read the channel's buffer itself, the
+// other two share one conversion, and what each gets is exactly what converting on its own would
+// give. Times that against what routing to four outputs cost before, capturing and running the
+// chain once per output. The exit code is 1 if a check failed.
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <blocks.hpp>
+#include <dsp.hpp>
+#include <fanout.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t BUFFER_FRAMES = 480;
+
+struct Destination {
+    int channels;
+    int sample_rate;
+};
+
+const Destination DESTINATIONS[] = {{2, 48000}, {2, 48000}, {2, 44100}, {2, 44100}};
+constexpr size_t DESTINATION_COUNT = sizeof(DESTINATIONS) / sizeof(DESTINATIONS[0]);
+
+const char* CHAIN = "gain amount=0.8\nreverb intensity=40\ndelay time=20\n";
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// One output's own conversion, the way each loop converted before.
+struct Separate {
+    LinearResampler resampler;
+    std::vector<float> resampled;
+    std::vector<float> remapped;
+    int channels;
+
+    Separate(const Destination& destination) : channels(destination.channels) {
+        resampler.Configure(CHANNELS, SAMPLE_RATE, destination.sample_rate);
+    }
+
+    const float* Convert(const float* in, size_t frames, size_t& out) {
+        out = resampler.Process(in, frames, resampled);
+        remapped.resize(out * channels);
+        remap_channels_into(resampled.data(), out, CHANNELS, channels, remapped.data());
+        return remapped.data();
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    Fanout fanout;
+    fanout.Configure(CHANNELS, SAMPLE_RATE);
+    std::vector<std::unique_ptr<Separate>> separate;
+    for (const Destination& destination : DESTINATIONS) {
+        fanout.Add(destination.channels, destination.sample_rate);
+        separate.push_back(std::make_unique<Separate>(destination));
+    }
+    check(fanout.Routes() == DESTINATION_COUNT && fanout.Conversions() == 1, "outputs in the same format share one conversion");
+
+    // A second of buffers through both.
+    const std::vector<float> input = noise(SAMPLE_RATE * CHANNELS, 0.5f);
+    bool shared = true, same = true;
+    size_t total[DESTINATION_COUNT] = {};
+    for (size_t start = 0; start + BUFFER_FRAMES <= SAMPLE_RATE; start += BUFFER_FRAMES) {
+        const float* buffer = input.data() + start * CHANNELS;
+        fanout.Process(buffer, BUFFER_FRAMES);
+        for (size_t d = 0; d < DESTINATION_COUNT; ++d) {
+            size_t frames = 0, expectedFrames = 0;
+            const float* out = fanout.Output(d, frames);
+            const float* expected = separate[d]->Convert(buffer, BUFFER_FRAMES, expectedFrames);
+            total[d] += frames;
+            if (DESTINATIONS[d].sample_rate == SAMPLE_RATE && out != buffer) shared = false;
+            if (frames != expectedFrames) {
+                same = false;
+                continue;
+            }
+            for (size_t i = 0; i < frames * DESTINATIONS[d].channels; ++i) {
+                if (out[i] != expected[i]) same = false;
+            }
+        }
+    }
+    size_t f0 = 0, f1 = 0;
+    check(shared, "outputs in the channel's format read its buffer directly");
+    check(fanout.Output(2, f0) == fanout.Output(3, f1), "outputs sharing a conversion read the same frames");
+    check(same, "each output gets exactly what converting on its own gives");
+    check(total[2] >= 44100 - 2 && total[2] <= 44100 + 2, "a second in is a second out at 44.1 kHz");
+
+    std::vector<BenchResult> results;
+    std::vector<float> buffer(BUFFER_FRAMES * CHANNELS);
+    const std::vector<float> block = noise(BUFFER_FRAMES * CHANNELS, 0.5f, 3);
+    if (matches(options, "fanout/per_output")) {
+        // Before, four outputs meant four channels: four chains and four conversions.
+        std::vector<BlocksManager> chains(DESTINATION_COUNT);
+        for (auto& chain : chains) chain.Initialize(CHAIN, SAMPLE_RATE);
+        results.push_back(measure(options, "fanout/per_output", BUFFER_FRAMES, CHANNELS, [&] {
+            for (size_t d = 0; d < DESTINATION_COUNT; ++d) {
+                buffer.assign(block.begin(), block.end());
+                chains[d].Process(buffer.data(), buffer.size());
+                size_t frames = 0;
+                keep(*separate[d]->Convert(buffer.data(), BUFFER_FRAMES, frames));
+            }
+        }));
+    }
+    if (matches(options, "fanout/shared")) {
+        BlocksManager chain;
+        chain.Initialize(CHAIN, SAMPLE_RATE);
+        results.push_back(measure(options, "fanout/shared", BUFFER_FRAMES, CHANNELS, [&] {
+            buffer.assign(block.begin(), block.end());
+            chain.Process(buffer.data(), buffer.size());
+            fanout.Process(buffer.data(), BUFFER_FRAMES);
+            for (size_t d = 0; d < DESTINATION_COUNT; ++d) {
+                size_t frames = 0;
+                keep(*fanout.Output(d, frames));
+            }
+        }));
+    }
+
+    char extra[128];
+    std::snprintf(extra, sizeof(extra), "  \"fanout\": {\"outputs\": %zu, \"conversions\": %zu},\n", fanout.Routes(), fanout.Conversions());
+
+    if (!write_json(options, "fanout", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
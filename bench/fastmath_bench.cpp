@@ -0,0 +1,205 @@
+// Fast math (fast_math.hpp). Sweeps every function over the range its documented error covers,
+// through both the scalar version and the array version on the widest lanes this was built for,
+// and checks the worst error against libm in double stays within what the header promises. Times
+// each array version against the libm loop it replaces. Built twice, fastmath_bench on the default
+// lanes and fastmath_bench_avx2 with AVX2 where the compiler has it. The exit code is 1 if a
+// check failed.
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fast_math.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr size_t BUFFER = 960;
+constexpr size_t POINTS = 1 << 21;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// LOG is absolute where the result is under 1 and relative above, for functions that cross zero.
+enum class Measure { ULP, RELATIVE, LOG };
+
+double ulp(double value) {
+    float f = std::fabs(static_cast<float>(value));
+    return std::nextafter(f, FLT_MAX) - f;
+}
+
+double error(double got, double expected, Measure measure) {
+    double diff = std::fabs(got - expected);
+    switch (measure) {
+    case Measure::ULP: return diff / ulp(expected);
+    case Measure::RELATIVE: return expected != 0.0 ? diff / std::fabs(expected) : diff;
+    default: return diff / std::max(1.0, std::fabs(expected));
+    }
+}
+
+struct Accuracy {
+    const char* name;
+    Measure measure;
+    double bound;
+    std::vector<float> inputs;
+    std::function<double(double)> reference;
+    float (*scalar)(float);
+    void (*array)(const float*, float*, size_t);
+    double worst = 0.0;
+};
+
+std::vector<float> uniform(float lo, float hi, size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> pick(lo, hi);
+    std::vector<float> out(count);
+    for (float& x : out) x = pick(rng);
+    out.push_back(lo);
+    out.push_back(hi);
+    return out;
+}
+
+// Positive normal floats picked evenly by their bits, so every exponent gets as many, plus a dense
+// run around 1.
+std::vector<float> positive(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> pick(0x00800000u, 0x7f7fffffu);
+    std::vector<float> out(count);
+    for (float& x : out) {
+        uint32_t bits = pick(rng);
+        std::memcpy(&x, &bits, 4);
+    }
+    std::vector<float> near = uniform(0.5f, 2.0f, count / 4, seed + 1);
+    out.insert(out.end(), near.begin(), near.end());
+    out.push_back(FLT_MIN);
+    out.push_back(1.0f);
+    return out;
+}
+
+double worst(Accuracy& accuracy) {
+    std::vector<float> out(accuracy.inputs.size());
+    accuracy.array(accuracy.inputs.data(), out.data(), out.size());
+    double worst = 0.0;
+    for (size_t i = 0; i < accuracy.inputs.size(); ++i) {
+        double expected = accuracy.reference(accuracy.inputs[i]);
+        worst = std::max(worst, error(accuracy.scalar(accuracy.inputs[i]), expected, accuracy.measure));
+        worst = std::max(worst, error(out[i], expected, accuracy.measure));
+    }
+    return worst;
+}
+
+const char* unit(Measure measure) {
+    return measure == Measure::ULP ? "ulp" : measure == Measure::RELATIVE ? "relative" : "absolute/relative";
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+#if defined(VICE_HAS_AVX2) && defined(__GNUC__)
+    if (!__builtin_cpu_supports("avx2")) {
+        std::fprintf(stderr, "built for AVX2 but this CPU doesn't have it, skipping\n");
+        return 0;
+    }
+#endif
+    std::fprintf(stderr, "lanes: %s\n", fastmath::isa());
+
+    const double dbToLog2 = std::log2(10.0) / 20.0;
+    std::vector<Accuracy> accuracies = {
+        {"exp2", Measure::ULP, 2.0, uniform(-126.0f, 127.0f, POINTS, 1), [](double x) {return std::exp2(x);}, fastmath::exp2, fastmath::exp2},
+        {"exp", Measure::ULP, 2.0, uniform(-87.0f, 88.0f, POINTS, 2), [](double x) {return std::exp(x);}, fastmath::exp, fastmath::exp},
+        {"log2", Measure::LOG, 1.2e-7, positive(POINTS, 3), [](double x) {return std::log2(x);}, fastmath::log2, fastmath::log2},
+        {"log", Measure::LOG, 1.5e-7, positive(POINTS, 4), [](double x) {return std::log(x);}, fastmath::log, fastmath::log},
+        {"db_to_gain", Measure::RELATIVE, 2e-6, uniform(-200.0f, 200.0f, POINTS, 5), [=](double x) {return std::exp2(x * dbToLog2);}, fastmath::db_to_gain, fastmath::db_to_gain},
+        {"gain_to_db", Measure::LOG, 3e-7, positive(POINTS, 6), [](double x) {return 20.0 * std::log10(x);}, fastmath::gain_to_db, fastmath::gain_to_db},
+        {"tanh", Measure::RELATIVE, 3e-7, uniform(-20.0f, 20.0f, POINTS, 7), [](double x) {return std::tanh(x);}, fastmath::tanh, fastmath::tanh},
+        {"sqrt", Measure::ULP, 0.5, positive(POINTS, 8), [](double x) {return std::sqrt(x);}, fastmath::sqrt, fastmath::sqrt},
+    };
+    // tanh near 0 is where the polynomial and the cancellation in the exp form would show.
+    std::vector<float> small = uniform(-1.0f, 1.0f, POINTS / 2, 9);
+    accuracies[6].inputs.insert(accuracies[6].inputs.end(), small.begin(), small.end());
+
+    char what[96];
+    for (Accuracy& accuracy : accuracies) {
+        accuracy.worst = worst(accuracy);
+        std::fprintf(stderr, "%-12s worst %.3g %s, bound %.3g\n", accuracy.name, accuracy.worst, unit(accuracy.measure), accuracy.bound);
+        std::snprintf(what, sizeof(what), "%s is within its documented error", accuracy.name);
+        check(accuracy.worst <= accuracy.bound, what);
+    }
+
+    // pow's error grows with the size of y * log2(x), the exp2 it ends in scales the log's error.
+    {
+        std::vector<float> xs = uniform(1e-4f, 10.0f, POINTS / 4, 10), ys = uniform(-3.0f, 3.0f, POINTS / 4, 11);
+        bool within = true;
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double expected = std::pow(static_cast<double>(xs[i]), static_cast<double>(ys[i]));
+            double bound = 2.4e-7 + std::fabs(ys[i] * std::log2(static_cast<double>(xs[i]))) * 8.3e-8;
+            if (error(fastmath::pow(xs[i], ys[i]), expected, Measure::RELATIVE) > bound) within = false;
+        }
+        std::vector<float> out(xs.size());
+        fastmath::pow(xs.data(), -0.75f, out.data(), xs.size());
+        for (size_t i = 0; i < xs.size(); ++i) {
+            if (out[i] != fastmath::pow(xs[i], -0.75f) && error(out[i], std::pow(static_cast<double>(xs[i]), -0.75), Measure::RELATIVE) > 3e-7) within = false;
+        }
+        check(within, "pow is within its documented error");
+    }
+
+    check(fastmath::exp2(1000.0f) < FLT_MAX && fastmath::exp2(-1000.0f) >= FLT_MIN, "exp2 never returns inf or a denormal");
+    check(fastmath::exp(1000.0f) < FLT_MAX && fastmath::exp(-1000.0f) >= FLT_MIN, "exp never returns inf or a denormal");
+    check(std::isfinite(fastmath::gain_to_db(0.0f)) && fastmath::gain_to_db(0.0f) < -750.0f, "gain_to_db(0) is a very quiet finite level");
+    check(fastmath::tanh(-0.0f) == 0.0f && fastmath::tanh(50.0f) == 1.0f && fastmath::tanh(-50.0f) == -1.0f, "tanh saturates and keeps its sign");
+
+    // What a block would run per buffer, the libm loop against the array version.
+    std::vector<BenchResult> results;
+    const std::vector<float> signal = noise(BUFFER, 0.9f);
+    std::vector<float> levels(BUFFER), out(BUFFER);
+    for (size_t i = 0; i < BUFFER; ++i) levels[i] = std::fabs(signal[i]) + 1e-6f;
+
+    struct Timing {
+        const char* name;
+        std::function<void()> libm;
+        std::function<void()> fast;
+    };
+    const std::vector<Timing> timings = {
+        {"exp", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = std::exp(signal[i]);}, [&] {fastmath::exp(signal.data(), out.data(), BUFFER);}},
+        {"log", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = std::log(levels[i]);}, [&] {fastmath::log(levels.data(), out.data(), BUFFER);}},
+        {"gain_to_db", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = 20.0f * std::log10(levels[i]);}, [&] {fastmath::gain_to_db(levels.data(), out.data(), BUFFER);}},
+        {"db_to_gain", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = std::pow(10.0f, signal[i] * 40.0f / 20.0f);}, [&] {
+            for (size_t i = 0; i < BUFFER; ++i) out[i] = signal[i] * 40.0f;
+            fastmath::db_to_gain(out.data(), out.data(), BUFFER);
+        }},
+        {"tanh", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = std::tanh(signal[i] * 4.0f);}, [&] {
+            for (size_t i = 0; i < BUFFER; ++i) out[i] = signal[i] * 4.0f;
+            fastmath::tanh(out.data(), out.data(), BUFFER);
+        }},
+        {"pow", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = std::pow(levels[i], -0.75f);}, [&] {fastmath::pow(levels.data(), -0.75f, out.data(), BUFFER);}},
+        {"sqrt", [&] {for (size_t i = 0; i < BUFFER; ++i) out[i] = std::sqrt(levels[i]);}, [&] {fastmath::sqrt(levels.data(), out.data(), BUFFER);}},
+    };
+    for (const Timing& timing : timings) {
+        std::string libm = std::string("math/") + timing.name + "/libm", fast = std::string("math/") + timing.name + "/" + fastmath::isa();
+        if (matches(options, libm)) results.push_back(measure(options, libm, BUFFER, 1, [&] {timing.libm(); keep(out[0]);}));
+        if (matches(options, fast)) results.push_back(measure(options, fast, BUFFER, 1, [&] {timing.fast(); keep(out[0]);}));
+    }
+
+    std::string extra = std::string("  \"lanes\": \"") + fastmath::isa() + "\",\n  \"max_error\": {";
+    for (size_t i = 0; i < accuracies.size(); ++i) {
+        char entry[96];
+        std::snprintf(entry, sizeof(entry), "%s\"%s\": %.4g", i ? ", " : "", accuracies[i].name, accuracies[i].worst);
+        extra += entry;
+    }
+    extra += "},\n";
+
+    if (!write_json(options, "fastmath", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
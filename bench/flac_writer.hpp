@@ -0,0 +1,82 @@
+#pragma once
+
+// Writes whole FLAC files through the recorder's encoder so decode_bench has real FLAC files to
+// read without shipping any or needing libFLAC.
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <flac_encoder.hpp>
+
+class FlacWriter {
+public:
+    static constexpr size_t BLOCK_SIZE = FlacEncoder::BLOCK_SIZE;
+
+    // samples are interleaved integers at bits per sample (16 or 24). sampleNumbers writes the
+    // frames the way a variable blocksize stream does, see Renumber.
+    static bool Write(const std::string& path, const std::vector<int32_t>& samples, int channels, int rate, int bits,
+                      bool sampleNumbers = false) {
+        size_t frames = samples.size() / channels;
+        FlacEncoder encoder;
+        encoder.Configure(rate, channels, bits);
+
+        std::vector<uint8_t> audio;
+        std::vector<uint8_t> frame;
+        for (size_t start = 0; start < frames; start += BLOCK_SIZE) {
+            frame.clear();
+            encoder.Encode(samples.data() + start * channels, std::min(BLOCK_SIZE, frames - start), frame);
+            if (sampleNumbers) frame = Renumber(frame, start);
+            audio.insert(audio.end(), frame.begin(), frame.end());
+        }
+        std::vector<uint8_t> bytes = encoder.Header();
+        bytes.insert(bytes.end(), audio.begin(), audio.end());
+
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) return false;
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+        return std::fclose(f) == 0 && ok;
+    }
+
+private:
+    // Sets the frame's variable blocksize bit and replaces its frame number with the sample
+    // number in the longest form there is, a 0xFE lead and six bytes of 36 bits, then redoes
+    // both CRCs.
+    static std::vector<uint8_t> Renumber(const std::vector<uint8_t>& frame, uint64_t sample) {
+        int ones = 0;
+        while (ones < 8 && (frame[4] & (0x80 >> ones))) ++ones;
+        size_t numberEnd = 4 + (ones == 0 ? 1 : ones);
+        size_t headerEnd = numberEnd + ((frame[2] >> 4) == 7 ? 2 : 0);
+
+        std::vector<uint8_t> out(frame.begin(), frame.begin() + 4);
+        out[1] |= 0x01;
+        out.push_back(0xFE);
+        for (int i = 5; i >= 0; --i) out.push_back(static_cast<uint8_t>(0x80 | ((sample >> (6 * i)) & 0x3F)));
+        out.insert(out.end(), frame.begin() + numberEnd, frame.begin() + headerEnd);
+        out.push_back(Crc8(out.data(), out.size()));
+        out.insert(out.end(), frame.begin() + headerEnd + 1, frame.end() - 2);
+        uint16_t crc = Crc16(out.data(), out.size());
+        out.push_back(static_cast<uint8_t>(crc >> 8));
+        out.push_back(static_cast<uint8_t>(crc & 0xFF));
+        return out;
+    }
+
+    static uint8_t Crc8(const uint8_t* data, size_t size) {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= data[i];
+            for (int b = 0; b < 8; ++b) crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+        return crc;
+    }
+
+    static uint16_t Crc16(const uint8_t* data, size_t size) {
+        uint16_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= static_cast<uint16_t>(data[i] << 8);
+            for (int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x8005) : static_cast<uint16_t>(crc << 1);
+        }
+        return crc;
+    }
+};
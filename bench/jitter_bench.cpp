@@ -0,0 +1,253 @@
+// Jitter buffer (jitter_buffer.hpp). Runs a channel's capture and one output's render against a
+// simulated device on a virtual clock: capture delivering 10 ms packets late by up to 5 ms,
+// stalling, running fast and pausing, render pulling a period at a time the way a shared mode
+// device asks for it. Checks steady capture never underruns at the automatic target, that what's
+// played comes out in order with nothing lost, that a stall counts one underrun, that fast capture
+// and a stalled render are held near the target by skipping and dropping instead of blocking, that
+// a pause goes idle without an underrun, and that real threads on both sides pass every frame
+// through in order. Times a push and a pull per buffer. The exit code is 1 if a check failed.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <jitter_buffer.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t PACKET = 480;
+constexpr size_t PERIOD = 480;
+// Two periods, what shared mode usually gives for a 10 ms request.
+constexpr size_t DEVICE_FRAMES = 960;
+// A capture period plus a render one, what the loops use without a setting.
+constexpr size_t TARGET = PACKET + PERIOD;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+uint64_t frames_to_us(size_t frames) {
+    return frames * 1000000ull / SAMPLE_RATE;
+}
+
+// Capture and a device on one clock in microseconds. Every frame pushed carries its index, so what
+// the device plays shows anything lost, repeated or out of order.
+struct Simulation {
+    JitterBuffer jitter;
+    std::mt19937 rng{5};
+
+    // Capture side: a packet every packetUs, each up to lateUs late, none during stalls.
+    uint64_t packetUs = frames_to_us(PACKET);
+    uint64_t lateUs = 5000;
+    uint64_t stallFrom = 0, stallTo = 0;
+    uint64_t pauseFrom = 0;
+    // Render side: no events between these.
+    uint64_t renderStallFrom = 0, renderStallTo = 0;
+
+    size_t pushed = 0, dropped = 0, played = 0, silence = 0, underruns = 0, skipped = 0;
+    size_t maxBuffered = 0;
+    double bufferedSum = 0.0;
+    size_t events = 0;
+    bool ordered = true;
+    float expected = 0.0f;
+
+    Simulation() {
+        jitter.Configure(CHANNELS, TARGET, SAMPLE_RATE);
+    }
+
+    void Run(uint64_t durationUs) {
+        std::vector<float> packet(PACKET * CHANNELS), out(DEVICE_FRAMES * CHANNELS);
+        std::uniform_int_distribution<uint64_t> late(0, lateUs);
+        uint64_t nominal = 0, arrival = late(rng);
+        uint64_t device = frames_to_us(PERIOD);
+        size_t padding = 0;
+        bool rendering = false;
+
+        while (std::min(arrival, device) < durationUs) {
+            if (arrival <= device) {
+                bool stalled = nominal >= stallFrom && nominal < stallTo;
+                if (pauseFrom && nominal >= pauseFrom) {
+                    jitter.Pause();
+                } else if (!stalled) {
+                    for (size_t i = 0; i < PACKET; ++i) {
+                        float index = static_cast<float>(pushed + i);
+                        for (int c = 0; c < CHANNELS; ++c) packet[i * CHANNELS + c] = index;
+                    }
+                    size_t lost = jitter.Push(packet.data(), PACKET);
+                    dropped += lost;
+                    // Dropped frames are the newest, the next packet carries on after them.
+                    pushed += PACKET;
+                }
+                nominal += packetUs;
+                arrival = nominal + late(rng);
+                continue;
+            }
+
+            uint64_t now = device;
+            device += frames_to_us(PERIOD);
+            if (now >= renderStallFrom && now < renderStallTo) continue;
+
+            // The device played a period since its last event.
+            if (rendering) padding -= std::min(padding, PERIOD);
+            if (!rendering) {
+                if (!jitter.Ready()) continue;
+                Deliver(out, DEVICE_FRAMES, 0, padding);
+                rendering = true;
+                continue;
+            }
+            if (jitter.Idle() && padding == 0) {
+                rendering = false;
+                continue;
+            }
+
+            size_t buffered = padding + jitter.Fill();
+            maxBuffered = std::max(maxBuffered, buffered);
+            bufferedSum += static_cast<double>(buffered);
+            ++events;
+            Deliver(out, DEVICE_FRAMES - padding, PERIOD > padding ? PERIOD - padding : 0, padding);
+        }
+    }
+
+    void Deliver(std::vector<float>& out, size_t count, size_t minimum, size_t& padding) {
+        JitterBuffer::Pulled pulled = jitter.Pull(out.data(), count, minimum);
+        underruns += pulled.underrun;
+        skipped += pulled.skipped;
+        for (size_t i = 0; i < pulled.played; ++i) {
+            // A gap where input was dropped or skipped is fine, going backwards or repeating isn't.
+            float index = out[i * CHANNELS];
+            if (index < expected || out[i * CHANNELS + 1] != index) ordered = false;
+            expected = index + 1.0f;
+        }
+        played += pulled.played;
+        silence += pulled.frames - pulled.played;
+        padding += pulled.frames;
+    }
+
+    double MeanMs() const {
+        return events ? bufferedSum / events * 1000.0 / SAMPLE_RATE : 0.0;
+    }
+};
+
+// Producer and consumer on real threads, the target at half the capacity so nothing is skipped and
+// the consumer reading in odd sizes so reads and writes wrap the ring at every offset.
+bool threaded(size_t total) {
+    JitterBuffer jitter;
+    jitter.Configure(CHANNELS, 2048, 4096);
+    std::atomic<bool> done{false};
+    std::thread producer([&] {
+        std::vector<float> packet(PACKET * CHANNELS);
+        size_t next = 0;
+        while (next < total) {
+            size_t room = std::min(PACKET, (jitter.CapacityFrames() - jitter.Fill()));
+            if (room == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            room = std::min(room, total - next);
+            for (size_t i = 0; i < room; ++i) {
+                for (int c = 0; c < CHANNELS; ++c) packet[i * CHANNELS + c] = static_cast<float>(next + i);
+            }
+            next += room - jitter.Push(packet.data(), room);
+        }
+        jitter.Pause();
+        done.store(true);
+    });
+
+    std::vector<float> out(331 * CHANNELS);
+    size_t expected = 0;
+    bool ok = true;
+    while (expected < total) {
+        if (done.load() && jitter.Idle()) break;
+        JitterBuffer::Pulled pulled = jitter.Pull(out.data(), 331, 0);
+        for (size_t i = 0; i < pulled.played; ++i) {
+            if (out[i * CHANNELS] != static_cast<float>(expected) || out[i * CHANNELS + 1] != static_cast<float>(expected)) ok = false;
+            ++expected;
+        }
+        if (pulled.played == 0) std::this_thread::yield();
+    }
+    producer.join();
+    return ok && expected == total;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+    const uint64_t minute = 60000000;
+
+    Simulation steady;
+    steady.Run(minute);
+    check(steady.underruns == 0 && steady.skipped == 0 && steady.dropped == 0, "5 ms late capture never underruns at the automatic target");
+    check(steady.ordered && steady.played + steady.jitter.Fill() == steady.pushed, "every frame is played in order with nothing lost");
+    check(steady.maxBuffered <= TARGET + DEVICE_FRAMES, "steady latency stays within the target plus the device");
+
+    Simulation stall;
+    stall.stallFrom = 10000000;
+    stall.stallTo = 10100000;
+    stall.Run(minute);
+    check(stall.underruns == 1 && stall.ordered, "a 100 ms capture stall counts one underrun");
+    check(stall.silence >= 4000 && stall.silence <= 6000, "and plays silence for it, not old frames");
+
+    Simulation fast;
+    fast.packetUs = fast.packetUs * 99 / 100;
+    fast.Run(minute);
+    check(fast.skipped > 0 && fast.ordered && fast.underruns == 0, "capture running 1% fast is skipped back to the target");
+    check(fast.maxBuffered <= 2 * TARGET + PACKET + DEVICE_FRAMES, "and never piles up past twice the target");
+
+    Simulation blocked;
+    blocked.renderStallFrom = 10000000;
+    blocked.renderStallTo = 12000000;
+    blocked.Run(minute);
+    check(blocked.dropped > 0 && blocked.ordered, "a stalled render drops input instead of holding up capture");
+    check(blocked.skipped > 0 && blocked.jitter.Fill() <= 2 * TARGET, "and is back near the target once it resumes");
+
+    Simulation paused;
+    paused.pauseFrom = 10000000;
+    paused.Run(minute);
+    check(paused.underruns == 0 && paused.jitter.Idle() && paused.played == paused.pushed, "a pause plays out what's left and goes idle");
+
+    JitterBuffer level;
+    level.Configure(CHANNELS, TARGET, SAMPLE_RATE);
+    std::vector<float> buffer(PACKET * CHANNELS, 0.25f);
+    level.Push(buffer.data(), PACKET);
+    level.Push(buffer.data(), PACKET);
+    size_t before = level.Fill();
+    JitterBuffer::Pulled first = level.Pull(buffer.data(), 300, 0);
+    check(before == 2 * PACKET && first.played == 300 && level.Fill() == 2 * PACKET - 300, "the fill level counts frames pushed less frames pulled");
+    level.SetTarget(1 << 30);
+    check(level.Target() == level.CapacityFrames() / 2, "the target is limited to half the capacity");
+
+    check(threaded(options.target_ms >= 20.0 ? 4000000 : 400000), "real threads on both sides pass every frame in order");
+
+    std::vector<BenchResult> results;
+    if (matches(options, "jitter/push_pull")) {
+        JitterBuffer jitter;
+        jitter.Configure(CHANNELS, TARGET, SAMPLE_RATE);
+        const std::vector<float> block = noise(PACKET * CHANNELS, 0.5f);
+        std::vector<float> out(PACKET * CHANNELS);
+        results.push_back(measure(options, "jitter/push_pull", PACKET, CHANNELS, [&] {
+            jitter.Push(block.data(), PACKET, 0.8f);
+            keep(jitter.Pull(out.data(), PACKET, PERIOD).played);
+        }));
+    }
+
+    char extra[256];
+    std::snprintf(extra, sizeof(extra),
+        "  \"jitter\": {\"target_ms\": %.1f, \"steady_mean_ms\": %.2f, \"steady_max_ms\": %.2f, \"fast_skipped_frames\": %zu, \"stalled_render_dropped_frames\": %zu},\n",
+        1000.0 * TARGET / SAMPLE_RATE, steady.MeanMs(), 1000.0 * steady.maxBuffered / SAMPLE_RATE, fast.skipped, blocked.dropped);
+
+    if (!write_json(options, "jitter", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+// Adaptive latency (latency_tuner.hpp). Runs a channel's capture, one output's jitter buffer and
+// its device on a virtual clock counted in frames, with capture packets and render wakeups late by
+// a random amount, and lets the tuner pick how much to queue in the device and buffer in between.
+// Checks that a quiet machine settles low and stays clean, that a noisy one settles higher and is
+// clean once settled, that the tuner grows when the machine gets worse and comes back down when it
+// recovers, that it doesn't keep flapping once settled, that it holds still while processing
+// leaves no headroom, and that it never goes past its limits. The exit code is 1 if a check failed.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <jitter_buffer.hpp>
+#include <latency_tuner.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t PACKET = 480;
+constexpr size_t PERIOD = 480;
+// The device buffer an adaptive output opens, 50 ms.
+constexpr size_t DEVICE_FRAMES = 2400;
+constexpr size_t CAPACITY = SAMPLE_RATE;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+size_t ms_to_frames(double ms) {
+    return static_cast<size_t>(ms * SAMPLE_RATE / 1000.0);
+}
+
+double frames_to_ms(double frames) {
+    return frames * 1000.0 / SAMPLE_RATE;
+}
+
+// What the machine does to the stream: how late capture packets and render wakeups arrive, how
+// often the render thread is held up for longer, and how much of a packet's time processing takes.
+struct Machine {
+    double captureLateMs = 1.0;
+    double renderLateMs = 1.0;
+    double spikeChance = 0.0;
+    double spikeMs = 0.0;
+    float load = 0.1f;
+};
+
+struct Simulation {
+    JitterBuffer jitter;
+    AdaptiveLatency tuner;
+    std::mt19937 rng{9};
+
+    uint64_t now = 0;
+    uint64_t nextPacket = 0, arrival = 0;
+    uint64_t nextWake = PERIOD;
+    // The device's queue as of the last wake.
+    size_t deviceQueued = 0;
+    uint64_t lastWake = 0;
+    bool rendering = false;
+    // Only silence went into the device last time, it running out isn't another xrun.
+    bool underran = false;
+
+    size_t starved = 0, underruns = 0, skipped = 0;
+    double latencySum = 0.0;
+    size_t wakes = 0;
+
+    Simulation() {
+        tuner.Configure(PERIOD, CAPACITY / 2, SAMPLE_RATE);
+        jitter.Configure(CHANNELS, tuner.Target(), CAPACITY);
+    }
+
+    // Runs for seconds more on machine, counting afresh.
+    void Run(const Machine& machine, double seconds) {
+        starved = underruns = skipped = wakes = 0;
+        latencySum = 0.0;
+        std::vector<float> packet(PACKET * CHANNELS, 0.5f), out(DEVICE_FRAMES * CHANNELS);
+        std::uniform_real_distribution<double> captureLate(0.0, machine.captureLateMs), renderLate(0.0, machine.renderLateMs);
+        std::uniform_real_distribution<double> chance(0.0, 1.0), spike(0.0, machine.spikeMs);
+        uint64_t end = now + ms_to_frames(seconds * 1000.0);
+
+        while (now < end) {
+            if (arrival <= nextWake) {
+                now = arrival;
+                jitter.Push(packet.data(), PACKET);
+                nextPacket += PACKET;
+                arrival = std::max(now, nextPacket + ms_to_frames(captureLate(rng)));
+                continue;
+            }
+
+            now = nextWake;
+            nextWake += PERIOD;
+            // A thread held up past its next event wakes for that one straight away.
+            uint64_t woke = std::max(lastWake, now + ms_to_frames(renderLate(rng) + (chance(rng) < machine.spikeChance ? spike(rng) : 0.0)));
+            if (!rendering) {
+                if (!jitter.Ready()) continue;
+                deviceQueued = jitter.Pull(out.data(), DEVICE_FRAMES, 0).frames;
+                lastWake = woke;
+                rendering = true;
+                continue;
+            }
+
+            // The device plays continuously, what was queued runs out if the thread wakes late.
+            uint64_t played = woke - lastWake;
+            bool ranOut = played > deviceQueued;
+            bool dry = ranOut && !underran;
+            size_t padding = ranOut ? 0 : deviceQueued - static_cast<size_t>(played);
+            starved += dry;
+
+            skipped += jitter.Skip(tuner.Period(padding, jitter.Fill(), dry || underran, machine.load));
+            jitter.SetTarget(tuner.Target());
+
+            size_t minimum = PERIOD > padding ? PERIOD - padding : 0;
+            JitterBuffer::Pulled pulled = jitter.Pull(out.data(), DEVICE_FRAMES - padding, minimum);
+            deviceQueued = padding + pulled.frames;
+            lastWake = woke;
+            underran = pulled.underrun;
+            underruns += pulled.underrun;
+
+            latencySum += static_cast<double>(deviceQueued + jitter.Fill());
+            ++wakes;
+        }
+    }
+
+    size_t Xruns() const {
+        return starved + underruns;
+    }
+
+    // Mean frames held right after topping the device up, in ms.
+    double MeanMs() const {
+        return wakes ? frames_to_ms(latencySum / wakes) : 0.0;
+    }
+};
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    Machine quiet;
+    Machine noisy;
+    noisy.captureLateMs = 4.0;
+    noisy.renderLateMs = 3.0;
+    noisy.spikeChance = 0.01;
+    noisy.spikeMs = 20.0;
+
+    // The tuner on its own.
+    LatencyTuner unit;
+    unit.Configure(100, 1000, 50, 10);
+    unit.Update(true, false);
+    bool grew = unit.Level() == 200;
+    for (int i = 0; i < 9; ++i) unit.Update(false, false);
+    bool waited = unit.Level() == 200;
+    unit.Update(false, false);
+    check(grew && waited && unit.Level() == 150, "grows two steps on an xrun, steps down one after settling");
+    for (int i = 0; i < 10; ++i) unit.Update(false, false);
+    unit.Update(true, false);
+    for (int i = 0; i < 10; ++i) unit.Update(false, false);
+    bool above = unit.Level() == 150;
+    for (int i = 0; i < 19; ++i) unit.Update(false, false);
+    bool backedOff = unit.Level() == 150;
+    unit.Update(false, false);
+    check(above && backedOff && unit.Level() == 100, "a level that runs dry again waits twice as long to retry");
+    for (int i = 0; i < 100; ++i) unit.Update(true, false);
+    bool capped = unit.Level() == 1000;
+    for (int i = 0; i < 100000; ++i) unit.Update(false, false);
+    check(capped && unit.Level() == 100, "stays within its limits");
+    unit.Update(true, false);
+    size_t held = unit.Level();
+    for (int i = 0; i < 100000; ++i) unit.Update(false, true);
+    check(unit.Level() == held, "never steps down while busy");
+
+    Simulation calm;
+    calm.Run(quiet, 60.0);
+    calm.Run(quiet, 60.0);
+    check(calm.Xruns() == 0, "a quiet machine runs clean once settled");
+    check(calm.MeanMs() <= 15.0, "and settles close to a capture and a render period");
+
+    Simulation rough;
+    rough.Run(noisy, 120.0);
+    size_t settling = rough.Xruns();
+    rough.Run(noisy, 120.0);
+    check(rough.Xruns() <= 3, "a machine with stalls runs close to clean once settled");
+    check(rough.MeanMs() > calm.MeanMs() + 5.0, "and settles higher than a quiet one");
+
+    // The machine gets worse, then recovers.
+    Simulation shifting;
+    shifting.Run(quiet, 30.0);
+    double before = shifting.MeanMs();
+    shifting.Run(noisy, 60.0);
+    double during = shifting.MeanMs();
+    shifting.Run(quiet, 240.0);
+    shifting.Run(quiet, 10.0);
+    double after = shifting.MeanMs();
+    check(during > before + 5.0, "grows when the machine gets worse");
+    check(after < before + 2.0, "and comes back down when it recovers");
+
+    // Once settled, the margin shouldn't flap.
+    uint64_t changes = rough.tuner.Changes();
+    rough.Run(noisy, 120.0);
+    check(rough.tuner.Changes() - changes <= 10, "a settled stream changes its margin rarely");
+
+    // A channel whose processing leaves no headroom holds where it is.
+    Simulation loaded;
+    loaded.Run(noisy, 30.0);
+    size_t margin = loaded.tuner.Margin();
+    uint64_t trimmed = loaded.tuner.Trimmed();
+    Machine busy = quiet;
+    busy.load = 0.9f;
+    loaded.Run(busy, 60.0);
+    check(loaded.tuner.Margin() == margin && loaded.tuner.Trimmed() == trimmed, "holds still while processing leaves no headroom");
+
+    std::vector<BenchResult> results;
+    if (matches(options, "latency/period")) {
+        AdaptiveLatency tuner;
+        tuner.Configure(PERIOD, CAPACITY / 2, SAMPLE_RATE);
+        uint32_t n = 0;
+        results.push_back(measure(options, "latency/period", PERIOD, CHANNELS, [&] {
+            keep(tuner.Period(PERIOD, PACKET, (++n & 1023) == 0, 0.1f));
+            keep(tuner.Target());
+        }));
+    }
+
+    char extra[320];
+    std::snprintf(extra, sizeof(extra),
+        "  \"latency\": {\"quiet_mean_ms\": %.1f, \"stalls_mean_ms\": %.1f, \"stalls_settling_xruns\": %zu, \"worse_mean_ms\": %.1f, \"recovered_mean_ms\": %.1f},\n",
+        calm.MeanMs(), rough.MeanMs(), settling, during, after);
+
+    if (!write_json(options, "latency", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+// Pitch block (pitch_shifter.hpp, fft.hpp). Checks the real FFT against a plain DFT and its
+// inverse against the input, that sine tones shifted up and down land within a few cents of where
+// they should and most of their energy ends up there, that the formant control keeps or moves a
+// harmonic tone's envelope, that no shift gives the input back delayed by exactly the reported
+// latency, and that a whole chain built from text does the same. Times the block on a mono mic,
+// a stereo one and eight mics at once against the buffer's real time. The exit code is 1 if a
+// check failed.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <blocks.hpp>
+#include <fft.hpp>
+#include <pitch_shifter.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr size_t BUFFER_FRAMES = 480;
+constexpr double PI = 3.14159265358979323846;
+// Long enough for the estimate to resolve a cent at 100 Hz.
+constexpr size_t ANALYSIS = 1 << 16;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+std::vector<float> tone(double hz, size_t count, double amplitude = 0.5) {
+    std::vector<float> out(count);
+    for (size_t i = 0; i < count; ++i) out[i] = static_cast<float>(amplitude * std::sin(2.0 * PI * hz * i / SAMPLE_RATE));
+    return out;
+}
+
+// Harmonics of hz up to 4 kHz shaped by a resonance at formant Hz, a crude vowel.
+std::vector<float> vowel(double hz, double formant, size_t count) {
+    std::vector<float> out(count, 0.0f);
+    for (int h = 1; h * hz < 4000.0; ++h) {
+        double f = h * hz;
+        double amplitude = 0.1 / (1.0 + std::pow((f - formant) / 150.0, 2.0));
+        for (size_t i = 0; i < count; ++i) out[i] += static_cast<float>(amplitude * std::sin(2.0 * PI * f * i / SAMPLE_RATE));
+    }
+    return out;
+}
+
+std::vector<float> shift(const std::vector<float>& input, double semitones, double formant) {
+    PitchShifter shifter;
+    shifter.SetShift(semitones, formant);
+    std::vector<float> out = input;
+    for (size_t start = 0; start < out.size(); start += BUFFER_FRAMES) {
+        shifter.Process(out.data() + start, std::min(BUFFER_FRAMES, out.size() - start));
+    }
+    return out;
+}
+
+struct Spectrum {
+    std::vector<float> power;
+
+    // Hann windowed power of the last ANALYSIS samples.
+    explicit Spectrum(const std::vector<float>& signal) {
+        RealFft fft;
+        fft.Configure(ANALYSIS);
+        std::vector<float> windowed(ANALYSIS);
+        size_t offset = signal.size() - ANALYSIS;
+        for (size_t i = 0; i < ANALYSIS; ++i) {
+            windowed[i] = signal[offset + i] * static_cast<float>(0.5 - 0.5 * std::cos(2.0 * PI * i / ANALYSIS));
+        }
+        power.resize(ANALYSIS / 2 + 1);
+        fft.Power(windowed.data(), power.data());
+    }
+
+    double Hz(double bin) const {
+        return bin * SAMPLE_RATE / ANALYSIS;
+    }
+
+    // Frequency of the strongest bin between lo and hi Hz, interpolated on the log magnitude.
+    double Peak(double lo, double hi) const {
+        size_t first = static_cast<size_t>(lo * ANALYSIS / SAMPLE_RATE), last = static_cast<size_t>(hi * ANALYSIS / SAMPLE_RATE);
+        size_t best = first;
+        for (size_t k = first; k <= last; ++k) {
+            if (power[k] > power[best]) best = k;
+        }
+        double a = std::log(power[best - 1] + 1e-30), b = std::log(power[best] + 1e-30), c = std::log(power[best + 1] + 1e-30);
+        return Hz(best + 0.5 * (a - c) / (a - 2.0 * b + c));
+    }
+
+    // Share of the power within a quarter tone of hz.
+    double Share(double hz) const {
+        double total = 0.0, near = 0.0;
+        double lo = hz * std::pow(2.0, -0.5 / 12.0), hi = hz * std::pow(2.0, 0.5 / 12.0);
+        for (size_t k = 1; k < power.size(); ++k) {
+            total += power[k];
+            if (Hz(k) >= lo && Hz(k) <= hi) near += power[k];
+        }
+        return total > 0.0 ? near / total : 0.0;
+    }
+};
+
+double cents(double hz, double expected) {
+    return 1200.0 * std::log2(hz / expected);
+}
+
+// Largest difference between out and in delayed by latency, relative to in's peak.
+double delayed_error(const std::vector<float>& in, const std::vector<float>& out, size_t latency) {
+    double error = 0.0, peak = 0.0;
+    for (size_t i = 0; i + latency < out.size(); ++i) {
+        error = std::max(error, static_cast<double>(std::fabs(out[i + latency] - in[i])));
+        peak = std::max(peak, static_cast<double>(std::fabs(in[i])));
+    }
+    return error / peak;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    // FFT against a plain DFT, then back.
+    {
+        const size_t size = 256;
+        RealFft fft;
+        fft.Configure(size);
+        std::vector<float> input = noise(size, 0.5f), re(size / 2 + 1), im(size / 2 + 1), back(size);
+        fft.Forward(input.data(), re.data(), im.data());
+        double dftError = 0.0;
+        for (size_t k = 0; k <= size / 2; ++k) {
+            double sumRe = 0.0, sumIm = 0.0;
+            for (size_t i = 0; i < size; ++i) {
+                sumRe += input[i] * std::cos(2.0 * PI * k * i / size);
+                sumIm -= input[i] * std::sin(2.0 * PI * k * i / size);
+            }
+            dftError = std::max(dftError, std::hypot(re[k] - sumRe, im[k] - sumIm));
+        }
+        fft.Inverse(re.data(), im.data(), back.data());
+        double roundTrip = 0.0;
+        for (size_t i = 0; i < size; ++i) roundTrip = std::max(roundTrip, static_cast<double>(std::fabs(back[i] - input[i])));
+        check(dftError < 1e-4, "the real FFT matches a plain DFT");
+        check(roundTrip < 1e-5, "the inverse FFT gives the input back");
+    }
+
+    const size_t latency = PitchShifter::LatencySamples();
+    const size_t length = ANALYSIS + SAMPLE_RATE / 2;
+
+    struct Case {
+        double hz;
+        double semitones;
+        const char* what;
+    };
+    const Case cases[] = {
+        {220.0, 12.0, "220 Hz up an octave lands on 440 Hz"},
+        {220.0, -5.0, "220 Hz down a fourth lands on 164.8 Hz"},
+        {440.0, 7.0, "440 Hz up a fifth lands on 659.3 Hz"},
+        {330.0, -12.0, "330 Hz down an octave lands on 165 Hz"},
+    };
+    double worstCents = 0.0, worstShare = 1.0;
+    for (const Case& c : cases) {
+        double expected = c.hz * std::pow(2.0, c.semitones / 12.0);
+        Spectrum spectrum(shift(tone(c.hz, length), c.semitones, c.semitones));
+        double error = std::fabs(cents(spectrum.Peak(expected * 0.8, expected * 1.25), expected));
+        double share = spectrum.Share(expected);
+        worstCents = std::max(worstCents, error);
+        worstShare = std::min(worstShare, share);
+        check(error < 5.0, c.what);
+    }
+    check(worstShare > 0.95, "shifted tones keep their energy at the new pitch");
+
+    // A 150 Hz vowel with its formant at 1 kHz, an octave up.
+    double kept = 0.0, moved = 0.0;
+    {
+        std::vector<float> input = vowel(150.0, 1000.0, length);
+        kept = Spectrum(shift(input, 12.0, 0.0)).Peak(200.0, 4000.0);
+        moved = Spectrum(shift(input, 12.0, 12.0)).Peak(200.0, 4000.0);
+        check(kept > 700.0 && kept < 1300.0, "formant 0 keeps the envelope where it was");
+        check(moved > 1700.0 && moved < 2300.0, "formant equal to the pitch moves the envelope with it");
+    }
+
+    // No shift is the input delayed by the latency.
+    const std::vector<float> speech = noise(SAMPLE_RATE, 0.5f, 7);
+    double transparent = delayed_error(speech, shift(speech, 0.0, 0.0), latency);
+    check(transparent < 1e-4, "no shift gives the input back delayed by the latency");
+
+    std::vector<float> impulse(SAMPLE_RATE / 10, 0.0f);
+    impulse[100] = 1.0f;
+    std::vector<float> response = shift(impulse, 0.0, 0.0);
+    size_t measured = std::max_element(response.begin(), response.end(), [](float a, float b) {return std::fabs(a) < std::fabs(b);}) - response.begin() - 100;
+    check(measured == latency, "the reported latency is the measured one");
+
+    BlocksManager chain;
+    chain.Initialize("pitch semitones=0 formant=0\n", SAMPLE_RATE, 2);
+    std::vector<float> stereo(speech.size() * 2);
+    for (size_t i = 0; i < speech.size(); ++i) stereo[2 * i] = stereo[2 * i + 1] = speech[i];
+    std::vector<float> processed = stereo;
+    for (size_t start = 0; start < processed.size(); start += BUFFER_FRAMES * 2) chain.Process(processed.data() + start, BUFFER_FRAMES * 2);
+    check(delayed_error(stereo, processed, latency * 2) < 1e-4, "a pitch chain on a stereo channel delays both sides alike");
+    BlocksManager whole;
+    whole.Initialize("pitch semitones=0 formant=0\n", SAMPLE_RATE, 2);
+    std::vector<float> oneGo = stereo;
+    whole.Process(oneGo.data(), oneGo.size());
+    check(oneGo == processed, "a buffer longer than a downmix chunk comes out the same");
+    check(chain.SetParam(0, "semitones", 3.0) && chain.SetParam(0, "formant", -2.0), "pitch and formant change while running");
+
+    std::vector<BenchResult> results;
+    const std::vector<float> voice = vowel(180.0, 800.0, BUFFER_FRAMES * 8);
+    double budget = 0.0;
+    auto run = [&](const char* name, int channels, int chains) {
+        if (!matches(options, name)) return;
+        std::vector<BlocksManager> managers(chains);
+        for (auto& manager : managers) manager.Initialize("pitch semitones=4 formant=0\n", SAMPLE_RATE, channels);
+        std::vector<float> block(BUFFER_FRAMES * channels), buffer(block.size());
+        for (size_t i = 0; i < block.size(); ++i) block[i] = voice[i / channels];
+        BenchResult result = measure(options, name, BUFFER_FRAMES, channels * chains, [&] {
+            for (auto& manager : managers) {
+                buffer.assign(block.begin(), block.end());
+                manager.Process(buffer.data(), buffer.size());
+                keep(buffer.back());
+            }
+        });
+        if (chains > 1) budget = result.ns_per_buffer / (1e9 * BUFFER_FRAMES / SAMPLE_RATE);
+        results.push_back(result);
+    };
+    run("pitch/mono", 1, 1);
+    run("pitch/stereo", 2, 1);
+    run("pitch/8_mics", 1, 8);
+
+    char extra[256];
+    std::snprintf(extra, sizeof(extra),
+        "  \"pitch\": {\"latency_samples\": %zu, \"latency_ms\": %.2f, \"worst_cents\": %.3f, \"worst_share\": %.4f, \"formant_kept_hz\": %.1f, \"formant_moved_hz\": %.1f, \"eight_mics_realtime\": %.4f},\n",
+        latency, 1000.0 * latency / SAMPLE_RATE, worstCents, worstShare, kept, moved, budget);
+
+    if (!write_json(options, "pitch", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
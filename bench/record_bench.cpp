@@ -0,0 +1,252 @@
+// Disk recorder (recorder.hpp). Records a clip through a RecordPoint in every format and checks
+// the decoders read back exactly what was recorded, then runs eight simulated channel loops in
+// real time with and without a FLAC recording each and compares what RecordPoint::Write costs
+// them. The exit code is 1 if a file didn't read back exactly, a recording overflowed or a
+// recording that couldn't start left a file behind.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <decoders.hpp>
+#include <recorder.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t BUFFER_FRAMES = 480;
+constexpr int LOOPS = 8;
+
+struct Format {
+    const char* name;
+    const char* extension;
+    RecordFormat format;
+    int bits;
+};
+
+const Format FORMATS[] = {
+    {"wav_s16", "wav", RecordFormat::Wav, 16},
+    {"wav_s24", "wav", RecordFormat::Wav, 24},
+    {"wav_f32", "wav", RecordFormat::Wav, 32},
+    {"flac_s16", "flac", RecordFormat::Flac, 16},
+    {"flac_s24", "flac", RecordFormat::Flac, 24},
+};
+
+// Partials and a little noise, like the other benches.
+std::vector<float> test_signal(double seconds) {
+    size_t frames = static_cast<size_t>(seconds * SAMPLE_RATE);
+    std::vector<float> out = noise(frames * CHANNELS, 0.01f, 5);
+    const double partials[] = {110.0, 440.0, 1046.5, 3520.0};
+    for (size_t f = 0; f < frames; ++f) {
+        double t = static_cast<double>(f) / SAMPLE_RATE;
+        for (int c = 0; c < CHANNELS; ++c) {
+            double sample = 0.0;
+            for (size_t p = 0; p < 4; ++p) sample += std::sin(2.0 * M_PI * partials[p] * t + 0.3 * c) * (0.2 / (p + 1));
+            out[f * CHANNELS + c] += static_cast<float>(sample);
+        }
+    }
+    return out;
+}
+
+// Pushes the signal through a point as fast as the writer keeps up, a second at a time so the
+// two second ring never fills, and stops the recording.
+bool record(Recorder& recorder, const Format& format, const std::string& path, const std::vector<float>& signal, RecordingInfo& info) {
+    std::shared_ptr<RecordPoint> point = recorder.Register(format.name, SAMPLE_RATE, CHANNELS);
+    uint64_t id = recorder.Start(format.name, path.c_str(), format.format, format.bits);
+    if (!id) return false;
+
+    size_t frames = signal.size() / CHANNELS;
+    for (size_t start = 0; start < frames; start += BUFFER_FRAMES) {
+        point->Write(signal.data() + start * CHANNELS, std::min(BUFFER_FRAMES, frames - start));
+        if ((start / BUFFER_FRAMES + 1) % (SAMPLE_RATE / BUFFER_FRAMES) == 0) {
+            // Stops waiting if the recording is gone or its writer failed, Stop reports which.
+            RecordingInfo progress{};
+            while (recorder.List(&progress, 1) == 1 && !progress.failed && progress.frames < start) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+    }
+    bool ok = recorder.Stop(id, &info);
+    recorder.Unregister(point);
+    return ok;
+}
+
+bool exact(const Format& format, const std::string& path, const std::vector<float>& signal) {
+    std::unique_ptr<SoundSource> source = open_native_source(path.c_str());
+    if (!source || source->Channels() != CHANNELS || source->SampleRate() != SAMPLE_RATE) return false;
+
+    float full = static_cast<float>(1 << (format.bits - 1));
+    std::vector<float> chunk(4096 * CHANNELS);
+    size_t offset = 0;
+    while (size_t frames = source->Read(chunk.data(), 4096)) {
+        for (size_t i = 0; i < frames * CHANNELS; ++i) {
+            if (offset + i >= signal.size()) return false;
+            float expected = signal[offset + i];
+            bool same = format.bits == 32 ? chunk[i] == expected
+                                           : std::lround(chunk[i] * full) == std::lrint(std::max(-1.0f, std::min(1.0f, expected)) * (full - 1.0f));
+            if (!same) return false;
+        }
+        offset += frames * CHANNELS;
+    }
+    return offset == signal.size();
+}
+
+struct LoopTiming {
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t overflows = 0;
+};
+
+// LOOPS threads each write a buffer every 10ms like a channel loop and time the Write call.
+LoopTiming run_loops(double seconds, bool recording, const std::string& dir) {
+    Recorder recorder;
+    std::vector<std::shared_ptr<RecordPoint>> points;
+    std::vector<uint64_t> ids;
+    for (int l = 0; l < LOOPS; ++l) {
+        std::string name = "loop" + std::to_string(l);
+        points.push_back(recorder.Register(name.c_str(), SAMPLE_RATE, CHANNELS));
+        if (recording) {
+            std::string path = dir + "/vice_record_" + name + ".flac";
+            ids.push_back(recorder.Start(name.c_str(), path.c_str(), RecordFormat::Flac, 24));
+        }
+    }
+
+    const std::vector<float> signal = test_signal(1.0);
+    const size_t buffers = static_cast<size_t>(seconds * SAMPLE_RATE / BUFFER_FRAMES);
+    std::vector<std::vector<uint64_t>> times(LOOPS);
+    std::vector<std::thread> threads;
+    for (int l = 0; l < LOOPS; ++l) {
+        threads.emplace_back([&, l] {
+            auto next = std::chrono::steady_clock::now();
+            times[l].reserve(buffers);
+            for (size_t b = 0; b < buffers; ++b) {
+                const float* in = signal.data() + (b * BUFFER_FRAMES) % (signal.size() - BUFFER_FRAMES * CHANNELS);
+                auto start = std::chrono::steady_clock::now();
+                points[l]->Write(in, BUFFER_FRAMES, 0.8f);
+                times[l].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                next += std::chrono::microseconds(BUFFER_FRAMES * 1000000 / SAMPLE_RATE);
+                std::this_thread::sleep_until(next);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    LoopTiming timing;
+    for (uint64_t id : ids) {
+        RecordingInfo info{};
+        recorder.Stop(id, &info);
+        timing.overflows += info.overflows;
+        std::remove((dir + "/vice_record_" + info.source + ".flac").c_str());
+    }
+    for (auto& point : points) recorder.Unregister(point);
+
+    std::vector<uint64_t> all;
+    for (auto& loop : times) all.insert(all.end(), loop.begin(), loop.end());
+    std::sort(all.begin(), all.end());
+    timing.p50_ns = all[all.size() / 2];
+    timing.p99_ns = all[all.size() * 99 / 100];
+    timing.max_ns = all.back();
+    return timing;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    const double seconds = options.batches < 5 ? 3.0 : 10.0;
+    const std::string dir = std::filesystem::temp_directory_path().string();
+    const std::vector<float> signal = test_signal(seconds);
+
+    bool ok = true;
+    std::string formats = "  \"formats\": [\n";
+    Recorder recorder;
+    for (const Format& format : FORMATS) {
+        if (!matches(options, std::string("record/") + format.name)) continue;
+        std::string path = dir + "/vice_record_" + format.name + "." + format.extension;
+
+        auto start = std::chrono::steady_clock::now();
+        RecordingInfo info{};
+        bool recorded = record(recorder, format, path, signal, info);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        bool same = recorded && exact(format, path, signal);
+        ok = ok && same && info.overflows == 0;
+
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "    {\"format\": \"%s\", \"bytes\": %llu, \"exact\": %s, \"overflows\": %llu, \"x_realtime\": %.0f},\n",
+            format.name, static_cast<unsigned long long>(info.bytes), same ? "true" : "false",
+            static_cast<unsigned long long>(info.overflows), seconds * 1000.0 / ms);
+        formats += line;
+        std::remove(path.c_str());
+    }
+    if (formats.size() > 2 && formats[formats.size() - 2] == ',') formats.erase(formats.size() - 2, 1);
+    formats += "  ],\n";
+
+    // A point with every slot taken refuses a recording without leaving a file behind.
+    std::shared_ptr<RecordPoint> full = recorder.Register("full", SAMPLE_RATE, CHANNELS);
+    std::vector<std::unique_ptr<RecordTap>> taps;
+    for (size_t s = 0; s < RecordPoint::SLOTS; ++s) {
+        taps.push_back(std::make_unique<RecordTap>(SAMPLE_RATE, CHANNELS));
+        full->Attach(taps.back().get());
+    }
+    const std::string refusedPath = dir + "/vice_record_full.wav";
+    std::remove(refusedPath.c_str());
+    bool refused = recorder.Start("full", refusedPath.c_str(), RecordFormat::Wav, 16) == 0 && !std::filesystem::exists(refusedPath);
+    ok = ok && refused;
+    for (auto& tap : taps) full->Detach(tap.get());
+    recorder.Unregister(full);
+
+    std::vector<BenchResult> results;
+    const std::vector<float> buffer = noise(BUFFER_FRAMES * CHANNELS, 0.3f);
+    if (matches(options, "record/idle")) {
+        RecordPoint point("idle", SAMPLE_RATE, CHANNELS);
+        results.push_back(measure(options, "record/idle", BUFFER_FRAMES, CHANNELS, [&] {
+            point.Write(buffer.data(), BUFFER_FRAMES, 0.8f);
+        }));
+    }
+    // The consumer side is a Skip here so the ring never fills and only the push is timed.
+    if (matches(options, "record/push")) {
+        RecordPoint point("push", SAMPLE_RATE, CHANNELS);
+        RecordTap tap(SAMPLE_RATE, CHANNELS);
+        point.Attach(&tap);
+        results.push_back(measure(options, "record/push", BUFFER_FRAMES, CHANNELS, [&] {
+            point.Write(buffer.data(), BUFFER_FRAMES, 0.8f);
+            tap.ring.Skip(BUFFER_FRAMES * CHANNELS);
+        }));
+        point.Detach(&tap);
+    }
+
+    std::string loops;
+    if (matches(options, "record/loops")) {
+        LoopTiming idle = run_loops(seconds, false, dir);
+        LoopTiming recording = run_loops(seconds, true, dir);
+        ok = ok && recording.overflows == 0;
+        char line[512];
+        std::snprintf(line, sizeof(line),
+            "  \"loops\": {\"count\": %d, \"buffer_frames\": %zu, \"idle_p50_ns\": %llu, \"idle_p99_ns\": %llu, \"idle_max_ns\": %llu, "
+            "\"recording_p50_ns\": %llu, \"recording_p99_ns\": %llu, \"recording_max_ns\": %llu, \"overflows\": %llu},\n",
+            LOOPS, BUFFER_FRAMES, static_cast<unsigned long long>(idle.p50_ns), static_cast<unsigned long long>(idle.p99_ns),
+            static_cast<unsigned long long>(idle.max_ns), static_cast<unsigned long long>(recording.p50_ns),
+            static_cast<unsigned long long>(recording.p99_ns), static_cast<unsigned long long>(recording.max_ns),
+            static_cast<unsigned long long>(recording.overflows));
+        loops = line;
+    }
+
+    std::string extra = "  \"sample_rate\": " + std::to_string(SAMPLE_RATE) + ",\n" + formats + loops +
+                        "  \"refused_leaves_no_file\": " + (refused ? "true" : "false") + ",\n";
+    if (!write_json(options, "record", results, extra)) return 1;
+    return ok ? 0 : 1;
+}
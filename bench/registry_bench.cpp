@@ -0,0 +1,218 @@
+// DeviceRegistry driven by a stub enumerator. Checks that lookups don't go back to the
+// enumerator, that each notification only refreshes what it names, and that notifications
+// from another thread while lookups run leave the registry consistent. Also times the lookups
+// the UI and the channel loops make. The exit code is 1 if a check failed.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <device_registry.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+// Devices and sessions held in memory, counting every call the registry makes.
+class StubEnumerator : public DeviceEnumerator {
+public:
+    std::vector<AudioDevice> devices;
+    std::vector<AudioSession> sessions;
+    std::atomic<int> deviceListCalls{0}, deviceCalls{0}, sessionCalls{0}, forgetCalls{0};
+    std::mutex mutex;
+
+    std::vector<AudioDevice> Devices() override {
+        ++deviceListCalls;
+        std::lock_guard<std::mutex> lock(mutex);
+        return devices;
+    }
+
+    bool Device(const std::string& id, AudioDevice& out) override {
+        ++deviceCalls;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const AudioDevice& device : devices) {
+            if (device.id == id) {
+                out = device;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<AudioSession> Sessions(const std::string& deviceId) override {
+        ++sessionCalls;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<AudioSession> out;
+        for (const AudioSession& session : sessions) {
+            if (session.deviceId == deviceId) out.push_back(session);
+        }
+        return out;
+    }
+
+    void Watch(DeviceRegistry&) override {}
+
+    void Forget(const std::string&) override {
+        ++forgetCalls;
+    }
+
+    void Rename(const std::string& id, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (AudioDevice& device : devices) {
+            if (device.id == id) device.name = name;
+        }
+    }
+
+    void Remove(const std::string& id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        devices.erase(std::remove_if(devices.begin(), devices.end(), [&](const AudioDevice& d) { return d.id == id; }),
+                      devices.end());
+        sessions.erase(std::remove_if(sessions.begin(), sessions.end(), [&](const AudioSession& s) { return s.deviceId == id; }),
+                       sessions.end());
+    }
+};
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// 8 outputs and 4 inputs with 3 sessions on each output, like a busy desktop.
+void populate(StubEnumerator& stub) {
+    for (int i = 0; i < 8; ++i) stub.devices.push_back({"render-" + std::to_string(i), "Speakers " + std::to_string(i), DeviceFlow::Render});
+    for (int i = 0; i < 4; ++i) stub.devices.push_back({"capture-" + std::to_string(i), "Mic " + std::to_string(i), DeviceFlow::Capture});
+    uint32_t pid = 100;
+    for (int i = 0; i < 8; ++i) {
+        for (int s = 0; s < 3; ++s, ++pid) stub.sessions.push_back({"render-" + std::to_string(i), pid, "app" + std::to_string(pid)});
+    }
+}
+
+void check_incremental() {
+    StubEnumerator stub;
+    populate(stub);
+    DeviceRegistry registry(stub);
+
+    std::string id;
+    for (int i = 0; i < 1000; ++i) {
+        registry.FindDevice(DeviceFlow::Render, "Speakers 3", id);
+        registry.Names(DeviceFlow::Capture);
+        registry.Sessions();
+    }
+    check(stub.deviceListCalls == 1 && stub.deviceCalls == 0 && stub.sessionCalls == 8,
+          "enumerates once, then lookups don't touch the enumerator");
+    check(id == "render-3", "finds a device by name");
+    check(!registry.FindDevice(DeviceFlow::Capture, "Speakers 3", id), "names are per flow");
+
+    AudioSession session;
+    check(registry.FindSession("APP104", session) && session.deviceId == "render-1" && session.pid == 104,
+          "finds a session by app, ignoring case");
+
+    stub.Rename("render-3", "Headphones");
+    registry.DeviceChanged("render-3");
+    bool renamed = registry.FindDevice(DeviceFlow::Render, "Headphones", id) && id == "render-3" &&
+                   !registry.FindDevice(DeviceFlow::Render, "Speakers 3", id);
+    check(renamed && stub.deviceCalls == 1 && stub.deviceListCalls == 1 && stub.sessionCalls == 8,
+          "a rename refreshes only that device");
+
+    {
+        std::lock_guard<std::mutex> lock(stub.mutex);
+        stub.devices.push_back({"render-8", "Speakers 1", DeviceFlow::Render});
+        stub.sessions.push_back({"render-8", 900, "late"});
+    }
+    registry.DeviceChanged("render-8");
+    check(registry.FindDevice(DeviceFlow::Render, "Speakers 1", id) && id == "render-1",
+          "a duplicate name resolves to the first device");
+    check(registry.FindSession("late", session) && stub.sessionCalls == 9, "a new device's sessions are read once");
+
+    stub.Remove("render-1");
+    registry.DeviceRemoved("render-1");
+    check(registry.FindDevice(DeviceFlow::Render, "Speakers 1", id) && id == "render-8",
+          "removing a device hands its name to the next one");
+    check(!registry.FindSession("app104", session) && stub.forgetCalls == 1, "removing a device drops its sessions");
+
+    {
+        std::lock_guard<std::mutex> lock(stub.mutex);
+        stub.sessions.push_back({"render-2", 1000, "voice"});
+    }
+    registry.SessionsChanged("render-2");
+    check(registry.FindSession("voice", session) && stub.sessionCalls == 10, "a new session re-reads only its device");
+
+    registry.SessionEnded("render-2", 1000);
+    check(!registry.FindSession("voice", session) && stub.sessionCalls == 10, "an ended session is dropped without enumerating");
+
+    registry.DeviceChanged("gone");
+    uint64_t generation = registry.Generation();
+    check(registry.Generation() == generation && registry.Names(DeviceFlow::Render).size() == 8,
+          "unknown devices are ignored, generation only moves on changes");
+}
+
+// One thread keeps notifying about devices and sessions while another looks them up.
+void check_concurrent() {
+    StubEnumerator stub;
+    populate(stub);
+    DeviceRegistry registry(stub);
+    registry.Generation();
+
+    std::atomic<bool> done{false};
+    std::thread notifier([&] {
+        for (int i = 0; i < 20000; ++i) {
+            std::string id = "render-" + std::to_string(i % 8);
+            stub.Rename(id, "Speakers " + std::to_string(i % 8));
+            registry.DeviceChanged(id);
+            registry.SessionsChanged(id);
+            registry.SessionEnded(id, 100 + (i % 24));
+        }
+        done = true;
+    });
+
+    bool consistent = true;
+    std::string id;
+    while (!done) {
+        for (int i = 0; i < 8; ++i) {
+            if (!registry.FindDevice(DeviceFlow::Render, "Speakers " + std::to_string(i), id) || id != "render-" + std::to_string(i))
+                consistent = false;
+        }
+    }
+    notifier.join();
+    check(consistent && registry.Names(DeviceFlow::Render).size() == 8, "lookups stay consistent under notifications");
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    check_incremental();
+    check_concurrent();
+
+    StubEnumerator stub;
+    populate(stub);
+    DeviceRegistry registry(stub);
+    std::vector<BenchResult> results;
+    std::string id;
+    AudioSession session;
+    if (matches(options, "registry/find_device")) {
+        results.push_back(measure(options, "registry/find_device", 1, 1, [&] {
+            keep(registry.FindDevice(DeviceFlow::Render, "Speakers 7", id));
+        }));
+    }
+    if (matches(options, "registry/find_session")) {
+        results.push_back(measure(options, "registry/find_session", 1, 1, [&] {
+            keep(registry.FindSession("app120", session));
+        }));
+    }
+    if (matches(options, "registry/names")) {
+        results.push_back(measure(options, "registry/names", 1, 1, [&] {
+            keep(registry.Names(DeviceFlow::Render).size());
+        }));
+    }
+
+    if (!write_json(options, "registry", results, "")) return 1;
+    return failures ? 1 : 0;
+}
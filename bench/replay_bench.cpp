@@ -0,0 +1,183 @@
+// Instant replay (replay.hpp). Feeds ten minutes of eight stereo channels through RecordPoints,
+// some playing music, some talking with pauses and some silent, and reports what the history
+// costs in memory against keeping it as float. Checks the history stays within its length and
+// budget, that an export comes back at the right length and close to what was played, and times
+// what the replay adds per buffer. The exit code is 1 if a check failed.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <decoders.hpp>
+#include <replay.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t BUFFER_FRAMES = 480;
+constexpr int SOURCES = 8;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+// Music on sources 0-1, talking one second in three on 2-4, silence on the rest.
+void fill(int source, size_t frame, float* out, size_t frames) {
+    for (size_t f = 0; f < frames; ++f) {
+        double t = static_cast<double>(frame + f) / SAMPLE_RATE;
+        double sample = 0.0;
+        if (source < 2) {
+            sample = 0.3 * std::sin(2.0 * M_PI * 220.0 * t) + 0.15 * std::sin(2.0 * M_PI * 1318.5 * t + source) +
+                     0.05 * std::sin(2.0 * M_PI * 5274.0 * t);
+        } else if (source < 5 && static_cast<long>(t) % 3 == 0) {
+            sample = 0.4 * std::sin(2.0 * M_PI * 180.0 * t) * std::sin(2.0 * M_PI * 4.0 * t);
+        }
+        for (int c = 0; c < CHANNELS; ++c) out[f * CHANNELS + c] = static_cast<float>(sample * (c ? 0.9 : 1.0));
+    }
+}
+
+// Plays seconds of every source into the points a second at a time, draining in between so the
+// taps never fill however fast this runs.
+void play(ReplayBuffer& replay, std::vector<std::shared_ptr<RecordPoint>>& points, size_t& frame, double seconds) {
+    std::vector<float> buffer(BUFFER_FRAMES * CHANNELS);
+    size_t end = frame + static_cast<size_t>(seconds * SAMPLE_RATE);
+    while (frame < end) {
+        for (size_t b = 0; b < SAMPLE_RATE / BUFFER_FRAMES && frame < end; ++b, frame += BUFFER_FRAMES) {
+            for (int s = 0; s < SOURCES; ++s) {
+                fill(s, frame, buffer.data(), BUFFER_FRAMES);
+                points[s]->Write(buffer.data(), BUFFER_FRAMES);
+            }
+        }
+        replay.Drain();
+    }
+}
+
+bool wait_export(ReplayBuffer& replay, uint64_t id, ReplayExportInfo& info) {
+    for (int i = 0; i < 30000; ++i) {
+        ReplayExportInfo all[16];
+        size_t count = replay.Exports(all, 16);
+        for (size_t e = 0; e < count; ++e) {
+            if (all[e].id == id && all[e].done) {
+                info = all[e];
+                return true;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+// SNR in dB of a decoded export against the last frames of source 0 up to frame.
+double export_snr(const std::string& path, size_t frame, size_t frames, size_t& decoded) {
+    decoded = 0;
+    std::unique_ptr<SoundSource> source = open_native_source(path.c_str());
+    if (!source || source->Channels() != CHANNELS) return 0.0;
+
+    std::vector<float> expected(4096 * CHANNELS), chunk(4096 * CHANNELS);
+    double signal = 0.0, noise = 0.0;
+    size_t start = frame - frames;
+    while (size_t count = source->Read(chunk.data(), 4096)) {
+        fill(0, start + decoded, expected.data(), count);
+        for (size_t i = 0; i < count * CHANNELS; ++i) {
+            signal += static_cast<double>(expected[i]) * expected[i];
+            noise += static_cast<double>(chunk[i] - expected[i]) * (chunk[i] - expected[i]);
+        }
+        decoded += count;
+    }
+    return 10.0 * std::log10(signal / std::max(noise, 1e-20));
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+
+    const double minutes = 10.0;
+    const size_t budget = 512ull * 1024 * 1024;
+    ReplayBuffer replay;
+    replay.Configure(true, minutes * 60.0, budget);
+
+    std::vector<std::shared_ptr<RecordPoint>> points;
+    for (int s = 0; s < SOURCES; ++s) {
+        points.push_back(std::make_shared<RecordPoint>(("channel" + std::to_string(s)).c_str(), SAMPLE_RATE, CHANNELS));
+        replay.Add(points.back());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t frame = 0;
+    play(replay, points, frame, minutes * 60.0 + 30.0);
+    double fillMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ReplayStats stats = replay.Stats();
+    double floatBytes = SOURCES * minutes * 60.0 * SAMPLE_RATE * CHANNELS * sizeof(float);
+    double chunkSeconds = static_cast<double>(ReplayBuffer::CHUNK_FRAMES) / SAMPLE_RATE;
+    check(stats.seconds >= minutes * 60.0 && stats.seconds < minutes * 60.0 + chunkSeconds, "history holds exactly the last ten minutes");
+
+    const std::string path = (std::filesystem::temp_directory_path() / "vice_replay.wav").string();
+    start = std::chrono::steady_clock::now();
+    uint64_t id = replay.Export("channel0", path.c_str(), RecordFormat::Wav, 32, 60.0);
+    ReplayExportInfo info{};
+    bool exported = id && wait_export(replay, id, info) && !info.failed;
+    double exportMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    size_t decoded = 0;
+    double snr = exported ? export_snr(path, frame, 60 * SAMPLE_RATE, decoded) : 0.0;
+    check(exported && decoded == 60u * SAMPLE_RATE && info.frames == decoded, "an export has the length asked for, up to the last buffer");
+    check(snr > 25.0, "an export is within ADPCM's error of what was played");
+    std::remove(path.c_str());
+
+    check(replay.Export("nothing", path.c_str(), RecordFormat::Wav, 16, 10.0) == 0, "no export for an unknown source");
+
+    // A tighter budget drops the oldest chunks first and the rest of the history keeps going.
+    replay.Configure(true, minutes * 60.0, stats.bytes / 2);
+    play(replay, points, frame, 5.0);
+    ReplayStats halved = replay.Stats();
+    check(halved.bytes <= stats.bytes / 2 && halved.seconds > 0.0, "stays within a smaller budget");
+
+    replay.Configure(false, 0.0, 0);
+    check(replay.Stats().bytes == 0, "disabling drops the history");
+
+    std::vector<BenchResult> results;
+    replay.Configure(true, 60.0, budget);
+    std::vector<float> buffer(BUFFER_FRAMES * CHANNELS);
+    fill(0, 0, buffer.data(), BUFFER_FRAMES);
+    // Both sides, the loop's push and the background drain and encode it leads to.
+    if (matches(options, "replay/per_buffer")) {
+        results.push_back(measure(options, "replay/per_buffer", BUFFER_FRAMES, CHANNELS, [&] {
+            points[0]->Write(buffer.data(), BUFFER_FRAMES);
+            replay.Drain();
+        }));
+    }
+    if (matches(options, "replay/silent_buffer")) {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        results.push_back(measure(options, "replay/silent_buffer", BUFFER_FRAMES, CHANNELS, [&] {
+            points[5]->Silence(BUFFER_FRAMES);
+            replay.Drain();
+        }));
+    }
+    for (auto& point : points) replay.Remove(point);
+
+    char extra[768];
+    std::snprintf(extra, sizeof(extra),
+        "  \"history\": {\"sources\": %d, \"minutes\": %.0f, \"bytes\": %llu, \"mb\": %.1f, \"float_mb\": %.1f, \"ratio\": %.1f, "
+        "\"chunks\": %llu, \"fill_x_realtime\": %.0f},\n"
+        "  \"export\": {\"seconds\": 60, \"ms\": %.1f, \"snr_db\": %.1f},\n",
+        SOURCES, minutes, static_cast<unsigned long long>(stats.bytes), stats.bytes / 1048576.0, floatBytes / 1048576.0,
+        floatBytes / std::max<double>(1.0, stats.bytes), static_cast<unsigned long long>(stats.chunks),
+        (minutes * 60.0 + 30.0) * 1000.0 / fillMs, exportMs, snr);
+
+    if (!write_json(options, "replay", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
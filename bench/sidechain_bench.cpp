@@ -0,0 +1,240 @@
+// Sidechain buses (sidechain.hpp) and the blocks keyed off them. Runs a voice chain publishing to
+// a bus next to a music chain ducking under it and checks how far and how fast the music goes
+// down and comes back, that a compressor keyed off a bus with a different buffer size lands on
+// its ratio, that a bus only takes one publisher, stays published through a chain edit and goes
+// silent when it's stale, and that readers on other threads never see a torn buffer. Times
+// publishing and the keyed blocks per buffer. The exit code is 1 if a check failed.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <blocks.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int SAMPLE_RATE = 48000;
+constexpr int CHANNELS = 2;
+constexpr size_t BUFFER_FRAMES = 480;
+constexpr float MUSIC = 0.5f;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+bool near(float value, float expected, float tolerance) {
+    return std::fabs(value - expected) <= std::fabs(expected) * tolerance;
+}
+
+// One buffer through each chain, the voice chain first like a loop that came around sooner.
+// Returns the music chain's last sample.
+float step(BlocksManager& voice, BlocksManager& music, float level) {
+    std::vector<float> buffer(BUFFER_FRAMES * CHANNELS, level);
+    voice.Process(buffer.data(), buffer.size());
+    buffer.assign(buffer.size(), MUSIC);
+    music.Process(buffer.data(), buffer.size());
+    return buffer.back();
+}
+
+// Buffers until the music chain's output crosses target, -1 if it never did in max buffers.
+int buffers_until(BlocksManager& voice, BlocksManager& music, float level, bool below, float target, int max) {
+    for (int b = 0; b < max; ++b) {
+        float out = step(voice, music, level);
+        if (below ? out < target : out > target) return b + 1;
+    }
+    return -1;
+}
+
+struct TearResult {
+    uint64_t reads = 0;
+    uint64_t torn = 0;
+};
+
+// A writer publishes buffers that are one value throughout while readers check they only ever
+// see one value per buffer.
+TearResult tear_check(double seconds, int readers) {
+    SidechainBus bus;
+    std::atomic<bool> done{false};
+    std::vector<TearResult> results(readers);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&, r] {
+            std::vector<float> out(SidechainBus::MAX_SAMPLES);
+            while (!done.load(std::memory_order_relaxed)) {
+                size_t count = bus.Read(out.data(), out.size(), now_ns());
+                if (!count) continue;
+                results[r].reads++;
+                for (size_t i = 1; i < count; ++i) {
+                    if (out[i] != out[0]) {
+                        results[r].torn++;
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    std::vector<float> buffer(BUFFER_FRAMES * CHANNELS);
+    auto end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    for (uint32_t value = 1; std::chrono::steady_clock::now() < end; ++value) {
+        buffer.assign(buffer.size(), static_cast<float>(value % 1000000));
+        bus.Publish(buffer.data(), buffer.size());
+    }
+    done.store(true);
+    for (auto& thread : threads) thread.join();
+
+    TearResult total;
+    for (auto& result : results) {
+        total.reads += result.reads;
+        total.torn += result.torn;
+    }
+    return total;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+    const double bufferMs = 1000.0 * BUFFER_FRAMES / SAMPLE_RATE;
+
+    BlocksManager voice, music;
+    voice.Initialize("sidechain bus=voice\n", SAMPLE_RATE, CHANNELS);
+    music.Initialize("ducker bus=voice threshold=-40 amount=12 attack=10 release=300 hold=250\n", SAMPLE_RATE, CHANNELS);
+
+    // Quiet voice under the threshold leaves the music alone.
+    float out = 0.0f;
+    for (int b = 0; b < 20; ++b) out = step(voice, music, 0.001f);
+    check(out == MUSIC, "music is untouched while the voice is under the threshold");
+
+    const float ducked = MUSIC * fastmath::db_to_gain(-12.0f);
+    int duckBuffers = buffers_until(voice, music, 0.3f, true, MUSIC * fastmath::db_to_gain(-9.0f), 100);
+    for (int b = 0; b < 20; ++b) out = step(voice, music, 0.3f);
+    check(duckBuffers > 0 && duckBuffers * bufferMs <= 30.0, "music ducks within a few buffers of the voice starting");
+    check(near(out, ducked, 0.01f), "music settles at the ducked level");
+
+    // Silence sends the voice chain to sleep, which has to let the music back up.
+    int releaseBuffers = buffers_until(voice, music, 0.0f, false, MUSIC * fastmath::db_to_gain(-1.0f), 500);
+    check(releaseBuffers > 0 && releaseBuffers * bufferMs >= 250.0, "music stays down through the hold");
+    for (int b = 0; b < 200; ++b) out = step(voice, music, 0.0f);
+    check(near(out, MUSIC, 0.001f), "music comes back once the voice stops");
+
+    // A key that's gone quiet because its channel stopped publishing, not because it's silent.
+    for (int b = 0; b < 20; ++b) step(voice, music, 0.3f);
+    std::this_thread::sleep_for(std::chrono::nanoseconds(SidechainBus::STALE_NS + 20000000));
+    std::vector<float> buffer(BUFFER_FRAMES * CHANNELS, MUSIC);
+    for (int b = 0; b < 400; ++b) {
+        buffer.assign(buffer.size(), MUSIC);
+        music.Process(buffer.data(), buffer.size());
+    }
+    check(near(buffer.back(), MUSIC, 0.001f), "a stale bus reads as silent");
+
+    check(SidechainBuses::Instance().Claim("voice") == nullptr, "a bus only takes one publisher");
+    voice.Initialize("", SAMPLE_RATE, CHANNELS);
+    std::shared_ptr<SidechainBus> claimed = SidechainBuses::Instance().Claim("voice");
+    check(claimed != nullptr, "the bus is free again once its chain is gone");
+    SidechainBuses::Instance().Release(claimed);
+    claimed.reset();
+
+    // A live chain edit: the new chain is built while the old one still publishes, swapped in,
+    // and the old one freed after, the way the engine does it.
+    BlocksManager editing;
+    editing.Initialize("sidechain bus=edit\n", SAMPLE_RATE, CHANNELS);
+    BlocksManager edited;
+    edited.Initialize("gain amount=1\nsidechain bus=edit\n", SAMPLE_RATE, CHANNELS);
+    edited.TakeOver(editing);
+    editing.Initialize("", SAMPLE_RATE, CHANNELS);
+    buffer.assign(buffer.size(), 0.3f);
+    edited.Process(buffer.data(), buffer.size());
+    check(near(SidechainBuses::Instance().Get("edit")->Envelope(now_ns()), 0.3f, 0.001f), "an edited chain keeps publishing to its bus");
+
+    // Render runs once per interleaved sample, the ducker's times have to hold up in stereo.
+    BlocksManager talk, bed;
+    talk.Initialize("sidechain bus=timing\n", SAMPLE_RATE, CHANNELS);
+    bed.Initialize("ducker bus=timing threshold=-40 amount=12 attack=10 release=300 hold=100\n", SAMPLE_RATE, CHANNELS);
+    std::vector<float> loud(BUFFER_FRAMES * CHANNELS, 0.3f);
+    talk.Process(loud.data(), loud.size());
+    std::vector<float> bedBuffer(SAMPLE_RATE / 10 * CHANNELS, MUSIC);
+    bed.Process(bedBuffer.data(), bedBuffer.size());
+    const float attackLevel = MUSIC - 0.632f * (MUSIC - ducked);
+    size_t attackFrame = 0;
+    while (attackFrame < bedBuffer.size() / CHANNELS && bedBuffer[attackFrame * CHANNELS] > attackLevel) ++attackFrame;
+    const double attackMs = 1000.0 * attackFrame / SAMPLE_RATE;
+    check(attackMs >= 9.0 && attackMs <= 11.0, "a stereo ducker gets most of the way down in its attack time");
+
+    for (int b = 0; b < 20; ++b) step(talk, bed, 0.3f);
+    int holdBuffers = -1;
+    for (int b = 0; b < 100 && holdBuffers < 0; ++b) {
+        if (step(talk, bed, 0.0f) > ducked * 1.001f) holdBuffers = b + 1;
+    }
+    const double holdMs = holdBuffers * bufferMs;
+    check(holdMs >= 90.0 && holdMs <= 110.0, "and holds for its hold time");
+
+    // Keyed off a full scale bus in 1024 sample buffers, amount=50 puts the threshold at -30
+    // dBFS, 30 dB over it at 4:1 comes out 22.5 dB down.
+    BlocksManager keyed;
+    keyed.Initialize("compression amount=50 bus=drums\n", SAMPLE_RATE, CHANNELS);
+    BlocksManager drums;
+    drums.Initialize("sidechain bus=drums\n", SAMPLE_RATE, CHANNELS);
+    std::vector<float> key(1024, 1.0f);
+    for (int b = 0; b < 100; ++b) {
+        key.assign(key.size(), 1.0f);
+        drums.Process(key.data(), key.size());
+        buffer.assign(buffer.size(), MUSIC);
+        keyed.Process(buffer.data(), buffer.size());
+    }
+    check(near(buffer.back(), MUSIC * fastmath::db_to_gain(-22.5f), 0.02f), "a keyed compressor lands on its ratio");
+
+    BlocksManager fractional;
+    fractional.Initialize("gain amount=0.5\n", SAMPLE_RATE, CHANNELS);
+    buffer.assign(buffer.size(), MUSIC);
+    fractional.Process(buffer.data(), buffer.size());
+    check(buffer.back() == MUSIC * 0.5f, "block parameters keep their fraction");
+
+    TearResult tears = tear_check(options.batches < 5 ? 0.3 : 2.0, 3);
+    check(tears.reads > 0 && tears.torn == 0, "readers never see a torn buffer");
+
+    std::vector<BenchResult> results;
+    const std::vector<float> input = noise(BUFFER_FRAMES * CHANNELS, 0.3f);
+    if (matches(options, "sidechain/publish")) {
+        SidechainBus bus;
+        results.push_back(measure(options, "sidechain/publish", BUFFER_FRAMES, CHANNELS, [&] {
+            bus.Publish(input.data(), input.size());
+        }));
+    }
+    voice.Initialize("sidechain bus=voice\n", SAMPLE_RATE, CHANNELS);
+    std::vector<float> voiceBuffer = input;
+    voice.Process(voiceBuffer.data(), voiceBuffer.size());
+    if (matches(options, "sidechain/ducker")) {
+        results.push_back(measure(options, "sidechain/ducker", BUFFER_FRAMES, CHANNELS, [&] {
+            buffer.assign(input.begin(), input.end());
+            music.Process(buffer.data(), buffer.size());
+            keep(buffer.back());
+        }));
+    }
+    keyed.Initialize("compression amount=50 bus=voice\n", SAMPLE_RATE, CHANNELS);
+    if (matches(options, "sidechain/keyed_compression")) {
+        results.push_back(measure(options, "sidechain/keyed_compression", BUFFER_FRAMES, CHANNELS, [&] {
+            buffer.assign(input.begin(), input.end());
+            keyed.Process(buffer.data(), buffer.size());
+            keep(buffer.back());
+        }));
+    }
+
+    char extra[256];
+    std::snprintf(extra, sizeof(extra),
+        "  \"ducking\": {\"buffer_ms\": %.1f, \"duck_ms\": %.1f, \"release_ms\": %.1f, \"attack_ms\": %.2f, \"hold_ms\": %.1f, \"reads\": %llu, \"torn\": %llu},\n",
+        bufferMs, duckBuffers * bufferMs, releaseBuffers * bufferMs, attackMs, holdMs, static_cast<unsigned long long>(tears.reads),
+        static_cast<unsigned long long>(tears.torn));
+
+    if (!write_json(options, "sidechain", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
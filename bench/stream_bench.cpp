@@ -0,0 +1,214 @@
+// Time to first sample and peak memory for playing a long file, decoding it all up front the
+// way play_sound used to against SoundStream. Each mode runs in its own process so the peak
+// RSS of one doesn't hide the other. Linux only, it uses fork and getrusage.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <dsp.hpp>
+#include <sound_source.hpp>
+#include <sound_stream.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int DEVICE_RATE = 48000;
+constexpr int DEVICE_CHANNELS = 2;
+constexpr size_t DEVICE_PERIOD = 480;
+
+struct StreamResult {
+    double ttfs_ms = 0.0;
+    double total_ms = 0.0;
+    long peak_rss_kb = 0;
+    size_t frames = 0;
+};
+
+// Writes a 44.1kHz stereo 16-bit WAV of noise, in pieces so the parent stays small.
+bool write_wav(const std::string& path, double seconds) {
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+
+    const uint32_t rate = 44100;
+    const uint16_t channels = 2;
+    const uint32_t frames = static_cast<uint32_t>(seconds * rate);
+    const uint32_t dataSize = frames * channels * 2;
+    const uint32_t riffSize = 36 + dataSize;
+    const uint32_t fmtSize = 16, byteRate = rate * channels * 2;
+    const uint16_t pcm = 1, blockAlign = channels * 2, bits = 16;
+
+    std::fwrite("RIFF", 1, 4, f); std::fwrite(&riffSize, 4, 1, f); std::fwrite("WAVE", 1, 4, f);
+    std::fwrite("fmt ", 1, 4, f); std::fwrite(&fmtSize, 4, 1, f);
+    std::fwrite(&pcm, 2, 1, f); std::fwrite(&channels, 2, 1, f); std::fwrite(&rate, 4, 1, f);
+    std::fwrite(&byteRate, 4, 1, f); std::fwrite(&blockAlign, 2, 1, f); std::fwrite(&bits, 2, 1, f);
+    std::fwrite("data", 1, 4, f); std::fwrite(&dataSize, 4, 1, f);
+
+    std::vector<float> chunk = noise(rate * channels, 0.5f);
+    std::vector<int16_t> pcm16(chunk.size());
+    float_to_int16_gain(chunk.data(), pcm16.data(), chunk.size(), 1.0f);
+    for (uint32_t written = 0; written < frames;) {
+        uint32_t n = std::min<uint32_t>(rate, frames - written);
+        std::fwrite(pcm16.data(), 2, n * channels, f);
+        written += n;
+    }
+    return std::fclose(f) == 0;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The old play_sound: the whole file into a growing buffer, then float, resample, remap and
+// device format as separate whole-file passes before anything can play.
+StreamResult run_whole(const std::string& path) {
+    StreamResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    WavSource source;
+    if (!source.Open(path.c_str())) return result;
+
+    std::vector<float> chunk(4096 * source.Channels());
+    std::vector<float> decoded;
+    while (size_t frames = source.Read(chunk.data(), 4096)) {
+        decoded.insert(decoded.end(), chunk.begin(), chunk.begin() + frames * source.Channels());
+    }
+
+    size_t srcFrames = decoded.size() / source.Channels();
+    size_t outFrames = 0;
+    float* resampled = linear_resample_interleaved(decoded.data(), srcFrames, source.Channels(), source.SampleRate(), DEVICE_RATE, &outFrames);
+    float* remapped = remap_channels_interleaved(resampled, outFrames, source.Channels(), DEVICE_CHANNELS);
+    std::vector<int32_t> device(outFrames * DEVICE_CHANNELS);
+    float_to_int32_gain(remapped, device.data(), device.size(), 1.0f);
+
+    result.ttfs_ms = ms_since(start);
+    keep(device[0]);
+    delete[] resampled;
+    delete[] remapped;
+
+    result.frames = outFrames;
+    result.total_ms = ms_since(start);
+    return result;
+}
+
+// SoundStream drained one device period at a time as fast as it will go.
+StreamResult run_stream(const std::string& path) {
+    StreamResult result;
+    auto start = std::chrono::steady_clock::now();
+
+    auto source = std::make_unique<WavSource>();
+    if (!source->Open(path.c_str())) return result;
+
+    StreamDecoder decoder(1);
+    auto stream = std::make_shared<SoundStream>(std::move(source), DEVICE_RATE, DEVICE_CHANNELS, DEVICE_RATE);
+    if (!decoder.Add(stream) || !stream->WaitReady(std::chrono::milliseconds(5000))) return result;
+
+    std::vector<float> period(DEVICE_PERIOD * DEVICE_CHANNELS);
+    std::vector<int32_t> device(period.size());
+    bool first = true;
+    while (!stream->Finished()) {
+        size_t frames = stream->Read(period.data(), DEVICE_PERIOD);
+        if (frames == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+        float_to_int32_gain(period.data(), device.data(), frames * DEVICE_CHANNELS, 1.0f);
+        if (first) {
+            result.ttfs_ms = ms_since(start);
+            first = false;
+        }
+        result.frames += frames;
+    }
+    keep(device[0]);
+    stream->Stop();
+
+    result.total_ms = ms_since(start);
+    return result;
+}
+
+bool run_child(const std::string& mode, const std::string& path, StreamResult& out) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        StreamResult r = mode == "whole" ? run_whole(path) : run_stream(path);
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        r.peak_rss_kb = usage.ru_maxrss;
+        ssize_t ignored = write(fds[1], &r, sizeof(r));
+        (void)ignored;
+        close(fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    bool ok = read(fds[0], &out, sizeof(out)) == static_cast<ssize_t>(sizeof(out));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return ok && out.frames > 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::vector<double> lengths = {10.0, 60.0, 600.0};
+    std::string dir = "/tmp";
+    std::string out;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            lengths = {10.0, 60.0};
+        } else if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else {
+            std::fprintf(stderr, "usage: %s [--quick] [--dir tmpdir] [--out file.json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    FILE* f = out.empty() ? stdout : std::fopen(out.c_str(), "w");
+    if (!f) {
+        std::fprintf(stderr, "Failed to open \"%s\"\n", out.c_str());
+        return 2;
+    }
+
+    std::fprintf(f, "{\n  \"suite\": \"stream\",\n  \"device_rate\": %d,\n  \"results\": [\n", DEVICE_RATE);
+    bool firstLine = true;
+    bool failed = false;
+    for (double seconds : lengths) {
+        std::string path = dir + "/vice_stream_bench_" + std::to_string(static_cast<int>(seconds)) + ".wav";
+        if (!write_wav(path, seconds)) {
+            std::fprintf(stderr, "Failed to write \"%s\"\n", path.c_str());
+            failed = true;
+            break;
+        }
+
+        for (const char* mode : {"whole", "stream"}) {
+            StreamResult r;
+            if (!run_child(mode, path, r)) {
+                std::fprintf(stderr, "%s run failed for %.0fs file\n", mode, seconds);
+                failed = true;
+                continue;
+            }
+            std::fprintf(f, "%s    {\"mode\": \"%s\", \"seconds\": %.0f, \"ttfs_ms\": %.2f, \"total_ms\": %.1f, \"peak_rss_kb\": %ld, \"frames\": %zu}",
+                firstLine ? "" : ",\n", mode, seconds, r.ttfs_ms, r.total_ms, r.peak_rss_kb, r.frames);
+            firstLine = false;
+        }
+        std::remove(path.c_str());
+    }
+    std::fprintf(f, "\n  ]\n}\n");
+    if (f != stdout) std::fclose(f);
+    return failed ? 1 : 0;
+}
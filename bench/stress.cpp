@@ -0,0 +1,329 @@
+// Worst-case timing harness for block chains. Builds random chains out of every block type,
+// changes their parameters while running and feeds them silence, full-scale noise,
+// denormals and impulses through BlocksManager::Process, the same path the audio loops use.
+// A chain fails if its p99.9 buffer time is over the budget, more than a few buffers take longer
+// than the buffer period, or it outputs NaN/Inf.
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <blocks.hpp>
+#include <dsp.hpp>
+#include <telemetry.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+struct StressOptions {
+    size_t chains = 200;
+    size_t buffers = 10000;
+    size_t frames = 480;
+    int channels = 2;
+    int sample_rate = 48000;
+    double budget = 0.25;
+    size_t max_outliers = 2;
+    double denormal_ratio = 2.0;
+    uint32_t seed = 1;
+    bool flush_denormals = true;
+    std::string out;
+};
+
+struct ParamSpec {
+    const char* type;
+    // nullptr for a block with nothing to change.
+    const char* key;
+    double min;
+    double max;
+    bool integer;
+    // Publishes to or keys off BUS.
+    bool keyed = false;
+};
+
+// Every sidechain block in a chain publishes here and every keyed block listens, so a chain can
+// key off itself.
+const char* BUS = "stress";
+
+// Ranges go past what the UI allows so odd values get covered too.
+const ParamSpec PARAMS[] = {
+    {"delay", "time", 0, 1000, true},
+    {"distortion", "intensity", 0, 100, true},
+    {"compression", "amount", 0, 100, true},
+    {"gain", "amount", 0, 4, false},
+    {"gating", "threshold", 0, 100, true},
+    {"reverb", "intensity", 1, 1000, true},
+    {"ducker", "threshold", -60, 0, false},
+    {"ducker", "amount", 0, 40, false},
+    {"sidechain", nullptr, 0, 0, false, true},
+    {"compression", "amount", 0, 100, true, true},
+    {"ducker", "threshold", -60, 0, false, true},
+    {"ducker", "amount", 0, 40, false, true},
+};
+constexpr size_t PARAM_COUNT = sizeof(PARAMS) / sizeof(PARAMS[0]);
+
+enum Pattern { SILENCE, NOISE, DENORMAL, IMPULSE, PATTERN_COUNT };
+const char* PATTERN_NAMES[] = {"silence", "noise", "denormal", "impulse"};
+
+struct PatternResult {
+    uint64_t buffers = 0;
+    uint64_t p50_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+struct ChainResult {
+    std::string text;
+    uint64_t p50_ns = 0;
+    uint64_t p99_ns = 0;
+    uint64_t p999_ns = 0;
+    uint64_t max_ns = 0;
+    // Buffers that took longer than the whole period, each one a dropout on a real device.
+    uint64_t outliers = 0;
+    uint64_t non_finite = 0;
+    uint64_t denormal_outputs = 0;
+    uint64_t param_changes = 0;
+    double denormal_ratio = 0.0;
+    // Buffers the chain was awake for, by input pattern.
+    PatternResult patterns[PATTERN_COUNT];
+    bool over_budget = false;
+    bool denormal_slowdown = false;
+
+    bool Failed() const {
+        return over_budget || non_finite > 0;
+    }
+};
+
+double random_value(std::mt19937& rng, const ParamSpec& spec) {
+    std::uniform_real_distribution<double> dist(spec.min, spec.max);
+    double value = dist(rng);
+    return spec.integer ? std::floor(value) : value;
+}
+
+std::string random_chain(std::mt19937& rng, std::vector<size_t>& specs) {
+    std::uniform_int_distribution<size_t> length(1, 8);
+    std::uniform_int_distribution<size_t> pick(0, PARAM_COUNT - 1);
+
+    std::string text;
+    size_t count = length(rng);
+    for (size_t i = 0; i < count; ++i) {
+        size_t s = pick(rng);
+        specs.push_back(s);
+        const ParamSpec& spec = PARAMS[s];
+        text += spec.type;
+        if (spec.key) text += std::string(" ") + spec.key + "=" + std::to_string(random_value(rng, spec));
+        if (spec.keyed) text += std::string(" bus=") + BUS;
+        text += "\n";
+    }
+    return text;
+}
+
+void fill(std::mt19937& rng, Pattern pattern, std::vector<float>& buffer) {
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    switch (pattern) {
+    case SILENCE:
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        break;
+    case NOISE:
+        for (auto& sample : buffer) sample = unit(rng);
+        break;
+    case DENORMAL:
+        for (auto& sample : buffer) sample = unit(rng) * FLT_MIN;
+        break;
+    case IMPULSE: {
+        std::fill(buffer.begin(), buffer.end(), 0.0f);
+        std::uniform_int_distribution<size_t> at(0, buffer.size() - 1);
+        buffer[at(rng)] = unit(rng) < 0.0f ? -1.0f : 1.0f;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+ChainResult run_chain(const StressOptions& options, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<size_t> specs;
+
+    ChainResult result;
+    result.text = random_chain(rng, specs);
+
+    BlocksManager manager;
+    manager.Initialize(result.text, options.sample_rate, options.channels);
+
+    const size_t count = options.frames * options.channels;
+    std::vector<float> buffer(count);
+    LatencyHistogram all;
+    LatencyHistogram awake[PATTERN_COUNT];
+
+    std::uniform_int_distribution<int> pattern_pick(0, PATTERN_COUNT - 1);
+    std::uniform_int_distribution<size_t> segment_length(1, 200);
+    std::uniform_int_distribution<size_t> block_pick(0, specs.size() - 1);
+    std::uniform_int_distribution<int> change(0, 63);
+
+    Pattern pattern = NOISE;
+    size_t segment_left = 0;
+    double period_ns = 1.0e9 * static_cast<double>(options.frames) / options.sample_rate;
+
+    for (size_t n = 0; n < options.buffers; ++n) {
+        if (segment_left == 0) {
+            pattern = static_cast<Pattern>(pattern_pick(rng));
+            segment_left = segment_length(rng);
+        }
+        --segment_left;
+
+        if (change(rng) == 0) {
+            size_t index = block_pick(rng);
+            const ParamSpec& spec = PARAMS[specs[index]];
+            if (spec.key && manager.SetParam(index, spec.key, random_value(rng, spec))) ++result.param_changes;
+        }
+
+        fill(rng, pattern, buffer);
+
+        uint64_t start = CycleClock::Now();
+        bool asleep = manager.Process(buffer.data(), count);
+        uint64_t elapsed = CycleClock::ToNs(CycleClock::Now() - start);
+
+        all.Record(elapsed);
+        if (!asleep) awake[pattern].Record(elapsed);
+        if (elapsed > period_ns) ++result.outliers;
+
+        for (float sample : buffer) {
+            if (!std::isfinite(sample)) ++result.non_finite;
+            else if (std::fpclassify(sample) == FP_SUBNORMAL) ++result.denormal_outputs;
+        }
+    }
+
+    result.p50_ns = all.Percentile(50.0);
+    result.p99_ns = all.Percentile(99.0);
+    result.p999_ns = all.Percentile(99.9);
+    result.max_ns = all.Max();
+    for (int p = 0; p < PATTERN_COUNT; ++p) {
+        result.patterns[p].buffers = awake[p].Count();
+        result.patterns[p].p50_ns = awake[p].Percentile(50.0);
+        result.patterns[p].max_ns = awake[p].Max();
+    }
+
+    // p99.9 is still a few buffers in at --quick's 2000, where p99.99 would just be the max. The
+    // outlier count catches a chain that is only rarely too slow.
+    result.over_budget = result.p999_ns > period_ns * options.budget || result.outliers > options.max_outliers;
+
+    // Same chain doing the same work, so denormal input taking longer than noise is the FPU's slow path.
+    if (awake[DENORMAL].Count() > 0 && awake[NOISE].Count() > 0 && awake[NOISE].Percentile(50.0) > 0) {
+        result.denormal_ratio = static_cast<double>(awake[DENORMAL].Percentile(50.0)) / awake[NOISE].Percentile(50.0);
+        result.denormal_slowdown = result.denormal_ratio > options.denormal_ratio;
+    }
+    return result;
+}
+
+bool parse(int argc, char** argv, StressOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--quick") {
+            options.chains = 20;
+            options.buffers = 2000;
+        } else if (arg == "--chains" && has_value) {
+            options.chains = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--buffers" && has_value) {
+            options.buffers = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--frames" && has_value) {
+            options.frames = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--channels" && has_value) {
+            options.channels = std::atoi(argv[++i]);
+        } else if (arg == "--rate" && has_value) {
+            options.sample_rate = std::atoi(argv[++i]);
+        } else if (arg == "--budget" && has_value) {
+            options.budget = std::atof(argv[++i]);
+        } else if (arg == "--max-outliers" && has_value) {
+            options.max_outliers = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--denormal-ratio" && has_value) {
+            options.denormal_ratio = std::atof(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--no-ftz") {
+            options.flush_denormals = false;
+        } else if (arg == "--out" && has_value) {
+            options.out = argv[++i];
+        } else {
+            std::fprintf(stderr,
+                "usage: %s [--quick] [--chains n] [--buffers n] [--frames n] [--channels n] [--rate hz]\n"
+                "          [--budget fraction] [--max-outliers n] [--denormal-ratio x] [--seed n] [--no-ftz] [--out file.json]\n", argv[0]);
+            return false;
+        }
+    }
+    return options.chains > 0 && options.buffers > 0 && options.frames > 0 && options.channels > 0 && options.sample_rate > 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    StressOptions options;
+    if (!parse(argc, argv, options)) return 2;
+
+    CycleClock::Start();
+
+    // The audio loops run their chains under a DenormalGuard, --no-ftz shows what happens without it.
+    std::unique_ptr<DenormalGuard> denormals;
+    if (options.flush_denormals) denormals = std::make_unique<DenormalGuard>();
+
+    std::vector<ChainResult> results;
+    size_t failed = 0;
+    size_t slow_denormals = 0;
+    uint64_t worst_ns = 0;
+    for (size_t c = 0; c < options.chains; ++c) {
+        results.push_back(run_chain(options, options.seed + static_cast<uint32_t>(c)));
+        const ChainResult& r = results.back();
+        if (r.Failed()) ++failed;
+        if (r.denormal_slowdown) ++slow_denormals;
+        worst_ns = std::max(worst_ns, r.max_ns);
+    }
+
+    FILE* f = options.out.empty() ? stdout : std::fopen(options.out.c_str(), "w");
+    if (!f) {
+        std::fprintf(stderr, "Failed to open \"%s\"\n", options.out.c_str());
+        return 2;
+    }
+
+    double period_ns = 1.0e9 * static_cast<double>(options.frames) / options.sample_rate;
+    std::fprintf(f, "{\n  \"suite\": \"stress\",\n  \"seed\": %u,\n  \"frames\": %zu,\n  \"channels\": %d,\n  \"sample_rate\": %d,\n  \"flush_denormals\": %s,\n",
+        options.seed, options.frames, options.channels, options.sample_rate, options.flush_denormals ? "true" : "false");
+    std::fprintf(f, "  \"buffers_per_chain\": %zu,\n  \"budget_ns\": %.0f,\n  \"max_outliers\": %zu,\n  \"worst_ns\": %llu,\n  \"failed\": %zu,\n  \"denormal_slowdowns\": %zu,\n",
+        options.buffers, period_ns * options.budget, options.max_outliers, static_cast<unsigned long long>(worst_ns), failed, slow_denormals);
+    std::fprintf(f, "  \"chains\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const ChainResult& r = results[i];
+        std::string text = r.text;
+        for (auto& ch : text) if (ch == '\n') ch = ';';
+        std::string patterns;
+        for (int p = 0; p < PATTERN_COUNT; ++p) {
+            char entry[160];
+            std::snprintf(entry, sizeof(entry), "%s\"%s\": {\"buffers\": %llu, \"p50_ns\": %llu, \"max_ns\": %llu}",
+                p ? ", " : "", PATTERN_NAMES[p], static_cast<unsigned long long>(r.patterns[p].buffers),
+                static_cast<unsigned long long>(r.patterns[p].p50_ns), static_cast<unsigned long long>(r.patterns[p].max_ns));
+            patterns += entry;
+        }
+        std::fprintf(f,
+            "    {\"seed\": %u, \"chain\": \"%s\", \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu, "
+            "\"outliers\": %llu, \"param_changes\": %llu, \"non_finite\": %llu, \"denormal_outputs\": %llu, \"denormal_ratio\": %.2f, "
+            "\"denormal_slowdown\": %s, \"awake\": {%s}, \"passed\": %s}%s\n",
+            options.seed + static_cast<uint32_t>(i), json_escape(text).c_str(),
+            static_cast<unsigned long long>(r.p50_ns), static_cast<unsigned long long>(r.p99_ns),
+            static_cast<unsigned long long>(r.p999_ns), static_cast<unsigned long long>(r.max_ns),
+            static_cast<unsigned long long>(r.outliers),
+            static_cast<unsigned long long>(r.param_changes), static_cast<unsigned long long>(r.non_finite),
+            static_cast<unsigned long long>(r.denormal_outputs), r.denormal_ratio,
+            r.denormal_slowdown ? "true" : "false", patterns.c_str(), r.Failed() ? "false" : "true",
+            i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+    if (f != stdout) std::fclose(f);
+
+    std::fprintf(stderr, "%zu/%zu chains failed, %zu with denormal slowdown, worst buffer %.3f ms of %.3f ms period\n",
+        failed, results.size(), slow_denormals, worst_ns / 1.0e6, period_ns / 1.0e6);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,142 @@
+// Trace export (trace.hpp). Runs a trace over threads emitting spans, some of which exit while
+// it's running, and checks every span ends up either in the file or in the dropped count, that the
+// file is well formed Chrome trace JSON with escaped thread names, and that nothing is recorded
+// while tracing is off. Times a span with tracing off and on. The exit code is 1 if a check failed.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <trace.hpp>
+
+#include "bench.hpp"
+
+namespace {
+
+constexpr int THREADS = 4;
+constexpr int SPANS = 20000;
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    std::fprintf(stderr, "%-60s %s\n", what, ok ? "ok" : "FAILED");
+    if (!ok) ++failures;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+size_t count(const std::string& text, const std::string& needle) {
+    size_t found = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + needle.size())) ++found;
+    return found;
+}
+
+// Emits spans in bursts with short pauses, about how a channel loop looks with its waits.
+void emit(int spans) {
+    for (int i = 0; i < spans; ++i) {
+        TraceSpan span("work");
+        keep(i);
+        if (i % 500 == 499) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parse_options(argc, argv, options)) return 2;
+    CycleClock::Start();
+
+    TraceCollector& collector = TraceCollector::Instance();
+    const std::string path = (std::filesystem::temp_directory_path() / "vice_trace.json").string();
+
+    // Spans from before a trace starts aren't recorded.
+    std::atomic<bool> go{false}, done{false};
+    std::thread early([&] {
+        TraceThread trace("early");
+        emit(1000);
+        go.store(true);
+        while (!done.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+    while (!go.load()) std::this_thread::yield();
+
+    check(collector.Start(path.c_str()), "a trace starts");
+    check(!collector.Start(path.c_str()), "a second trace doesn't start while one runs");
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([t] {
+            std::string name = t == 0 ? "quote\" back\\slash\ttab" : "emitter " + std::to_string(t);
+            TraceThread trace(name.c_str());
+            emit(SPANS);
+        });
+    }
+    // Ones that come and go mid-trace, the last of their events still get written.
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([] {
+            TraceThread trace("short lived");
+            emit(100);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    TraceSummary summary{};
+    check(collector.Stop(&summary), "the trace stops");
+    check(!collector.Stop(nullptr), "stopping twice does nothing");
+    done.store(true);
+    early.join();
+
+    const uint64_t emitted = THREADS * static_cast<uint64_t>(SPANS) + THREADS * 100;
+    check(summary.events + summary.dropped == emitted, "every span is written or counted as dropped");
+    check(summary.threads == 2 * THREADS + 1, "every registered thread is named");
+
+    const std::string text = read_file(path);
+    check(text.rfind("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", 0) == 0 && text.size() > 4 &&
+          text.compare(text.size() - 4, 4, "\n]}\n") == 0, "the file is one JSON object with an event array");
+    check(count(text, "\"ph\":\"X\"") == summary.events, "the file has every event the summary counts");
+    check(count(text, "\"ph\":\"M\"") == summary.threads + 1, "the file names the process and every thread");
+    check(text.find("quote\\\" back\\\\slash\\u0009tab") != std::string::npos, "thread names are escaped");
+    check(text.find(",\n,") == std::string::npos && text.find("[\n,") == std::string::npos, "no empty entries");
+
+    // With tracing off a span is a load and nothing else.
+    std::thread([&] {
+        TraceThread trace("untraced");
+        emit(1000);
+    }).join();
+    check(collector.Start(path.c_str()) && collector.Stop(&summary) && summary.events == 0, "nothing is recorded while tracing is off");
+    std::remove(path.c_str());
+
+    std::vector<BenchResult> results;
+    TraceThread trace("bench");
+    if (matches(options, "trace/span_disabled")) {
+        results.push_back(measure(options, "trace/span_disabled", 1, 1, [&] {
+            TraceSpan span("off");
+        }));
+    }
+    if (matches(options, "trace/span_enabled")) {
+        collector.Start(path.c_str());
+        results.push_back(measure(options, "trace/span_enabled", 1, 1, [&] {
+            TraceSpan span("on");
+        }));
+        collector.Stop(&summary);
+        std::remove(path.c_str());
+    }
+
+    char extra[256];
+    std::snprintf(extra, sizeof(extra), "  \"trace\": {\"threads\": %d, \"spans\": %llu, \"capacity\": %zu, \"flush_ms\": %d},\n",
+                  2 * THREADS + 1, static_cast<unsigned long long>(emitted), TraceBuffer::CAPACITY, TraceCollector::FLUSH_MS);
+
+    if (!write_json(options, "trace", results, extra)) return 1;
+    return failures ? 1 : 0;
+}
@@ -3,6 +3,7 @@ fn main() {
         .cpp(true)
         .file("src/audio/audio.cpp")
         .include("src/audio")
+        .std("c++17")
         .compile("audio");
 
     cc::Build::new()
@@ -0,0 +1,115 @@
+import 'package:flutter/material.dart';
+import '../../randoms.dart';
+
+class DuckerBlock extends StatelessWidget {
+  final String? bus;
+  final double? threshold;
+  final double? amount;
+  final bool interactable;
+  final ValueChanged<String>? onBusChanged;
+  final ValueChanged<double>? onThresholdChanged;
+  final ValueChanged<double>? onAmountChanged;
+  final Function? onDelete;
+
+  const DuckerBlock({
+    super.key,
+    this.bus,
+    this.threshold,
+    this.amount,
+    this.interactable = true,
+    this.onBusChanged,
+    this.onThresholdChanged,
+    this.onAmountChanged,
+    this.onDelete
+  });
+
+  @override
+  Widget build(BuildContext context) {
+    return Container(
+      decoration: BoxDecoration(
+        color: Colors.blueGrey,
+        borderRadius: BorderRadius.circular(8),
+      ),
+      height: 100,
+      child: Stack(
+        children: [
+          Row(
+            mainAxisAlignment: MainAxisAlignment.center,
+            children: [
+              const Text(
+                "DUCKER",
+                style: TextStyle(
+                  color: Colors.white,
+                  fontWeight: FontWeight.bold,
+                  fontSize: 48,
+                ),
+              ),
+              const SizedBox(width: 16),
+              SizedBox(
+                width: 120,
+                child: TextFormField(
+                  initialValue: bus ?? "",
+                  enabled: interactable,
+                  onChanged: onBusChanged,
+                  style: const TextStyle(color: Colors.white, fontSize: 16),
+                  decoration: const InputDecoration(
+                    labelText: "Key bus",
+                    labelStyle: TextStyle(color: Colors.white),
+                  ),
+                ),
+              ),
+              Expanded(
+                child: Column(
+                  mainAxisAlignment: MainAxisAlignment.center,
+                  children: [
+                    Slider(
+                      value: threshold ?? -40,
+                      min: -60,
+                      max: 0,
+                      divisions: 60,
+                      activeColor: accent,
+                      label: threshold?.toStringAsFixed(0),
+                      onChanged: interactable ? onThresholdChanged : null,
+                    ),
+                    Text(
+                      "Threshold: ${threshold?.toStringAsFixed(0) ?? '-40'} dB",
+                      style: const TextStyle(color: Colors.white, fontSize: 12),
+                    ),
+                  ],
+                ),
+              ),
+              Expanded(
+                child: Column(
+                  mainAxisAlignment: MainAxisAlignment.center,
+                  children: [
+                    Slider(
+                      value: amount ?? 12,
+                      min: 0,
+                      max: 40,
+                      divisions: 40,
+                      activeColor: accent,
+                      label: amount?.toStringAsFixed(0),
+                      onChanged: interactable ? onAmountChanged : null,
+                    ),
+                    Text(
+                      "Duck by: ${amount?.toStringAsFixed(0) ?? '12'} dB",
+                      style: const TextStyle(color: Colors.white, fontSize: 12),
+                    ),
+                  ],
+                ),
+              ),
+            ],
+          ),
+          Positioned(
+            bottom: 0,
+            right: 0,
+            child: IconButton(
+              icon: Icon(Icons.delete, color: Colors.white),
+              onPressed: onDelete != null ? () => onDelete!() : null,
+            ),
+          ),
+        ],
+      )
+    );
+  }
+}
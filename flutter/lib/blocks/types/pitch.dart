@@ -0,0 +1,98 @@
+import 'package:flutter/material.dart';
+import '../../randoms.dart';
+
+class PitchBlock extends StatelessWidget {
+  final double? semitones;
+  final double? formant;
+  final bool interactable;
+  final ValueChanged<double>? onSemitonesChanged;
+  final ValueChanged<double>? onFormantChanged;
+  final Function? onDelete;
+
+  const PitchBlock({
+    super.key,
+    this.semitones,
+    this.formant,
+    this.interactable = true,
+    this.onSemitonesChanged,
+    this.onFormantChanged,
+    this.onDelete
+  });
+
+  @override
+  Widget build(BuildContext context) {
+    return Container(
+      decoration: BoxDecoration(
+        color: Colors.deepPurple,
+        borderRadius: BorderRadius.circular(8),
+      ),
+      height: 100,
+      child: Stack(
+        children: [
+          Row(
+            mainAxisAlignment: MainAxisAlignment.center,
+            children: [
+              const Text(
+                "PITCH",
+                style: TextStyle(
+                  color: Colors.white,
+                  fontWeight: FontWeight.bold,
+                  fontSize: 48,
+                ),
+              ),
+              const SizedBox(width: 16),
+              Expanded(
+                child: Column(
+                  mainAxisAlignment: MainAxisAlignment.center,
+                  children: [
+                    Slider(
+                      value: semitones ?? 0,
+                      min: -12,
+                      max: 12,
+                      divisions: 24,
+                      activeColor: accent,
+                      label: semitones?.toStringAsFixed(0),
+                      onChanged: interactable ? onSemitonesChanged : null,
+                    ),
+                    Text(
+                      "Pitch: ${semitones?.toStringAsFixed(0) ?? '0'} st",
+                      style: const TextStyle(color: Colors.white, fontSize: 12),
+                    ),
+                  ],
+                ),
+              ),
+              Expanded(
+                child: Column(
+                  mainAxisAlignment: MainAxisAlignment.center,
+                  children: [
+                    Slider(
+                      value: formant ?? 0,
+                      min: -12,
+                      max: 12,
+                      divisions: 24,
+                      activeColor: accent,
+                      label: formant?.toStringAsFixed(0),
+                      onChanged: interactable ? onFormantChanged : null,
+                    ),
+                    Text(
+                      "Formant: ${formant?.toStringAsFixed(0) ?? '0'} st",
+                      style: const TextStyle(color: Colors.white, fontSize: 12),
+                    ),
+                  ],
+                ),
+              ),
+            ],
+          ),
+          Positioned(
+            bottom: 0,
+            right: 0,
+            child: IconButton(
+              icon: Icon(Icons.delete, color: Colors.white),
+              onPressed: onDelete != null ? () => onDelete!() : null,
+            ),
+          ),
+        ],
+      )
+    );
+  }
+}
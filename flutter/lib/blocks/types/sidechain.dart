@@ -0,0 +1,68 @@
+import 'package:flutter/material.dart';
+
+class SidechainBlock extends StatelessWidget {
+  final String? bus;
+  final bool interactable;
+  final ValueChanged<String>? onChanged;
+  final Function? onDelete;
+
+  const SidechainBlock({
+    super.key,
+    this.bus,
+    this.interactable = true,
+    this.onChanged,
+    this.onDelete
+  });
+
+  @override
+  Widget build(BuildContext context) {
+    return Container(
+      decoration: BoxDecoration(
+        color: Colors.indigo,
+        borderRadius: BorderRadius.circular(8),
+      ),
+      height: 100,
+      child: Stack(
+        children: [
+          Row(
+            mainAxisAlignment: MainAxisAlignment.center,
+            children: [
+              const Text(
+                "SIDECHAIN",
+                style: TextStyle(
+                  color: Colors.white,
+                  fontWeight: FontWeight.bold,
+                  fontSize: 48,
+                ),
+              ),
+              const SizedBox(width: 16),
+              Expanded(
+                child: Padding(
+                  padding: const EdgeInsets.only(right: 48),
+                  child: TextFormField(
+                    initialValue: bus ?? "",
+                    enabled: interactable,
+                    onChanged: onChanged,
+                    style: const TextStyle(color: Colors.white, fontSize: 16),
+                    decoration: const InputDecoration(
+                      labelText: "Publish to bus",
+                      labelStyle: TextStyle(color: Colors.white),
+                    ),
+                  ),
+                ),
+              ),
+            ],
+          ),
+          Positioned(
+            bottom: 0,
+            right: 0,
+            child: IconButton(
+              icon: Icon(Icons.delete, color: Colors.white),
+              onPressed: onDelete != null ? () => onDelete!() : null,
+            ),
+          ),
+        ],
+      )
+    );
+  }
+}
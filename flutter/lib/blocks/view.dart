@@ -1,3 +1,4 @@
+import 'dart:async';
 import 'dart:convert';
 import 'package:flutter/material.dart';
 import '../invoke_js.dart';
@@ -5,9 +6,12 @@ import '../randoms.dart';
 import 'types/compression.dart';
 import 'types/delay.dart';
 import 'types/distortion.dart';
+import 'types/ducker.dart';
 import 'types/gain.dart';
 import 'types/gating.dart';
+import 'types/pitch.dart';
 import 'types/reverb.dart';
+import 'types/sidechain.dart';
 
 final Map<String, Widget> blockTypes = {
   "compression": CompressionBlock(interactable: false),
@@ -16,6 +20,9 @@ final Map<String, Widget> blockTypes = {
   "gating": GatingBlock(interactable: false),
   "reverb": ReverbBlock(interactable: false),
   "gain": GainBlock(interactable: false),
+  "sidechain": SidechainBlock(interactable: false),
+  "ducker": DuckerBlock(interactable: false),
+  "pitch": PitchBlock(interactable: false),
 };
 
 class BlocksView extends StatefulWidget {
@@ -30,7 +37,9 @@ class BlocksView extends StatefulWidget {
 class _BlocksViewState extends State<BlocksView> {
   late final ScrollController scrollController;
   List<Map<String, dynamic>> Blocks = [];
+  List<double> loads = [];
   bool _loading = true;
+  Timer? _loadTimer;
 
   @override
   void initState() {
@@ -40,6 +49,36 @@ class _BlocksViewState extends State<BlocksView> {
     scrollController = ScrollController();
 
     _init();
+    _loadTimer = Timer.periodic(const Duration(seconds: 1), (_) => _updateLoads());
+  }
+
+  void _updateLoads() async {
+    final result = await invokeJS("get_block_costs", {"item": widget.item});
+    if (!mounted || result is! String) return;
+
+    final parsed = jsonDecode(result);
+    if (parsed is! List) return;
+
+    setState(() {
+      loads = parsed.map((b) => (b is Map && b["load"] is num) ? (b["load"] as num).toDouble() : 0.0).toList();
+    });
+  }
+
+  Widget _withLoad(int index, Widget child) {
+    if (index >= loads.length) return child;
+    return Stack(
+      children: [
+        child,
+        Positioned(
+          top: 12,
+          right: 12,
+          child: Text(
+            "${loads[index].toStringAsFixed(1)}%",
+            style: const TextStyle(color: Colors.white, fontSize: 14, fontWeight: FontWeight.bold),
+          ),
+        ),
+      ],
+    );
   }
 
   void _init() async {
@@ -57,10 +96,199 @@ class _BlocksViewState extends State<BlocksView> {
 
   @override
   void dispose() {
+    _loadTimer?.cancel();
     scrollController.dispose();
     super.dispose();
   }
 
+  Widget _buildBlock(int index) {
+    final block = Blocks[index];
+    final type = block["type"];
+    switch (type) {
+      case "delay":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: DelayBlock(
+            time: block["time"],
+            interactable: true,
+            onChanged: (newTime) {
+              setState(() {
+                block["time"] = newTime;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "reverb":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: ReverbBlock(
+            intensity: block["intensity"],
+            interactable: true,
+            onChanged: (newIntensity) {
+              setState(() {
+                block["intensity"] = newIntensity;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "compression":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: CompressionBlock(
+            amount: block["amount"],
+            interactable: true,
+            onChanged: (newAmount) {
+              setState(() {
+                block["amount"] = newAmount;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "distortion":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: DistortionBlock(
+            intensity: block["intensity"],
+            interactable: true,
+            onChanged: (newIntensity) {
+              setState(() {
+                block["intensity"] = newIntensity;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "gain":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: GainBlock(
+            amount: block["amount"],
+            interactable: true,
+            onChanged: (newAmount) {
+              setState(() {
+                block["amount"] = newAmount;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "gating":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: GatingBlock(
+            threshold: block["threshold"],
+            interactable: true,
+            onChanged: (newThreshold) {
+              setState(() {
+                block["threshold"] = newThreshold;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "sidechain":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: SidechainBlock(
+            key: ObjectKey(block),
+            bus: block["bus"],
+            interactable: true,
+            onChanged: (newBus) {
+              block["bus"] = newBus;
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "ducker":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: DuckerBlock(
+            key: ObjectKey(block),
+            bus: block["bus"],
+            threshold: block["threshold"],
+            amount: block["amount"],
+            interactable: true,
+            onBusChanged: (newBus) {
+              block["bus"] = newBus;
+            },
+            onThresholdChanged: (newThreshold) {
+              setState(() {
+                block["threshold"] = newThreshold;
+              });
+            },
+            onAmountChanged: (newAmount) {
+              setState(() {
+                block["amount"] = newAmount;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      case "pitch":
+        return Padding(
+          padding: EdgeInsetsGeometry.all(8),
+          child: PitchBlock(
+            key: ObjectKey(block),
+            semitones: block["semitones"],
+            formant: block["formant"],
+            interactable: true,
+            onSemitonesChanged: (newSemitones) {
+              setState(() {
+                block["semitones"] = newSemitones;
+              });
+            },
+            onFormantChanged: (newFormant) {
+              setState(() {
+                block["formant"] = newFormant;
+              });
+            },
+            onDelete: () => {
+              setState(() {
+                Blocks.removeAt(index);
+              })
+            },
+          )
+        );
+      default:
+        return Container();
+    }
+  }
+
   @override
   Widget build(BuildContext context) {
     int container_width = (MediaQuery.of(context).size.width / 1.5).toInt();
@@ -90,122 +318,7 @@ class _BlocksViewState extends State<BlocksView> {
                     controller: scrollController,
                     padding: const EdgeInsets.all(8),
                     itemCount: Blocks.length,
-                    itemBuilder: (context, index) {
-                      final block = Blocks[index];
-                      final type = block["type"];
-                      switch (type) {
-                        case "delay":
-                          return Padding(
-                            padding: EdgeInsetsGeometry.all(8),
-                            child: DelayBlock(
-                              time: block["time"],
-                              interactable: true,
-                              onChanged: (newTime) {
-                                setState(() {
-                                  block["time"] = newTime;
-                                });
-                              },
-                              onDelete: () => {
-                                setState(() {
-                                  Blocks.removeAt(index);
-                                })
-                              },
-                            )
-                          );
-                        case "reverb":
-                          return Padding(
-                            padding: EdgeInsetsGeometry.all(8),
-                            child: ReverbBlock(
-                              intensity: block["intensity"],
-                              interactable: true,
-                              onChanged: (newIntensity) {
-                                setState(() {
-                                  block["intensity"] = newIntensity;
-                                });
-                              },
-                              onDelete: () => {
-                                setState(() {
-                                  Blocks.removeAt(index);
-                                })
-                              },
-                            )
-                          );
-                        case "compression":
-                          return Padding(
-                            padding: EdgeInsetsGeometry.all(8),
-                            child: CompressionBlock(
-                              amount: block["amount"],
-                              interactable: true,
-                              onChanged: (newAmount) {
-                                setState(() {
-                                  block["amount"] = newAmount;
-                                });
-                              },
-                              onDelete: () => {
-                                setState(() {
-                                  Blocks.removeAt(index);
-                                })
-                              },
-                            )
-                          );
-                        case "distortion":
-                          return Padding(
-                            padding: EdgeInsetsGeometry.all(8),
-                            child: DistortionBlock(
-                              intensity: block["intensity"],
-                              interactable: true,
-                              onChanged: (newIntensity) {
-                                setState(() {
-                                  block["intensity"] = newIntensity;
-                                });
-                              },
-                              onDelete: () => {
-                                setState(() {
-                                  Blocks.removeAt(index);
-                                })
-                              },
-                            )
-                          );
-                        case "gain":
-                          return Padding(
-                            padding: EdgeInsetsGeometry.all(8),
-                            child: GainBlock(
-                              amount: block["amount"],
-                              interactable: true,
-                              onChanged: (newAmount) {
-                                setState(() {
-                                  block["amount"] = newAmount;
-                                });
-                              },
-                              onDelete: () => {
-                                setState(() {
-                                  Blocks.removeAt(index);
-                                })
-                              },
-                            )
-                          );
-                        case "gating":
-                          return Padding(
-                            padding: EdgeInsetsGeometry.all(8),
-                            child: GatingBlock(
-                              threshold: block["threshold"],
-                              interactable: true,
-                              onChanged: (newThreshold) {
-                                setState(() {
-                                  block["threshold"] = newThreshold;
-                                });
-                              },
-                              onDelete: () => {
-                                setState(() {
-                                  Blocks.removeAt(index);
-                                })
-                              },
-                            )
-                          );
-                        default:
-                          return Container();
-                      }
-                    },
+                    itemBuilder: (context, index) => _withLoad(index, _buildBlock(index)),
                   )
                 )
               ),
@@ -266,6 +379,21 @@ class _BlocksViewState extends State<BlocksView> {
                                 Blocks.add({"type": "gating", "threshold": 50.0});
                               });
                               break;
+                            case "sidechain":
+                              setState(() {
+                                Blocks.add({"type": "sidechain", "bus": "voice"});
+                              });
+                              break;
+                            case "ducker":
+                              setState(() {
+                                Blocks.add({"type": "ducker", "bus": "voice", "threshold": -40.0, "amount": 12.0});
+                              });
+                              break;
+                            case "pitch":
+                              setState(() {
+                                Blocks.add({"type": "pitch", "semitones": 0.0, "formant": 0.0});
+                              });
+                              break;
                             default:
                               break;
                           }
@@ -1,9 +1,12 @@
+import 'package:flutter/foundation.dart';
 import 'package:flutter/material.dart';
 import 'package:vice/settings/page.dart';
 import 'dart:async';
+import 'dart:convert';
 import '../invoke_js.dart';
 import 'edit_page.dart';
 import 'page.dart';
+import 'spectrum.dart';
 import '../randoms.dart';
 
 class ChannelsColor {
@@ -36,12 +39,68 @@ class ChannelsMain extends StatefulWidget {
 class _ChannelsMainState extends State<ChannelsMain> {
   bool _loading = true;
   List<ChannelsClass>? Channels;
+  final ValueNotifier<Map<String, double>> _peaks = ValueNotifier({});
+  final ValueNotifier<Map<String, ChannelSpectrum>> _spectra = ValueNotifier({});
+  Timer? _levelsTimer;
+  Timer? _spectraTimer;
+  bool _polling = false;
+  bool _pollingSpectra = false;
 
   @override
   void initState() {
     super.initState();
 
     _init();
+    if (settings.peaks == true) {
+      _levelsTimer = Timer.periodic(const Duration(milliseconds: 16), (_) => _getLevels());
+      invokeJS("set_spectrum", {"enabled": true});
+      _spectraTimer = Timer.periodic(const Duration(milliseconds: 33), (_) => _getSpectra());
+    }
+  }
+
+  @override
+  void dispose() {
+    _levelsTimer?.cancel();
+    _spectraTimer?.cancel();
+    if (_spectraTimer != null) invokeJS("set_spectrum", {"enabled": false});
+    _peaks.dispose();
+    _spectra.dispose();
+    super.dispose();
+  }
+
+  Future<void> _getSpectra() async {
+    if (_pollingSpectra) return;
+    _pollingSpectra = true;
+
+    try {
+      final result = await invokeJS("get_spectra");
+      if (!mounted || result is! String) return;
+
+      final parsed = jsonDecode(result);
+      if (parsed is! Map) return;
+
+      _spectra.value = parsed.map((name, spectrum) => MapEntry(name as String, ChannelSpectrum.fromJson(spectrum)));
+    } finally {
+      _pollingSpectra = false;
+    }
+  }
+
+  // One call for every channel's levels, measured by the engine as it renders.
+  Future<void> _getLevels() async {
+    if (_polling) return;
+    _polling = true;
+
+    try {
+      final result = await invokeJS("get_levels");
+      if (!mounted || result is! String) return;
+
+      final parsed = jsonDecode(result);
+      if (parsed is! Map) return;
+
+      _peaks.value = parsed.map((name, level) => MapEntry(name as String, ((level["peak"] as num?) ?? 0).toDouble()));
+    } finally {
+      _polling = false;
+    }
   }
 
   Future<void> _init() async {
@@ -91,7 +150,7 @@ class _ChannelsMainState extends State<ChannelsMain> {
                       childAspectRatio: 1/0.5,
                     ),
                     itemBuilder: (context, index) {
-                      return ChannelBar(channel: Channels![index]);
+                      return ChannelBar(channel: Channels![index], peaks: _peaks, spectra: _spectra);
                     },
                   ),
                 )
@@ -103,8 +162,10 @@ class _ChannelsMainState extends State<ChannelsMain> {
 
 class ChannelBar extends StatefulWidget {
   final ChannelsClass channel;
+  final ValueListenable<Map<String, double>> peaks;
+  final ValueListenable<Map<String, ChannelSpectrum>> spectra;
 
-  const ChannelBar({Key? key, required this.channel}) : super(key: key);
+  const ChannelBar({Key? key, required this.channel, required this.peaks, required this.spectra}) : super(key: key);
 
   @override
   State<ChannelBar> createState() => _ChannelBarState();
@@ -112,43 +173,11 @@ class ChannelBar extends StatefulWidget {
 
 class _ChannelBarState extends State<ChannelBar> {
   double sliderVolume = 0;
-  double volume = 0.0;
-  String translatedName = "null";
-  Timer? _timer;
 
   @override
   void initState() {
     super.initState();
     sliderVolume = widget.channel.volume / 2;
-
-    _initVolume();
-  }
-
-  @override
-  void dispose() {
-    if (_timer != null) _timer?.cancel();
-    super.dispose();
-  }
-
-  Future<void> _initVolume() async {
-    if (settings.peaks == true) {
-      await _getVolume();
-      _timer = Timer.periodic(const Duration(milliseconds: 100), (_) => _getVolume());
-    }
-  }
-
-  Future<void> _getVolume() async {
-    String result = await invokeJS("get_volume", {
-      "name": translatedName == "null" ? widget.channel.device : translatedName,
-      "get": translatedName == "null",
-      "device": widget.channel.deviceOrApp
-    });
-
-    setState(() {volume = double.parse(result.split("¬")[0]) * sliderVolume;});
-
-    if (translatedName == "null")
-      setState(() {translatedName = result.split("¬")[1];});
-
   }
 
   Future<void> _setVolume() async {
@@ -173,6 +202,20 @@ class _ChannelBarState extends State<ChannelBar> {
       child: Stack(
         alignment: Alignment.center,
         children: [
+          Positioned.fill(
+            child: Padding(
+              padding: const EdgeInsets.fromLTRB(16, 110, 16, 70),
+              child: ValueListenableBuilder<Map<String, ChannelSpectrum>>(
+                valueListenable: widget.spectra,
+                builder: (context, spectra, _) {
+                  final spectrum = spectra[widget.channel.name];
+                  if (spectrum == null) return const SizedBox.shrink();
+                  return CustomPaint(painter: SpectrumPainter(spectrum, Colors.white));
+                },
+              ),
+            ),
+          ),
+
           LayoutBuilder(
             builder: (context, constraints) {
               final sliderHeight = constraints.maxHeight - 150;
@@ -194,15 +237,22 @@ class _ChannelBarState extends State<ChannelBar> {
 
                 Align(
                   alignment: Alignment.bottomCenter,
-                  child: AnimatedContainer(
-                    duration: const Duration(milliseconds: 200),
-                    height: (sliderHeight - 40) * volume,
-                    width: 12,
-                    margin: EdgeInsets.only(bottom: (constraints.maxHeight - sliderHeight) / 2 + 25),
-                    decoration: BoxDecoration(
-                      color: getColor(volume),
-                      borderRadius: BorderRadius.circular(12),
-                    ),
+                  child: ValueListenableBuilder<Map<String, double>>(
+                    valueListenable: widget.peaks,
+                    builder: (context, peaks, _) {
+                      final volume = (peaks[widget.channel.name] ?? 0.0).clamp(0.0, 1.0).toDouble();
+
+                      return AnimatedContainer(
+                        duration: const Duration(milliseconds: 50),
+                        height: (sliderHeight - 40) * volume,
+                        width: 12,
+                        margin: EdgeInsets.only(bottom: (constraints.maxHeight - sliderHeight) / 2 + 25),
+                        decoration: BoxDecoration(
+                          color: getColor(volume),
+                          borderRadius: BorderRadius.circular(12),
+                        ),
+                      );
+                    },
                   ),
                 ),
 
@@ -0,0 +1,50 @@
+import 'package:flutter/material.dart';
+
+class ChannelSpectrum {
+  final int frame;
+  final List<double> bands;
+  final List<double> peaks;
+
+  const ChannelSpectrum(this.frame, this.bands, this.peaks);
+
+  static ChannelSpectrum fromJson(dynamic json) {
+    List<double> values(dynamic list) => (list as List? ?? []).map((v) => (v as num).toDouble()).toList();
+    return ChannelSpectrum((json["frame"] as num?)?.toInt() ?? 0, values(json["bands"]), values(json["peaks"]));
+  }
+}
+
+// One bar per band from floorDb up to 0 dB, with a line at each band's held peak.
+class SpectrumPainter extends CustomPainter {
+  static const double floorDb = -90.0;
+
+  final ChannelSpectrum spectrum;
+  final Color color;
+
+  SpectrumPainter(this.spectrum, this.color);
+
+  double _height(double db, double height) => ((db - floorDb) / -floorDb).clamp(0.0, 1.0) * height;
+
+  @override
+  void paint(Canvas canvas, Size size) {
+    final count = spectrum.bands.length;
+    if (count == 0) return;
+
+    final width = size.width / count;
+    final bar = Paint()..color = color.withOpacity(0.35);
+    final peak = Paint()..color = color.withOpacity(0.7)..strokeWidth = 2;
+
+    for (int b = 0; b < count; b++) {
+      final left = b * width;
+      final level = _height(spectrum.bands[b], size.height);
+      canvas.drawRect(Rect.fromLTWH(left + 1, size.height - level, width - 2, level), bar);
+
+      if (b < spectrum.peaks.length) {
+        final top = size.height - _height(spectrum.peaks[b], size.height);
+        canvas.drawLine(Offset(left + 1, top), Offset(left + width - 1, top), peak);
+      }
+    }
+  }
+
+  @override
+  bool shouldRepaint(SpectrumPainter old) => old.spectrum.frame != spectrum.frame || old.color != color;
+}
@@ -10,8 +10,68 @@ class Data {
   Map<String, List<double>> system;
   Map<String, List<double>> app;
   Map<String, double> general;
+  List<ChannelLatency> channels;
+  SfxCache sfxCache;
 
-  Data(this.system, this.app, this.general);
+  Data(this.system, this.app, this.general, this.channels, this.sfxCache);
+}
+
+class SfxCache {
+  int hits;
+  int misses;
+  int sounds;
+  double used;
+  double budget;
+  double decoded;
+
+  SfxCache(this.hits, this.misses, this.sounds, this.used, this.budget, this.decoded);
+
+  static SfxCache fromMap(Map<String, dynamic> map) {
+    double toDouble(dynamic v) => v is num ? v.toDouble() : 0.0;
+    int toInt(dynamic v) => v is num ? v.toInt() : 0;
+
+    return SfxCache(
+      toInt(map["hits"]),
+      toInt(map["misses"]),
+      toInt(map["sounds"]),
+      toDouble(map["used"]),
+      toDouble(map["budget"]),
+      toDouble(map["decoded"]),
+    );
+  }
+}
+
+class ChannelLatency {
+  String name;
+  int underruns;
+  int overruns;
+  int discontinuities;
+  double p50;
+  double p99;
+  double max;
+  double jitter;
+  double jitterTarget;
+  double latency;
+
+  ChannelLatency(this.name, this.underruns, this.overruns, this.discontinuities, this.p50, this.p99, this.max, this.jitter, this.jitterTarget, this.latency);
+
+  static ChannelLatency fromMap(Map<String, dynamic> map) {
+    double toDouble(dynamic v) => v is num ? v.toDouble() : 0.0;
+    int toInt(dynamic v) => v is num ? v.toInt() : 0;
+
+    return ChannelLatency(
+      (map["name"] ?? "").toString(),
+      toInt(map["underruns"]),
+      toInt(map["overruns"]),
+      toInt(map["discontinuities"]),
+      toDouble(map["process_p50"]),
+      toDouble(map["process_p99"]),
+      toDouble(map["process_max"]),
+      toDouble(map["jitter_p50"]),
+      toDouble(map["jitter_target"]),
+      toDouble(map["latency"]),
+    );
+  }
 }
 
 class PerformancePage extends StatefulWidget {
@@ -110,6 +170,8 @@ class _PerformancePageState extends State<PerformancePage> {
         final systemRaw = (dataMap["system"] as Map<String, dynamic>?) ?? <String, dynamic>{};
         final appRaw = (dataMap["app"] as Map<String, dynamic>?) ?? <String, dynamic>{};
         final generalRaw = (dataMap["general"] as Map<String, dynamic>?) ?? <String, dynamic>{};
+        final channelsRaw = (dataMap["channels"] as List<dynamic>?) ?? <dynamic>[];
+        final sfxCacheRaw = (dataMap["sfx_cache"] as Map<String, dynamic>?) ?? <String, dynamic>{};
 
         final system = <String, List<double>>{};
         systemRaw.forEach((k, v) {
@@ -158,9 +220,16 @@ class _PerformancePageState extends State<PerformancePage> {
           general["ram"] = 1;
         }
 
+        final channels = <ChannelLatency>[];
+        for (final c in channelsRaw) {
+          if (c is Map) {
+            channels.add(ChannelLatency.fromMap(Map<String, dynamic>.from(c)));
+          }
+        }
+
         if (!mounted) return;
         setState(() {
-          data = Data(system, app, general);
+          data = Data(system, app, general, channels, SfxCache.fromMap(sfxCacheRaw));
         });
       } catch (e) {
         await printText("PerformanceData parse error: $e");
@@ -339,6 +408,22 @@ class _PerformancePageState extends State<PerformancePage> {
                           ),
                         ),
                       ),
+
+                      const SizedBox(height: 32),
+
+                      Text("Channel Latency", style: TextStyle(fontSize: 36, color: text)),
+
+                      const SizedBox(height: 12),
+
+                      _latencyTable(data?.channels ?? const []),
+
+                      const SizedBox(height: 32),
+
+                      Text("Soundboard Cache", style: TextStyle(fontSize: 36, color: text)),
+
+                      const SizedBox(height: 12),
+
+                      _cacheText(data?.sfxCache),
                     ],
                   ),
                 ),
@@ -348,6 +433,54 @@ class _PerformancePageState extends State<PerformancePage> {
     );
   }
 
+  Widget _latencyTable(List<ChannelLatency> channels) {
+    if (channels.isEmpty) {
+      return Text("No channels running", style: TextStyle(fontSize: 18, color: text_muted));
+    }
+
+    TableRow row(List<String> cells, {bool header = false}) {
+      return TableRow(
+        children: cells.map((c) => Padding(
+          padding: const EdgeInsets.all(6),
+          child: Text(c, style: TextStyle(fontSize: header ? 16 : 14, color: header ? text : text_muted)),
+        )).toList(),
+      );
+    }
+
+    return Table(
+      border: TableBorder.all(color: text_muted),
+      children: [
+        row(["Channel", "p50", "p99", "Max", "Buffered", "Latency", "Underruns", "Overruns", "Glitches"], header: true),
+        ...channels.map((c) => row([
+          c.name,
+          "${c.p50.toStringAsFixed(2)}ms",
+          "${c.p99.toStringAsFixed(2)}ms",
+          "${c.max.toStringAsFixed(2)}ms",
+          "${c.jitter.toStringAsFixed(1)}/${c.jitterTarget.toStringAsFixed(1)}ms",
+          "${c.latency.toStringAsFixed(1)}ms",
+          c.underruns.toString(),
+          c.overruns.toString(),
+          c.discontinuities.toString(),
+        ])),
+      ],
+    );
+  }
+
+  Widget _cacheText(SfxCache? cache) {
+    if (cache == null) {
+      return Text("No data", style: TextStyle(fontSize: 18, color: text_muted));
+    }
+
+    final total = cache.hits + cache.misses;
+    final rate = total > 0 ? (cache.hits * 100 / total).toStringAsFixed(0) : "0";
+    final compressed = cache.decoded > cache.used + 0.05 ? " (${cache.decoded.toStringAsFixed(1)}MB decoded)" : "";
+
+    return Text(
+      "${cache.sounds} sounds, ${cache.used.toStringAsFixed(1)}MB$compressed of ${cache.budget.toStringAsFixed(0)}MB, ${cache.hits} hits, ${cache.misses} misses ($rate%)",
+      style: TextStyle(fontSize: 18, color: text_muted),
+    );
+  }
+
   LineChartBarData _line(List<double> values, Color color) {
     final spots = <FlSpot>[];
     for (int i = 0; i < values.length; i++) {
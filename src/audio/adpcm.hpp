@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+// IMA ADPCM in independent blocks, used to keep cached soundboard clips at 4 bits per sample
+// instead of 32. Every block starts from its own header, so a voice only ever decodes the block
+// it is playing and the work per block is fixed.
+//
+// Block layout, for each channel a 4 byte header (first sample as int16, step index, unused)
+// followed by each channel's remaining frames as nibbles, low nibble first.
+namespace adpcm {
+
+constexpr int STEPS[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+constexpr int INDEX_STEP[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+struct State {
+    int predictor = 0;
+    int index = 0;
+};
+
+inline int16_t to_int16(float sample) {
+    return static_cast<int16_t>(std::lrint(std::max(-32768.0f, std::min(32767.0f, sample * 32768.0f))));
+}
+
+// Difference for each step index and magnitude, the standard shift and add decoder done once
+// up front so decoding a sample is two table lookups.
+struct Tables {
+    int diff[89][8];
+    uint8_t next[89][8];
+
+    constexpr Tables() : diff(), next() {
+        for (int i = 0; i < 89; ++i) {
+            for (int n = 0; n < 8; ++n) {
+                int step = STEPS[i];
+                int d = step >> 3;
+                if (n & 4) d += step;
+                if (n & 2) d += step >> 1;
+                if (n & 1) d += step >> 2;
+                diff[i][n] = d;
+
+                int index = i + INDEX_STEP[n];
+                next[i][n] = static_cast<uint8_t>(index < 0 ? 0 : (index > 88 ? 88 : index));
+            }
+        }
+    }
+};
+
+inline constexpr Tables TABLES;
+
+inline int decode_nibble(State& state, uint8_t nibble) {
+    int diff = TABLES.diff[state.index][nibble & 7];
+    state.predictor += (nibble & 8) ? -diff : diff;
+    state.predictor = std::max(-32768, std::min(32767, state.predictor));
+    state.index = TABLES.next[state.index][nibble & 7];
+    return state.predictor;
+}
+
+inline uint8_t encode_sample(State& state, int sample) {
+    int step = STEPS[state.index];
+    int diff = sample - state.predictor;
+    uint8_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) { nibble |= 4; diff -= step; }
+    if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+    if (diff >= step >> 2) nibble |= 1;
+
+    // Step the state the same way the decoder will so errors don't build up.
+    decode_nibble(state, nibble);
+    return nibble;
+}
+
+}
+
+class AdpcmClip {
+public:
+    static constexpr size_t BLOCK_FRAMES = 2048;
+
+    static AdpcmClip Encode(const float* samples, size_t frames, int channels) {
+        AdpcmClip clip;
+        clip.frames = frames;
+        clip.channels = channels;
+
+        size_t blocks = (frames + BLOCK_FRAMES - 1) / BLOCK_FRAMES;
+        clip.offsets.reserve(blocks + 1);
+        clip.data.reserve(blocks * BlockBytes(BLOCK_FRAMES, channels));
+
+        std::vector<adpcm::State> states(channels);
+        for (size_t start = 0; start < frames; start += BLOCK_FRAMES) {
+            size_t count = std::min(BLOCK_FRAMES, frames - start);
+            const float* block = samples + start * channels;
+            clip.offsets.push_back(clip.data.size());
+
+            for (int c = 0; c < channels; ++c) {
+                int16_t first = adpcm::to_int16(block[c]);
+                states[c].predictor = first;
+                // Later blocks carry the step over, the first one starts it near the signal's
+                // slope instead of ramping up from the smallest step.
+                if (start == 0 && count > 1) {
+                    int slope = std::abs(adpcm::to_int16(block[channels + c]) - first);
+                    while (states[c].index < 88 && adpcm::STEPS[states[c].index] < slope) ++states[c].index;
+                }
+                uint16_t bits = static_cast<uint16_t>(first);
+                clip.data.push_back(static_cast<uint8_t>(bits & 0xFF));
+                clip.data.push_back(static_cast<uint8_t>(bits >> 8));
+                clip.data.push_back(static_cast<uint8_t>(states[c].index));
+                clip.data.push_back(0);
+            }
+
+            for (int c = 0; c < channels; ++c) {
+                for (size_t f = 1; f < count; f += 2) {
+                    uint8_t lo = adpcm::encode_sample(states[c], adpcm::to_int16(block[f * channels + c]));
+                    uint8_t hi = f + 1 < count ? adpcm::encode_sample(states[c], adpcm::to_int16(block[(f + 1) * channels + c])) : 0;
+                    clip.data.push_back(static_cast<uint8_t>(lo | (hi << 4)));
+                }
+            }
+        }
+        clip.offsets.push_back(clip.data.size());
+        clip.data.shrink_to_fit();
+        return clip;
+    }
+
+    // Decodes one block as interleaved float into out, which needs room for BLOCK_FRAMES frames.
+    // Returns the frames in the block.
+    size_t DecodeBlock(size_t block, float* out) const {
+        if (block >= BlockCount()) return 0;
+
+        size_t count = std::min(BLOCK_FRAMES, frames - block * BLOCK_FRAMES);
+        const uint8_t* header = data.data() + offsets[block];
+        const uint8_t* nibbles = header + channels * 4;
+        size_t channelBytes = count / 2;
+
+        for (int c = 0; c < channels; ++c) {
+            const uint8_t* h = header + c * 4;
+            adpcm::State state;
+            state.predictor = static_cast<int16_t>(static_cast<uint16_t>(h[0] | (h[1] << 8)));
+            state.index = std::min<int>(h[2], 88);
+            out[c] = state.predictor * SCALE;
+
+            const uint8_t* src = nibbles + c * channelBytes;
+            for (size_t f = 1; f < count; f += 2) {
+                uint8_t byte = *src++;
+                out[f * channels + c] = adpcm::decode_nibble(state, byte & 0x0F) * SCALE;
+                if (f + 1 < count) out[(f + 1) * channels + c] = adpcm::decode_nibble(state, byte >> 4) * SCALE;
+            }
+        }
+        return count;
+    }
+
+    size_t Frames() const {
+        return frames;
+    }
+
+    int Channels() const {
+        return channels;
+    }
+
+    size_t BlockCount() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    size_t Bytes() const {
+        return data.size() + offsets.size() * sizeof(size_t);
+    }
+
+private:
+    static constexpr float SCALE = 1.0f / 32768.0f;
+
+    std::vector<uint8_t> data;
+    std::vector<size_t> offsets;
+    size_t frames = 0;
+    int channels = 0;
+
+    static size_t BlockBytes(size_t count, int channels) {
+        return channels * (4 + count / 2);
+    }
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <meter.hpp>
+#include <sound_source.hpp>
+
+// Offline analysis of a whole clip, run once per file on import and stored in the sound index
+// (analysis_index.hpp) so playback never has to look at the audio to normalize or trim it.
+
+// Anything below this (-60 dBFS) counts as silence for the trim points.
+constexpr float TRIM_THRESHOLD = 0.001f;
+
+// Min/max of every bucketFrames frames across all channels, as int8 (-127..127 for -1..1),
+// rounded outwards so the drawn waveform never looks quieter than the clip.
+struct WaveformLevel {
+    uint32_t bucketFrames = 0;
+    std::vector<int8_t> minmax;
+
+    size_t Buckets() const {
+        return minmax.size() / 2;
+    }
+};
+
+struct ClipAnalysis {
+    int sampleRate = 0;
+    int channels = 0;
+    uint64_t frames = 0;
+    float peak = 0.0f;
+    float loudness = SILENT_LUFS;
+    uint64_t trimStart = 0;
+    uint64_t trimEnd = 0;
+    // Finest first, each level has buckets twice as long as the one before.
+    std::vector<WaveformLevel> waveform;
+
+    double Duration() const {
+        return sampleRate ? static_cast<double>(frames) / sampleRate : 0.0;
+    }
+};
+
+// EBU R128 integrated loudness: K-weighted 400ms blocks every 100ms, gated at -70 LUFS and
+// 10 LU below the ungated mean.
+class LoudnessMeter {
+public:
+    void Configure(int sampleRate, int channels) {
+        this->channels = channels;
+        weighting.Configure(sampleRate, channels);
+        segmentFrames = std::max(1, sampleRate / 10);
+        segmentPosition = 0;
+        segment = 0.0;
+        history.clear();
+        blocks.clear();
+    }
+
+    void Process(const float* samples, size_t frames) {
+        for (size_t f = 0; f < frames; ++f) {
+            segment += weighting.Frame(samples + f * channels);
+            if (++segmentPosition == segmentFrames) EndSegment();
+        }
+    }
+
+    // Integrated loudness in LUFS, SILENT_LUFS if nothing passed the absolute gate.
+    double Integrated() const {
+        const double absoluteGate = KWeighting::Energy(-70.0);
+        double sum = 0.0;
+        size_t count = 0;
+        for (double block : blocks) {
+            if (block > absoluteGate) {
+                sum += block;
+                ++count;
+            }
+        }
+        if (count == 0) return SILENT_LUFS;
+
+        const double relativeGate = sum / count * std::pow(10.0, -1.0);
+        sum = 0.0;
+        count = 0;
+        for (double block : blocks) {
+            if (block > absoluteGate && block > relativeGate) {
+                sum += block;
+                ++count;
+            }
+        }
+        return count ? KWeighting::Lufs(sum / count) : SILENT_LUFS;
+    }
+
+private:
+    int channels = 0;
+    KWeighting weighting;
+    int segmentFrames = 0;
+    int segmentPosition = 0;
+    double segment = 0.0;
+    // Weighted energy of the last 4 segments, a block is their sum.
+    std::vector<double> history;
+    std::vector<double> blocks;
+
+    void EndSegment() {
+        history.push_back(segment);
+        segment = 0.0;
+        segmentPosition = 0;
+        if (history.size() > 4) history.erase(history.begin());
+        if (history.size() == 4) {
+            double sum = history[0] + history[1] + history[2] + history[3];
+            blocks.push_back(sum / (4.0 * segmentFrames));
+        }
+    }
+};
+
+// Builds the waveform pyramid a buffer at a time. Only the finest level is built while
+// reading, the rest are merged from it at the end.
+class WaveformBuilder {
+public:
+    static constexpr uint32_t BASE_BUCKET = 512;
+
+    void Add(const float* samples, size_t frames, int channels) {
+        for (size_t f = 0; f < frames; ++f) {
+            for (int c = 0; c < channels; ++c) {
+                float v = samples[f * channels + c];
+                low = std::min(low, v);
+                high = std::max(high, v);
+            }
+            if (++filled == BASE_BUCKET) Flush();
+        }
+    }
+
+    std::vector<WaveformLevel> Finish() {
+        if (filled) Flush();
+
+        std::vector<WaveformLevel> levels;
+        WaveformLevel level;
+        level.bucketFrames = BASE_BUCKET;
+        level.minmax = std::move(base);
+        levels.push_back(std::move(level));
+
+        while (levels.back().Buckets() > 1) {
+            const WaveformLevel& fine = levels.back();
+            WaveformLevel coarse;
+            coarse.bucketFrames = fine.bucketFrames * 2;
+            for (size_t b = 0; b < fine.Buckets(); b += 2) {
+                size_t last = std::min(b + 1, fine.Buckets() - 1);
+                coarse.minmax.push_back(std::min(fine.minmax[b * 2], fine.minmax[last * 2]));
+                coarse.minmax.push_back(std::max(fine.minmax[b * 2 + 1], fine.minmax[last * 2 + 1]));
+            }
+            levels.push_back(std::move(coarse));
+        }
+        return levels;
+    }
+
+private:
+    std::vector<int8_t> base;
+    float low = 0.0f;
+    float high = 0.0f;
+    uint32_t filled = 0;
+
+    static int8_t Quantize(float v, bool up) {
+        float scaled = std::max(-1.0f, std::min(1.0f, v)) * 127.0f;
+        return static_cast<int8_t>(up ? std::ceil(scaled) : std::floor(scaled));
+    }
+
+    void Flush() {
+        base.push_back(Quantize(low, false));
+        base.push_back(Quantize(high, true));
+        low = high = 0.0f;
+        filled = 0;
+    }
+};
+
+// Reads the whole source and fills in everything in ClipAnalysis. False if it had no audio.
+inline bool analyze_source(SoundSource& source, ClipAnalysis& out) {
+    const size_t CHUNK = 4096;
+    int channels = source.Channels();
+    if (channels <= 0) return false;
+
+    out = ClipAnalysis();
+    out.sampleRate = source.SampleRate();
+    out.channels = channels;
+
+    LoudnessMeter loudness;
+    loudness.Configure(out.sampleRate, channels);
+    WaveformBuilder waveform;
+
+    bool heard = false;
+    std::vector<float> chunk(CHUNK * channels);
+    while (size_t frames = source.Read(chunk.data(), CHUNK)) {
+        for (size_t f = 0; f < frames; ++f) {
+            float framePeak = 0.0f;
+            for (int c = 0; c < channels; ++c) framePeak = std::max(framePeak, std::fabs(chunk[f * channels + c]));
+            out.peak = std::max(out.peak, framePeak);
+            if (framePeak > TRIM_THRESHOLD) {
+                if (!heard) out.trimStart = out.frames + f;
+                out.trimEnd = out.frames + f + 1;
+                heard = true;
+            }
+        }
+
+        loudness.Process(chunk.data(), frames);
+        waveform.Add(chunk.data(), frames, channels);
+        out.frames += frames;
+    }
+
+    if (out.frames == 0) return false;
+    out.loudness = static_cast<float>(loudness.Integrated());
+    out.waveform = waveform.Finish();
+    return true;
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <analysis.hpp>
+#include <mapped_file.hpp>
+
+// ClipAnalysis for every clip we've seen, keyed by path and the file's mtime so an edited file
+// is analyzed again. Kept on disk as one small binary file:
+//   "VICEANLZ" u32 version u32 count
+//   per entry: u32 pathBytes, path, i64 mtime, i32 sampleRate, i32 channels, u64 frames,
+//              f32 peak, f32 loudness, u64 trimStart, u64 trimEnd, u32 levels,
+//              per level: u32 bucketFrames, u32 buckets, buckets * (i8 min, i8 max)
+// All little endian.
+class AnalysisIndex {
+public:
+    static constexpr uint32_t VERSION = 1;
+
+    // Replaces what's in memory with the file, false if it's missing or not a valid index.
+    bool Load(const std::string& path) {
+        MappedFile file;
+        if (!file.Open(path.c_str())) return false;
+
+        Reader reader{file.Data(), file.Size()};
+        if (file.Size() < 16 || std::memcmp(file.Data(), MAGIC, 8) != 0) return false;
+        reader.pos = 8;
+        if (reader.U32() != VERSION) return false;
+
+        std::map<std::string, Entry> loaded;
+        uint32_t count = reader.U32();
+        for (uint32_t i = 0; i < count && reader.ok; ++i) {
+            std::string clip = reader.String();
+            Entry entry;
+            entry.mtime = reader.I64();
+            auto analysis = std::make_shared<ClipAnalysis>();
+            analysis->sampleRate = static_cast<int32_t>(reader.U32());
+            analysis->channels = static_cast<int32_t>(reader.U32());
+            analysis->frames = reader.U64();
+            analysis->peak = reader.F32();
+            analysis->loudness = reader.F32();
+            analysis->trimStart = reader.U64();
+            analysis->trimEnd = reader.U64();
+            uint32_t levels = reader.U32();
+            for (uint32_t l = 0; l < levels && reader.ok; ++l) {
+                WaveformLevel level;
+                level.bucketFrames = reader.U32();
+                uint32_t buckets = reader.U32();
+                if (!reader.Has(static_cast<size_t>(buckets) * 2)) break;
+                level.minmax.resize(static_cast<size_t>(buckets) * 2);
+                std::memcpy(level.minmax.data(), reader.data + reader.pos, level.minmax.size());
+                reader.pos += level.minmax.size();
+                analysis->waveform.push_back(std::move(level));
+            }
+            entry.analysis = std::move(analysis);
+            if (reader.ok) loaded[clip] = std::move(entry);
+        }
+        if (!reader.ok) return false;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entries = std::move(loaded);
+        dirty = false;
+        return true;
+    }
+
+    // Writes to a temporary file and renames it over the old index, so a crash mid save leaves
+    // the previous one intact. Does nothing if nothing changed since the last Load or Save.
+    bool Save(const std::string& path) {
+        std::vector<uint8_t> out;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!dirty) return true;
+
+            out.insert(out.end(), MAGIC, MAGIC + 8);
+            PutU32(out, VERSION);
+            PutU32(out, static_cast<uint32_t>(entries.size()));
+            for (const auto& [clip, entry] : entries) {
+                const ClipAnalysis& a = *entry.analysis;
+                PutU32(out, static_cast<uint32_t>(clip.size()));
+                out.insert(out.end(), clip.begin(), clip.end());
+                PutU64(out, static_cast<uint64_t>(entry.mtime));
+                PutU32(out, static_cast<uint32_t>(a.sampleRate));
+                PutU32(out, static_cast<uint32_t>(a.channels));
+                PutU64(out, a.frames);
+                PutF32(out, a.peak);
+                PutF32(out, a.loudness);
+                PutU64(out, a.trimStart);
+                PutU64(out, a.trimEnd);
+                PutU32(out, static_cast<uint32_t>(a.waveform.size()));
+                for (const WaveformLevel& level : a.waveform) {
+                    PutU32(out, level.bucketFrames);
+                    PutU32(out, static_cast<uint32_t>(level.Buckets()));
+                    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(level.minmax.data());
+                    out.insert(out.end(), bytes, bytes + level.minmax.size());
+                }
+            }
+            dirty = false;
+        }
+
+        std::lock_guard<std::mutex> lock(saving);
+        std::filesystem::path target = std::filesystem::u8path(path);
+        std::filesystem::path temporary = target;
+        temporary += ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+        file.close();
+        bool ok = !file.fail();
+
+        std::error_code error;
+        if (ok) std::filesystem::rename(temporary, target, error);
+        if (!ok || error) {
+            std::filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    // The analysis for path if it was made from the file as it was at mtime.
+    std::shared_ptr<const ClipAnalysis> Get(const std::string& path, int64_t mtime) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it == entries.end() || it->second.mtime != mtime) return nullptr;
+        return it->second.analysis;
+    }
+
+    // The analysis for path whatever the file looks like now, for callers on the playback path
+    // that shouldn't touch the filesystem.
+    std::shared_ptr<const ClipAnalysis> Get(const std::string& path) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        return it == entries.end() ? nullptr : it->second.analysis;
+    }
+
+    void Put(const std::string& path, int64_t mtime, std::shared_ptr<const ClipAnalysis> analysis) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[path] = {mtime, std::move(analysis)};
+        dirty = true;
+    }
+
+    // Drops entries for clips that are no longer in the soundboard.
+    void Retain(const std::vector<std::string>& paths) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, Entry> kept;
+        for (const std::string& path : paths) {
+            auto it = entries.find(path);
+            if (it != entries.end()) kept.insert(*it);
+        }
+        if (kept.size() != entries.size()) dirty = true;
+        entries = std::move(kept);
+    }
+
+private:
+    static constexpr char MAGIC[9] = "VICEANLZ";
+
+    struct Entry {
+        int64_t mtime = 0;
+        std::shared_ptr<const ClipAnalysis> analysis;
+    };
+
+    // Bounds checked little endian reads, ok goes false on the first read past the end.
+    struct Reader {
+        const uint8_t* data;
+        size_t size;
+        size_t pos = 0;
+        bool ok = true;
+
+        bool Has(size_t bytes) {
+            if (!ok || size - pos < bytes) ok = false;
+            return ok;
+        }
+
+        uint64_t Bytes(int count) {
+            if (!Has(count)) return 0;
+            uint64_t value = 0;
+            for (int i = 0; i < count; ++i) value |= static_cast<uint64_t>(data[pos + i]) << (8 * i);
+            pos += count;
+            return value;
+        }
+
+        uint32_t U32() { return static_cast<uint32_t>(Bytes(4)); }
+        uint64_t U64() { return Bytes(8); }
+        int64_t I64() { return static_cast<int64_t>(Bytes(8)); }
+
+        float F32() {
+            uint32_t bits = U32();
+            float value;
+            std::memcpy(&value, &bits, 4);
+            return value;
+        }
+
+        std::string String() {
+            uint32_t length = U32();
+            if (!Has(length)) return {};
+            std::string value(reinterpret_cast<const char*>(data + pos), length);
+            pos += length;
+            return value;
+        }
+    };
+
+    static void PutBytes(std::vector<uint8_t>& out, uint64_t value, int count) {
+        for (int i = 0; i < count; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    static void PutU32(std::vector<uint8_t>& out, uint32_t value) { PutBytes(out, value, 4); }
+    static void PutU64(std::vector<uint8_t>& out, uint64_t value) { PutBytes(out, value, 8); }
+
+    static void PutF32(std::vector<uint8_t>& out, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, 4);
+        PutU32(out, bits);
+    }
+
+    mutable std::mutex mutex;
+    // Saves from two batches finishing at once would otherwise share the temporary file.
+    std::mutex saving;
+    std::map<std::string, Entry> entries;
+    bool dirty = false;
+};
@@ -11,7 +11,26 @@
 #include <atomic>
 #include <cmath>
 #include <chrono>
+#include <mutex>
+#include <future>
 #include <blocks.hpp>
+#include <dsp.hpp>
+#include <fanout.hpp>
+#include <jitter_buffer.hpp>
+#include <latency_tuner.hpp>
+#include <channel_engine.hpp>
+#include <telemetry.hpp>
+#include <spectrum.hpp>
+#include <recorder.hpp>
+#include <replay.hpp>
+#include <trace.hpp>
+#include <device_registry.hpp>
+#include <sound_cache.hpp>
+#include <analysis_index.hpp>
+#include <worker_pool.hpp>
+#include <decoders.hpp>
+#include <sound_stream.hpp>
+#include <voice_mixer.hpp>
 #define NOMINMAX
 #include <windows.h>
 #include <mmdeviceapi.h>
@@ -19,7 +38,6 @@
 #include <audioclient.h>
 #include <audiopolicy.h>
 #include <propvarutil.h>
-#include <tlhelp32.h>
 #include <wtsapi32.h>
 #include <mfapi.h>
 #include <mfobjects.h>
@@ -33,6 +51,17 @@
 static std::vector<std::string> storage;
 static std::vector<const char*> c_strs;
 static std::vector<std::unique_ptr<char[]>> c_copies;
+static StatsRegistry channel_stats;
+static SpectrumAnalyzer spectrum([]() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST); });
+static Recorder recorder([]() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL); });
+static ReplayBuffer replay([]() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL); });
+static SoundCache sound_cache;
+static std::atomic<bool> compress_sounds{false};
+static AnalysisIndex sound_index;
+static std::atomic<bool> normalize_sounds{false};
+static std::atomic<float> normalize_target{-16.0f};
+// Milliseconds each output's jitter buffer aims to hold, 0 for a capture period plus a render one.
+static std::atomic<float> jitter_target_ms{0.0f};
 
 #pragma region Helpers
 std::string wideToUtf8(const wchar_t* wstr) {
@@ -46,138 +75,115 @@ std::string wideToUtf8(const wchar_t* wstr) {
     return str;
 }
 
-struct PCMData {
-    char* buffer = nullptr;
-    size_t bufferSize = 0;
-    int sampleRate = 0;
-    int channels = 0;
-};
+// Decodes anything Media Foundation understands (mp3, wma, aac, m4a) a sample at a time, as
+// float so nothing is lost converting through 16 bits.
+class MFSoundSource : public SoundSource {
+public:
+    ~MFSoundSource() override {
+        if (reader) reader->Release();
+        if (started) MFShutdown();
+    }
 
-struct PCMResult {
-    PCMData pcm;
-    int result; // 0 = success, 1 = unknown format, 2 = file error
-};
+    bool Open(const char* path) {
+        if (FAILED(MFStartup(MF_VERSION))) return false;
+        started = true;
+
+        int size = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+        if (size <= 0) return false;
+        std::wstring wide(size, 0);
+        MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide[0], size);
+
+        if (FAILED(MFCreateSourceReaderFromURL(wide.c_str(), nullptr, &reader)) || !reader) return false;
+
+        IMFMediaType* audioTypeOut = nullptr;
+        if (FAILED(MFCreateMediaType(&audioTypeOut)) || !audioTypeOut) return false;
+        audioTypeOut->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
+        audioTypeOut->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_Float);
+        audioTypeOut->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, 32);
+        HRESULT hr = reader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, audioTypeOut);
+        audioTypeOut->Release();
+        if (FAILED(hr)) return false;
+
+        IMFMediaType* pOutType = nullptr;
+        if (FAILED(reader->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &pOutType)) || !pOutType) return false;
+        sampleRate = MFGetAttributeUINT32(pOutType, MF_MT_AUDIO_SAMPLES_PER_SECOND, 44100);
+        channels = MFGetAttributeUINT32(pOutType, MF_MT_AUDIO_NUM_CHANNELS, 2);
+        pOutType->Release();
+        return channels > 0;
+    }
 
-PCMResult loadPCM(const char* filename) {
-    std::string lower(filename);
-    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
-
-    if (lower.size() >= 4 && lower.compare(lower.size() - 4, 4, ".wav") == 0) {
-        std::ifstream f(filename, std::ios::binary);
-        if (!f) return { {}, 2 };
-
-        char riff[4]; f.read(riff, 4);
-        if (std::strncmp(riff, "RIFF", 4) != 0) return { {}, 2 };
-        f.seekg(4, std::ios::cur);
-        char wave[4]; f.read(wave, 4);
-        if (std::strncmp(wave, "WAVE", 4) != 0) return { {}, 2 };
-
-
-        PCMData pcm;
-        while (f) {
-            char chunkId[4];
-            uint32_t chunkSize = 0;
-            f.read(chunkId, 4);
-            f.read(reinterpret_cast<char*>(&chunkSize), 4);
-            if (!f) break;
-
-            if (std::strncmp(chunkId, "fmt ", 4) == 0) {
-                uint16_t audioFormat, channels, blockAlign, bitsPerSample;
-                uint32_t sampleRate, byteRate;
-                f.read(reinterpret_cast<char*>(&audioFormat), 2);
-                f.read(reinterpret_cast<char*>(&channels), 2);
-                f.read(reinterpret_cast<char*>(&sampleRate), 4);
-                f.read(reinterpret_cast<char*>(&byteRate), 4);
-                f.read(reinterpret_cast<char*>(&blockAlign), 2);
-                f.read(reinterpret_cast<char*>(&bitsPerSample), 2);
-                if (chunkSize > 16) f.seekg(chunkSize - 16, std::ios::cur);
-                pcm.channels = channels;
-                pcm.sampleRate = sampleRate;
-            } else if (std::strncmp(chunkId, "data", 4) == 0) {
-                pcm.bufferSize = chunkSize;
-                pcm.buffer = new char[chunkSize];
-                f.read(pcm.buffer, chunkSize);
-                break;
-            } else f.seekg(chunkSize, std::ios::cur);
-        }
-        return { pcm, 0 };
+    int SampleRate() const override {
+        return sampleRate;
+    }
+
+    int Channels() const override {
+        return channels;
     }
 
-    HRESULT hr = MFStartup(MF_VERSION);
-    if (FAILED(hr)) return { {}, 1 };
+    size_t Read(float* out, size_t frames) override {
+        size_t read = 0;
+        while (read < frames) {
+            if (pending.size() == pendingOffset && !Fill()) break;
 
-    IMFSourceReader* reader = nullptr;
-    std::wstring wfilename(filename, filename + strlen(filename));
-    hr = MFCreateSourceReaderFromURL(wfilename.c_str(), nullptr, &reader);
-    if (FAILED(hr) || !reader) return { {}, 1 };
-
-    IMFMediaType* audioTypeOut = nullptr;
-    hr = MFCreateMediaType(&audioTypeOut);
-    if (FAILED(hr) || !audioTypeOut) {
-        reader->Release();
-        return { {}, 1 };
-    }
-
-    audioTypeOut->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio);
-    audioTypeOut->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_PCM);
-    reader->SetCurrentMediaType((DWORD)MF_SOURCE_READER_FIRST_AUDIO_STREAM, nullptr, audioTypeOut);
-
-    IMFMediaType* pOutType = nullptr;
-    reader->GetCurrentMediaType(MF_SOURCE_READER_FIRST_AUDIO_STREAM, &pOutType);
-
-    UINT32 sampleRate = MFGetAttributeUINT32(pOutType, MF_MT_AUDIO_SAMPLES_PER_SECOND, 44100);
-    UINT32 channels = MFGetAttributeUINT32(pOutType, MF_MT_AUDIO_NUM_CHANNELS, 2);
-
-    std::vector<char> pcmData;
-
-    while (true) {
-        DWORD streamIndex, flags;
-        LONGLONG timestamp;
-        IMFSample* sample = nullptr;
-        hr = reader->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &streamIndex, &flags, &timestamp, &sample);
-        if (FAILED(hr) || (flags & MF_SOURCE_READERF_ENDOFSTREAM)) break;
-        if (!sample) continue;
-
-        IMFMediaBuffer* buffer = nullptr;
-        hr = sample->ConvertToContiguousBuffer(&buffer);
-        if (SUCCEEDED(hr) && buffer) {
-            BYTE* audioData = nullptr;
-            DWORD audioDataLen = 0;
-            buffer->Lock(&audioData, nullptr, &audioDataLen);
-
-            size_t oldSize = pcmData.size();
-            pcmData.resize(oldSize + audioDataLen);
-            memcpy(pcmData.data() + oldSize, audioData, audioDataLen);
-
-            buffer->Unlock();
-            buffer->Release();
+            size_t take = std::min(frames - read, (pending.size() - pendingOffset) / channels);
+            std::memcpy(out + read * channels, pending.data() + pendingOffset, take * channels * sizeof(float));
+            pendingOffset += take * channels;
+            read += take;
         }
-        sample->Release();
+        return read;
     }
 
-    if (pOutType) pOutType->Release();
-    if (audioTypeOut) audioTypeOut->Release();
-    if (reader) reader->Release();
-    MFShutdown();
+private:
+    IMFSourceReader* reader = nullptr;
+    bool started = false;
+    bool ended = false;
+    int sampleRate = 0;
+    int channels = 0;
+    std::vector<float> pending;
+    size_t pendingOffset = 0;
+
+    // Pulls the next decoded sample into pending, false at the end of the file.
+    bool Fill() {
+        pending.clear();
+        pendingOffset = 0;
+
+        while (!ended) {
+            DWORD streamIndex, flags;
+            LONGLONG timestamp;
+            IMFSample* sample = nullptr;
+            HRESULT hr = reader->ReadSample(MF_SOURCE_READER_FIRST_AUDIO_STREAM, 0, &streamIndex, &flags, &timestamp, &sample);
+            if (FAILED(hr) || (flags & MF_SOURCE_READERF_ENDOFSTREAM)) {
+                ended = true;
+                if (sample) sample->Release();
+                break;
+            }
+            if (!sample) continue;
+
+            IMFMediaBuffer* buffer = nullptr;
+            if (SUCCEEDED(sample->ConvertToContiguousBuffer(&buffer)) && buffer) {
+                BYTE* audioData = nullptr;
+                DWORD audioDataLen = 0;
+                buffer->Lock(&audioData, nullptr, &audioDataLen);
+                const float* samples = reinterpret_cast<const float*>(audioData);
+                pending.assign(samples, samples + audioDataLen / sizeof(float));
+                buffer->Unlock();
+                buffer->Release();
+            }
+            sample->Release();
 
-    PCMData pcm{};
-    pcm.bufferSize = pcmData.size();
-    pcm.buffer = new char[pcm.bufferSize];
-    memcpy(pcm.buffer, pcmData.data(), pcm.bufferSize);
-    pcm.channels = channels;
-    pcm.sampleRate = sampleRate;
-    return { pcm, 0 };
-}
+            if (!pending.empty()) return true;
+        }
+        return false;
+    }
+};
 
-const char* string_to_cchar(std::string string) {
-    return strdup(string.c_str());
-}
+// WAV and FLAC are decoded natively, Media Foundation handles everything else (MP3, AAC, compressed WAVs...).
+std::unique_ptr<SoundSource> open_sound_source(const char* filename) {
+    if (std::unique_ptr<SoundSource> native = open_native_source(filename)) return native;
 
-float* int16_to_float(const int16_t* data, size_t frames, int channels) {
-    float* out = new float[frames * channels];
-    for (size_t i = 0; i < frames * channels; ++i)
-        out[i] = data[i] / 32768.f;
-    return out;
+    auto mf = std::make_unique<MFSoundSource>();
+    if (mf->Open(filename)) return mf;
+    return nullptr;
 }
 
 bool is_format_float(WAVEFORMATEX* wf) {
@@ -200,96 +206,1012 @@ bool is_format_int32(WAVEFORMATEX* wf) {
     return false;
 }
 
-float* linear_resample_interleaved(const float* src, size_t srcFrames, int channels, int srcRate, int dstRate, size_t* outFrames) {
-    *outFrames = srcFrames * dstRate / srcRate;
-    float* out = new float[*outFrames * channels];
-    for (size_t i = 0; i < *outFrames; ++i) {
-        float srcPos = i * float(srcFrames) / (*outFrames);
-        size_t idx = size_t(srcPos);
-        float frac = srcPos - idx;
-        for (int c = 0; c < channels; ++c) {
-            float s0 = (idx < srcFrames) ? src[idx * channels + c] : 0.f;
-            float s1 = (idx + 1 < srcFrames) ? src[(idx + 1) * channels + c] : 0.f;
-            out[i * channels + c] = s0 * (1 - frac) + s1 * frac;
-        }
+void capture_to_float(const BYTE* data, WAVEFORMATEX* wf, float* dst, size_t count, float gain) {
+    if (is_format_float(wf)) {
+        float_to_float_gain(reinterpret_cast<const float*>(data), dst, count, gain);
+    } else if (wf->wBitsPerSample == 16) {
+        int16_to_float_gain(reinterpret_cast<const int16_t*>(data), dst, count, gain);
+    } else if (wf->wBitsPerSample == 32) {
+        int32_to_float_gain(reinterpret_cast<const int32_t*>(data), dst, count, gain);
     }
-    return out;
 }
 
-float* remap_channels_interleaved(const float* src, size_t frames, int srcCh, int dstCh) {
-    float* out = new float[frames * dstCh];
-    for (size_t f = 0; f < frames; ++f) {
-        for (int c = 0; c < dstCh; ++c) {
-            out[f * dstCh + c] = src[f * srcCh + (c % srcCh)];
-        }
+void float_to_render(const float* src, WAVEFORMATEX* wf, BYTE* dst, size_t count, float gain) {
+    if (is_format_float(wf) && wf->wBitsPerSample == 32) {
+        float_to_float_gain(src, reinterpret_cast<float*>(dst), count, gain);
+    } else if (wf->wBitsPerSample == 16) {
+        float_to_int16_gain(src, reinterpret_cast<int16_t*>(dst), count, gain);
+    } else if (wf->wBitsPerSample == 32) {
+        float_to_int32_gain(src, reinterpret_cast<int32_t*>(dst), count, gain);
     }
-    return out;
 }
 
+std::string get_device_name(IMMDevice* pDevice)
+{
+    IPropertyStore* pProps = nullptr;
+    HRESULT hr = pDevice->OpenPropertyStore(STGM_READ, &pProps);
+    if (FAILED(hr)) return "null";
+
+    PROPVARIANT varName;
+    PropVariantInit(&varName);
+
+    hr = pProps->GetValue(PKEY_Device_FriendlyName, &varName);
+    std::string name = "null";
+    if (SUCCEEDED(hr)) {
+        name = wideToUtf8(varName.pwszVal);
+    }
+
+    PropVariantClear(&varName);
+    pProps->Release();
+
+    return name;
+}
+
+std::wstring utf8ToWide(const std::string& str) {
+    int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, nullptr, 0);
+    if (size <= 0) return {};
+    std::wstring wide(size - 1, 0);
+    MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, &wide[0], size);
+    return wide;
+}
+
+// Executable name of a process without the directory or ".exe", empty if we can't open it.
+std::string process_app_name(DWORD pid) {
+    HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!hProcess) return {};
+
+    std::string name;
+    wchar_t exePath[MAX_PATH] = {};
+    DWORD size = MAX_PATH;
+    if (QueryFullProcessImageNameW(hProcess, 0, exePath, &size)) {
+        std::wstring ws(exePath);
+        size_t slash = ws.find_last_of(L"\\/");
+        name = wideToUtf8((slash != std::wstring::npos) ? ws.substr(slash + 1).c_str() : ws.c_str());
+        if (name.size() > 4 && _stricmp(name.c_str() + name.size() - 4, ".exe") == 0)
+            name = name.substr(0, name.size() - 4);
+    }
+    CloseHandle(hProcess);
+    return name;
+}
+
+// Reports one session's end back to the registry. Kept per session because WASAPI has no
+// device wide notification for sessions going away.
+class SessionWatcher : public IAudioSessionEvents {
+public:
+    SessionWatcher(DeviceRegistry& registry, std::string deviceId, DWORD pid, IAudioSessionControl* control)
+        : registry(registry), deviceId(std::move(deviceId)), pid(pid), control(control) {
+        control->AddRef();
+        control->RegisterAudioSessionNotification(this);
+    }
+
+    // Unregisters and drops the watcher's own reference.
+    void Close() {
+        control->UnregisterAudioSessionNotification(this);
+        control->Release();
+        Release();
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++refs; }
+
+    ULONG STDMETHODCALLTYPE Release() override {
+        ULONG left = --refs;
+        if (left == 0) delete this;
+        return left;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** out) override {
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IAudioSessionEvents)) {
+            *out = static_cast<IAudioSessionEvents*>(this);
+            AddRef();
+            return S_OK;
+        }
+        *out = nullptr;
+        return E_NOINTERFACE;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnStateChanged(AudioSessionState state) override {
+        if (state == AudioSessionStateExpired) registry.SessionEnded(deviceId, pid);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnSessionDisconnected(AudioSessionDisconnectReason) override {
+        registry.SessionEnded(deviceId, pid);
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDisplayNameChanged(LPCWSTR, LPCGUID) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnIconPathChanged(LPCWSTR, LPCGUID) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnSimpleVolumeChanged(float, BOOL, LPCGUID) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnChannelVolumeChanged(DWORD, float[], DWORD, LPCGUID) override { return S_OK; }
+    HRESULT STDMETHODCALLTYPE OnGroupingParamChanged(LPCGUID, LPCGUID) override { return S_OK; }
+
+private:
+    std::atomic<ULONG> refs{1};
+    DeviceRegistry& registry;
+    std::string deviceId;
+    DWORD pid;
+    IAudioSessionControl* control;
+};
+
+// The MMDevice API behind DeviceRegistry. Device changes come from IMMNotificationClient, new
+// sessions from one IAudioSessionNotification per render endpoint and ended sessions from a
+// SessionWatcher each. Lives as long as the process, so its own COM refcount is fixed.
+class WasapiEnumerator : public DeviceEnumerator, public IMMNotificationClient, public IAudioSessionNotification {
+public:
+    std::vector<AudioDevice> Devices() override {
+        std::vector<AudioDevice> devices;
+        IMMDeviceCollection* collection = nullptr;
+        if (!pEnum || FAILED(pEnum->EnumAudioEndpoints(eAll, DEVICE_STATE_ACTIVE, &collection))) return devices;
+
+        UINT count = 0;
+        collection->GetCount(&count);
+        for (UINT i = 0; i < count; ++i) {
+            IMMDevice* dev = nullptr;
+            if (FAILED(collection->Item(i, &dev))) continue;
+            AudioDevice device;
+            if (Describe(dev, device)) devices.push_back(std::move(device));
+            dev->Release();
+        }
+        collection->Release();
+        return devices;
+    }
+
+    bool Device(const std::string& id, AudioDevice& out) override {
+        IMMDevice* dev = Open(id);
+        if (!dev) return false;
+        DWORD state = 0;
+        bool ok = SUCCEEDED(dev->GetState(&state)) && state == DEVICE_STATE_ACTIVE && Describe(dev, out);
+        dev->Release();
+        return ok;
+    }
+
+    std::vector<AudioSession> Sessions(const std::string& deviceId) override {
+        std::vector<AudioSession> sessions;
+        Endpoint& endpoint = endpoints[deviceId];
+        for (SessionWatcher* watcher : endpoint.watchers) watcher->Close();
+        endpoint.watchers.clear();
+
+        if (!endpoint.manager) {
+            IMMDevice* dev = Open(deviceId);
+            if (!dev) return sessions;
+            HRESULT hr = dev->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, nullptr, (void**)&endpoint.manager);
+            dev->Release();
+            if (FAILED(hr) || !endpoint.manager) {
+                endpoint.manager = nullptr;
+                return sessions;
+            }
+            endpoint.manager->RegisterSessionNotification(this);
+            std::lock_guard<std::mutex> lock(watchedMutex);
+            watched.push_back(deviceId);
+        }
+
+        // OnSessionCreated only fires once the session list has been read like this.
+        IAudioSessionEnumerator* sessionEnum = nullptr;
+        if (FAILED(endpoint.manager->GetSessionEnumerator(&sessionEnum)) || !sessionEnum) return sessions;
+
+        int count = 0;
+        sessionEnum->GetCount(&count);
+        for (int i = 0; i < count; ++i) {
+            IAudioSessionControl* control = nullptr;
+            if (FAILED(sessionEnum->GetSession(i, &control)) || !control) continue;
+
+            IAudioSessionControl2* control2 = nullptr;
+            AudioSessionState state = AudioSessionStateExpired;
+            DWORD pid = 0;
+            if (SUCCEEDED(control->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&control2)) && control2) {
+                control2->GetProcessId(&pid);
+                control2->Release();
+            }
+            control->GetState(&state);
+
+            if (pid > 0 && state != AudioSessionStateExpired) {
+                endpoint.watchers.push_back(new SessionWatcher(*registry, deviceId, pid, control));
+                sessions.push_back({deviceId, static_cast<uint32_t>(pid), process_app_name(pid)});
+            }
+            control->Release();
+        }
+        sessionEnum->Release();
+        return sessions;
+    }
+
+    void Watch(DeviceRegistry& target) override {
+        registry = &target;
+        // Keeps the MTA alive for the rest of the process, so the enumerator and the callbacks
+        // don't depend on whichever thread asked first staying initialized.
+        CO_MTA_USAGE_COOKIE cookie;
+        CoIncrementMTAUsage(&cookie);
+        if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum)))) {
+            pEnum = nullptr;
+            return;
+        }
+        pEnum->RegisterEndpointNotificationCallback(this);
+    }
+
+    void Forget(const std::string& deviceId) override {
+        {
+            std::lock_guard<std::mutex> lock(watchedMutex);
+            watched.erase(std::remove(watched.begin(), watched.end(), deviceId), watched.end());
+        }
+        auto it = endpoints.find(deviceId);
+        if (it == endpoints.end()) return;
+        for (SessionWatcher* watcher : it->second.watchers) watcher->Close();
+        if (it->second.manager) {
+            it->second.manager->UnregisterSessionNotification(this);
+            it->second.manager->Release();
+        }
+        endpoints.erase(it);
+    }
+
+    // Opens an endpoint by the id the registry keeps, nullptr if it's gone.
+    IMMDevice* Open(const std::string& id) {
+        IMMDevice* dev = nullptr;
+        if (!pEnum || FAILED(pEnum->GetDevice(utf8ToWide(id).c_str(), &dev))) return nullptr;
+        return dev;
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** out) override {
+        if (riid == __uuidof(IUnknown) || riid == __uuidof(IMMNotificationClient)) {
+            *out = static_cast<IMMNotificationClient*>(this);
+        } else if (riid == __uuidof(IAudioSessionNotification)) {
+            *out = static_cast<IAudioSessionNotification*>(this);
+        } else {
+            *out = nullptr;
+            return E_NOINTERFACE;
+        }
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceAdded(LPCWSTR id) override {
+        if (registry) registry->DeviceChanged(wideToUtf8(id));
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceRemoved(LPCWSTR id) override {
+        if (registry) registry->DeviceRemoved(wideToUtf8(id));
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDeviceStateChanged(LPCWSTR id, DWORD) override {
+        if (registry) registry->DeviceChanged(wideToUtf8(id));
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnPropertyValueChanged(LPCWSTR id, const PROPERTYKEY key) override {
+        if (registry && IsEqualPropertyKey(key, PKEY_Device_FriendlyName)) registry->DeviceChanged(wideToUtf8(id));
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE OnDefaultDeviceChanged(EDataFlow, ERole, LPCWSTR) override { return S_OK; }
+
+    // Which endpoint the session is on isn't passed in, so every render endpoint is refreshed.
+    // The registry merges them into one re-enumeration per endpoint on the next lookup.
+    HRESULT STDMETHODCALLTYPE OnSessionCreated(IAudioSessionControl*) override {
+        if (!registry) return S_OK;
+        std::vector<std::string> ids;
+        {
+            std::lock_guard<std::mutex> lock(watchedMutex);
+            ids = watched;
+        }
+        for (const std::string& id : ids) registry->SessionsChanged(id);
+        return S_OK;
+    }
+
+private:
+    struct Endpoint {
+        IAudioSessionManager2* manager = nullptr;
+        std::vector<SessionWatcher*> watchers;
+    };
+
+    DeviceRegistry* registry = nullptr;
+    IMMDeviceEnumerator* pEnum = nullptr;
+    // Only touched from registry calls, which it serializes.
+    std::unordered_map<std::string, Endpoint> endpoints;
+    // Endpoints with a session notification, for OnSessionCreated on the callback thread.
+    std::mutex watchedMutex;
+    std::vector<std::string> watched;
+
+    static bool Describe(IMMDevice* dev, AudioDevice& out) {
+        LPWSTR id = nullptr;
+        IMMEndpoint* endpoint = nullptr;
+        EDataFlow flow = eRender;
+        if (FAILED(dev->GetId(&id))) return false;
+        out.id = wideToUtf8(id);
+        CoTaskMemFree(id);
+        if (SUCCEEDED(dev->QueryInterface(__uuidof(IMMEndpoint), (void**)&endpoint))) {
+            endpoint->GetDataFlow(&flow);
+            endpoint->Release();
+        }
+        out.flow = flow == eCapture ? DeviceFlow::Capture : DeviceFlow::Render;
+        out.name = get_device_name(dev);
+        return true;
+    }
+};
+
+static WasapiEnumerator device_enumerator;
+static DeviceRegistry device_registry(device_enumerator);
+
 IMMDevice* find_device_by_name(EDataFlow flow, const char* name) {
+    std::string id;
+    if (!name || !device_registry.FindDevice(flow == eCapture ? DeviceFlow::Capture : DeviceFlow::Render, name, id))
+        return nullptr;
+    return device_enumerator.Open(id);
+}
+
+IMMDevice* render_device_or_default(const char* name) {
+    IMMDevice* device = find_device_by_name(eRender, name);
+    if (device) return device;
+
     IMMDeviceEnumerator* pEnum = nullptr;
-    IMMDeviceCollection* pDevices = nullptr;
-    IMMDevice* result = nullptr;
+    if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum)))) return nullptr;
+    pEnum->GetDefaultAudioEndpoint(eRender, eConsole, &device);
+    pEnum->Release();
+    return device;
+}
+
+// WaitForSingleObject as a span on the calling thread's trace.
+DWORD traced_wait(const char* name, HANDLE handle, DWORD ms) {
+    TraceSpan span(name);
+    return WaitForSingleObject(handle, ms);
+}
+
+// traced_wait on a channel's packet event that also returns early when the engine wakes the loop.
+DWORD traced_wait_channel(const char* name, HANDLE packet, const ChannelControl& control, DWORD ms) {
+    TraceSpan span(name);
+    HANDLE handles[] = {packet, static_cast<HANDLE>(control.event)};
+    return WaitForMultipleObjects(control.event ? 2 : 1, handles, FALSE, ms);
+}
+
+// One of the devices a channel plays to, in shared mode on its own event driven thread. The
+// channel's capture loop pushes into its jitter buffer and never waits on the device, the thread
+// pulls whatever the device has room for each period.
+struct RenderOutput {
+    // Room in the jitter buffer, a second so the target can be raised while running.
+    static constexpr REFERENCE_TIME CAPACITY = 10000000;
+
+    std::string id;
+    IMMDevice* device = nullptr;
+    IAudioClient* client = nullptr;
+    IAudioRenderClient* render = nullptr;
+    WAVEFORMATEX* format = nullptr;
+    UINT32 frames = 0;
+    UINT32 periodFrames = 0;
+    float gain = 1.0f;
+    // The render thread tunes the jitter target and trims latency, Retarget leaves it alone.
+    bool adaptive = false;
+    JitterBuffer jitter;
+
+    ~RenderOutput() {
+        Close();
+    }
+
+    // name empty or not found opens the default output.
+    bool Open(const char* name, REFERENCE_TIME duration) {
+        REFERENCE_TIME period = 0;
+        device = render_device_or_default(name);
+        if (!device || FAILED(device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&client)) ||
+            FAILED(client->GetMixFormat(&format)) || !format ||
+            FAILED(client->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, duration, 0, format, nullptr)) ||
+            FAILED(client->GetService(__uuidof(IAudioRenderClient), (void**)&render)) ||
+            FAILED(client->GetDevicePeriod(&period, nullptr))) {
+            Close();
+            return false;
+        }
+        LPWSTR wideId = nullptr;
+        if (SUCCEEDED(device->GetId(&wideId))) {
+            id = wideToUtf8(wideId);
+            CoTaskMemFree(wideId);
+        }
+        client->GetBufferSize(&frames);
+        periodFrames = static_cast<UINT32>(period * format->nSamplesPerSec / 10000000);
+
+        event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        wake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (!event || !wake || FAILED(client->SetEventHandle(event))) {
+            Close();
+            return false;
+        }
+        jitter.Configure(format->nChannels, periodFrames * 2, static_cast<size_t>(CAPACITY * format->nSamplesPerSec / 10000000));
+        return true;
+    }
+
+    // Starts the render thread, off the audio thread. It stays idle until the capture loop has
+    // attached it and pushed the first packet.
+    void Start(const char* channel_name) {
+        traceName = std::string(channel_name) + " render";
+        if (adaptive) {
+            tuner.Configure(periodFrames, frames, format->nSamplesPerSec);
+            jitter.SetTarget(tuner.Target());
+        }
+        running.store(true);
+        thread = std::thread([this]() { Run(); });
+    }
+
+    // From the capture loop before its first Push, only stores. main records the device and
+    // jitter buffer occupancy.
+    void Attach(ChannelStats* channelStats, bool isMain) {
+        resets = channelStats->resets.load(std::memory_order_relaxed);
+        main.store(isMain, std::memory_order_relaxed);
+        stats.store(channelStats, std::memory_order_release);
+        PublishTarget();
+    }
+
+    // Jitter buffer target from the setting, or a capture period plus one of this device's, the
+    // least that covers both sides waking at their worst relative phase.
+    void Retarget(REFERENCE_TIME capturePeriod) {
+        if (adaptive) return;
+        float ms = jitter_target_ms.load(std::memory_order_relaxed);
+        double seconds = ms > 0.0f ? ms / 1000.0 : static_cast<double>(capturePeriod) / 10000000.0 + static_cast<double>(periodFrames) / format->nSamplesPerSec;
+        jitter.SetTarget(static_cast<size_t>(seconds * format->nSamplesPerSec + 0.5));
+        PublishTarget();
+    }
+
+    // From the capture loop, count frames in this device's format. Never waits, what doesn't fit
+    // is dropped.
+    void Push(const float* buffer, size_t count, float volume) {
+        if (!running.load(std::memory_order_relaxed)) return;
+        if (jitter.Push(buffer, count, volume * gain) > 0) Stats()->overruns.fetch_add(1, std::memory_order_relaxed);
+        SetEvent(wake);
+    }
+
+    // From the capture loop while the channel is silent, the device stops once it has played out.
+    void Pause() {
+        jitter.Pause();
+    }
+
+    void Close() {
+        running.store(false);
+        if (wake) SetEvent(wake);
+        if (thread.joinable()) thread.join();
+        if (render) render->Release();
+        if (client) client->Release();
+        if (device) device->Release();
+        if (format) CoTaskMemFree(format);
+        if (event) CloseHandle(event);
+        if (wake) CloseHandle(wake);
+        render = nullptr;
+        client = nullptr;
+        device = nullptr;
+        format = nullptr;
+        event = nullptr;
+        wake = nullptr;
+    }
+
+private:
+    HANDLE event = nullptr;
+    HANDLE wake = nullptr;
+    std::atomic<ChannelStats*> stats{nullptr};
+    std::atomic<bool> main{false};
+    // Render thread once attached, the last reset request of stats it has acted on.
+    uint32_t resets = 0;
+    std::string traceName;
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::vector<float> scratch;
+    AdaptiveLatency tuner;
+    // The last Deliver.
+    JitterBuffer::Pulled pulled;
+
+    ChannelStats* Stats() const {
+        return stats.load(std::memory_order_acquire);
+    }
+
+    bool Main() const {
+        return main.load(std::memory_order_relaxed);
+    }
+
+    uint64_t FramesToNs(size_t count) const {
+        return static_cast<uint64_t>(count * 1e9 / format->nSamplesPerSec);
+    }
+
+    void PublishTarget() {
+        if (Main() && Stats()) Stats()->jitter_target_ns.store(FramesToNs(jitter.Target()), std::memory_order_relaxed);
+    }
+
+    // Once per period in adaptive mode, before topping the device up. The device running out
+    // while it was last handed real audio is a glitch the jitter buffer didn't see.
+    void Adapt(UINT32 padding) {
+        bool starved = padding == 0 && !pulled.underrun;
+        if (starved) Stats()->underruns.fetch_add(1, std::memory_order_relaxed);
+        size_t skip = tuner.Period(padding, jitter.Fill(), starved || pulled.underrun, Stats()->load.load(std::memory_order_relaxed));
+        if (skip) jitter.Skip(skip);
+        jitter.SetTarget(tuner.Target());
+        PublishTarget();
+    }
+
+    // Moves up to count frames from the jitter buffer to the device, at least minimum even if
+    // that means silence. False if the device went away.
+    bool Deliver(UINT32 count, UINT32 minimum) {
+        pulled = jitter.Pull(scratch.data(), count, minimum);
+        if (pulled.underrun) Stats()->underruns.fetch_add(1, std::memory_order_relaxed);
+        if (pulled.skipped) Stats()->overruns.fetch_add(1, std::memory_order_relaxed);
+        if (pulled.frames == 0) return true;
+
+        TraceSpan span("render");
+        BYTE* data = nullptr;
+        if (FAILED(render->GetBuffer(static_cast<UINT32>(pulled.frames), &data))) return false;
+        float_to_render(scratch.data(), format, data, pulled.frames * format->nChannels, 1.0f);
+        return SUCCEEDED(render->ReleaseBuffer(static_cast<UINT32>(pulled.frames), 0));
+    }
+
+    void Run() {
+        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        TraceThread trace(traceName.c_str());
+
+        scratch.resize(static_cast<size_t>(frames) * format->nChannels);
+        bool rendering = false;
+        while (running.load()) {
+            if (!rendering) {
+                if (!jitter.Ready() || !Stats()) {
+                    traced_wait("idle", wake, 100);
+                    continue;
+                }
+
+                // Hand the device what's buffered before starting so its first period isn't silence.
+                if (!Deliver(frames, 0)) break;
+                client->Start();
+                rendering = true;
+                continue;
+            }
+
+            if (traced_wait("wait render", event, 200) != WAIT_OBJECT_0) continue;
+
+            UINT32 padding = 0;
+            if (FAILED(client->GetCurrentPadding(&padding))) break;
+
+            // Let what's already queued play out before stopping.
+            if (jitter.Idle()) {
+                if (padding == 0) {
+                    client->Stop();
+                    client->Reset();
+                    rendering = false;
+                }
+                continue;
+            }
+
+            if (Main()) {
+                uint32_t requested = Stats()->resets.load(std::memory_order_relaxed);
+                if (requested != resets) {
+                    resets = requested;
+                    Stats()->ClearRender();
+                }
+                Stats()->occupancy_frames.Record(padding);
+                Stats()->jitter_ns.Record(FramesToNs(jitter.Fill()));
+            }
+            if (adaptive) Adapt(padding);
+            // Silence only goes in when the device would otherwise run out before its next period.
+            UINT32 minimum = periodFrames > padding ? periodFrames - padding : 0;
+            pulled = {};
+            if (frames > padding && !Deliver(frames - padding, minimum)) break;
+            if (Main()) Stats()->latency_ns.store(FramesToNs(padding + pulled.frames + jitter.Fill()), std::memory_order_relaxed);
+        }
+
+        if (rendering) client->Stop();
+        running.store(false);
+        CoUninitialize();
+    }
+};
 
-    if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum))))
+// Opens every output a channel routes to, skipping any that fail. No routes plays to the default
+// output at unity gain.
+std::vector<std::unique_ptr<RenderOutput>> open_outputs(const std::vector<ChannelRoute>& routes, REFERENCE_TIME duration, bool adaptive) {
+    std::vector<std::unique_ptr<RenderOutput>> opened;
+    for (size_t i = 0; i < std::max<size_t>(routes.size(), 1); ++i) {
+        auto output = std::make_unique<RenderOutput>();
+        const char* name = i < routes.size() && !routes[i].device.empty() ? routes[i].device.c_str() : nullptr;
+        if (!output->Open(name, duration)) {
+            std::cerr << "WASAPI: could not open output " << (name ? name : "(default)") << "\n";
+            continue;
+        }
+        output->gain = i < routes.size() ? routes[i].gain : 1.0f;
+        output->adaptive = adaptive;
+        opened.push_back(std::move(output));
+    }
+    return opened;
+}
+
+// Closes any output on the device an app channel captures from.
+void drop_feedback(std::vector<std::unique_ptr<RenderOutput>>& renders, const std::string& deviceId) {
+    renders.erase(std::remove_if(renders.begin(), renders.end(), [&](auto& render) {
+        if (render->id != deviceId) return false;
+        std::cerr << "Capture and render device are the same. Feedback possible!\n";
+        render->Close();
+        return true;
+    }), renders.end());
+}
+
+// Adaptive channels open with room for the tuner to grow into, it decides how much of it is used.
+REFERENCE_TIME channel_buffer_duration(const ChannelSpec& spec) {
+    if (spec.adaptive) return 500000;
+    if (spec.device) return spec.lowLatency ? 100000 : 500000;
+    return spec.lowLatency ? 20000 : 1000000;
+}
+
+bool file_mtime(const char* path, int64_t* mtime) {
+    int size = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+    if (size <= 0) return false;
+    std::wstring wide(size, 0);
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide[0], size);
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(wide.c_str(), GetFileExInfoStandard, &data)) return false;
+    *mtime = (static_cast<int64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+bool is_render_format_supported(WAVEFORMATEX* wf) {
+    return (is_format_float(wf) && wf->wBitsPerSample == 32) || wf->wBitsPerSample == 16 || is_format_int32(wf);
+}
+
+std::shared_ptr<const RenderedSound> to_rendered_sound(std::vector<float>&& samples, int channels) {
+    auto sound = std::make_shared<RenderedSound>();
+    sound->channels = channels;
+    sound->frames = samples.size() / channels;
+    if (compress_sounds.load(std::memory_order_relaxed)) {
+        sound->compressed = AdpcmClip::Encode(samples.data(), sound->frames, channels);
+    } else {
+        sound->samples = std::move(samples);
+    }
+    return sound;
+}
+
+// Decodes a whole file at the device's rate and channel count, used for preloading.
+std::shared_ptr<const RenderedSound> render_sound(const char* file, int sampleRate, int channels) {
+    std::unique_ptr<SoundSource> source = open_sound_source(file);
+    if (!source) {
+        std::cerr << "Failed to load \"" << file << "\": Unrecognized file format\n";
         return nullptr;
+    }
 
-    if (FAILED(pEnum->EnumAudioEndpoints(flow, DEVICE_STATE_ACTIVE, &pDevices))) {
-        pEnum->Release();
+    LinearResampler resampler;
+    resampler.Configure(source->Channels(), source->SampleRate(), sampleRate);
+
+    std::vector<float> decoded(SoundStream::CHUNK_FRAMES * source->Channels());
+    std::vector<float> resampled;
+    std::vector<float> samples;
+    while (size_t frames = source->Read(decoded.data(), SoundStream::CHUNK_FRAMES)) {
+        size_t outFrames = resampler.Process(decoded.data(), frames, resampled);
+        size_t offset = samples.size();
+        samples.resize(offset + outFrames * channels);
+        remap_channels_into(resampled.data(), outFrames, source->Channels(), channels, samples.data() + offset);
+    }
+
+    if (samples.empty()) {
+        std::cerr << "Failed to load \"" << file << "\": No audio data\n";
         return nullptr;
     }
+    return to_rendered_sound(std::move(samples), channels);
+}
 
-    UINT count = 0;
-    pDevices->GetCount(&count);
-    for (UINT i = 0; i < count; ++i) {
-        IMMDevice* dev = nullptr;
-        if (SUCCEEDED(pDevices->Item(i, &dev))) {
-            IPropertyStore* props = nullptr;
-            if (SUCCEEDED(dev->OpenPropertyStore(STGM_READ, &props))) {
-                PROPVARIANT varName;
-                PropVariantInit(&varName);
-                if (SUCCEEDED(props->GetValue(PKEY_Device_FriendlyName, &varName))) {
-                    if (name && strlen(name) > 0) {
-                        std::string friendly = wideToUtf8(varName.pwszVal);
-                        if (friendly == std::string(name)) {
-                            result = dev;
-                            PropVariantClear(&varName);
-                            props->Release();
-                            break;
-                        }
-                    }
-                    PropVariantClear(&varName);
+std::string sound_key(const char* file, int sampleRate, int channels) {
+    int64_t mtime = 0;
+    if (!file_mtime(file, &mtime)) return "";
+    return SoundCache::Key(file, mtime, sampleRate, channels);
+}
+
+// Cached version of render_sound. preload lookups don't count towards the hit rate.
+std::shared_ptr<const RenderedSound> get_sound(const char* file, int sampleRate, int channels, bool preload) {
+    std::string key = sound_key(file, sampleRate, channels);
+    if (key.empty()) {
+        std::cerr << "Failed to load \"" << file << "\": File doesn't exist or the file is in use\n";
+        return nullptr;
+    }
+
+    std::shared_ptr<const RenderedSound> sound = sound_cache.Get(key, !preload);
+    if (sound) return sound;
+
+    sound = render_sound(file, sampleRate, channels);
+    sound_cache.Put(key, sound);
+    return sound;
+}
+
+WorkerPool& preload_pool() {
+    static WorkerPool pool(WorkerPool::DefaultThreads(),
+        []() { CoInitializeEx(nullptr, COINIT_MULTITHREADED); MFStartup(MF_VERSION); },
+        []() { MFShutdown(); CoUninitialize(); });
+    return pool;
+}
+
+// Decodes every streamed sound, so a trigger that misses the cache doesn't start a thread.
+StreamDecoder& stream_decoder() {
+    static StreamDecoder decoder(2,
+        []() { CoInitializeEx(nullptr, COINIT_MULTITHREADED); MFStartup(MF_VERSION); },
+        []() { MFShutdown(); CoUninitialize(); });
+    return decoder;
+}
+
+// Gain that brings an analyzed sound to the normalization target, never pushing its peak past
+// full scale. 1 when normalization is off or the sound hasn't been analyzed yet.
+float normalization_gain(const char* file) {
+    if (!normalize_sounds.load(std::memory_order_relaxed)) return 1.0f;
+    std::shared_ptr<const ClipAnalysis> analysis = sound_index.Get(file);
+    if (!analysis || analysis->loudness <= -70.0f) return 1.0f;
+
+    float gain = std::pow(10.0f, (normalize_target.load(std::memory_order_relaxed) - analysis->loudness) / 20.0f);
+    if (analysis->peak > 0.0f) gain = std::min(gain, 1.0f / analysis->peak);
+    return gain;
+}
+
+// One event driven stream per output device and latency that every soundboard sound is mixed
+// into, instead of a stream and a thread per sound. The thread sleeps while nothing is playing.
+class SoundboardOutput {
+public:
+    static constexpr size_t POLYPHONY = 32;
+
+    std::string device;
+    bool lowLatency = false;
+    int sampleRate = 0;
+    int channels = 0;
+    VoiceMixer mixer{POLYPHONY};
+
+    ~SoundboardOutput() {
+        running.store(false);
+        if (wake) SetEvent(wake);
+        if (thread.joinable()) thread.join();
+        if (renderClient) renderClient->Release();
+        if (audioClient) audioClient->Release();
+        if (renderEvent) CloseHandle(renderEvent);
+        if (wake) CloseHandle(wake);
+    }
+
+    bool Open(const char* device_name, bool low_latency) {
+        device = device_name ? device_name : "";
+        lowLatency = low_latency;
+
+        IMMDevice* targetDevice = render_device_or_default(device_name);
+        if (!targetDevice) {
+            std::cerr << "No audio device found\n";
+            return false;
+        }
+
+        HRESULT hr = targetDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&audioClient);
+        targetDevice->Release();
+        if (FAILED(hr)) return false;
+
+        WAVEFORMATEX* pwfx = nullptr;
+        if (FAILED(audioClient->GetMixFormat(&pwfx)) || !pwfx) {
+            std::cerr << "GetMixFormat failed\n";
+            return false;
+        }
+
+        if (!is_render_format_supported(pwfx)) {
+            std::cerr << "Unsupported device format\n";
+            CoTaskMemFree(pwfx);
+            return false;
+        }
+
+        REFERENCE_TIME bufferDuration = low_latency ? 100000 : 500000;
+        hr = audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, bufferDuration, 0, pwfx, nullptr);
+        format.assign(reinterpret_cast<BYTE*>(pwfx), reinterpret_cast<BYTE*>(pwfx) + sizeof(WAVEFORMATEX) + pwfx->cbSize);
+        sampleRate = pwfx->nSamplesPerSec;
+        channels = pwfx->nChannels;
+        CoTaskMemFree(pwfx);
+        if (FAILED(hr)) {
+            std::cerr << "AudioClient Initialize failed\n";
+            return false;
+        }
+
+        renderEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        wake = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        if (!renderEvent || !wake || FAILED(audioClient->SetEventHandle(renderEvent))) return false;
+        if (FAILED(audioClient->GetService(__uuidof(IAudioRenderClient), (void**)&renderClient))) return false;
+        audioClient->GetBufferSize(&bufferFrames);
+
+        mixer.Configure(sampleRate, channels, bufferFrames);
+        running.store(true);
+        thread = std::thread([this]() { Run(); });
+        return true;
+    }
+
+    bool Alive() const {
+        return running.load();
+    }
+
+    void Wake() {
+        SetEvent(wake);
+    }
+
+private:
+    IAudioClient* audioClient = nullptr;
+    IAudioRenderClient* renderClient = nullptr;
+    HANDLE renderEvent = nullptr;
+    HANDLE wake = nullptr;
+    UINT32 bufferFrames = 0;
+    std::vector<BYTE> format;
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+    // Mixes frames into the device buffer, false if the device went away.
+    bool Write(std::vector<float>& mix, UINT32 frames) {
+        TraceSpan span("mix");
+        BYTE* pData = nullptr;
+        if (FAILED(renderClient->GetBuffer(frames, &pData))) return false;
+        mixer.Mix(mix.data(), frames);
+        float_to_render(mix.data(), reinterpret_cast<WAVEFORMATEX*>(format.data()), pData, frames * channels, 1.0f);
+        renderClient->ReleaseBuffer(frames, 0);
+        mixer.FreeRetired();
+        return true;
+    }
+
+    void Run() {
+        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+        DenormalGuard denormals;
+        TraceThread trace("soundboard");
+
+        std::vector<float> mix(bufferFrames * channels);
+        bool rendering = false;
+        while (running.load()) {
+            if (!rendering) {
+                if (mixer.Idle()) {
+                    mixer.FreeRetired();
+                    traced_wait("idle", wake, 100);
+                    continue;
                 }
-                props->Release();
+
+                // Fill the whole buffer before starting so the first period isn't silence.
+                if (!Write(mix, bufferFrames)) break;
+                audioClient->Start();
+                rendering = true;
+                continue;
             }
-            dev->Release();
+
+            if (traced_wait("wait render", renderEvent, 200) != WAIT_OBJECT_0) continue;
+
+            UINT32 padding = 0;
+            if (FAILED(audioClient->GetCurrentPadding(&padding))) break;
+
+            // Let what's already queued play out before stopping.
+            if (mixer.Idle()) {
+                mixer.FreeRetired();
+                if (padding == 0) {
+                    audioClient->Stop();
+                    audioClient->Reset();
+                    rendering = false;
+                }
+                continue;
+            }
+
+            UINT32 framesAvailable = bufferFrames - padding;
+            if (framesAvailable > 0 && !Write(mix, framesAvailable)) break;
         }
+
+        if (rendering) audioClient->Stop();
+        running.store(false);
+        CoUninitialize();
     }
+};
 
-    pDevices->Release();
-    pEnum->Release();
-    return result;
+static std::mutex soundboard_mutex;
+static std::vector<std::shared_ptr<SoundboardOutput>> soundboard_outputs;
+
+std::shared_ptr<SoundboardOutput> soundboard_output(const char* device_name, bool low_latency) {
+    std::string device = device_name ? device_name : "";
+    std::lock_guard<std::mutex> lock(soundboard_mutex);
+
+    // Outputs stop themselves when their device goes away.
+    soundboard_outputs.erase(std::remove_if(soundboard_outputs.begin(), soundboard_outputs.end(),
+        [](const std::shared_ptr<SoundboardOutput>& output) { return !output->Alive(); }), soundboard_outputs.end());
+
+    for (auto& output : soundboard_outputs) {
+        if (output->device == device && output->lowLatency == low_latency) return output;
+    }
+
+    auto output = std::make_shared<SoundboardOutput>();
+    if (!output->Open(device_name, low_latency)) return nullptr;
+    soundboard_outputs.push_back(output);
+    return output;
 }
 
-std::string get_device_name(IMMDevice* pDevice)
-{
-    IPropertyStore* pProps = nullptr;
-    HRESULT hr = pDevice->OpenPropertyStore(STGM_READ, &pProps);
-    if (FAILED(hr)) return "null";
+// A loopback capture of what a render device plays, offered to the recorder and the replay as
+// "output:<device>". Runs while something is attached to its point or it's kept for the replay.
+struct OutputCapture {
+    std::string name;
+    std::shared_ptr<RecordPoint> point;
+    std::promise<bool> ready;
+    // Under output_capture_mutex.
+    bool replay = false;
+};
 
-    PROPVARIANT varName;
-    PropVariantInit(&varName);
+static std::mutex output_capture_mutex;
+static std::vector<std::shared_ptr<OutputCapture>> output_captures;
+
+void output_capture_loop(std::string device_name, std::shared_ptr<OutputCapture> capture) {
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    TraceThread trace(capture->name.c_str());
+
+    IMMDevice* device = render_device_or_default(device_name.c_str());
+    IAudioClient* client = nullptr;
+    IAudioCaptureClient* pCapture = nullptr;
+    WAVEFORMATEX* wf = nullptr;
+    HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    bool ok = device && SUCCEEDED(device->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&client)) &&
+              SUCCEEDED(client->GetMixFormat(&wf)) &&
+              SUCCEEDED(client->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK,
+                                           500000, 0, wf, nullptr)) &&
+              SUCCEEDED(client->GetService(__uuidof(IAudioCaptureClient), (void**)&pCapture)) &&
+              SUCCEEDED(client->SetEventHandle(event)) && SUCCEEDED(client->Start());
+
+    std::shared_ptr<RecordPoint> point;
+    if (ok) {
+        point = recorder.Register(capture->name.c_str(), wf->nSamplesPerSec, wf->nChannels);
+        capture->point = point;
+    }
+    capture->ready.set_value(ok);
+
+    std::vector<float> buffer(ok ? static_cast<size_t>(wf->nSamplesPerSec) * wf->nChannels : 0);
+    while (ok) {
+        // Whoever opened the capture holds the mutex until they've attached, so it can't end
+        // before they do.
+        if (point->Attached() == 0) {
+            std::lock_guard<std::mutex> lock(output_capture_mutex);
+            if (point->Attached() == 0 && !capture->replay) {
+                output_captures.erase(std::remove(output_captures.begin(), output_captures.end(), capture), output_captures.end());
+                break;
+            }
+        }
 
-    hr = pProps->GetValue(PKEY_Device_FriendlyName, &varName);
-    std::string name = "null";
-    if (SUCCEEDED(hr)) {
-        name = wideToUtf8(varName.pwszVal);
+        // Loopback delivers nothing while the device plays nothing, fill the gap with silence.
+        if (traced_wait("wait capture", event, 100) != WAIT_OBJECT_0) {
+            point->Silence(wf->nSamplesPerSec / 10);
+            continue;
+        }
+
+        UINT32 packetFrames = 0;
+        while (SUCCEEDED(pCapture->GetNextPacketSize(&packetFrames)) && packetFrames > 0) {
+            TraceSpan span("capture");
+            BYTE* pData = nullptr;
+            UINT32 numFrames = 0;
+            DWORD flags = 0;
+            if (FAILED(pCapture->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr))) {
+                ok = false;
+                break;
+            }
+            numFrames = std::min<UINT32>(numFrames, wf->nSamplesPerSec);
+            if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+                point->Silence(numFrames);
+            } else {
+                capture_to_float(pData, wf, buffer.data(), static_cast<size_t>(numFrames) * wf->nChannels, 1.0f);
+                point->Write(buffer.data(), numFrames);
+            }
+            pCapture->ReleaseBuffer(numFrames);
+        }
     }
 
-    PropVariantClear(&varName);
-    pProps->Release();
+    {
+        std::lock_guard<std::mutex> lock(output_capture_mutex);
+        output_captures.erase(std::remove(output_captures.begin(), output_captures.end(), capture), output_captures.end());
+    }
+    if (point) {
+        replay.Remove(point);
+        recorder.Unregister(point);
+    }
+    if (client) client->Stop();
+    if (pCapture) pCapture->Release();
+    if (client) client->Release();
+    if (device) device->Release();
+    if (wf) CoTaskMemFree(wf);
+    CloseHandle(event);
+    CoUninitialize();
+}
 
-    return name;
+// The running capture of device, started if there's none. Call with output_capture_mutex held
+// and attach to it before letting go. Null if the device couldn't be opened.
+std::shared_ptr<OutputCapture> open_output_capture(const char* device_name) {
+    std::string device = device_name ? device_name : "";
+    std::string name = "output:" + device;
+    for (auto& capture : output_captures) {
+        if (capture->name == name) return capture;
+    }
+
+    auto capture = std::make_shared<OutputCapture>();
+    capture->name = name;
+    std::future<bool> ready = capture->ready.get_future();
+    output_captures.push_back(capture);
+    std::thread(output_capture_loop, device, capture).detach();
+    if (!ready.get()) return nullptr;
+    return capture;
 }
 
 bool isValidName(const std::string& name) {
@@ -309,6 +1231,15 @@ bool isValidName(const std::string& name) {
     return true;
 }
 
+// Copies name for the string lists handed to Rust, which hold on to them until clear_statics.
+void push_c_str(const std::string& name) {
+    storage.emplace_back(name);
+    auto copy = std::make_unique<char[]>(name.size() + 1);
+    strcpy(copy.get(), name.c_str());
+    c_strs.push_back(copy.get());
+    c_copies.push_back(std::move(copy));
+}
+
 void clear_statics() {
     std::thread([]() mutable {
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
@@ -320,224 +1251,123 @@ void clear_statics() {
 #pragma endregion
 
 extern "C" {
-    std::atomic<bool> stop_audio(true);
-    #pragma region Volumes
-    static std::unordered_map<std::string, float> volume;
-
-    void reset_volume() {
-        volume.clear();
+    #pragma region Latency
+    // How much each output buffers between capture and render, 0 for automatic. Running channels
+    // pick it up on their next packet.
+    void set_jitter_target(float ms) {
+        jitter_target_ms.store(std::max(ms, 0.0f), std::memory_order_relaxed);
     }
-
-    void insert_volume(const char* key, float value) {
-        volume[key] = value;
+    #pragma endregion
+    #pragma region Channel Stats
+    size_t get_channel_stats(ChannelStatsSnapshot* out, size_t max) {
+        if (!out) return 0;
+        return channel_stats.Snapshot(out, max);
     }
 
-    void free_cstr(const char* ptr) {
-        if (ptr) free((void*)ptr);
+    void reset_channel_stats() {
+        channel_stats.ClearAll();
     }
 
-    const char* get_volume(const char* name, bool get, bool device) {
-        CoInitialize(nullptr);
-
-        if (device == true) {
-            IMMDevice* targetDevice = find_device_by_name(eCapture, name);
-            if (!targetDevice) {
-                CoUninitialize();
-                return string_to_cchar(get ? "0¬null" : "0");
-            }
-
-            IAudioMeterInformation* pMeterInfo = nullptr;
-
-            if (FAILED(targetDevice->Activate(__uuidof(IAudioMeterInformation), CLSCTX_ALL, NULL, (void**)&pMeterInfo))) {
-                std::cerr << "Failed to activate IAudioMeterInformation\n";
-                targetDevice->Release();
-                CoUninitialize();
-                return string_to_cchar(get ? "0¬null" : "0");
-            }
+    // Levels of every running channel in one call, cheap enough to poll every frame.
+    size_t get_channel_levels(ChannelLevelSnapshot* out, size_t max) {
+        if (!out) return 0;
+        return channel_stats.Levels(out, max, 250000000);
+    }
 
-            float peak = 0.0f;
-            if (SUCCEEDED(pMeterInfo->GetPeakValue(&peak))) {
-                std::string device_name = get_device_name(targetDevice);
-                targetDevice->Release();
-                pMeterInfo->Release();
-                CoUninitialize();
-                if (get == true) {
-                    return string_to_cchar(std::to_string(peak)+"¬"+device_name);
-                } else {
-                    return string_to_cchar(std::to_string(peak));
-                }
-            } else {
-                std::cerr << "GetPeakValue failed\n";
-                targetDevice->Release();
-                pMeterInfo->Release();
-                CoUninitialize();
-                return string_to_cchar(get ? "0¬null" : "0");
-            }
-        } else {
-            IMMDevice* targetDevice = nullptr;
-            std::wstring trueName;
-
-            if (get == true) {
-                DWORD targetPid = 0;
-                PROCESSENTRY32W pe32{};
-                pe32.dwSize = sizeof(pe32);
-                HANDLE hSnap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-                if (Process32FirstW(hSnap, &pe32)) {
-                    do {
-                        std::string exe = wideToUtf8(pe32.szExeFile);
-                        if (exe.size() > 4 && exe.substr(exe.size() - 4) == ".exe")
-                            exe = exe.substr(0, exe.size() - 4);
-                        if (_stricmp(exe.c_str(), name) == 0) {
-                            targetPid = pe32.th32ProcessID;
-                            break;
-                        }
-                    } while (Process32NextW(hSnap, &pe32));
-                }
-                CloseHandle(hSnap);
-                if (!targetPid) {
-                    std::cerr << "Process not found: " << name << "\n";
-                    CoUninitialize();
-                    return string_to_cchar("0¬null");
-                }
+    // The analyzer thread only runs, and the loops only copy samples for it, while enabled.
+    void set_spectrum_enabled(bool enabled) {
+        spectrum.SetEnabled(enabled);
+    }
 
-                IMMDeviceEnumerator* pEnum = nullptr;
-                CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnum);
-
-                IMMDeviceCollection* devicesAll = nullptr;
-                pEnum->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &devicesAll);
-                UINT deviceCount = 0; devicesAll->GetCount(&deviceCount);
-
-                for (UINT i = 0; i < deviceCount; ++i) {
-                    IMMDevice* dev = nullptr;
-                    if (FAILED(devicesAll->Item(i, &dev)) || !dev) continue;
-
-                    IAudioSessionManager2* mgr2 = nullptr;
-                    if (FAILED(dev->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, nullptr, (void**)&mgr2)) || !mgr2) {
-                        dev->Release();
-                        continue;
-                    }
-
-                    IAudioSessionEnumerator* sessionEnum = nullptr;
-                    if (FAILED(mgr2->GetSessionEnumerator(&sessionEnum)) || !sessionEnum) {
-                        mgr2->Release();
-                        dev->Release();
-                        continue;
-                    }
-
-                    int sessionCount = 0;
-                    sessionEnum->GetCount(&sessionCount);
-                    bool found = false;
-
-                    for (int s = 0; s < sessionCount; ++s) {
-                        IAudioSessionControl* ctrl = nullptr;
-                        if (FAILED(sessionEnum->GetSession(s, &ctrl)) || !ctrl) continue;
-
-                        IAudioSessionControl2* ctrl2 = nullptr;
-                        if (SUCCEEDED(ctrl->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&ctrl2)) && ctrl2) {
-                            DWORD pid = 0;
-                            ctrl2->GetProcessId(&pid);
-                            ctrl2->Release();
-                            if (pid == targetPid) {
-                                targetDevice = dev;
-                                targetDevice->AddRef();
-                                found = true;
-                                break;
-                            }
-                        }
-                        ctrl->Release();
-                    }
-
-                    sessionEnum->Release();
-                    mgr2->Release();
-                    dev->Release();
-                    if (found) break;
-                }
-                devicesAll->Release();
+    size_t get_channel_spectra(ChannelSpectrumSnapshot* out, size_t max) {
+        if (!out) return 0;
+        return spectrum.Snapshot(out, max);
+    }
 
-                if (!targetDevice) {
-                    std::cerr << "Failed to find audio session for PID\n";
-                    pEnum->Release();
-                    CoUninitialize();
-                    return string_to_cchar(get ? "0¬null" : "0");
-                }
-            } else {
-                targetDevice = find_device_by_name(eRender, name);
-                if (!targetDevice) {
-                    CoUninitialize();
-                    return string_to_cchar("0");
-                }
-            }
+    size_t get_block_costs(const char* channel_name, BlockCostSnapshot* out, size_t max) {
+        if (!channel_name || !out) return 0;
+        return channel_stats.BlockCosts(channel_name, out, max);
+    }
 
-            IAudioMeterInformation* pMeterInfo = nullptr;
+    void set_block_profiling(bool enabled) {
+        block_profiling.store(enabled, std::memory_order_relaxed);
+    }
+    #pragma endregion
+    #pragma region Recording
+    // Records the running channel called source, or with output what the render device called
+    // source plays. format is a RecordFormat. Returns the recording id, 0 on failure.
+    uint64_t start_recording(const char* source, bool output, const char* path, int format, int bits) {
+        if (!source || !path || (format != 0 && format != 1)) return 0;
+        if (!output) return recorder.Start(source, path, static_cast<RecordFormat>(format), bits);
+
+        std::lock_guard<std::mutex> lock(output_capture_mutex);
+        std::shared_ptr<OutputCapture> capture = open_output_capture(source);
+        if (!capture) return 0;
+        return recorder.Start(capture->name.c_str(), path, static_cast<RecordFormat>(format), bits);
+    }
 
-            if (FAILED(targetDevice->Activate(__uuidof(IAudioMeterInformation), CLSCTX_ALL, NULL, (void**)&pMeterInfo))) {
-                std::cerr << "Failed to activate IAudioMeterInformation\n";
-                targetDevice->Release();
-                CoUninitialize();
-                return string_to_cchar(get ? "0¬null" : "0");
-            }
+    // Waits until the file is finished, out gets its final size.
+    bool stop_recording(uint64_t id, RecordingInfo* out) {
+        return recorder.Stop(id, out);
+    }
 
-            float peak = 0.0f;
-            if (SUCCEEDED(pMeterInfo->GetPeakValue(&peak))) {
-                std::string device_name = get_device_name(targetDevice);
-                targetDevice->Release();
-                pMeterInfo->Release();
-                CoUninitialize();
-                if (get == true) {
-                    return string_to_cchar(std::to_string(peak)+"¬"+device_name);
-                } else {
-                    return string_to_cchar(std::to_string(peak));
-                }
-            } else {
-                std::cerr << "GetPeakValue failed\n";
-                targetDevice->Release();
-                pMeterInfo->Release();
-                CoUninitialize();
-                return string_to_cchar(get ? "0¬null" : "0");
-            }
-        }
+    size_t get_recordings(RecordingInfo* out, size_t max) {
+        if (!out) return 0;
+        return recorder.List(out, max);
     }
     #pragma endregion
-    #pragma region Get Outputs
-    const char** get_outputs(size_t* len) {
-        *len = 0;
-        CoInitialize(nullptr);
+    #pragma region Replay
+    // Keeps the last seconds of every channel, and of output_device's mix unless it's null, in at
+    // most budget_bytes. Disabling drops the history.
+    void set_replay(bool enabled, double seconds, size_t budget_bytes, const char* output_device) {
+        std::lock_guard<std::mutex> lock(output_capture_mutex);
+        replay.Configure(enabled, seconds, budget_bytes);
+
+        std::string wanted = std::string("output:") + (output_device ? output_device : "");
+        bool keepOutput = enabled && output_device;
+        for (auto& capture : output_captures) {
+            if (!capture->replay || (keepOutput && capture->name == wanted)) continue;
+            capture->replay = false;
+            replay.Remove(capture->point);
+        }
+        if (!keepOutput) return;
 
-        IMMDeviceEnumerator* pEnum = nullptr;
-        IMMDeviceCollection* pDevices = nullptr;
+        std::shared_ptr<OutputCapture> capture = open_output_capture(output_device);
+        if (capture && !capture->replay) {
+            capture->replay = true;
+            replay.Add(capture->point);
+        }
+    }
 
-        if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum))))
-            return c_strs.data();
+    // Saves the last seconds of the channel called source, or with output of the device called
+    // source, on a background thread. Returns the export id, 0 if there's no history for it.
+    uint64_t export_replay(const char* source, bool output, const char* path, int format, int bits, double seconds) {
+        if (!source || !path || (format != 0 && format != 1)) return 0;
+        std::string name = output ? std::string("output:") + source : std::string(source);
+        return replay.Export(name.c_str(), path, static_cast<RecordFormat>(format), bits, seconds);
+    }
 
-        if (FAILED(pEnum->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &pDevices))) {
-            pEnum->Release();
-            return c_strs.data();
-        }
+    size_t get_replay_exports(ReplayExportInfo* out, size_t max) {
+        if (!out) return 0;
+        return replay.Exports(out, max);
+    }
 
-        UINT count;
-        pDevices->GetCount(&count);
-
-        for (UINT i = 0; i < count; i++) {
-            IMMDevice* pDevice = nullptr;
-            if (SUCCEEDED(pDevices->Item(i, &pDevice))) {
-                IPropertyStore* pProps = nullptr;
-                if (SUCCEEDED(pDevice->OpenPropertyStore(STGM_READ, &pProps))) {
-                    PROPVARIANT varName;
-                    PropVariantInit(&varName);
-                    if (SUCCEEDED(pProps->GetValue(PKEY_Device_FriendlyName, &varName))) {
-                        storage.emplace_back(wideToUtf8(varName.pwszVal));
-                        c_strs.push_back(storage.back().c_str());
-                        PropVariantClear(&varName);
-                    }
-                    pProps->Release();
-                }
-                pDevice->Release();
-            }
-        }
+    void get_replay_stats(ReplayStats* out) {
+        if (out) *out = replay.Stats();
+    }
+    #pragma endregion
+    #pragma region Trace
+    bool start_trace(const char* path) {
+        return TraceCollector::Instance().Start(path);
+    }
 
-        pDevices->Release();
-        pEnum->Release();
-        CoUninitialize();
+    bool stop_trace(TraceSummary* out) {
+        return TraceCollector::Instance().Stop(out);
+    }
+    #pragma endregion
+    #pragma region Get Outputs
+    const char** get_outputs(size_t* len) {
+        for (const std::string& name : device_registry.Names(DeviceFlow::Render)) push_c_str(name);
 
         clear_statics();
         *len = c_strs.size();
@@ -546,118 +1376,24 @@ extern "C" {
     #pragma endregion
     #pragma region Get Inputs
     const char** get_inputs(size_t* len) {
-        *len = 0;
-
-        CoInitialize(nullptr);
-
-        IMMDeviceEnumerator* pEnum = nullptr;
-        IMMDeviceCollection* pDevices = nullptr;
-
-        if (FAILED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum))))
-            return c_strs.data();
+        for (const std::string& name : device_registry.Names(DeviceFlow::Capture)) push_c_str(name);
 
-        if (FAILED(pEnum->EnumAudioEndpoints(eCapture, DEVICE_STATE_ACTIVE, &pDevices))) {
-            pEnum->Release();
-            return c_strs.data();
-        }
-
-        UINT count; pDevices->GetCount(&count);
-
-        for (UINT i = 0; i < count; i++) {
-            IMMDevice* pDevice = nullptr;
-            if (SUCCEEDED(pDevices->Item(i, &pDevice))) {
-                IPropertyStore* pProps = nullptr;
-                if (SUCCEEDED(pDevice->OpenPropertyStore(STGM_READ, &pProps))) {
-                    PROPVARIANT varName;
-                    PropVariantInit(&varName);
-                    if (SUCCEEDED(pProps->GetValue(PKEY_Device_FriendlyName, &varName))) {
-                        storage.emplace_back(wideToUtf8(varName.pwszVal));
-                        c_strs.push_back(storage.back().c_str());
-                        PropVariantClear(&varName);
-                    }
-                    pProps->Release();
-                }
-                pDevice->Release();
-            }
-        }
-
-        pDevices->Release();
-        pEnum->Release();
-        CoUninitialize();
-        
         clear_statics();
         *len = c_strs.size();
         return c_strs.data();
     }
     #pragma endregion
     #pragma region Get Apps
+    // Apps with an audio session on any output, then visible windows in the console session.
     const char** get_apps(size_t* len) {
         *len = 0;
 
         std::unordered_set<DWORD> seenPIDs;
-
-        CoInitialize(nullptr);
-
-        IMMDeviceEnumerator* pEnum = nullptr;
-        IMMDevice* pDevice = nullptr;
-        IAudioSessionManager2* pSessionManager = nullptr;
-        IAudioSessionEnumerator* pSessionEnum = nullptr;
-
-        if (SUCCEEDED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum))) &&
-            SUCCEEDED(pEnum->GetDefaultAudioEndpoint(eRender, eMultimedia, &pDevice)) &&
-            SUCCEEDED(pDevice->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, nullptr, (void**)&pSessionManager)) &&
-            SUCCEEDED(pSessionManager->GetSessionEnumerator(&pSessionEnum)))
-        {
-            int sessionCount = 0;
-            pSessionEnum->GetCount(&sessionCount);
-
-            for (int i = 0; i < sessionCount; i++) {
-                IAudioSessionControl* pControl = nullptr;
-                if (FAILED(pSessionEnum->GetSession(i, &pControl))) continue;
-
-                IAudioSessionControl2* pControl2 = nullptr;
-                if (SUCCEEDED(pControl->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&pControl2))) {
-                    DWORD pid = 0;
-                    if (SUCCEEDED(pControl2->GetProcessId(&pid)) && pid > 0) {
-                        seenPIDs.insert(pid);
-
-                        HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
-                        if (hProcess) {
-                            wchar_t exePath[MAX_PATH] = {};
-                            DWORD size = MAX_PATH;
-                            if (QueryFullProcessImageNameW(hProcess, 0, exePath, &size)) {
-                                std::wstring ws(exePath);
-                                size_t slash = ws.find_last_of(L"\\/");
-                                std::wstring justName = (slash != std::wstring::npos) ? ws.substr(slash + 1) : ws;
-
-                                std::string name = wideToUtf8(justName.c_str());
-                                if (name.size() > 4 && name.substr(name.size() - 4) == ".exe")
-                                    name = name.substr(0, name.size() - 4);
-
-                                if (isValidName(name)) {
-                                    storage.emplace_back(name);
-                                    auto copy = std::make_unique<char[]>(name.size() + 1);
-                                    strcpy(copy.get(), name.c_str());
-                                    c_strs.push_back(copy.get());
-                                    c_copies.push_back(std::move(copy));
-                                }
-                            }
-                            CloseHandle(hProcess);
-                        }
-                    }
-                    pControl2->Release();
-                }
-                pControl->Release();
-            }
-
-            pSessionEnum->Release();
-            pSessionManager->Release();
-            pDevice->Release();
-            pEnum->Release();
+        for (const AudioSession& session : device_registry.Sessions()) {
+            if (!seenPIDs.insert(session.pid).second) continue;
+            if (isValidName(session.app)) push_c_str(session.app);
         }
 
-        CoUninitialize();
-
         std::vector<DWORD> pids;
         EnumWindows([](HWND hwnd, LPARAM lParam) -> BOOL {
             if (IsWindowVisible(hwnd)) {
@@ -677,29 +1413,8 @@ extern "C" {
             if (!ProcessIdToSessionId(pid, &sessionId) || sessionId != WTSGetActiveConsoleSessionId())
                 continue;
 
-            HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
-            if (!hProcess) continue;
-
-            wchar_t exePath[MAX_PATH] = {};
-            DWORD size = MAX_PATH;
-            if (QueryFullProcessImageNameW(hProcess, 0, exePath, &size)) {
-                std::wstring ws(exePath);
-                size_t slash = ws.find_last_of(L"\\/");
-                std::wstring justName = (slash != std::wstring::npos) ? ws.substr(slash + 1) : ws;
-
-                std::string name = wideToUtf8(justName.c_str());
-                if (name.size() > 4 && name.substr(name.size() - 4) == ".exe")
-                    name = name.substr(0, name.size() - 4);
-
-                if (isValidName(name)) {
-                    storage.emplace_back(name);
-                    auto copy = std::make_unique<char[]>(name.size() + 1);
-                    strcpy(copy.get(), name.c_str());
-                    c_strs.push_back(copy.get());
-                    c_copies.push_back(std::move(copy));
-                }
-            }
-            CloseHandle(hProcess);
+            std::string name = process_app_name(pid);
+            if (isValidName(name)) push_c_str(name);
         }
 
         clear_statics();
@@ -708,602 +1423,769 @@ extern "C" {
     }
     #pragma endregion
     #pragma region Play Sound
-    void play_sound(const char* file, const char* device_name, bool low_latency) {
-        PCMResult result = loadPCM(file);
-        if (result.result != 0) {
-            if (result.result == 1) {
+    // Queues a sound on the device's soundboard output and returns its voice id, 0 if it couldn't be played.
+    // The voice goes to the render thread through a lock free queue and a cache miss is decoded on
+    // the stream decoder's threads. Finding the output still takes soundboard_mutex, on purpose: it's
+    // only ever held by callers like this one to find or open an output, never by a render thread.
+    uint64_t play_sound_voice(const char* file, const char* device_name, bool low_latency, const VoiceParams* params) {
+        CoInitialize(nullptr);
+        std::shared_ptr<SoundboardOutput> output = soundboard_output(device_name, low_latency);
+        CoUninitialize();
+        if (!output) return 0;
+
+        int sampleRate = output->sampleRate;
+        int channels = output->channels;
+
+        std::string key = sound_key(file, sampleRate, channels);
+        if (key.empty()) {
+            std::cerr << "Failed to load \"" << file << "\": File doesn't exist or the file is in use\n";
+            return 0;
+        }
+
+        // A cache miss streams the file instead of decoding it first. Sounds short enough to
+        // cache are kept while streaming and put in the cache once they finish.
+        std::unique_ptr<VoiceSource> voice;
+        if (std::shared_ptr<const RenderedSound> sound = sound_cache.Get(key)) {
+            voice = make_sound_voice(std::move(sound));
+        } else {
+            std::unique_ptr<SoundSource> source = open_sound_source(file);
+            if (!source) {
                 std::cerr << "Failed to load \"" << file << "\": Unrecognized file format\n";
-                return;
-            } else {
-                std::cerr << "Failed to load \"" << file << "\": File doesn't exist or the file is in use\n";
-                return;
+                return 0;
             }
-        }
 
-        PCMData pcm = result.pcm;
-        if (!pcm.buffer || pcm.channels <= 0) {
-            if (!pcm.buffer) {
-                std::cerr << "Failed to load \"" << file << "\": No audio data\n";
-                return;
-            } else {
-                std::cerr << "Failed to load \"" << file << "\": No channels\n";
-                return;
+            size_t keepFrames = sound_cache.Stats().budget_bytes / 4 / (channels * sizeof(float));
+            auto stream = std::make_shared<SoundStream>(std::move(source), sampleRate, channels, sampleRate, keepFrames,
+                [key, channels](std::vector<float>&& samples) {
+                    if (!samples.empty()) sound_cache.Put(key, to_rendered_sound(std::move(samples), channels));
+                });
+            if (!stream_decoder().Add(stream)) {
+                std::cerr << "Failed to play \"" << file << "\": Too many sounds streaming\n";
+                return 0;
             }
+            voice = std::make_unique<StreamVoiceSource>(std::move(stream));
         }
 
-        CoInitialize(nullptr);
-        IMMDevice* targetDevice = nullptr;
-
-        targetDevice = find_device_by_name(eRender, device_name);
-        if (!targetDevice) {
-            IMMDeviceEnumerator* pEnum = nullptr;
-            CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum));
-            pEnum->GetDefaultAudioEndpoint(eRender, eConsole, &targetDevice);
-            pEnum->Release();
-        }
+        VoiceParams voiceParams = params ? *params : VoiceParams{1.0f, 0, 0, 0};
+        voiceParams.gain *= normalization_gain(file);
+        uint64_t id = output->mixer.Play(std::move(voice), voiceParams);
+        output->Wake();
+        return id;
+    }
 
-        if (!targetDevice) {
-            std::cerr << "No audio device found\n";
-            CoUninitialize();
-            return;
-        }
+    void play_sound(const char* file, const char* device_name, bool low_latency) {
+        play_sound_voice(file, device_name, low_latency, nullptr);
+    }
 
-        IAudioClient* audioClient = nullptr;
-        if (FAILED(targetDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&audioClient))) {
-            targetDevice->Release(); CoUninitialize(); return;
+    void stop_sound_voice(uint64_t id, uint32_t fade_ms) {
+        std::lock_guard<std::mutex> lock(soundboard_mutex);
+        for (auto& output : soundboard_outputs) {
+            output->mixer.Stop(id, fade_ms);
+            output->Wake();
         }
+    }
 
-        WAVEFORMATEX* pwfx = nullptr;
-        if (FAILED(audioClient->GetMixFormat(&pwfx)) || !pwfx) {
-            std::cerr << "GetMixFormat failed\n";
-            audioClient->Release();
-            targetDevice->Release();
-            CoUninitialize();
-            return;
+    void stop_all_sounds(uint32_t fade_ms) {
+        std::lock_guard<std::mutex> lock(soundboard_mutex);
+        for (auto& output : soundboard_outputs) {
+            output->mixer.StopAll(fade_ms);
+            output->Wake();
         }
+    }
+    #pragma endregion
+    #pragma region Sound Cache
+    void set_sound_cache_budget(size_t bytes) {
+        sound_cache.SetBudget(bytes);
+    }
 
-        const int16_t* src16 = reinterpret_cast<const int16_t*>(pcm.buffer);
-        size_t srcFrames = pcm.bufferSize / (pcm.channels * sizeof(int16_t));
-        float* srcFloat = int16_to_float(src16, srcFrames, pcm.channels);
+    void get_sound_cache_stats(SoundCacheStats* out) {
+        if (out) *out = sound_cache.Stats();
+    }
 
-        size_t resampledFrames = 0;
-        float* resampled = linear_resample_interleaved(srcFloat, srcFrames, pcm.channels, pcm.sampleRate, pwfx->nSamplesPerSec, &resampledFrames);
+    void clear_sound_cache() {
+        sound_cache.Clear();
+    }
 
-        float* finalBuffer = remap_channels_interleaved(resampled, resampledFrames, pcm.channels, pwfx->nChannels);
+    // Keeps cached sounds as ADPCM instead of float, about 8 times smaller. Cached sounds are
+    // dropped when this changes so they get rebuilt in the new format.
+    void set_sound_cache_compression(bool enabled) {
+        if (compress_sounds.exchange(enabled) != enabled) sound_cache.Clear();
+    }
 
-        size_t bytesPerSample = pwfx->wBitsPerSample / 8;
-        size_t bytesPerFrame = pwfx->nChannels * bytesPerSample;
-        size_t totalBytes = resampledFrames * pwfx->nChannels * bytesPerSample;
-        std::vector<char> outBuffer(totalBytes);
+    // Decodes files into the cache for the given output device on the preload pool and returns straight away.
+    void preload_sounds(const char** files, size_t count, const char* device_name) {
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < count; ++i) {
+            if (files[i]) paths.emplace_back(files[i]);
+        }
+        std::string device = device_name ? device_name : "";
+
+        WorkerPool& pool = preload_pool();
+        pool.Submit([paths, device, &pool]() {
+            IMMDevice* targetDevice = render_device_or_default(device.c_str());
+            if (!targetDevice) return;
+
+            IAudioClient* audioClient = nullptr;
+            WAVEFORMATEX* pwfx = nullptr;
+            if (SUCCEEDED(targetDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&audioClient))) {
+                audioClient->GetMixFormat(&pwfx);
+                audioClient->Release();
+            }
+            targetDevice->Release();
 
-        if (is_format_float(pwfx) && pwfx->wBitsPerSample == 32) {
-            memcpy(outBuffer.data(), finalBuffer, totalBytes);
-        } else if (is_format_int32(pwfx)) {
-            int32_t* out32 = reinterpret_cast<int32_t*>(outBuffer.data());
-            for (size_t i = 0; i < resampledFrames * pwfx->nChannels; ++i) {
-                float v = std::max(-1.f, std::min(1.f, finalBuffer[i]));
-                out32[i] = static_cast<int32_t>(v * 2147483647.f);
+            if (!pwfx || !is_render_format_supported(pwfx)) {
+                if (pwfx) CoTaskMemFree(pwfx);
+                return;
             }
-        } else {
-            std::cerr << "Unsupported device format\n";
+
+            int sampleRate = pwfx->nSamplesPerSec;
+            int channels = pwfx->nChannels;
             CoTaskMemFree(pwfx);
-            audioClient->Release();
-            targetDevice->Release();
-            CoUninitialize();
+
+            for (const std::string& path : paths) {
+                pool.Submit([path, sampleRate, channels]() {
+                    get_sound(path.c_str(), sampleRate, channels, true);
+                });
+            }
+        });
+    }
+    #pragma endregion
+    #pragma region Sound Analysis
+    struct SoundAnalysisInfo {
+        double duration;
+        float peak;
+        float loudness;
+        double trim_start;
+        double trim_end;
+    };
+
+    // Analyzes files that aren't in the index yet, or changed since they were, on the preload
+    // pool and saves the index to index_path once they're all done. The first call loads the
+    // index from index_path and drops entries for files not in this list. Returns straight away.
+    void analyze_sounds(const char** files, size_t count, const char* index_path) {
+        static std::once_flag loaded;
+        std::string indexPath = index_path ? index_path : "";
+        std::vector<std::string> paths;
+        for (size_t i = 0; i < count; ++i) {
+            if (files[i]) paths.emplace_back(files[i]);
+        }
+        std::call_once(loaded, [&]() {
+            sound_index.Load(indexPath);
+            sound_index.Retain(paths);
+        });
+
+        std::vector<std::pair<std::string, int64_t>> stale;
+        for (const std::string& path : paths) {
+            int64_t mtime = 0;
+            if (file_mtime(path.c_str(), &mtime) && !sound_index.Get(path, mtime)) stale.emplace_back(path, mtime);
+        }
+        if (stale.empty()) {
+            sound_index.Save(indexPath);
             return;
         }
 
-        REFERENCE_TIME bufferDuration = low_latency ? 100000 : 500000;
-        if (FAILED(audioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, 0, bufferDuration, 0, pwfx, nullptr))) {
-            std::cerr << "AudioClient Initialize failed\n";
-            CoTaskMemFree(pwfx);
-            audioClient->Release();
-            targetDevice->Release();
-            CoUninitialize();
-            return;
+        auto remaining = std::make_shared<std::atomic<size_t>>(stale.size());
+        for (auto& [path, mtime] : stale) {
+            preload_pool().Submit([path = path, mtime = mtime, indexPath, remaining]() {
+                std::unique_ptr<SoundSource> source = open_sound_source(path.c_str());
+                auto analysis = std::make_shared<ClipAnalysis>();
+                if (source && analyze_source(*source, *analysis)) {
+                    sound_index.Put(path, mtime, std::move(analysis));
+                } else {
+                    std::cerr << "Failed to analyze \"" << path << "\"\n";
+                }
+                if (remaining->fetch_sub(1) == 1) sound_index.Save(indexPath);
+            });
         }
+    }
 
-        CoTaskMemFree(pwfx);
+    bool get_sound_analysis(const char* file, SoundAnalysisInfo* out) {
+        std::shared_ptr<const ClipAnalysis> analysis = file ? sound_index.Get(file) : nullptr;
+        if (!analysis || !out) return false;
+
+        double rate = analysis->sampleRate;
+        out->duration = analysis->Duration();
+        out->peak = analysis->peak;
+        out->loudness = analysis->loudness;
+        out->trim_start = analysis->trimStart / rate;
+        out->trim_end = analysis->trimEnd / rate;
+        return true;
+    }
 
-        IAudioRenderClient* renderClient = nullptr;
-        if (FAILED(audioClient->GetService(__uuidof(IAudioRenderClient), (void**)&renderClient))) {
-            audioClient->Release();
-            targetDevice->Release();
-            CoUninitialize();
-            return;
+    // Fills out with up to max_points min/max pairs (-1..1) covering the whole sound, taken from
+    // the coarsest waveform level that still has at least max_points buckets. Returns the number
+    // of pairs written.
+    size_t get_sound_waveform(const char* file, float* out, size_t max_points) {
+        std::shared_ptr<const ClipAnalysis> analysis = file ? sound_index.Get(file) : nullptr;
+        if (!analysis || !out || max_points == 0 || analysis->waveform.empty()) return 0;
+
+        const WaveformLevel* level = &analysis->waveform.front();
+        for (const WaveformLevel& candidate : analysis->waveform) {
+            if (candidate.Buckets() >= max_points) level = &candidate;
         }
 
-        UINT32 bufferFrameCount = 0;
-        audioClient->GetBufferSize(&bufferFrameCount);
-        audioClient->Start();
-
-        std::thread([renderClient, audioClient, outBuffer, bytesPerFrame, bufferFrameCount]() {
-            size_t offset = 0;
-            size_t totalBytes = outBuffer.size();
-            while (offset < totalBytes && !stop_audio.load()) {
-                UINT32 padding = 0;
-                if (FAILED(audioClient->GetCurrentPadding(&padding))) break;
-
-                UINT32 framesAvailable = bufferFrameCount - padding;
-                if (framesAvailable == 0) { Sleep(1); continue; }
-
-                UINT32 bytesAvailable = framesAvailable * bytesPerFrame;
-                UINT32 bytesLeft = static_cast<UINT32>(totalBytes - offset);
-                UINT32 bytesToWrite = std::min(bytesAvailable, bytesLeft);
-                UINT32 framesToWrite = bytesToWrite / bytesPerFrame;
-
-                BYTE* pData = nullptr;
-                if (FAILED(renderClient->GetBuffer(framesToWrite, &pData))) break;
-                memcpy(pData, outBuffer.data() + offset, framesToWrite * bytesPerFrame);
-                offset += framesToWrite * bytesPerFrame;
-                renderClient->ReleaseBuffer(framesToWrite, 0);
+        size_t buckets = level->Buckets();
+        size_t points = std::min(buckets, max_points);
+        for (size_t p = 0; p < points; ++p) {
+            size_t first = p * buckets / points;
+            size_t last = std::max(first + 1, (p + 1) * buckets / points);
+            int8_t low = 127, high = -127;
+            for (size_t b = first; b < last; ++b) {
+                low = std::min(low, level->minmax[b * 2]);
+                high = std::max(high, level->minmax[b * 2 + 1]);
             }
+            out[p * 2] = low / 127.0f;
+            out[p * 2 + 1] = high / 127.0f;
+        }
+        return points;
+    }
 
-            audioClient->Stop();
-            renderClient->Release();
-            audioClient->Release();
-        }).detach();
-
-        targetDevice->Release();
+    // Plays analyzed sounds at target_lufs integrated loudness.
+    void set_sound_normalization(bool enabled, float target_lufs) {
+        normalize_target.store(target_lufs, std::memory_order_relaxed);
+        normalize_sounds.store(enabled, std::memory_order_relaxed);
     }
     #pragma endregion
-    #pragma region Device to Device
-    void device_to_device(const char* input, const char* output, bool low_latency, const char* channel_name, const char* path) {
-        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    #pragma endregion
+}
+
+#pragma region Channels
+// A channel as Rust passes it. outputs and gains have output_count entries, gains may be null.
+struct ChannelConfig {
+    const char* name;
+    const char* input;
+    bool device;
+    bool low_latency;
+    bool adaptive;
+    float volume;
+    const char** outputs;
+    const float* gains;
+    size_t output_count;
+    const char* chain;
+};
+
+struct ChannelStateSnapshot {
+    char name[64];
+    int32_t state;
+    uint64_t restarts;
+    uint64_t updates;
+};
+
+// A live change built on the engine thread. The loop swaps in whatever is set and hands the update
+// back holding what it replaced, which is freed (and old outputs closed) on the engine thread.
+struct ChannelSwap : ChannelUpdate {
+    std::unique_ptr<BlocksManager> blocks;
+    std::vector<std::unique_ptr<RenderOutput>> renders;
+    std::unique_ptr<Fanout> fanout;
+};
+
+// Swaps a change into a running loop, between packets.
+void swap_in(ChannelControl& control, ChannelStats* stats, std::unique_ptr<BlocksManager>* blocks,
+             std::vector<std::unique_ptr<RenderOutput>>& renders, std::unique_ptr<Fanout>& fanout) {
+    ChannelUpdate* update = control.Take();
+    if (!update) return;
+
+    TraceSpan span("swap");
+    ChannelSwap& swap = *static_cast<ChannelSwap*>(update);
+    if (swap.blocks && blocks) {
+        std::swap(*blocks, swap.blocks);
+        (*blocks)->TakeOver(*swap.blocks);
+        (*blocks)->AttachCosts(stats);
+    }
+    if (!swap.renders.empty()) {
+        std::swap(renders, swap.renders);
+        std::swap(fanout, swap.fanout);
+        for (size_t r = 0; r < renders.size(); ++r) renders[r]->Attach(stats, r == 0);
+        // The old outputs play out what they have and go quiet until they're closed.
+        for (auto& render : swap.renders) render->Pause();
+    }
+    control.Done(update);
+}
+
+std::unique_ptr<Fanout> make_fanout(int channels, int sampleRate, const std::vector<std::unique_ptr<RenderOutput>>& renders) {
+    auto fanout = std::make_unique<Fanout>();
+    fanout->Configure(channels, sampleRate);
+    for (auto& render : renders) fanout->Add(render->format->nChannels, render->format->nSamplesPerSec);
+    return fanout;
+}
 
-        IMMDevice* captureDevice = find_device_by_name(eCapture, input);
-        IMMDevice* renderDevice  = find_device_by_name(eRender, output);
+bool device_to_device(ChannelControl& control) {
+    const ChannelSpec& spec = control.spec;
+    const char* channel_name = spec.name.c_str();
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    DenormalGuard denormals;
+    TraceThread trace(channel_name);
 
+    IMMDevice* captureDevice = find_device_by_name(eCapture, spec.input.empty() ? nullptr : spec.input.c_str());
+    if (!captureDevice) {
         IMMDeviceEnumerator* pEnum = nullptr;
-        if (!captureDevice || !renderDevice) {
-            if (SUCCEEDED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum)))) {
-                if (!captureDevice) pEnum->GetDefaultAudioEndpoint(eCapture, eConsole, &captureDevice);
-                if (!renderDevice) pEnum->GetDefaultAudioEndpoint(eRender, eConsole, &renderDevice);
-            }
+        if (SUCCEEDED(CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, IID_PPV_ARGS(&pEnum)))) {
+            pEnum->GetDefaultAudioEndpoint(eCapture, eConsole, &captureDevice);
+            pEnum->Release();
         }
+    }
 
-        if (!captureDevice || !renderDevice) {
-            std::cerr << "WASAPI: could not find capture or render device\n";
-            if (captureDevice) captureDevice->Release();
-            if (renderDevice) renderDevice->Release();
-            if (pEnum) pEnum->Release();
-            CoUninitialize();
-            return;
-        }
-        if (pEnum) pEnum->Release();
-
-        IAudioClient* captureClient = nullptr;
-        IAudioClient* renderClient  = nullptr;
-        if (FAILED(captureDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&captureClient)) ||
-            FAILED(renderDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&renderClient))) {
-            std::cerr << "WASAPI: failed to activate client\n";
-            captureDevice->Release();
-            renderDevice->Release();
-            CoUninitialize();
-            return;
-        }
+    if (!captureDevice) {
+        std::cerr << "WASAPI: could not find capture device\n";
+        CoUninitialize();
+        return false;
+    }
 
-        WAVEFORMATEX* wfCapture = nullptr;
-        WAVEFORMATEX* wfRender  = nullptr;
-        if (FAILED(captureClient->GetMixFormat(&wfCapture)) || FAILED(renderClient->GetMixFormat(&wfRender)) || !wfCapture || !wfRender) {
-            std::cerr << "WASAPI: GetMixFormat failed\n";
-            if (wfCapture) CoTaskMemFree(wfCapture);
-            if (wfRender) CoTaskMemFree(wfRender);
-            captureClient->Release();
-            renderClient->Release();
-            captureDevice->Release();
-            renderDevice->Release();
-            CoUninitialize(); return;
-        }
+    IAudioClient* captureClient = nullptr;
+    if (FAILED(captureDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&captureClient))) {
+        std::cerr << "WASAPI: failed to activate client\n";
+        captureDevice->Release();
+        CoUninitialize();
+        return false;
+    }
 
-        bool captureIsFloat = is_format_float(wfCapture);
-        bool renderIsFloat  = is_format_float(wfRender);
+    WAVEFORMATEX* wfCapture = nullptr;
+    if (FAILED(captureClient->GetMixFormat(&wfCapture)) || !wfCapture) {
+        std::cerr << "WASAPI: GetMixFormat failed\n";
+        captureClient->Release();
+        captureDevice->Release();
+        CoUninitialize(); return false;
+    }
 
-        REFERENCE_TIME bufferDuration = low_latency ? 100000 : 500000;
-        if (FAILED(captureClient->Initialize(AUDCLNT_SHAREMODE_SHARED, 0, bufferDuration, 0, wfCapture, nullptr)) ||
-            FAILED(renderClient->Initialize(AUDCLNT_SHAREMODE_SHARED, 0, bufferDuration, 0, wfRender, nullptr))) {
-            std::cerr << "WASAPI: Initialize failed\n";
-            CoTaskMemFree(wfCapture);
-            CoTaskMemFree(wfRender);
-            captureClient->Release();
-            renderClient->Release();
-            captureDevice->Release();
-            renderDevice->Release();
-            CoUninitialize(); return;
-        }
+    REFERENCE_TIME bufferDuration = channel_buffer_duration(spec);
+    IAudioCaptureClient* pCapture = nullptr;
+    if (FAILED(captureClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, bufferDuration, 0, wfCapture, nullptr)) ||
+        FAILED(captureClient->GetService(__uuidof(IAudioCaptureClient), (void**)&pCapture))) {
+        std::cerr << "WASAPI: Initialize failed\n";
+        CoTaskMemFree(wfCapture);
+        captureClient->Release();
+        captureDevice->Release();
+        CoUninitialize(); return false;
+    }
 
-        IAudioCaptureClient* pCapture = nullptr;
-        IAudioRenderClient*  pRender  = nullptr;
-        if (FAILED(captureClient->GetService(__uuidof(IAudioCaptureClient), (void**)&pCapture)) ||
-            FAILED(renderClient->GetService(__uuidof(IAudioRenderClient), (void**)&pRender))) {
-            std::cerr << "WASAPI: GetService failed\n";
-            CoTaskMemFree(wfCapture);
-            CoTaskMemFree(wfRender);
-            captureClient->Release();
-            renderClient->Release();
-            captureDevice->Release();
-            renderDevice->Release();
-            CoUninitialize(); return;
-        }
+    std::vector<std::unique_ptr<RenderOutput>> renders = open_outputs(spec.outputs, bufferDuration, spec.adaptive);
+    if (renders.empty()) {
+        std::cerr << "WASAPI: could not open any output\n";
+        pCapture->Release();
+        CoTaskMemFree(wfCapture);
+        captureClient->Release();
+        captureDevice->Release();
+        CoUninitialize(); return false;
+    }
 
-        UINT32 captureFrames = 0, renderFrames = 0;
-        captureClient->GetBufferSize(&captureFrames);
-        renderClient->GetBufferSize(&renderFrames);
+    HANDLE hCaptureEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    captureClient->SetEventHandle(hCaptureEvent);
 
-        size_t maxFrames = std::max(captureFrames, renderFrames);
-        int captureChannels = wfCapture->nChannels;
-        int renderChannels  = wfRender->nChannels;
+    UINT32 captureFrames = 0;
+    captureClient->GetBufferSize(&captureFrames);
+    int captureChannels = wfCapture->nChannels;
+    int captureRate = wfCapture->nSamplesPerSec;
+    std::vector<float> captureBuffer(captureFrames * captureChannels);
 
-        std::vector<float> captureBuffer(maxFrames * captureChannels);
-        std::vector<float> renderBuffer(maxFrames * renderChannels);
+    // The chain runs once in the capture format, each output converts from that.
+    std::unique_ptr<Fanout> fanout = make_fanout(captureChannels, captureRate, renders);
 
-        captureClient->Start();
-        renderClient->Start();
+    captureClient->Start();
 
-        BlocksManager blocks = BlocksManager{};
-        blocks.Initialize(path, wfRender->nSamplesPerSec);
+    auto blocks = std::make_unique<BlocksManager>();
+    blocks->Initialize(spec.chain, captureRate, captureChannels);
 
-        while (!stop_audio.load()) {
-            UINT32 packetFrames = 0;
-            if (FAILED(pCapture->GetNextPacketSize(&packetFrames)) || packetFrames == 0) {
-                Sleep(1);
-                continue;
-            }
+    REFERENCE_TIME capturePeriod = 0;
+    captureClient->GetDevicePeriod(&capturePeriod, nullptr);
 
+    ChannelStats* stats = channel_stats.Register(channel_name);
+    LoopTimer timer(stats);
+    blocks->AttachCosts(stats);
+    for (size_t r = 0; r < renders.size(); ++r) {
+        renders[r]->Start(channel_name);
+        renders[r]->Attach(stats, r == 0);
+    }
+    LevelMeter meter;
+    meter.Configure(captureRate, captureChannels);
+    std::shared_ptr<SpectrumTap> tap = spectrum.Register(channel_name, captureRate, captureChannels);
+    std::shared_ptr<RecordPoint> recordPoint = recorder.Register(channel_name, captureRate, captureChannels);
+    replay.Add(recordPoint);
+
+    control.channels.store(captureChannels);
+    control.sampleRate.store(captureRate);
+    control.state.store(ChannelState::Running);
+
+    // Asleep, the loop only has to notice the input coming back, so it takes packets half a capture
+    // buffer at a time instead of waking for every one, nothing is dropped. A buffer of a period or
+    // two has no room for that and keeps waking per packet.
+    DWORD asleepMs = static_cast<DWORD>(captureFrames * 500ull / captureRate);
+    bool batchAsleep = control.event && asleepMs > capturePeriod / 10000;
+
+    while (!control.stop.load(std::memory_order_relaxed)) {
+        bool asleep = batchAsleep && blocks->IsSleeping();
+        DWORD wait = asleep ? traced_wait("asleep", static_cast<HANDLE>(control.event), asleepMs)
+                            : traced_wait_channel("wait capture", hCaptureEvent, control, 2000);
+        swap_in(control, stats, &blocks, renders, fanout);
+        if (!asleep && wait != WAIT_OBJECT_0) continue;
+
+        // The event only says there's something to read, take every packet queued since the last one.
+        UINT32 packetFrames = 0;
+        bool failed = false;
+        while (SUCCEEDED(pCapture->GetNextPacketSize(&packetFrames)) && packetFrames > 0) {
+            timer.Wake();
+
+            uint64_t captureStart = tracing.load(std::memory_order_relaxed) ? CycleClock::Now() : 0;
             BYTE* pData = nullptr;
             UINT32 numFrames = 0;
             DWORD flags = 0;
-            if (FAILED(pCapture->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr))) break;
+            if (FAILED(pCapture->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr))) {
+                failed = true;
+                break;
+            }
+
+            if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) stats->discontinuities.fetch_add(1, std::memory_order_relaxed);
+            if (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) stats->timestamp_errors.fetch_add(1, std::memory_order_relaxed);
 
             captureBuffer.resize(numFrames * captureChannels);
+            float gain = control.volume.load(std::memory_order_relaxed);
 
-            if (captureIsFloat) {
-                const float* src = reinterpret_cast<const float*>(pData);
-                for (UINT32 i = 0; i < numFrames * captureChannels; ++i)
-                    captureBuffer[i] = std::max(-1.0f, std::min(1.0f, src[i] * volume[channel_name]));
-            } else if (wfCapture->wBitsPerSample == 16) {
-                const int16_t* src16 = reinterpret_cast<const int16_t*>(pData);
-                for (UINT32 i = 0; i < numFrames * captureChannels; ++i) {
-                    float sample = static_cast<float>(src16[i]) / 32767.0f;
-                    captureBuffer[i] = std::max(-1.0f, std::min(1.0f, sample * volume[channel_name]));
-                }
-            } else if (wfCapture->wBitsPerSample == 32) {
-                const int32_t* src32 = reinterpret_cast<const int32_t*>(pData);
-                for (UINT32 i = 0; i < numFrames * captureChannels; ++i) {
-                    double sample = static_cast<double>(src32[i]) / 2147483647.0;
-                    captureBuffer[i] = static_cast<float>(std::max(-1.0, std::min(1.0, sample * volume[channel_name])));
-                }
+            if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+                std::fill(captureBuffer.begin(), captureBuffer.end(), 0.0f);
+            } else {
+                capture_to_float(pData, wfCapture, captureBuffer.data(), captureBuffer.size(), gain);
             }
 
             pCapture->ReleaseBuffer(numFrames);
+            if (captureStart) trace_event("capture", captureStart, CycleClock::Now());
 
-            float* toRender = nullptr;
-            size_t outFrames = 0;
-
-            if (wfCapture->nSamplesPerSec != wfRender->nSamplesPerSec || captureChannels != renderChannels) {
-                float* resampled = linear_resample_interleaved(captureBuffer.data(), numFrames, captureChannels, wfCapture->nSamplesPerSec,
-                    wfRender->nSamplesPerSec, &outFrames);
-
-                float* remapped = remap_channels_interleaved(resampled, outFrames, captureChannels, renderChannels);
+            // Input has been silent past the chain's tail, leave the render streams stopped and wait for the next packet.
+            if (blocks->StaysAsleep(captureBuffer.data(), captureBuffer.size())) {
+                meter.Silence(numFrames, now_ns(), stats->levels);
+                recordPoint->Silence(numFrames);
+                timer.Done();
+                continue;
+            }
 
-                delete[] resampled;
-                toRender = remapped;
-            } else {
-                toRender = captureBuffer.data();
-                outFrames = numFrames;
+            bool asleep;
+            {
+                TraceSpan span("chain");
+                asleep = blocks->Process(captureBuffer.data(), captureBuffer.size());
+            }
+            if (asleep) {
+                for (auto& render : renders) render->Pause();
+                meter.Silence(numFrames, now_ns(), stats->levels);
+                recordPoint->Silence(numFrames);
+                timer.Done();
+                continue;
             }
 
-            for (size_t i = 0; i < outFrames * renderChannels; ++i) {
-                toRender[i] = blocks.Render(&toRender[i]);
+            // float_to_render applies the channel volume again on the way out.
+            meter.Process(captureBuffer.data(), numFrames, gain, now_ns(), stats->levels);
+            tap->Write(captureBuffer.data(), numFrames);
+            recordPoint->Write(captureBuffer.data(), numFrames, gain);
+
+            uint64_t writeStart = tracing.load(std::memory_order_relaxed) ? CycleClock::Now() : 0;
+            fanout->Process(captureBuffer.data(), numFrames);
+            for (size_t r = 0; r < renders.size(); ++r) {
+                size_t frames = 0;
+                const float* out = fanout->Output(r, frames);
+                renders[r]->Retarget(capturePeriod);
+                renders[r]->Push(out, frames, gain);
             }
+            if (writeStart) trace_event("render push", writeStart, CycleClock::Now());
 
-            size_t written = 0;
-            while (written < outFrames && !stop_audio.load()) {
-                UINT32 padding = 0;
-                renderClient->GetCurrentPadding(&padding);
-                UINT32 avail = renderFrames - padding;
-                if (avail == 0) {
-                    Sleep(1);
-                    continue;
-                }
+            timer.Done();
+        }
+        if (failed) break;
+    }
 
-                UINT32 framesToWrite = std::min(avail, static_cast<UINT32>(outFrames - written));
-                BYTE* renderPtr = nullptr;
-                if (FAILED(pRender->GetBuffer(framesToWrite, &renderPtr))) break;
-
-                if (renderIsFloat && wfRender->wBitsPerSample == 32) {
-                    float* dst = reinterpret_cast<float*>(renderPtr);
-                    for (UINT32 i = 0; i < framesToWrite * renderChannels; ++i) {
-                        float v = toRender[written * renderChannels + i] * volume[channel_name];
-                        dst[i] = std::max(-1.0f, std::min(1.0f, v));
-                    }
-                } else if (!renderIsFloat && wfRender->wBitsPerSample == 16) {
-                    int16_t* out16 = reinterpret_cast<int16_t*>(renderPtr);
-                    for (UINT32 i = 0; i < framesToWrite * renderChannels; ++i) {
-                        float v = toRender[written * renderChannels + i] * volume[channel_name] * 32767.0f;
-                        out16[i] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, v)));
-                    }
-                } else if (!renderIsFloat && wfRender->wBitsPerSample == 32) {
-                    int32_t* out32 = reinterpret_cast<int32_t*>(renderPtr);
-                    for (UINT32 i = 0; i < framesToWrite * renderChannels; ++i) {
-                        double v = toRender[written * renderChannels + i] * volume[channel_name] * 2147483647.0;
-                        out32[i] = static_cast<int32_t>(std::max(static_cast<double>(INT32_MIN), std::min(static_cast<double>(INT32_MAX), v)));
-                    }
-                }
+    spectrum.Unregister(tap);
+    replay.Remove(recordPoint);
+    recorder.Unregister(recordPoint);
+
+    captureClient->Stop();
+    for (auto& render : renders) render->Close();
+    // Only once the outputs have stopped writing to the slot.
+    channel_stats.Unregister(stats);
+    CloseHandle(hCaptureEvent);
+    pCapture->Release();
+    captureClient->Release();
+    captureDevice->Release();
+    CoTaskMemFree(wfCapture);
+    CoUninitialize();
+    return true;
+}
 
-                if (FAILED(pRender->ReleaseBuffer(framesToWrite, 0))) break;
-                written += framesToWrite;
-            }
+bool app_to_device(ChannelControl& control) {
+    const ChannelSpec& spec = control.spec;
+    const char* channel_name = spec.name.c_str();
+    CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    TraceThread trace(channel_name);
 
-            if (toRender != captureBuffer.data())
-                delete[] toRender;
-        }
+    AudioSession session;
+    if (spec.input.empty() || !device_registry.FindSession(spec.input, session)) {
+        std::cerr << "No audio session found for: " << spec.input << "\n";
+        CoUninitialize();
+        return false;
+    }
 
-        captureClient->Stop();
-        renderClient->Stop();
-        pCapture->Release();
-        pRender->Release();
-        captureClient->Release();
-        renderClient->Release();
+    IMMDevice* captureDevice = device_enumerator.Open(session.deviceId);
+    if (!captureDevice) {
+        std::cerr << "Failed to find audio session for PID\n";
+        CoUninitialize();
+        return false;
+    }
+
+    REFERENCE_TIME bufferDuration = channel_buffer_duration(spec);
+    std::vector<std::unique_ptr<RenderOutput>> renders = open_outputs(spec.outputs, bufferDuration, spec.adaptive);
+    drop_feedback(renders, session.deviceId);
+    if (renders.empty()) {
+        std::cerr << "No render device found\n";
         captureDevice->Release();
-        renderDevice->Release();
-        CoTaskMemFree(wfCapture);
-        CoTaskMemFree(wfRender);
         CoUninitialize();
+        return false;
     }
-    #pragma endregion
-    #pragma region App to Device
-    void app_to_device(const char* input, const char* output, bool low_latency, const char* channel_name) {
-        CoInitialize(nullptr);
 
-        DWORD targetPid = 0;
-        PROCESSENTRY32W pe32{};
-        pe32.dwSize = sizeof(pe32);
-        HANDLE hSnap = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
-        if (Process32FirstW(hSnap, &pe32)) {
-            do {
-                std::string exe = wideToUtf8(pe32.szExeFile);
-                if (exe.size() > 4 && exe.substr(exe.size() - 4) == ".exe")
-                    exe = exe.substr(0, exe.size() - 4);
-                if (_stricmp(exe.c_str(), input) == 0) {
-                    targetPid = pe32.th32ProcessID;
-                    break;
-                }
-            } while (Process32NextW(hSnap, &pe32));
-        }
-        CloseHandle(hSnap);
-        if (!targetPid) {
-            std::cerr << "Process not found: " << input << "\n";
-            CoUninitialize();
-            return;
-        }
+    IAudioClient2* captureClient = nullptr;
+    WAVEFORMATEX* wfCapture = nullptr;
+    IAudioCaptureClient* pCaptureClient = nullptr;
+    HANDLE hCaptureEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    DWORD captureFlags = AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+    if (!hCaptureEvent ||
+        FAILED(captureDevice->Activate(__uuidof(IAudioClient2), CLSCTX_ALL, nullptr, (void**)&captureClient)) ||
+        FAILED(captureClient->GetMixFormat(&wfCapture)) || !wfCapture ||
+        FAILED(captureClient->Initialize(AUDCLNT_SHAREMODE_SHARED, captureFlags, bufferDuration, 0, wfCapture, nullptr)) ||
+        FAILED(captureClient->GetService(__uuidof(IAudioCaptureClient), (void**)&pCaptureClient)) ||
+        FAILED(captureClient->SetEventHandle(hCaptureEvent)) ||
+        FAILED(captureClient->Start())) {
+        std::cerr << "WASAPI: could not open app capture for " << spec.input << "\n";
+        for (auto& render : renders) render->Close();
+        if (pCaptureClient) pCaptureClient->Release();
+        if (wfCapture) CoTaskMemFree(wfCapture);
+        if (captureClient) captureClient->Release();
+        if (hCaptureEvent) CloseHandle(hCaptureEvent);
+        captureDevice->Release();
+        CoUninitialize();
+        return false;
+    }
 
-        IMMDeviceEnumerator* pEnum = nullptr;
-        CoCreateInstance(__uuidof(MMDeviceEnumerator), nullptr, CLSCTX_ALL, __uuidof(IMMDeviceEnumerator), (void**)&pEnum);
-
-        IMMDevice* renderDevice = nullptr;
-        if (output && strlen(output) > 0)
-            renderDevice = find_device_by_name(eRender, output);
-        if (!renderDevice)
-            pEnum->GetDefaultAudioEndpoint(eRender, eConsole, &renderDevice);
-        if (!renderDevice) {
-            std::cerr << "No render device found\n";
-            pEnum->Release();
-            CoUninitialize();
-            return;
-        }
+    int captureChannels = wfCapture->nChannels;
+    int captureRate = wfCapture->nSamplesPerSec;
+    std::vector<float> captureBuffer(static_cast<size_t>(captureRate) * captureChannels);
 
-        IMMDevice* captureDevice = nullptr;
-        IMMDeviceCollection* devicesAll = nullptr;
-        pEnum->EnumAudioEndpoints(eRender, DEVICE_STATE_ACTIVE, &devicesAll);
-        UINT deviceCount = 0; devicesAll->GetCount(&deviceCount);
+    std::unique_ptr<Fanout> fanout = make_fanout(captureChannels, captureRate, renders);
 
-        for (UINT i = 0; i < deviceCount; ++i) {
-            IMMDevice* dev = nullptr;
-            if (FAILED(devicesAll->Item(i, &dev)) || !dev) continue;
+    // Keep rendering for one render buffer after the app goes quiet so short gaps don't restart the stream.
+    UINT32 renderBufferFrames = renders[0]->frames;
+    SilenceDetector silence(static_cast<size_t>(renderBufferFrames) * captureChannels);
 
-            IAudioSessionManager2* mgr2 = nullptr;
-            if (FAILED(dev->Activate(__uuidof(IAudioSessionManager2), CLSCTX_ALL, nullptr, (void**)&mgr2)) || !mgr2) {
-                dev->Release();
-                continue;
+    REFERENCE_TIME capturePeriod = 0;
+    captureClient->GetDevicePeriod(&capturePeriod, nullptr);
+
+    ChannelStats* stats = channel_stats.Register(channel_name);
+    LoopTimer timer(stats);
+    for (size_t r = 0; r < renders.size(); ++r) {
+        renders[r]->Start(channel_name);
+        renders[r]->Attach(stats, r == 0);
+    }
+    LevelMeter meter;
+    meter.Configure(captureRate, captureChannels);
+    std::shared_ptr<SpectrumTap> tap = spectrum.Register(channel_name, captureRate, captureChannels);
+    std::shared_ptr<RecordPoint> recordPoint = recorder.Register(channel_name, captureRate, captureChannels);
+    replay.Add(recordPoint);
+
+    control.channels.store(captureChannels);
+    control.sampleRate.store(captureRate);
+    control.state.store(ChannelState::Running);
+
+    while (!control.stop.load(std::memory_order_relaxed)) {
+        DWORD wait = traced_wait_channel("wait capture", hCaptureEvent, control, 2000);
+        swap_in(control, stats, nullptr, renders, fanout);
+        if (wait != WAIT_OBJECT_0) continue;
+
+        // The event only says there's something to read, take every packet queued since the last one.
+        UINT32 packetFrames = 0;
+        while (SUCCEEDED(pCaptureClient->GetNextPacketSize(&packetFrames)) && packetFrames > 0) {
+            timer.Wake();
+
+            uint64_t captureStart = tracing.load(std::memory_order_relaxed) ? CycleClock::Now() : 0;
+            BYTE* pData = nullptr;
+            UINT32 numFrames = 0;
+            DWORD flags = 0;
+            if (FAILED(pCaptureClient->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr))) break;
+
+            if (flags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) stats->discontinuities.fetch_add(1, std::memory_order_relaxed);
+            if (flags & AUDCLNT_BUFFERFLAGS_TIMESTAMP_ERROR) stats->timestamp_errors.fetch_add(1, std::memory_order_relaxed);
+
+            captureBuffer.resize(numFrames * captureChannels);
+            float gain = control.volume.load(std::memory_order_relaxed);
+            if (flags & AUDCLNT_BUFFERFLAGS_SILENT) {
+                std::fill(captureBuffer.begin(), captureBuffer.end(), 0.0f);
+            } else {
+                capture_to_float(pData, wfCapture, captureBuffer.data(), captureBuffer.size(), gain);
             }
 
-            IAudioSessionEnumerator* sessionEnum = nullptr;
-            if (FAILED(mgr2->GetSessionEnumerator(&sessionEnum)) || !sessionEnum) {
-                mgr2->Release();
-                dev->Release();
+            pCaptureClient->ReleaseBuffer(numFrames);
+            if (captureStart) trace_event("capture", captureStart, CycleClock::Now());
+
+            // The app stopped producing sound, stop feeding the render streams until it does again.
+            if (silence.Update(captureBuffer.data(), captureBuffer.size())) {
+                for (auto& render : renders) render->Pause();
+                meter.Silence(numFrames, now_ns(), stats->levels);
+                recordPoint->Silence(numFrames);
+                timer.Done();
                 continue;
             }
 
-            int sessionCount = 0;
-            sessionEnum->GetCount(&sessionCount);
-            bool found = false;
-
-            for (int s = 0; s < sessionCount; ++s) {
-                IAudioSessionControl* ctrl = nullptr;
-                if (FAILED(sessionEnum->GetSession(s, &ctrl)) || !ctrl) continue;
-
-                IAudioSessionControl2* ctrl2 = nullptr;
-                if (SUCCEEDED(ctrl->QueryInterface(__uuidof(IAudioSessionControl2), (void**)&ctrl2)) && ctrl2) {
-                    DWORD pid = 0;
-                    ctrl2->GetProcessId(&pid);
-                    ctrl2->Release();
-                    if (pid == targetPid) {
-                        captureDevice = dev;
-                        captureDevice->AddRef();
-                        found = true;
-                        break;
-                    }
-                }
-                ctrl->Release();
+            meter.Process(captureBuffer.data(), numFrames, 1.0f, now_ns(), stats->levels);
+            tap->Write(captureBuffer.data(), numFrames);
+            recordPoint->Write(captureBuffer.data(), numFrames);
+
+            uint64_t writeStart = tracing.load(std::memory_order_relaxed) ? CycleClock::Now() : 0;
+            fanout->Process(captureBuffer.data(), numFrames);
+            for (size_t r = 0; r < renders.size(); ++r) {
+                size_t frames = 0;
+                const float* out = fanout->Output(r, frames);
+                renders[r]->Retarget(capturePeriod);
+                renders[r]->Push(out, frames, 1.0f);
             }
+            if (writeStart) trace_event("render push", writeStart, CycleClock::Now());
 
-            sessionEnum->Release();
-            mgr2->Release();
-            dev->Release();
-            if (found) break;
-        }
-        devicesAll->Release();
-
-        if (!captureDevice) {
-            std::cerr << "Failed to find audio session for PID\n";
-            renderDevice->Release();
-            pEnum->Release();
-            CoUninitialize();
-            return;
-        }
-
-        if (captureDevice == renderDevice) {
-            std::cerr << "Capture and render device are the same. Feedback possible!\n";
-            captureDevice->Release();
-            renderDevice->Release();
-            pEnum->Release();
-            CoUninitialize();
-            return;
+            timer.Done();
         }
+    }
 
-        IAudioClient2* captureClient = nullptr;
-        captureDevice->Activate(__uuidof(IAudioClient2), CLSCTX_ALL, nullptr, (void**)&captureClient);
-
-        IAudioClient* renderClient = nullptr;
-        renderDevice->Activate(__uuidof(IAudioClient), CLSCTX_ALL, nullptr, (void**)&renderClient);
-
-        WAVEFORMATEX* wfCapture = nullptr;
-        WAVEFORMATEX* wfRender  = nullptr;
-        captureClient->GetMixFormat(&wfCapture);
-        renderClient->GetMixFormat(&wfRender);
-
-        DWORD renderFlags = AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
-        DWORD captureFlags = AUDCLNT_STREAMFLAGS_LOOPBACK | AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
-        REFERENCE_TIME bufferDuration = low_latency ? 20000 : 1000000;
+    spectrum.Unregister(tap);
+    replay.Remove(recordPoint);
+    recorder.Unregister(recordPoint);
+
+    captureClient->Stop();
+    for (auto& render : renders) render->Close();
+    // Only once the outputs have stopped writing to the slot.
+    channel_stats.Unregister(stats);
+    CloseHandle(hCaptureEvent);
+    if (pCaptureClient) pCaptureClient->Release();
+    captureClient->Release();
+    captureDevice->Release();
+    CoTaskMemFree(wfCapture);
+    CoUninitialize();
+    return true;
+}
 
-        captureClient->Initialize(AUDCLNT_SHAREMODE_SHARED, captureFlags, bufferDuration, 0, wfCapture, nullptr);
-        renderClient->Initialize(AUDCLNT_SHAREMODE_SHARED, renderFlags, bufferDuration, 0, wfRender, nullptr);
+// The engine's WASAPI side. Each channel's wake handle is an auto-reset event its loop waits on
+// alongside the capture event.
+class WasapiChannelHost : public ChannelHost {
+public:
+    void EngineStarted() override {
+        CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    }
 
-        IAudioCaptureClient* pCaptureClient = nullptr;
-        IAudioRenderClient* pRenderClient = nullptr;
-        captureClient->GetService(__uuidof(IAudioCaptureClient), (void**)&pCaptureClient);
-        renderClient->GetService(__uuidof(IAudioRenderClient), (void**)&pRenderClient);
+    void Attach(ChannelControl& control) override {
+        control.event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
 
-        HANDLE hCaptureEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        HANDLE hRenderEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-        captureClient->SetEventHandle(hCaptureEvent);
-        renderClient->SetEventHandle(hRenderEvent);
+    void Detach(ChannelControl& control) override {
+        if (control.event) CloseHandle(static_cast<HANDLE>(control.event));
+        control.event = nullptr;
+    }
 
-        UINT32 renderBufferFrames = 0;
-        renderClient->GetBufferSize(&renderBufferFrames);
+    void Wake(ChannelControl& control) override {
+        if (control.event) SetEvent(static_cast<HANDLE>(control.event));
+    }
 
-        captureClient->Start(); renderClient->Start();
+    bool Run(ChannelControl& control) override {
+        return control.spec.device ? device_to_device(control) : app_to_device(control);
+    }
 
-        size_t captureFramesMax = wfCapture->nSamplesPerSec;
-        std::vector<float> captureBuffer(captureFramesMax * wfCapture->nChannels);
+    // The chain is built and the outputs opened and started here, off the audio thread, for the
+    // capture format the loop reported. App channels have no chain.
+    std::unique_ptr<ChannelUpdate> Prepare(ChannelControl& control, const ChannelSpec& spec, unsigned changes) override {
+        int sampleRate = control.sampleRate.load(), channels = control.channels.load();
+        if (sampleRate == 0 || channels == 0) return nullptr;
 
-        bool captureIsFloat = is_format_float(wfCapture);
-        bool renderIsFloat  = is_format_float(wfRender);
-        bool needResample = (wfCapture->nChannels != wfRender->nChannels)
-            || (wfCapture->nSamplesPerSec != wfRender->nSamplesPerSec)
-            || (captureIsFloat != renderIsFloat)
-            || (wfCapture->wBitsPerSample != wfRender->wBitsPerSample);
+        auto swap = std::make_unique<ChannelSwap>();
+        if ((changes & ChannelChange::CHAIN) && spec.device) {
+            swap->blocks = std::make_unique<BlocksManager>();
+            swap->blocks->Initialize(spec.chain, sampleRate, channels);
+        }
+        if (changes & ChannelChange::OUTPUTS) {
+            swap->renders = open_outputs(spec.outputs, channel_buffer_duration(spec), spec.adaptive);
+            AudioSession session;
+            if (!spec.device && device_registry.FindSession(spec.input, session)) drop_feedback(swap->renders, session.deviceId);
+            if (swap->renders.empty()) return nullptr;
+            swap->fanout = make_fanout(channels, sampleRate, swap->renders);
+            for (auto& render : swap->renders) render->Start(spec.name.c_str());
+        }
+        return swap;
+    }
+};
 
-        const UINT32 renderBytesPerFrame = wfRender->nChannels * (wfRender->wBitsPerSample / 8);
+static WasapiChannelHost channel_host;
+static ChannelEngine channel_engine(channel_host);
+
+ChannelSpec to_channel_spec(const ChannelConfig& config) {
+    ChannelSpec spec;
+    spec.name = config.name ? config.name : "";
+    spec.input = config.input ? config.input : "";
+    spec.device = config.device;
+    spec.lowLatency = config.low_latency;
+    spec.adaptive = config.adaptive;
+    spec.volume = config.volume;
+    spec.chain = config.chain ? config.chain : "";
+    for (size_t i = 0; i < config.output_count; ++i) {
+        spec.outputs.push_back({config.outputs[i] ? config.outputs[i] : "", config.gains ? config.gains[i] : 1.0f});
+    }
+    return spec;
+}
+#pragma endregion
 
-        while (!stop_audio.load()) {
-            DWORD wait = WaitForSingleObject(hCaptureEvent, 2000);
-            if (wait != WAIT_OBJECT_0) continue;
+extern "C" {
+    #pragma region Channel Commands
+    // Each returns at once, the engine applies them in order on its own thread. Unaffected
+    // channels keep streaming, a new input restarts only its channel and anything else is swapped
+    // into the running loop at its next packet.
+
+    // Starts the channel, or changes it to config if one by that name is running.
+    void update_channel(const ChannelConfig* config) {
+        if (!config || !config->name) return;
+        channel_engine.Update(to_channel_spec(*config));
+    }
 
-            UINT32 packetFrames = 0;
-            pCaptureClient->GetNextPacketSize(&packetFrames);
-            if (packetFrames == 0) continue;
+    void remove_channel(const char* name) {
+        if (name) channel_engine.Remove(name);
+    }
 
-            BYTE* pData = nullptr;
-            UINT32 numFrames = 0;
-            DWORD flags = 0;
-            if (FAILED(pCaptureClient->GetBuffer(&pData, &numFrames, &flags, nullptr, nullptr))) continue;
-
-            captureBuffer.resize(numFrames * wfCapture->nChannels);
-            if (captureIsFloat) {
-                float* src = reinterpret_cast<float*>(pData);
-                for (UINT32 i = 0; i < numFrames * wfCapture->nChannels; ++i)
-                    captureBuffer[i] = src[i] * volume[channel_name];
-            } else if (wfCapture->wBitsPerSample == 16) {
-                int16_t* src16 = reinterpret_cast<int16_t*>(pData);
-                for (UINT32 i = 0; i < numFrames * wfCapture->nChannels; ++i)
-                    captureBuffer[i] = (src16[i] / 32768.f) * volume[channel_name];
-            } else if (wfCapture->wBitsPerSample == 32) {
-                int32_t* src32 = reinterpret_cast<int32_t*>(pData);
-                for (UINT32 i = 0; i < numFrames * wfCapture->nChannels; ++i)
-                    captureBuffer[i] = (src32[i] / 2147483648.f) * volume[channel_name];
-            }
+    void set_channel_input(const char* name, const char* input, bool device) {
+        if (name) channel_engine.SetInput(name, input ? input : "", device);
+    }
 
-            pCaptureClient->ReleaseBuffer(numFrames);
+    void set_channel_routes(const char* name, const char** outputs, const float* gains, size_t count) {
+        if (!name) return;
+        std::vector<ChannelRoute> routes;
+        for (size_t i = 0; i < count; ++i) routes.push_back({outputs[i] ? outputs[i] : "", gains ? gains[i] : 1.0f});
+        channel_engine.SetOutputs(name, std::move(routes));
+    }
 
-            float* outBuffer = nullptr;
-            size_t outFrames = 0;
-            if (needResample) {
-                outBuffer = linear_resample_interleaved(captureBuffer.data(), numFrames, wfCapture->nChannels, wfCapture->nSamplesPerSec,
-                    wfRender->nSamplesPerSec, &outFrames);
-                if (wfCapture->nChannels != wfRender->nChannels)
-                    outBuffer = remap_channels_interleaved(outBuffer, outFrames, wfCapture->nChannels, wfRender->nChannels);
-            } else {
-                outBuffer = captureBuffer.data();
-                outFrames = numFrames;
-            }
+    void set_channel_volume(const char* name, float volume) {
+        if (name) channel_engine.SetVolume(name, volume);
+    }
 
-            size_t framesLeft = outFrames;
-            size_t frameIdx = 0;
-            const UINT32 bytesPerFrame = wfRender->nChannels * (wfRender->wBitsPerSample / 8);
-            while (framesLeft > 0) {
-                DWORD waitRender = WaitForSingleObject(hRenderEvent, 2000);
-                if (waitRender != WAIT_OBJECT_0) break;
-
-                UINT32 padding = 0;
-                renderClient->GetCurrentPadding(&padding);
-                UINT32 available = (renderBufferFrames > padding) ? (renderBufferFrames - padding) : 0;
-                if (available == 0) break;
-
-                UINT32 toWrite = (framesLeft < available) ? (UINT32)framesLeft : available;
-                BYTE* renderPtr = nullptr;
-                if (FAILED(pRenderClient->GetBuffer(toWrite, &renderPtr))) break;
-
-                if (renderIsFloat) {
-                    memcpy(renderPtr, outBuffer + frameIdx * wfRender->nChannels, toWrite * wfRender->nChannels * sizeof(float));
-                } else if (wfRender->wBitsPerSample == 16) {
-                    int16_t* dst16 = reinterpret_cast<int16_t*>(renderPtr);
-                    for (UINT32 i = 0; i < toWrite * wfRender->nChannels; ++i) {
-                        float v = outBuffer[frameIdx * wfRender->nChannels + i] * 32767.f;
-                        dst16[i] = (int16_t)std::max(-32768.f, std::min(32767.f, v));
-                    }
-                } else if (wfRender->wBitsPerSample == 32) {
-                    int32_t* dst32 = reinterpret_cast<int32_t*>(renderPtr);
-                    for (UINT32 i = 0; i < toWrite * wfRender->nChannels; ++i) {
-                        double v = outBuffer[frameIdx * wfRender->nChannels + i] * 2147483647.0;
-                        dst32[i] = (int32_t)std::max(double(INT32_MIN), std::min(double(INT32_MAX), v));
-                    }
-                }
+    // Runs exactly the channels in configs, leaving the ones that didn't change alone.
+    void sync_channels(const ChannelConfig* configs, size_t count) {
+        std::vector<ChannelSpec> specs;
+        for (size_t i = 0; i < count; ++i) {
+            if (configs[i].name) specs.push_back(to_channel_spec(configs[i]));
+        }
+        channel_engine.Sync(std::move(specs));
+    }
 
-                pRenderClient->ReleaseBuffer(toWrite, 0);
-                framesLeft -= toWrite;
-                frameIdx += toWrite;
-            }
+    // Stops and starts every channel, for when a device got into a bad state.
+    void restart_channels() {
+        channel_engine.RestartAll();
+    }
 
-            if (needResample && outBuffer != captureBuffer.data())
-                delete[] outBuffer;
+    size_t get_channel_states(ChannelStateSnapshot* out, size_t max) {
+        if (!out) return 0;
+        std::vector<ChannelStatus> status = channel_engine.Status();
+        size_t count = std::min(max, status.size());
+        for (size_t i = 0; i < count; ++i) {
+            std::memset(&out[i], 0, sizeof(out[i]));
+            std::snprintf(out[i].name, sizeof(out[i].name), "%s", status[i].name.c_str());
+            out[i].state = static_cast<int32_t>(status[i].state);
+            out[i].restarts = status[i].restarts;
+            out[i].updates = status[i].updates;
         }
-
-        captureClient->Stop();
-        renderClient->Stop();
-        CloseHandle(hCaptureEvent);
-        CloseHandle(hRenderEvent);
-        if (pRenderClient) pRenderClient->Release();
-        if (pCaptureClient) pCaptureClient->Release();
-        captureClient->Release();
-        renderClient->Release();
-        captureDevice->Release();
-        renderDevice->Release();
-        pEnum->Release();
-        CoTaskMemFree(wfCapture);
-        CoTaskMemFree(wfRender);
-        CoUninitialize();
+        return count;
     }
     #pragma endregion
 }
@@ -8,12 +8,80 @@
 #include <stdexcept>
 #include <list>
 #include <deque>
+#include <cmath>
+#include <cstring>
+#include <fast_math.hpp>
+#include <pitch_shifter.hpp>
+#include <sidechain.hpp>
+#include <telemetry.hpp>
+#include <trace.hpp>
+
+// Anything quieter than this (~-120 dBFS) is treated as digital silence.
+constexpr float SILENCE_THRESHOLD = 1.0e-6f;
 
 class Block {
 public:
     virtual ~Block() = default;
 
     virtual float Render(float* buffer) {return *buffer;}
+
+    // How many samples this block keeps producing output after its input goes silent.
+    virtual size_t TailSamples() const {return 0;}
+
+    // Drops any internal state, called when the chain goes to sleep.
+    virtual void Reset() {}
+
+    virtual const char* Name() const {return "block";}
+
+    // Changes one parameter while running, returns false if the block has no such parameter.
+    virtual bool SetParam(const std::string& key, double value) {return false;}
+
+    // Called once per buffer before Render runs over it and once after, count is in samples.
+    virtual void BeginBuffer(size_t count) {}
+    virtual void EndBuffer(const float* buffer, size_t count) {}
+
+    // Renders the whole buffer in place instead of going through Render, for blocks that work on
+    // frames rather than samples. Returns false to have Render called per sample.
+    virtual bool RenderBuffer(float* buffer, size_t count) {return false;}
+
+    // Audio thread, when this block's chain has just replaced previous's. Hands over anything only
+    // one chain can hold at a time, without allocating or locking.
+    virtual void TakeOver(Block& previous) {}
+};
+
+// Per-sample smoothing coefficient for a one-pole filter that gets ~63% of the way in ms.
+inline float smoothing(double ms, int sample_rate) {
+    if (ms <= 0.0 || sample_rate <= 0) return 1.0f;
+    return static_cast<float>(1.0 - std::exp(-1000.0 / (ms * sample_rate)));
+}
+
+class SilenceDetector {
+public:
+    size_t tail_samples = 0;
+    size_t silent_samples = 0;
+
+    SilenceDetector(size_t tail = 0) : tail_samples(tail) {}
+
+    // Returns true once the input has been silent for longer than the tail.
+    bool Update(const float* buffer, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (std::fabs(buffer[i]) > SILENCE_THRESHOLD) {
+                silent_samples = 0;
+                return false;
+            }
+        }
+
+        silent_samples += count;
+        return IsSilent();
+    }
+
+    void MarkSilent(size_t count) {
+        silent_samples += count;
+    }
+
+    bool IsSilent() const {
+        return silent_samples > tail_samples;
+    }
 };
 
 class DelayBlock : public Block {
@@ -25,6 +93,8 @@ public:
 
     DelayBlock(int t, int sr) : time_ms(t), sample_rate(sr), delay_samples(t * sr / 1000) {}
 
+    const char* Name() const override {return "delay";}
+
     float Render(float* buffer) override {
         this->buffer.push_back(*buffer);
         if (this->buffer.size() > delay_samples) {
@@ -35,6 +105,22 @@ public:
             return 0.0f;
         }
     }
+
+    size_t TailSamples() const override {
+        return delay_samples;
+    }
+
+    void Reset() override {
+        buffer.clear();
+    }
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key != "time") return false;
+        time_ms = static_cast<int>(value);
+        delay_samples = time_ms * sample_rate / 1000;
+        while (buffer.size() > static_cast<size_t>(delay_samples)) buffer.pop_front();
+        return true;
+    }
 };
 
 class DistortionBlock : public Block {
@@ -43,20 +129,89 @@ public:
 
     DistortionBlock(int i) : intensity(i) {}
 
+    const char* Name() const override {return "distortion";}
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key != "intensity") return false;
+        intensity = static_cast<int>(value);
+        return true;
+    }
+
     float Render(float* buffer) override {
         return *buffer;
     }
 };
 
+// Without a bus this passes audio through as before. Keyed off a bus it compresses 4:1 above a
+// threshold amount sets (0 is 0 dBFS, 100 is -60 dBFS), detecting on the bus's audio instead of
+// its own, so one channel's level pushes another's down in proportion.
 class CompressionBlock : public Block {
 public:
+    static constexpr float RATIO = 4.0f;
+    static constexpr uint32_t GAIN_INTERVAL = 32;
+
     int amount;
+    int sample_rate;
+    std::shared_ptr<SidechainBus> bus;
+
+    // Render runs once per interleaved sample, so the envelope's time constants count channels.
+    CompressionBlock(int a, int sr = 48000, std::shared_ptr<SidechainBus> key = nullptr, int channels = 1)
+        : amount(a), sample_rate(sr), bus(std::move(key)),
+          attack(smoothing(5.0, sr * std::max(1, channels))), release(smoothing(150.0, sr * std::max(1, channels))) {
+        if (bus) keyBuffer.resize(SidechainBus::MAX_SAMPLES);
+    }
+
+    const char* Name() const override {return "compression";}
 
-    CompressionBlock(int a) : amount(a) {}
+    bool SetParam(const std::string& key, double value) override {
+        if (key != "amount") return false;
+        amount = static_cast<int>(value);
+        return true;
+    }
+
+    void BeginBuffer(size_t count) override {
+        if (!bus) return;
+        keyCount = bus->Read(keyBuffer.data(), keyBuffer.size(), now_ns());
+        keyStep = count > 0 ? static_cast<double>(keyCount) / count : 0.0;
+        keyPosition = 0.0;
+        threshold = fastmath::db_to_gain(-0.6f * amount);
+    }
 
     float Render(float* buffer) override {
-        return *buffer;
+        if (!bus) return *buffer;
+
+        // The key buffer is stretched over this one, they don't have to be the same length.
+        float key = 0.0f;
+        if (keyCount) {
+            key = std::fabs(keyBuffer[std::min(static_cast<size_t>(keyPosition), keyCount - 1)]);
+            keyPosition += keyStep;
+        }
+        envelope += (key - envelope) * (key > envelope ? attack : release);
+
+        // The envelope moves slowly enough that working out its gain every few samples is plenty.
+        if ((sinceGain++ & (GAIN_INTERVAL - 1)) == 0) {
+            gain = envelope > threshold ? fastmath::pow(envelope / threshold, 1.0f / RATIO - 1.0f) : 1.0f;
+        }
+        return *buffer * gain;
+    }
+
+    void Reset() override {
+        envelope = 0.0f;
+        gain = 1.0f;
+        sinceGain = 0;
     }
+
+private:
+    float attack;
+    float release;
+    float threshold = 1.0f;
+    float envelope = 0.0f;
+    float gain = 1.0f;
+    uint32_t sinceGain = 0;
+    std::vector<float> keyBuffer;
+    size_t keyCount = 0;
+    double keyStep = 0.0;
+    double keyPosition = 0.0;
 };
 
 class GainBlock : public Block {
@@ -65,6 +220,14 @@ public:
 
     GainBlock(double t) : amount(t) {}
 
+    const char* Name() const override {return "gain";}
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key != "amount") return false;
+        amount = value;
+        return true;
+    }
+
     float Render(float* buffer) override {
         float sample = *buffer * amount;
 
@@ -79,11 +242,198 @@ public:
 
     GatingBlock(int t) : threshold(t) {}
 
+    const char* Name() const override {return "gating";}
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key != "threshold") return false;
+        threshold = static_cast<int>(value);
+        return true;
+    }
+
     float Render(float* buffer) override {
         return *buffer;
     }
 };
 
+// Publishes the chain's audio up to this point to a sidechain bus, put it last to publish the
+// post-chain signal. Audio passes through untouched. A bus only takes one publisher, a second
+// block naming the same bus passes through without publishing. An edited chain is built while
+// the old one still publishes, so it takes the old one's claim when it's swapped in.
+class SidechainBlock : public Block {
+public:
+    std::shared_ptr<SidechainBus> bus;
+
+    SidechainBlock(const std::string& name)
+        : bus(name.empty() ? nullptr : SidechainBuses::Instance().Claim(name)),
+          wanted(bus || name.empty() ? nullptr : SidechainBuses::Instance().Get(name)) {}
+
+    ~SidechainBlock() override {
+        SidechainBuses::Instance().Release(bus);
+    }
+
+    const char* Name() const override {return "sidechain";}
+
+    void EndBuffer(const float* buffer, size_t count) override {
+        if (bus) bus->Publish(buffer, count);
+    }
+
+    // The chain went to sleep and stops publishing, readers see silence rather than the last buffer.
+    void Reset() override {
+        if (bus) bus->Clear();
+    }
+
+    void TakeOver(Block& previous) override {
+        if (bus || !wanted || std::strcmp(previous.Name(), Name()) != 0) return;
+        SidechainBlock& old = static_cast<SidechainBlock&>(previous);
+        if (old.bus != wanted) return;
+        bus = std::move(old.bus);
+        wanted.reset();
+    }
+
+private:
+    // The bus named when another chain held it, taken over if that chain is the one replaced.
+    std::shared_ptr<SidechainBus> wanted;
+};
+
+// Turns this channel down by amount dB while a bus's peak is over threshold dBFS, for ducking
+// music under a mic. The key is at most one of the publisher's buffers behind. hold keeps it
+// down through short gaps between words.
+class DuckerBlock : public Block {
+public:
+    double threshold;
+    double amount;
+    double attack_ms;
+    double release_ms;
+    double hold_ms;
+    int sample_rate;
+    int channels;
+    std::shared_ptr<SidechainBus> bus;
+
+    DuckerBlock(std::shared_ptr<SidechainBus> key, double threshold, double amount, double attack, double release, double hold, int sr, int channels)
+        : threshold(threshold), amount(amount), attack_ms(attack), release_ms(release), hold_ms(hold), sample_rate(sr),
+          channels(std::max(1, channels)), bus(std::move(key)) {
+        Update();
+    }
+
+    const char* Name() const override {return "ducker";}
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key == "threshold") threshold = value;
+        else if (key == "amount") amount = value;
+        else if (key == "attack") attack_ms = value;
+        else if (key == "release") release_ms = value;
+        else if (key == "hold") hold_ms = value;
+        else return false;
+        Update();
+        return true;
+    }
+
+    void BeginBuffer(size_t count) override {
+        if (bus && bus->Envelope(now_ns()) > keyThreshold) {
+            held = holdSamples;
+        } else {
+            held = held > count ? held - count : 0;
+        }
+        target = held > 0 ? duckedGain : 1.0f;
+    }
+
+    float Render(float* buffer) override {
+        gain += (target - gain) * (target < gain ? attack : release);
+        return *buffer * gain;
+    }
+
+    void Reset() override {
+        gain = 1.0f;
+        held = 0;
+    }
+
+private:
+    float keyThreshold = 0.0f;
+    float duckedGain = 1.0f;
+    float attack = 1.0f;
+    float release = 1.0f;
+    // Interleaved samples, what BeginBuffer counts down by.
+    size_t holdSamples = 0;
+    size_t held = 0;
+    float target = 1.0f;
+    float gain = 1.0f;
+
+    void Update() {
+        keyThreshold = fastmath::db_to_gain(static_cast<float>(threshold));
+        duckedGain = fastmath::db_to_gain(static_cast<float>(-std::max(0.0, amount)));
+        // Render steps once per interleaved sample.
+        attack = smoothing(attack_ms, sample_rate * channels);
+        release = smoothing(release_ms, sample_rate * channels);
+        holdSamples = static_cast<size_t>(std::max(0.0, hold_ms) * sample_rate / 1000.0) * channels;
+    }
+};
+
+// Shifts the pitch by semitones and the formants by formant, see PitchShifter. Works on the
+// channel as mono, every channel gets the shifted downmix. Delays the channel by the shifter's
+// latency, ~21 ms at 48 kHz.
+class PitchBlock : public Block {
+public:
+    // Multichannel buffers are downmixed this many frames at a time, so any buffer size works
+    // without allocating on the audio thread.
+    static constexpr size_t CHUNK_FRAMES = 1024;
+
+    double semitones;
+    double formant;
+    int channels;
+
+    PitchBlock(double semitones, double formant, int channels)
+        : semitones(semitones), formant(formant), channels(std::max(1, channels)) {
+        shifter.SetShift(semitones, formant);
+        if (this->channels > 1) mono.resize(CHUNK_FRAMES);
+    }
+
+    const char* Name() const override {return "pitch";}
+
+    size_t TailSamples() const override {
+        return PitchShifter::LatencySamples() * channels;
+    }
+
+    void Reset() override {
+        shifter.Reset();
+    }
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key == "semitones") semitones = value;
+        else if (key == "formant") formant = value;
+        else return false;
+        shifter.SetShift(semitones, formant);
+        return true;
+    }
+
+    bool RenderBuffer(float* buffer, size_t count) override {
+        size_t frames = count / channels;
+        if (channels == 1) {
+            shifter.Process(buffer, frames);
+            return true;
+        }
+
+        const float share = 1.0f / channels;
+        for (size_t start = 0; start < frames; start += CHUNK_FRAMES) {
+            size_t chunk = std::min(CHUNK_FRAMES, frames - start);
+            float* frame = buffer + start * channels;
+            for (size_t f = 0; f < chunk; ++f) {
+                float sum = 0.0f;
+                for (int c = 0; c < channels; ++c) sum += frame[f * channels + c];
+                mono[f] = sum * share;
+            }
+            shifter.Process(mono.data(), chunk);
+            for (size_t f = 0; f < chunk; ++f) {
+                for (int c = 0; c < channels; ++c) frame[f * channels + c] = mono[f];
+            }
+        }
+        return true;
+    }
+
+private:
+    PitchShifter shifter;
+    std::vector<float> mono;
+};
+
 class ReverbBlock : public Block {
 public:
     int intensity;
@@ -94,6 +444,26 @@ public:
 
     ReverbBlock(int i, int sr) : intensity(i), sample_rate(sr), delay_samples(i * sr / 1000), feedback(0.4) {}
 
+    size_t TailSamples() const override {
+        // Each pass through the loop is scaled by feedback, so count passes until it is below silence.
+        size_t passes = static_cast<size_t>(std::ceil(std::log(SILENCE_THRESHOLD) / std::log(feedback)));
+        return delay_samples * (passes + 1);
+    }
+
+    void Reset() override {
+        buffer.clear();
+    }
+
+    const char* Name() const override {return "reverb";}
+
+    bool SetParam(const std::string& key, double value) override {
+        if (key != "intensity") return false;
+        intensity = static_cast<int>(value);
+        delay_samples = intensity * sample_rate / 1000;
+        while (buffer.size() > static_cast<size_t>(delay_samples)) buffer.pop_front();
+        return true;
+    }
+
     float Render(float* buffer) override {
         float input = *buffer;
 
@@ -114,8 +484,10 @@ public:
 
 class BlocksManager {
 public:
-    void Initialize(const std::string& text, int sample_rate) {
+    // channels is how many the buffers passed to Process interleave.
+    void Initialize(const std::string& text, int sample_rate, int channels = 1) {
         this->sample_rate = sample_rate;
+        this->channels = channels;
         blocks.clear();
 
         std::istringstream input(text);
@@ -126,6 +498,38 @@ public:
                 blocks.push_back(CreateBlockFromLine(line));
             }
         }
+
+        silence = SilenceDetector(ChainTail());
+        sleeping = false;
+        CycleClock::Start();
+    }
+
+    // Changes a parameter of the block at index without rebuilding the chain.
+    bool SetParam(size_t index, const std::string& key, double value) {
+        if (index >= blocks.size() || !blocks[index]->SetParam(key, value)) return false;
+        silence.tail_samples = ChainTail();
+        return true;
+    }
+
+    size_t BlockCount() const {
+        return blocks.size();
+    }
+
+    const Block* BlockAt(size_t index) const {
+        return index < blocks.size() ? blocks[index].get() : nullptr;
+    }
+
+    // Publishes per-block timings into the channel's stats, queried through get_block_costs.
+    void AttachCosts(ChannelStats* stats) {
+        costs = stats ? stats->blocks : nullptr;
+        if (!stats) return;
+
+        size_t count = std::min(blocks.size(), ChannelStats::MAX_BLOCKS);
+        for (size_t i = 0; i < count; ++i) {
+            stats->blocks[i].Clear();
+            stats->blocks[i].name.store(blocks[i]->Name(), std::memory_order_relaxed);
+        }
+        stats->block_count.store(static_cast<uint32_t>(count), std::memory_order_release);
     }
 
     float Render(float* buffer) {
@@ -138,38 +542,125 @@ public:
         return current_buffer;
     }
 
+    // Renders a whole buffer in place. Once the input has been silent for longer than the
+    // chain's tail the blocks are skipped and the output is zeroed. Returns true while asleep.
+    bool Process(float* buffer, size_t count) {
+        if (silence.Update(buffer, count)) {
+            if (!sleeping) {
+                for (auto& block : blocks) {
+                    block->Reset();
+                }
+                sleeping = true;
+            }
+            std::memset(buffer, 0, count * sizeof(float));
+            return true;
+        }
+
+        sleeping = false;
+
+        // Runs each block over the whole buffer before the next one, which gives the same result
+        // as going sample by sample through the chain but lets each block be timed on its own.
+        bool profile = costs && block_profiling.load(std::memory_order_relaxed);
+        bool trace = tracing.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            Block* block = blocks[b].get();
+            uint64_t start = profile || trace ? CycleClock::Now() : 0;
+
+            block->BeginBuffer(count);
+            if (!block->RenderBuffer(buffer, count)) {
+                for (size_t i = 0; i < count; ++i) {
+                    buffer[i] = block->Render(&buffer[i]);
+                }
+            }
+            block->EndBuffer(buffer, count);
+
+            if (!profile && !trace) continue;
+            uint64_t end = CycleClock::Now();
+            if (profile && b < ChannelStats::MAX_BLOCKS) costs[b].Add(end - start);
+            if (trace) trace_event(block->Name(), start, end);
+        }
+        return false;
+    }
+
+    // Audio thread, right after this chain replaced previous. See Block::TakeOver.
+    void TakeOver(BlocksManager& previous) {
+        for (auto& block : blocks) {
+            for (auto& old : previous.blocks) block->TakeOver(*old);
+        }
+    }
+
+    // Cheap check before any conversion work, true if the chain is asleep and this input keeps it that way.
+    bool StaysAsleep(const float* input, size_t count) {
+        return sleeping && silence.Update(input, count);
+    }
+
+    bool IsSleeping() const {
+        return sleeping;
+    }
+
 private:
     int sample_rate;
+    int channels = 1;
     std::vector<std::unique_ptr<Block>> blocks;
+    SilenceDetector silence;
+    bool sleeping = false;
+    BlockCost* costs = nullptr;
+
+    size_t ChainTail() const {
+        size_t tail = 0;
+        for (auto& block : blocks) {
+            tail += block->TailSamples();
+        }
+        return tail;
+    }
 
     std::unique_ptr<Block> CreateBlockFromLine(const std::string& line) {
         std::istringstream iss(line);
         std::string type;
         iss >> type;
 
-        std::unordered_map<std::string, int> params;
+        std::unordered_map<std::string, std::string> params;
         std::string token;
 
         while (iss >> token) {
             auto pos = token.find('=');
             if (pos != std::string::npos) {
-                params[token.substr(0, pos)] =
-                    std::stoi(token.substr(pos + 1));
+                params[token.substr(0, pos)] = token.substr(pos + 1);
             }
         }
 
+        // Numbers can have a fraction, a missing optional one falls back to fallback.
+        auto number = [&](const std::string& key, double fallback) {
+            auto it = params.find(key);
+            return it == params.end() ? fallback : std::stod(it->second);
+        };
+        auto required = [&](const std::string& key) {
+            return std::stod(params.at(key));
+        };
+        auto key = [&]() -> std::shared_ptr<SidechainBus> {
+            auto it = params.find("bus");
+            return it == params.end() || it->second.empty() ? nullptr : SidechainBuses::Instance().Get(it->second);
+        };
+
         if (type == "delay")
-            return std::make_unique<DelayBlock>(params.at("time"), sample_rate);
+            return std::make_unique<DelayBlock>(required("time"), sample_rate);
         if (type == "distortion")
-            return std::make_unique<DistortionBlock>(params.at("intensity"));
+            return std::make_unique<DistortionBlock>(required("intensity"));
         if (type == "compression")
-            return std::make_unique<CompressionBlock>(params.at("amount"));
+            return std::make_unique<CompressionBlock>(required("amount"), sample_rate, key(), channels);
         if (type == "gating")
-            return std::make_unique<GatingBlock>(params.at("threshold"));
+            return std::make_unique<GatingBlock>(required("threshold"));
         if (type == "reverb")
-            return std::make_unique<ReverbBlock>(params.at("intensity"), sample_rate);
+            return std::make_unique<ReverbBlock>(required("intensity"), sample_rate);
         if (type == "gain")
-            return std::make_unique<GainBlock>(params.at("amount"));
+            return std::make_unique<GainBlock>(required("amount"));
+        if (type == "sidechain")
+            return std::make_unique<SidechainBlock>(params["bus"]);
+        if (type == "ducker")
+            return std::make_unique<DuckerBlock>(key(), number("threshold", -40.0), number("amount", 12.0),
+                                                 number("attack", 10.0), number("release", 300.0), number("hold", 250.0), sample_rate, channels);
+        if (type == "pitch")
+            return std::make_unique<PitchBlock>(number("semitones", 0.0), number("formant", 0.0), channels);
 
         return std::make_unique<DelayBlock>(0, sample_rate);
     }
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct ChannelRoute {
+    std::string device;
+    float gain = 1.0f;
+
+    bool operator==(const ChannelRoute& other) const {
+        return device == other.device && gain == other.gain;
+    }
+};
+
+// Everything a channel is started from.
+struct ChannelSpec {
+    std::string name;
+    // Capture device name, or with device false the app to capture. Empty is the default device.
+    std::string input;
+    bool device = true;
+    bool lowLatency = false;
+    // Tunes each output's latency from its xruns instead of the fixed lowLatency durations.
+    bool adaptive = false;
+    float volume = 1.0f;
+    // Empty plays to the default output.
+    std::vector<ChannelRoute> outputs;
+    // Block chain text, as BlocksManager::Initialize takes it.
+    std::string chain;
+};
+
+enum class ChannelState : int32_t { Starting, Running, Stopping, Stopped, Failed };
+
+// What differs between two specs. Volume, chain and outputs change while the channel streams, a
+// different input restarts it.
+namespace ChannelChange {
+constexpr unsigned VOLUME = 1;
+constexpr unsigned CHAIN = 2;
+constexpr unsigned OUTPUTS = 4;
+constexpr unsigned INPUT = 8;
+}
+
+inline unsigned channel_changes(const ChannelSpec& from, const ChannelSpec& to) {
+    unsigned changes = 0;
+    if (from.volume != to.volume) changes |= ChannelChange::VOLUME;
+    if (from.chain != to.chain) changes |= ChannelChange::CHAIN;
+    if (from.outputs != to.outputs) changes |= ChannelChange::OUTPUTS;
+    if (from.input != to.input || from.device != to.device || from.lowLatency != to.lowLatency ||
+        from.adaptive != to.adaptive) changes |= ChannelChange::INPUT;
+    return changes;
+}
+
+// A change built off the audio thread for a running loop to swap in between packets. The host
+// derives from it with whatever it swaps, and after swapping the loop hands it back holding what
+// it replaced, for the engine to free.
+struct ChannelUpdate {
+    virtual ~ChannelUpdate() = default;
+    unsigned changes = 0;
+};
+
+// What a channel's loop and the engine share. The loop only reads stop and volume and polls for
+// updates, none of which takes a lock or, with nothing pending, a locked instruction.
+struct ChannelControl {
+    explicit ChannelControl(ChannelSpec s) : spec(std::move(s)) {
+        volume.store(spec.volume, std::memory_order_relaxed);
+    }
+
+    ChannelControl(const ChannelControl&) = delete;
+    ChannelControl& operator=(const ChannelControl&) = delete;
+
+    // The spec this run started from, never changed. Live changes come as updates.
+    ChannelSpec spec;
+    std::atomic<bool> stop{false};
+    std::atomic<ChannelState> state{ChannelState::Starting};
+    std::atomic<float> volume{1.0f};
+    // The capture format, set by the loop once it knows it, 0 before. Updates are built for it.
+    std::atomic<int> sampleRate{0};
+    std::atomic<int> channels{0};
+    // The host's, for Wake to interrupt the loop's wait with.
+    void* event = nullptr;
+
+    // Loop. The update to swap in, if there is one.
+    ChannelUpdate* Take() {
+        if (!pending.load(std::memory_order_relaxed)) return nullptr;
+        return pending.exchange(nullptr, std::memory_order_acquire);
+    }
+
+    // Loop. Hands the update back after swapping.
+    void Done(ChannelUpdate* update) {
+        finished.store(update, std::memory_order_release);
+    }
+
+private:
+    friend class ChannelEngine;
+    std::atomic<ChannelUpdate*> pending{nullptr};
+    std::atomic<ChannelUpdate*> finished{nullptr};
+};
+
+// The platform side of the engine, so it can run against a stub.
+class ChannelHost {
+public:
+    virtual ~ChannelHost() = default;
+
+    // Called on the engine thread before its first command.
+    virtual void EngineStarted() {}
+    // Before a channel's thread starts and after it has been joined.
+    virtual void Attach(ChannelControl& control) {}
+    virtual void Detach(ChannelControl& control) {}
+    // Streams the channel on its own thread until control.stop, setting Running once it does.
+    // False if it couldn't start.
+    virtual bool Run(ChannelControl& control) = 0;
+    // Builds a live change to spec on the engine thread, null if it can't be done live and the
+    // channel restarts instead.
+    virtual std::unique_ptr<ChannelUpdate> Prepare(ChannelControl& control, const ChannelSpec& spec, unsigned changes) = 0;
+    // Interrupts the loop's wait so stopping and updates don't wait for a packet.
+    virtual void Wake(ChannelControl& control) {}
+};
+
+struct ChannelStatus {
+    std::string name;
+    ChannelState state = ChannelState::Stopped;
+    // Times the channel was started again for a new input, or by RestartAll.
+    uint64_t restarts = 0;
+    // Live changes its loop has taken.
+    uint64_t updates = 0;
+};
+
+// Runs every channel on its own thread with its own stop token. Commands queue and return at
+// once, one engine thread applies them in order: a new input restarts just that channel, anything
+// else is built on the engine thread and swapped into the running loop at its next packet, so
+// the other channels never notice.
+class ChannelEngine {
+public:
+    explicit ChannelEngine(ChannelHost& host) : host(host) {}
+
+    ChannelEngine(const ChannelEngine&) = delete;
+    ChannelEngine& operator=(const ChannelEngine&) = delete;
+
+    // At exit the process takes the threads down, joining from a static destructor could hang.
+    ~ChannelEngine() {
+        for (auto& [name, channel] : channels) {
+            if (channel.thread.joinable()) channel.thread.detach();
+        }
+        if (thread.joinable()) thread.detach();
+    }
+
+    // Starts the channel, or changes it to spec if one by that name exists.
+    void Update(ChannelSpec spec) {
+        Queue([this, spec = std::move(spec)]() mutable { Apply(std::move(spec)); });
+    }
+
+    void Remove(std::string name) {
+        Queue([this, name = std::move(name)]() {
+            auto it = channels.find(name);
+            if (it == channels.end()) return;
+            Stop(it->second);
+            channels.erase(it);
+        });
+    }
+
+    void SetInput(std::string name, std::string input, bool device) {
+        Modify(std::move(name), [input = std::move(input), device](ChannelSpec& spec) {
+            spec.input = input;
+            spec.device = device;
+        });
+    }
+
+    void SetOutputs(std::string name, std::vector<ChannelRoute> outputs) {
+        Modify(std::move(name), [outputs = std::move(outputs)](ChannelSpec& spec) { spec.outputs = outputs; });
+    }
+
+    void SetVolume(std::string name, float volume) {
+        Modify(std::move(name), [volume](ChannelSpec& spec) { spec.volume = volume; });
+    }
+
+    // Channels not in specs are removed, the rest updated.
+    void Sync(std::vector<ChannelSpec> specs) {
+        Queue([this, specs = std::move(specs)]() mutable {
+            for (auto it = channels.begin(); it != channels.end();) {
+                bool kept = false;
+                for (const ChannelSpec& spec : specs) kept = kept || spec.name == it->first;
+                if (kept) {
+                    ++it;
+                    continue;
+                }
+                Stop(it->second);
+                it = channels.erase(it);
+            }
+            for (ChannelSpec& spec : specs) Apply(std::move(spec));
+        });
+    }
+
+    // Stops and starts every channel, for when devices got into a bad state.
+    void RestartAll() {
+        Queue([this]() {
+            for (auto& [name, channel] : channels) {
+                ++channel.restarts;
+                Restart(channel, channel.spec);
+            }
+        });
+    }
+
+    // Waits for every command queued so far to be applied and taken by its loop, false on timeout.
+    bool Flush(std::chrono::milliseconds timeout = std::chrono::milliseconds(2000)) {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t wanted = queued;
+        return idle.wait_for(lock, timeout, [&] { return applied >= wanted && inFlight == 0; });
+    }
+
+    std::vector<ChannelStatus> Status() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<ChannelStatus> out = status;
+        for (size_t i = 0; i < out.size(); ++i) out[i].state = controls[i]->state.load();
+        return out;
+    }
+
+    // Stops every channel and the engine thread.
+    void Shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread.joinable()) return;
+            commands.push_back([this]() {
+                for (auto& [name, channel] : channels) Stop(channel);
+                channels.clear();
+                exiting = true;
+            });
+            ++queued;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+private:
+    struct Channel {
+        ChannelSpec spec;
+        std::shared_ptr<ChannelControl> control;
+        std::thread thread;
+        // Waiting for the loop to take the one in flight.
+        std::unique_ptr<ChannelUpdate> next;
+        bool inFlight = false;
+        uint64_t restarts = 0;
+        uint64_t updates = 0;
+    };
+
+    // How often the engine checks on updates in flight.
+    static constexpr std::chrono::milliseconds POLL{2};
+
+    ChannelHost& host;
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    // Under mutex.
+    std::deque<std::function<void()>> commands;
+    uint64_t queued = 0;
+    uint64_t applied = 0;
+    size_t inFlight = 0;
+    std::vector<ChannelStatus> status;
+    // Alongside status, so Status reads states as they are now.
+    std::vector<std::shared_ptr<ChannelControl>> controls;
+    // Engine thread only.
+    std::map<std::string, Channel> channels;
+    bool exiting = false;
+
+    void Queue(std::function<void()> command) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!thread.joinable()) {
+                exiting = false;
+                thread = std::thread([this]() { Run(); });
+            }
+            commands.push_back(std::move(command));
+            ++queued;
+        }
+        wake.notify_all();
+    }
+
+    void Modify(std::string name, std::function<void(ChannelSpec&)> change) {
+        Queue([this, name = std::move(name), change = std::move(change)]() {
+            auto it = channels.find(name);
+            if (it == channels.end()) return;
+            ChannelSpec spec = it->second.spec;
+            change(spec);
+            Apply(std::move(spec));
+        });
+    }
+
+    void Run() {
+        host.EngineStarted();
+        while (!exiting) {
+            std::function<void()> command;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                auto ready = [&] { return !commands.empty(); };
+                if (inFlight > 0) {
+                    wake.wait_for(lock, POLL, ready);
+                } else {
+                    wake.wait(lock, ready);
+                }
+                if (!commands.empty()) {
+                    command = std::move(commands.front());
+                    commands.pop_front();
+                }
+            }
+            if (command) command();
+            Collect();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (command) ++applied;
+            Publish();
+            idle.notify_all();
+        }
+    }
+
+    void Apply(ChannelSpec spec) {
+        auto it = channels.find(spec.name);
+        if (it == channels.end()) {
+            Channel& channel = channels[spec.name];
+            Start(channel, std::move(spec));
+            return;
+        }
+
+        Channel& channel = it->second;
+        unsigned changes = channel_changes(channel.spec, spec);
+        if (changes == 0) return;
+        ChannelState state = channel.control->state.load();
+        if ((changes & ChannelChange::INPUT) || state == ChannelState::Failed || state == ChannelState::Stopped) {
+            ++channel.restarts;
+            Restart(channel, std::move(spec));
+            return;
+        }
+
+        channel.control->volume.store(spec.volume, std::memory_order_relaxed);
+        changes &= ~ChannelChange::VOLUME;
+        if (changes != 0) {
+            // A newer change replaces one still waiting, so it carries that one's changes too.
+            if (channel.next) changes |= channel.next->changes;
+            std::unique_ptr<ChannelUpdate> update = host.Prepare(*channel.control, spec, changes);
+            if (!update) {
+                ++channel.restarts;
+                Restart(channel, std::move(spec));
+                return;
+            }
+            update->changes = changes;
+            // Only one at a time in the loop's hands, a newer change replaces one still waiting.
+            channel.next = std::move(update);
+            Post(channel);
+        }
+        channel.spec = std::move(spec);
+    }
+
+    void Start(Channel& channel, ChannelSpec spec) {
+        channel.spec = spec;
+        channel.control = std::make_shared<ChannelControl>(std::move(spec));
+        host.Attach(*channel.control);
+        std::shared_ptr<ChannelControl> control = channel.control;
+        channel.thread = std::thread([this, control]() {
+            bool ok = host.Run(*control);
+            control->state.store(ok ? ChannelState::Stopped : ChannelState::Failed);
+        });
+    }
+
+    void Restart(Channel& channel, ChannelSpec spec) {
+        Stop(channel);
+        Start(channel, std::move(spec));
+    }
+
+    void Stop(Channel& channel) {
+        if (!channel.control) return;
+        ChannelControl& control = *channel.control;
+        ChannelState running = ChannelState::Running, starting = ChannelState::Starting;
+        if (!control.state.compare_exchange_strong(running, ChannelState::Stopping)) {
+            control.state.compare_exchange_strong(starting, ChannelState::Stopping);
+        }
+        control.stop.store(true);
+        host.Wake(control);
+        if (channel.thread.joinable()) channel.thread.join();
+        host.Detach(control);
+
+        // Whatever the loop never took or hadn't been collected yet.
+        delete control.pending.exchange(nullptr);
+        delete control.finished.exchange(nullptr);
+        channel.next.reset();
+        if (channel.inFlight) {
+            channel.inFlight = false;
+            std::lock_guard<std::mutex> lock(mutex);
+            --inFlight;
+        }
+    }
+
+    void Post(Channel& channel) {
+        if (channel.inFlight || !channel.next) return;
+        channel.control->pending.store(channel.next.release(), std::memory_order_release);
+        channel.inFlight = true;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++inFlight;
+        }
+        host.Wake(*channel.control);
+    }
+
+    // Frees what loops handed back and posts anything that was waiting behind it.
+    void Collect() {
+        for (auto& [name, channel] : channels) {
+            if (!channel.inFlight) continue;
+            ChannelUpdate* finished = channel.control->finished.exchange(nullptr, std::memory_order_acquire);
+            if (!finished) continue;
+            delete finished;
+            ++channel.updates;
+            channel.inFlight = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --inFlight;
+            }
+            Post(channel);
+        }
+    }
+
+    // Under mutex.
+    void Publish() {
+        status.clear();
+        controls.clear();
+        for (auto& [name, channel] : channels) {
+            ChannelStatus s;
+            s.name = name;
+            s.restarts = channel.restarts;
+            s.updates = channel.updates;
+            status.push_back(std::move(s));
+            controls.push_back(channel.control);
+        }
+    }
+};
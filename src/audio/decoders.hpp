@@ -0,0 +1,19 @@
+#pragma once
+
+#include <memory>
+
+#include <flac_source.hpp>
+#include <sound_source.hpp>
+
+// Opens a file with one of the built in decoders, picked by the file's contents rather than its
+// extension. Returns nullptr for anything they don't handle so the caller can fall back to the
+// platform's decoder.
+inline std::unique_ptr<SoundSource> open_native_source(const char* path) {
+    auto wav = std::make_unique<WavSource>();
+    if (wav->Open(path)) return wav;
+
+    auto flac = std::make_unique<FlacSource>();
+    if (flac->Open(path)) return flac;
+
+    return nullptr;
+}
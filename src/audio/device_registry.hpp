@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+enum class DeviceFlow { Render, Capture };
+
+struct AudioDevice {
+    // The endpoint id as UTF-8, stable across renames and reboots.
+    std::string id;
+    std::string name;
+    DeviceFlow flow = DeviceFlow::Render;
+};
+
+struct AudioSession {
+    std::string deviceId;
+    uint32_t pid = 0;
+    // Executable name without the directory or ".exe".
+    std::string app;
+};
+
+class DeviceRegistry;
+
+// Everything the registry needs from the platform, so it can run against a stub. The registry
+// serializes all calls, and never makes them from inside a notification.
+class DeviceEnumerator {
+public:
+    virtual ~DeviceEnumerator() = default;
+
+    // Every active endpoint of both flows.
+    virtual std::vector<AudioDevice> Devices() = 0;
+    // One endpoint, false if it's gone or no longer active.
+    virtual bool Device(const std::string& id, AudioDevice& out) = 0;
+    // The sessions on a render endpoint.
+    virtual std::vector<AudioSession> Sessions(const std::string& deviceId) = 0;
+    // Called once before the first enumeration, from then on changes are reported to registry.
+    virtual void Watch(DeviceRegistry& registry) = 0;
+    // The device went away, drop anything kept for it.
+    virtual void Forget(const std::string& deviceId) {}
+};
+
+// Devices and sessions enumerated once and then kept up to date from notifications. The
+// notification entry points only queue what changed, the next lookup asks the enumerator about
+// just those devices, so lookups never walk every endpoint or open property stores.
+class DeviceRegistry {
+public:
+    explicit DeviceRegistry(DeviceEnumerator& enumerator) : enumerator(enumerator) {}
+
+    DeviceRegistry(const DeviceRegistry&) = delete;
+    DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+
+    // The notifications only queue what changed and are safe to call from any thread.
+
+    // An endpoint was added, changed state or was renamed.
+    void DeviceChanged(const std::string& id) {
+        Queue([&](Pending& p) { p.devices.push_back(id); });
+    }
+
+    void DeviceRemoved(const std::string& id) {
+        Queue([&](Pending& p) { p.removed.push_back(id); });
+    }
+
+    // A session was created on a render endpoint.
+    void SessionsChanged(const std::string& deviceId) {
+        Queue([&](Pending& p) { p.sessions.push_back(deviceId); });
+    }
+
+    void SessionEnded(const std::string& deviceId, uint32_t pid) {
+        Queue([&](Pending& p) { p.ended.emplace_back(deviceId, pid); });
+    }
+
+    // Bumped whenever a lookup applied a change, so callers can cache what they build from it.
+    uint64_t Generation() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Sync();
+        return generation;
+    }
+
+    // Friendly names in enumeration order.
+    std::vector<std::string> Names(DeviceFlow flow) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Sync();
+        std::vector<std::string> names;
+        for (const std::string& id : order) {
+            const AudioDevice& device = devices.at(id);
+            if (device.flow == flow) names.push_back(device.name);
+        }
+        return names;
+    }
+
+    // The id of the first endpoint called name, false if there's none.
+    bool FindDevice(DeviceFlow flow, const std::string& name, std::string& id) {
+        if (name.empty()) return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        Sync();
+        auto it = byName.find({flow, name});
+        if (it == byName.end()) return false;
+        id = it->second;
+        return true;
+    }
+
+    // Every session on every render endpoint.
+    std::vector<AudioSession> Sessions() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Sync();
+        std::vector<AudioSession> all;
+        for (const auto& [deviceId, onDevice] : sessions) {
+            for (const auto& [pid, session] : onDevice) all.push_back(session);
+        }
+        return all;
+    }
+
+    // A session of the app, compared case-insensitively.
+    bool FindSession(const std::string& app, AudioSession& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Sync();
+        auto it = byApp.find(Lower(app));
+        if (it == byApp.end() || it->second.empty()) return false;
+        const auto& [deviceId, pid] = it->second.front();
+        out = sessions.at(deviceId).at(pid);
+        return true;
+    }
+
+private:
+    struct Pending {
+        std::vector<std::string> devices, removed, sessions;
+        std::vector<std::pair<std::string, uint32_t>> ended;
+
+        bool Empty() const {
+            return devices.empty() && removed.empty() && sessions.empty() && ended.empty();
+        }
+    };
+
+    DeviceEnumerator& enumerator;
+
+    // Only guards pending, so notifications never wait on an enumeration.
+    std::mutex pendingMutex;
+    Pending pending;
+    std::atomic<bool> hasPending{false};
+
+    std::mutex mutex;
+    bool started = false;
+    uint64_t generation = 0;
+    std::unordered_map<std::string, AudioDevice> devices;
+    std::vector<std::string> order;
+    std::map<std::pair<DeviceFlow, std::string>, std::string> byName;
+    std::unordered_map<std::string, std::map<uint32_t, AudioSession>> sessions;
+    std::unordered_map<std::string, std::vector<std::pair<std::string, uint32_t>>> byApp;
+
+    template <typename F>
+    void Queue(F&& add) {
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        add(pending);
+        hasPending.store(true, std::memory_order_release);
+    }
+
+    static std::string Lower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    // Everything below runs with mutex held.
+    void Sync() {
+        if (!started) {
+            started = true;
+            enumerator.Watch(*this);
+            for (AudioDevice& device : enumerator.Devices()) {
+                std::string id = device.id;
+                PutDevice(std::move(device));
+                if (devices.at(id).flow == DeviceFlow::Render) PutSessions(id);
+            }
+            ++generation;
+        }
+        if (!hasPending.load(std::memory_order_acquire)) return;
+
+        Pending work;
+        {
+            std::lock_guard<std::mutex> lock(pendingMutex);
+            std::swap(work, pending);
+            hasPending.store(false, std::memory_order_relaxed);
+        }
+        if (work.Empty()) return;
+
+        for (const std::string& id : work.removed) RemoveDevice(id);
+        for (const std::string& id : work.devices) {
+            AudioDevice device;
+            if (!enumerator.Device(id, device)) {
+                RemoveDevice(id);
+                continue;
+            }
+            bool added = !devices.count(id);
+            PutDevice(std::move(device));
+            if (added && devices.at(id).flow == DeviceFlow::Render) PutSessions(id);
+        }
+        for (const auto& [deviceId, pid] : work.ended) {
+            auto it = sessions.find(deviceId);
+            if (it != sessions.end()) RemoveSession(it->second, pid);
+        }
+        for (const std::string& id : work.sessions) {
+            if (devices.count(id)) PutSessions(id);
+        }
+        ++generation;
+    }
+
+    void PutDevice(AudioDevice device) {
+        if (!devices.count(device.id)) order.push_back(device.id);
+        std::string id = device.id;
+        devices[id] = std::move(device);
+        IndexNames();
+    }
+
+    void RemoveDevice(const std::string& id) {
+        if (!devices.erase(id)) return;
+        order.erase(std::remove(order.begin(), order.end(), id), order.end());
+        IndexNames();
+
+        auto onDevice = sessions.find(id);
+        if (onDevice != sessions.end()) {
+            while (!onDevice->second.empty()) RemoveSession(onDevice->second, onDevice->second.begin()->first);
+            sessions.erase(onDevice);
+        }
+        enumerator.Forget(id);
+    }
+
+    // The first endpoint in enumeration order wins when two share a name.
+    void IndexNames() {
+        byName.clear();
+        for (const std::string& id : order) {
+            const AudioDevice& device = devices.at(id);
+            byName.emplace(std::make_pair(device.flow, device.name), id);
+        }
+    }
+
+    // Replaces what we know about a device's sessions with a fresh enumeration.
+    void PutSessions(const std::string& deviceId) {
+        auto& onDevice = sessions[deviceId];
+        while (!onDevice.empty()) RemoveSession(onDevice, onDevice.begin()->first);
+        for (AudioSession& session : enumerator.Sessions(deviceId)) {
+            if (session.pid == 0 || onDevice.count(session.pid)) continue;
+            session.deviceId = deviceId;
+            byApp[Lower(session.app)].emplace_back(deviceId, session.pid);
+            onDevice.emplace(session.pid, std::move(session));
+        }
+    }
+
+    void RemoveSession(std::map<uint32_t, AudioSession>& onDevice, uint32_t pid) {
+        auto it = onDevice.find(pid);
+        if (it == onDevice.end()) return;
+        auto app = byApp.find(Lower(it->second.app));
+        if (app != byApp.end()) {
+            auto& list = app->second;
+            list.erase(std::remove(list.begin(), list.end(), std::make_pair(it->second.deviceId, pid)), list.end());
+            if (list.empty()) byApp.erase(app);
+        }
+        onDevice.erase(it);
+    }
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cstring>
+
+// Sample kernels shared by the audio loops, soundboard and benchmarks. Nothing in here
+// touches Windows headers so it builds anywhere.
+
+inline float* int16_to_float(const int16_t* data, size_t frames, int channels) {
+    float* out = new float[frames * channels];
+    for (size_t i = 0; i < frames * channels; ++i)
+        out[i] = data[i] / 32768.f;
+    return out;
+}
+
+inline float* linear_resample_interleaved(const float* src, size_t srcFrames, int channels, int srcRate, int dstRate, size_t* outFrames) {
+    *outFrames = srcFrames * dstRate / srcRate;
+    float* out = new float[*outFrames * channels];
+    for (size_t i = 0; i < *outFrames; ++i) {
+        float srcPos = i * float(srcFrames) / (*outFrames);
+        size_t idx = size_t(srcPos);
+        float frac = srcPos - idx;
+        for (int c = 0; c < channels; ++c) {
+            float s0 = (idx < srcFrames) ? src[idx * channels + c] : 0.f;
+            float s1 = (idx + 1 < srcFrames) ? src[(idx + 1) * channels + c] : 0.f;
+            out[i * channels + c] = s0 * (1 - frac) + s1 * frac;
+        }
+    }
+    return out;
+}
+
+inline float* remap_channels_interleaved(const float* src, size_t frames, int srcCh, int dstCh) {
+    float* out = new float[frames * dstCh];
+    for (size_t f = 0; f < frames; ++f) {
+        for (int c = 0; c < dstCh; ++c) {
+            out[f * dstCh + c] = src[f * srcCh + (c % srcCh)];
+        }
+    }
+    return out;
+}
+
+// Same as remap_channels_interleaved but into a caller owned buffer.
+inline void remap_channels_into(const float* src, size_t frames, int srcCh, int dstCh, float* out) {
+    if (srcCh == dstCh) {
+        std::copy(src, src + frames * srcCh, out);
+        return;
+    }
+
+    for (size_t f = 0; f < frames; ++f) {
+        for (int c = 0; c < dstCh; ++c) {
+            out[f * dstCh + c] = src[f * srcCh + (c % srcCh)];
+        }
+    }
+}
+
+// Streaming replacement for linear_resample_interleaved in the audio loops. It keeps the last
+// input frame and the fractional read position between packets, so packet edges don't click,
+// and writes into a reused vector instead of allocating every packet.
+class LinearResampler {
+public:
+    void Configure(int channels, int srcRate, int dstRate) {
+        this->channels = channels;
+        this->srcRate = srcRate;
+        this->dstRate = dstRate;
+        step = static_cast<double>(srcRate) / static_cast<double>(dstRate);
+        position = 1.0;
+        last.assign(channels, 0.0f);
+    }
+
+    bool IsPassthrough() const {
+        return srcRate == dstRate;
+    }
+
+    // Most frames Process can produce for the given input.
+    size_t MaxOutput(size_t frames) const {
+        return static_cast<size_t>(static_cast<double>(frames) / step) + 2;
+    }
+
+    // Resamples frames of interleaved input into out (resized to fit), returns frames written.
+    size_t Process(const float* in, size_t frames, std::vector<float>& out) {
+        if (frames == 0) return 0;
+
+        if (IsPassthrough()) {
+            out.resize(frames * channels);
+            std::copy(in, in + frames * channels, out.begin());
+            return frames;
+        }
+
+        out.resize(MaxOutput(frames) * channels);
+
+        // position indexes into [last, in[0], in[1], ...], so 0 is the previous packet's final frame.
+        size_t written = 0;
+        while (position < static_cast<double>(frames)) {
+            size_t idx = static_cast<size_t>(position);
+            float frac = static_cast<float>(position - static_cast<double>(idx));
+            const float* s0 = idx == 0 ? last.data() : in + (idx - 1) * channels;
+            const float* s1 = in + idx * channels;
+
+            float* dst = out.data() + written * channels;
+            for (int c = 0; c < channels; ++c) {
+                dst[c] = s0[c] + (s1[c] - s0[c]) * frac;
+            }
+
+            ++written;
+            position += step;
+        }
+
+        position -= static_cast<double>(frames);
+        std::copy(in + (frames - 1) * channels, in + frames * channels, last.begin());
+
+        out.resize(written * channels);
+        return written;
+    }
+
+private:
+    int channels = 1;
+    int srcRate = 48000;
+    int dstRate = 48000;
+    double step = 1.0;
+    double position = 1.0;
+    std::vector<float> last;
+};
+
+// Device samples to float with the channel volume applied, clamped to [-1, 1].
+inline void float_to_float_gain(const float* src, float* dst, size_t count, float gain) {
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = std::max(-1.0f, std::min(1.0f, src[i] * gain));
+}
+
+inline void int16_to_float_gain(const int16_t* src, float* dst, size_t count, float gain) {
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = std::max(-1.0f, std::min(1.0f, (src[i] / 32768.0f) * gain));
+}
+
+inline void int32_to_float_gain(const int32_t* src, float* dst, size_t count, float gain) {
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<float>(std::max(-1.0, std::min(1.0, (src[i] / 2147483648.0) * gain)));
+}
+
+// Float to device samples with the channel volume applied, float devices use float_to_float_gain.
+inline void float_to_int16_gain(const float* src, int16_t* dst, size_t count, float gain) {
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<int16_t>(std::max(-32768.0f, std::min(32767.0f, src[i] * gain * 32767.0f)));
+}
+
+inline void float_to_int32_gain(const float* src, int32_t* dst, size_t count, float gain) {
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<int32_t>(std::max(-2147483648.0, std::min(2147483647.0, static_cast<double>(src[i]) * gain * 2147483647.0)));
+}
+
+// Sample formats found in files, all little endian.
+enum class SampleEncoding { U8, S16, S24, S32, F32, F64 };
+
+inline size_t encoding_bytes(SampleEncoding encoding) {
+    switch (encoding) {
+    case SampleEncoding::U8: return 1;
+    case SampleEncoding::S16: return 2;
+    case SampleEncoding::S24: return 3;
+    case SampleEncoding::S32: return 4;
+    case SampleEncoding::F32: return 4;
+    case SampleEncoding::F64: return 8;
+    }
+    return 0;
+}
+
+// Converts count samples straight out of file data to float. src doesn't have to be aligned,
+// which it often isn't in a memory mapped file.
+inline void decode_samples(const uint8_t* src, SampleEncoding encoding, float* dst, size_t count) {
+    switch (encoding) {
+    case SampleEncoding::U8:
+        for (size_t i = 0; i < count; ++i) dst[i] = (static_cast<int>(src[i]) - 128) / 128.0f;
+        break;
+    case SampleEncoding::S16:
+        for (size_t i = 0; i < count; ++i) {
+            int16_t v;
+            std::memcpy(&v, src + i * 2, 2);
+            dst[i] = v / 32768.0f;
+        }
+        break;
+    case SampleEncoding::S24:
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* p = src + i * 3;
+            int32_t v = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+            dst[i] = v / 8388608.0f;
+        }
+        break;
+    case SampleEncoding::S32:
+        for (size_t i = 0; i < count; ++i) {
+            int32_t v;
+            std::memcpy(&v, src + i * 4, 4);
+            dst[i] = static_cast<float>(v / 2147483648.0);
+        }
+        break;
+    case SampleEncoding::F32:
+        std::memcpy(dst, src, count * sizeof(float));
+        break;
+    case SampleEncoding::F64:
+        for (size_t i = 0; i < count; ++i) {
+            double v;
+            std::memcpy(&v, src + i * 8, 8);
+            dst[i] = static_cast<float>(v);
+        }
+        break;
+    }
+}
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VICE_HAS_MXCSR 1
+#endif
+
+// Flushes denormals to zero on the current thread while in scope. Feedback loops like the
+// reverb decay into the denormal range, which is many times slower on x86.
+class DenormalGuard {
+public:
+    DenormalGuard() {
+#ifdef VICE_HAS_MXCSR
+        saved = _mm_getcsr();
+        _mm_setcsr(saved | 0x8040); // FTZ | DAZ
+#endif
+    }
+
+    ~DenormalGuard() {
+#ifdef VICE_HAS_MXCSR
+        _mm_setcsr(saved);
+#endif
+    }
+
+    DenormalGuard(const DenormalGuard&) = delete;
+    DenormalGuard& operator=(const DenormalGuard&) = delete;
+
+private:
+    unsigned int saved = 0;
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <dsp.hpp>
+
+// A channel's processed audio converted for every device it plays to. The chain runs once in the
+// capture format, then each distinct rate and layout among the destinations is converted once.
+// Destinations already in the capture format read the channel's buffer itself, nothing is copied
+// for them.
+class Fanout {
+public:
+    void Configure(int channels, int sample_rate) {
+        this->channels = channels;
+        this->sample_rate = sample_rate;
+        conversions.clear();
+        routes.clear();
+        shared = nullptr;
+        sharedFrames = 0;
+    }
+
+    // Adds a destination, returns its index for Output.
+    size_t Add(int channels, int sample_rate) {
+        if (channels == this->channels && sample_rate == this->sample_rate) {
+            routes.push_back(SHARED);
+            return routes.size() - 1;
+        }
+
+        for (size_t c = 0; c < conversions.size(); ++c) {
+            if (conversions[c].channels == channels && conversions[c].sample_rate == sample_rate) {
+                routes.push_back(c);
+                return routes.size() - 1;
+            }
+        }
+
+        Conversion conversion;
+        conversion.channels = channels;
+        conversion.sample_rate = sample_rate;
+        conversion.resampler.Configure(this->channels, this->sample_rate, sample_rate);
+        conversions.push_back(std::move(conversion));
+        routes.push_back(conversions.size() - 1);
+        return routes.size() - 1;
+    }
+
+    size_t Routes() const {
+        return routes.size();
+    }
+
+    // How many conversions a buffer costs, at most one per distinct destination format.
+    size_t Conversions() const {
+        return conversions.size();
+    }
+
+    // Converts frames of the channel's buffer for every destination. buffer has to stay untouched
+    // until the outputs have been read.
+    void Process(const float* buffer, size_t frames) {
+        shared = buffer;
+        sharedFrames = frames;
+
+        for (Conversion& conversion : conversions) {
+            const float* in = buffer;
+            size_t count = frames;
+            if (!conversion.resampler.IsPassthrough()) {
+                count = conversion.resampler.Process(buffer, frames, conversion.resampled);
+                in = conversion.resampled.data();
+            }
+
+            if (conversion.channels == channels) {
+                conversion.out = in;
+            } else {
+                conversion.remapped.resize(count * conversion.channels);
+                remap_channels_into(in, count, channels, conversion.channels, conversion.remapped.data());
+                conversion.out = conversion.remapped.data();
+            }
+            conversion.frames = count;
+        }
+    }
+
+    // A destination's frames from the last Process, valid until the next one.
+    const float* Output(size_t route, size_t& frames) const {
+        if (route >= routes.size() || routes[route] == SHARED) {
+            frames = sharedFrames;
+            return shared;
+        }
+        const Conversion& conversion = conversions[routes[route]];
+        frames = conversion.frames;
+        return conversion.out;
+    }
+
+private:
+    static constexpr size_t SHARED = SIZE_MAX;
+
+    struct Conversion {
+        int channels = 0;
+        int sample_rate = 0;
+        LinearResampler resampler;
+        std::vector<float> resampled;
+        std::vector<float> remapped;
+        const float* out = nullptr;
+        size_t frames = 0;
+    };
+
+    int channels = 0;
+    int sample_rate = 0;
+    std::vector<Conversion> conversions;
+    std::vector<size_t> routes;
+    const float* shared = nullptr;
+    size_t sharedFrames = 0;
+};
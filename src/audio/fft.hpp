@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VICE_HAS_SSE 1
+#endif
+
+// Real FFT of a power of two size, done as a complex FFT of half the size on split real and
+// imaginary arrays plus one pass to untangle the two halves. Butterflies with a span of 4 or
+// more run 4 at a time on SSE, twiddles are laid out per stage so those loads are contiguous.
+class RealFft {
+public:
+    void Configure(size_t size) {
+        n = size;
+        m = size / 2;
+        bits = 0;
+        while ((size_t(1) << bits) < m) ++bits;
+
+        reverse.resize(m);
+        for (size_t i = 0; i < m; ++i) {
+            size_t r = 0;
+            for (int b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+            reverse[i] = static_cast<uint32_t>(r);
+        }
+
+        // Stage with span h uses twiddles e^(-i*pi*k/h) for k < h, stored from offset h.
+        twiddleRe.assign(std::max<size_t>(m, 1), 0.0f);
+        twiddleIm.assign(std::max<size_t>(m, 1), 0.0f);
+        for (size_t h = 1; h < m; h <<= 1) {
+            for (size_t k = 0; k < h; ++k) {
+                double angle = -3.14159265358979323846 * static_cast<double>(k) / static_cast<double>(h);
+                twiddleRe[h + k] = static_cast<float>(std::cos(angle));
+                twiddleIm[h + k] = static_cast<float>(std::sin(angle));
+            }
+        }
+
+        splitRe.resize(m / 2 + 1);
+        splitIm.resize(m / 2 + 1);
+        for (size_t k = 0; k <= m / 2; ++k) {
+            double angle = -2.0 * 3.14159265358979323846 * static_cast<double>(k) / static_cast<double>(n);
+            splitRe[k] = static_cast<float>(std::cos(angle));
+            splitIm[k] = static_cast<float>(std::sin(angle));
+        }
+
+        re.resize(m);
+        im.resize(m);
+    }
+
+    size_t Size() const {
+        return n;
+    }
+
+    // Squared magnitude of bins 0..size/2 of input (size samples) into power (size/2 + 1).
+    void Power(const float* input, float* power) {
+        Load(input);
+        Transform();
+
+        // X[k] = (Z[k] + conj(Z[m-k])) / 2 - i/2 * W^k * (Z[k] - conj(Z[m-k]))
+        for (size_t k = 0; k <= m / 2; ++k) {
+            float sumRe, sumIm, tr, ti;
+            Split(k, sumRe, sumIm, tr, ti);
+            power[k] = (sumRe + tr) * (sumRe + tr) + (sumIm + ti) * (sumIm + ti);
+            // For real input X[m-k] = conj(E - W^k * O), so the same pair gives its magnitude.
+            if (k != 0 && k != m / 2) power[m - k] = (sumRe - tr) * (sumRe - tr) + (sumIm - ti) * (sumIm - ti);
+        }
+        float dc = re[0] + im[0], nyquist = re[0] - im[0];
+        power[0] = dc * dc;
+        power[m] = nyquist * nyquist;
+    }
+
+    // Bins 0..size/2 of input (size samples) into outRe and outIm (size/2 + 1 each).
+    void Forward(const float* input, float* outRe, float* outIm) {
+        Load(input);
+        Transform();
+
+        for (size_t k = 0; k <= m / 2; ++k) {
+            float sumRe, sumIm, tr, ti;
+            Split(k, sumRe, sumIm, tr, ti);
+            outRe[k] = sumRe + tr;
+            outIm[k] = sumIm + ti;
+            if (k != 0 && k != m / 2) {
+                outRe[m - k] = sumRe - tr;
+                outIm[m - k] = ti - sumIm;
+            }
+        }
+        outRe[0] = re[0] + im[0];
+        outIm[0] = 0.0f;
+        outRe[m] = re[0] - im[0];
+        outIm[m] = 0.0f;
+    }
+
+    // Inverse of Forward: bins 0..size/2 back to size samples. The imaginary parts of bins 0 and
+    // size/2 are ignored.
+    void Inverse(const float* inRe, const float* inIm, float* output) {
+        // Z[k] = E[k] + i * O[k] with E[k] = (X[k] + conj(X[m-k])) / 2 and
+        // O[k] = (X[k] - conj(X[m-k])) / 2 * W^-k, and Z[m-k] = conj(E[k]) + i * conj(O[k]).
+        // The inverse is run as a forward transform of conj(Z), so conj(Z) is what's loaded.
+        for (size_t k = 0; k <= m / 2; ++k) {
+            size_t j = m - k;
+            float eRe = 0.5f * (inRe[k] + inRe[j]), eIm = 0.5f * (inIm[k] - inIm[j]);
+            float dRe = 0.5f * (inRe[k] - inRe[j]), dIm = 0.5f * (inIm[k] + inIm[j]);
+            if (k == 0) eIm = dIm = 0.0f;
+            float oRe = dRe * splitRe[k] + dIm * splitIm[k];
+            float oIm = dIm * splitRe[k] - dRe * splitIm[k];
+            re[reverse[k]] = eRe - oIm;
+            im[reverse[k]] = -(eIm + oRe);
+            if (k != 0 && k != m / 2) {
+                re[reverse[j]] = eRe + oIm;
+                im[reverse[j]] = eIm - oRe;
+            }
+        }
+
+        Transform();
+
+        float scale = 1.0f / static_cast<float>(m);
+        for (size_t i = 0; i < m; ++i) {
+            output[2 * i] = re[i] * scale;
+            output[2 * i + 1] = -im[i] * scale;
+        }
+    }
+
+private:
+    void Load(const float* input) {
+        for (size_t i = 0; i < m; ++i) {
+            re[reverse[i]] = input[2 * i];
+            im[reverse[i]] = input[2 * i + 1];
+        }
+    }
+
+    // In place complex FFT of re and im, already in bit reversed order.
+    void Transform() {
+        for (size_t h = 1; h < m; h <<= 1) {
+            const float* wr = twiddleRe.data() + h;
+            const float* wi = twiddleIm.data() + h;
+            for (size_t start = 0; start < m; start += 2 * h) {
+                float* ar = re.data() + start;
+                float* ai = im.data() + start;
+                float* br = ar + h;
+                float* bi = ai + h;
+                size_t k = 0;
+#ifdef VICE_HAS_SSE
+                for (; k + 4 <= h; k += 4) {
+                    __m128 xr = _mm_loadu_ps(br + k), xi = _mm_loadu_ps(bi + k);
+                    __m128 cr = _mm_loadu_ps(wr + k), ci = _mm_loadu_ps(wi + k);
+                    __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, cr), _mm_mul_ps(xi, ci));
+                    __m128 ti = _mm_add_ps(_mm_mul_ps(xr, ci), _mm_mul_ps(xi, cr));
+                    __m128 ur = _mm_loadu_ps(ar + k), ui = _mm_loadu_ps(ai + k);
+                    _mm_storeu_ps(ar + k, _mm_add_ps(ur, tr));
+                    _mm_storeu_ps(ai + k, _mm_add_ps(ui, ti));
+                    _mm_storeu_ps(br + k, _mm_sub_ps(ur, tr));
+                    _mm_storeu_ps(bi + k, _mm_sub_ps(ui, ti));
+                }
+#endif
+                for (; k < h; ++k) {
+                    float tr = br[k] * wr[k] - bi[k] * wi[k];
+                    float ti = br[k] * wi[k] + bi[k] * wr[k];
+                    float ur = ar[k], ui = ai[k];
+                    ar[k] = ur + tr;
+                    ai[k] = ui + ti;
+                    br[k] = ur - tr;
+                    bi[k] = ui - ti;
+                }
+            }
+        }
+    }
+
+    // Halves of bin k of the real transform from the complex one: X[k] = sum + t and
+    // X[m-k] = conj(sum - t).
+    void Split(size_t k, float& sumRe, float& sumIm, float& tr, float& ti) const {
+        size_t j = (m - k) & (m - 1);
+        sumRe = 0.5f * (re[k] + re[j]);
+        sumIm = 0.5f * (im[k] - im[j]);
+        float difRe = 0.5f * (im[k] + im[j]), difIm = -0.5f * (re[k] - re[j]);
+        tr = difRe * splitRe[k] - difIm * splitIm[k];
+        ti = difRe * splitIm[k] + difIm * splitRe[k];
+    }
+
+    size_t n = 0, m = 0;
+    int bits = 0;
+    std::vector<uint32_t> reverse;
+    std::vector<float> twiddleRe, twiddleIm;
+    std::vector<float> splitRe, splitIm;
+    std::vector<float> re, im;
+};
+
@@ -0,0 +1,384 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// MSB first bit packing for FlacEncoder.
+class BitWriter {
+public:
+    std::vector<uint8_t> bytes;
+
+    void Write(uint64_t value, int count) {
+        for (int i = count - 1; i >= 0; --i) PushBit((value >> i) & 1);
+    }
+
+    void WriteSigned(int64_t value, int count) {
+        Write(static_cast<uint64_t>(value) & ((uint64_t(1) << count) - 1), count);
+    }
+
+    void WriteUnary(uint32_t zeros) {
+        for (uint32_t i = 0; i < zeros; ++i) PushBit(0);
+        PushBit(1);
+    }
+
+    void Align() {
+        while (used != 0) PushBit(0);
+    }
+
+private:
+    int used = 0;
+
+    void PushBit(int bit) {
+        if (used == 0) bytes.push_back(0);
+        if (bit) bytes.back() |= static_cast<uint8_t>(0x80 >> used);
+        used = (used + 1) & 7;
+    }
+};
+
+// FLAC encoder for the recorder, a block at a time. Picks the cheapest of constant, verbatim,
+// fixed and order 8 LPC subframes and of independent or mid/side stereo for each block. No
+// MD5, which the format allows, so it never has to look at the audio twice.
+class FlacEncoder {
+public:
+    static constexpr size_t BLOCK_SIZE = 4096;
+    static constexpr size_t STREAMINFO_BYTES = 4 + 4 + 34;
+
+    // bits is 16 or 24.
+    void Configure(int sampleRate, int channels, int bits) {
+        this->sampleRate = sampleRate;
+        this->channels = channels;
+        this->bits = bits;
+        frameNumber = 0;
+        frames = 0;
+        minFrameBytes = UINT32_MAX;
+        maxFrameBytes = 0;
+        planar.assign(channels, std::vector<int32_t>());
+    }
+
+    // "fLaC" and STREAMINFO with what's been encoded so far, followed by a PADDING block so the
+    // first frame starts at headerBytes if that's given. Written once up front and again over
+    // the top when the stream ends.
+    std::vector<uint8_t> Header(size_t headerBytes = 0) const {
+        BitWriter out;
+        out.bytes = {'f', 'L', 'a', 'C'};
+        bool padded = headerBytes >= STREAMINFO_BYTES + 4;
+        out.Write(padded ? 0 : 1, 1);
+        out.Write(0, 7);
+        out.Write(34, 24);
+        out.Write(BLOCK_SIZE, 16);
+        out.Write(BLOCK_SIZE, 16);
+        out.Write(frames ? minFrameBytes : 0, 24);
+        out.Write(maxFrameBytes, 24);
+        out.Write(sampleRate, 20);
+        out.Write(channels - 1, 3);
+        out.Write(bits - 1, 5);
+        out.Write(frames, 36);
+        for (int i = 0; i < 16; ++i) out.Write(0, 8);
+
+        if (padded) {
+            size_t padding = headerBytes - STREAMINFO_BYTES - 4;
+            out.Write(1, 1);
+            out.Write(1, 7);
+            out.Write(padding, 24);
+            out.bytes.resize(out.bytes.size() + padding, 0);
+        }
+        return out.bytes;
+    }
+
+    // samples are interleaved integers at the configured bits, count is at most BLOCK_SIZE.
+    // Anything short of a whole block must be the last one in the stream.
+    void Encode(const int32_t* samples, size_t count, std::vector<uint8_t>& out) {
+        for (int c = 0; c < channels; ++c) {
+            planar[c].resize(count);
+            for (size_t i = 0; i < count; ++i) planar[c][i] = samples[i * channels + c];
+        }
+
+        BitWriter frame;
+        frame.bytes.swap(out);
+        size_t start = frame.bytes.size();
+        WriteFrame(frame, planar, count);
+        frame.bytes.swap(out);
+
+        uint32_t size = static_cast<uint32_t>(out.size() - start);
+        minFrameBytes = std::min(minFrameBytes, size);
+        maxFrameBytes = std::max(maxFrameBytes, size);
+        frames += count;
+        ++frameNumber;
+    }
+
+    uint64_t Frames() const {
+        return frames;
+    }
+
+private:
+    int sampleRate = 48000;
+    int channels = 2;
+    int bits = 16;
+    uint32_t frameNumber = 0;
+    uint64_t frames = 0;
+    uint32_t minFrameBytes = UINT32_MAX;
+    uint32_t maxFrameBytes = 0;
+    std::vector<std::vector<int32_t>> planar;
+
+    void WriteFrame(BitWriter& out, const std::vector<std::vector<int32_t>>& block, size_t count) {
+        // Stereo tries mid/side and keeps whichever is smaller.
+        std::vector<std::vector<int32_t>> coded = block;
+        int assignment = channels - 1;
+        if (channels == 2) {
+            std::vector<int32_t> mid(count), side(count);
+            for (size_t i = 0; i < count; ++i) {
+                mid[i] = (block[0][i] + block[1][i]) >> 1;
+                side[i] = block[0][i] - block[1][i];
+            }
+            size_t independent = SubframeBits(block[0], bits) + SubframeBits(block[1], bits);
+            if (SubframeBits(mid, bits) + SubframeBits(side, bits + 1) < independent) {
+                coded = {mid, side};
+                assignment = 10;
+            }
+        }
+
+        size_t frameStart = out.bytes.size();
+        out.Write(0x3FFE, 14);
+        out.Write(0, 2);
+        out.Write(count == BLOCK_SIZE ? 12 : 7, 4);
+        out.Write(sampleRate == 48000 ? 10 : (sampleRate == 44100 ? 9 : 0), 4);
+        out.Write(assignment, 4);
+        out.Write(bits == 16 ? 4 : 6, 3);
+        out.Write(0, 1);
+        WriteUtf8(out, frameNumber);
+        if (count != BLOCK_SIZE) out.Write(count - 1, 16);
+        out.Write(Crc8(out.bytes.data() + frameStart, out.bytes.size() - frameStart), 8);
+
+        for (int c = 0; c < channels; ++c) {
+            bool side = assignment == 10 && c == 1;
+            WriteSubframe(out, coded[c], bits + (side ? 1 : 0));
+        }
+
+        out.Align();
+        out.Write(Crc16(out.bytes.data() + frameStart, out.bytes.size() - frameStart), 16);
+    }
+
+    static uint8_t Crc8(const uint8_t* data, size_t size) {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= data[i];
+            for (int b = 0; b < 8; ++b) crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+        return crc;
+    }
+
+    static uint16_t Crc16(const uint8_t* data, size_t size) {
+        uint16_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= static_cast<uint16_t>(data[i] << 8);
+            for (int b = 0; b < 8; ++b) crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x8005) : static_cast<uint16_t>(crc << 1);
+        }
+        return crc;
+    }
+
+    static void WriteUtf8(BitWriter& out, uint32_t value) {
+        if (value < 0x80) {
+            out.Write(value, 8);
+            return;
+        }
+        int extra = value < 0x800 ? 1 : value < 0x10000 ? 2 : value < 0x200000 ? 3 : value < 0x4000000 ? 4 : 5;
+        out.Write(((0xFF00 >> (extra + 1)) & 0xFF) | (value >> (6 * extra)), 8);
+        for (int i = extra - 1; i >= 0; --i) out.Write(0x80 | ((value >> (6 * i)) & 0x3F), 8);
+    }
+
+    struct Candidate {
+        int type = 1;
+        uint32_t order = 0;
+        int precision = 0;
+        int shift = 0;
+        std::vector<int32_t> coefs;
+        std::vector<int64_t> residual;
+        size_t bits = SIZE_MAX;
+    };
+
+    static size_t SubframeBits(const std::vector<int32_t>& x, int bits) {
+        return Best(x, bits).bits;
+    }
+
+    static Candidate Best(const std::vector<int32_t>& x, int bits) {
+        Candidate best;
+        best.bits = 8 + x.size() * bits;
+
+        if (std::all_of(x.begin(), x.end(), [&](int32_t v) { return v == x[0]; })) {
+            best.type = 0;
+            best.bits = 8 + bits;
+            return best;
+        }
+
+        for (uint32_t order = 0; order <= 4 && order < x.size(); ++order) {
+            Candidate fixed;
+            fixed.type = 8 + order;
+            fixed.order = order;
+            fixed.residual.resize(x.size() - order);
+            for (size_t i = order; i < x.size(); ++i) {
+                int64_t p = 0;
+                if (order == 1) p = x[i - 1];
+                else if (order == 2) p = 2ll * x[i - 1] - x[i - 2];
+                else if (order == 3) p = 3ll * (x[i - 1] - x[i - 2]) + x[i - 3];
+                else if (order == 4) p = 4ll * (x[i - 1] + x[i - 3]) - 6ll * x[i - 2] - x[i - 4];
+                fixed.residual[i - order] = x[i] - p;
+            }
+            fixed.bits = 8 + order * bits + ResidualBits(fixed.residual, x.size(), order, bits);
+            if (fixed.bits < best.bits) best = fixed;
+        }
+
+        Candidate lpc = Lpc(x, bits, 8);
+        if (lpc.bits < best.bits) best = lpc;
+        return best;
+    }
+
+    static Candidate Lpc(const std::vector<int32_t>& x, int bits, uint32_t order) {
+        Candidate lpc;
+        if (x.size() <= order * 2) return lpc;
+
+        size_t n = x.size();
+        std::vector<double> windowed(n);
+        for (size_t i = 0; i < n; ++i) {
+            double w = 0.5 - 0.5 * std::cos(2.0 * 3.14159265358979323846 * i / (n - 1));
+            windowed[i] = x[i] * w;
+        }
+
+        double r[33] = {};
+        for (uint32_t lag = 0; lag <= order; ++lag) {
+            for (size_t i = lag; i < n; ++i) r[lag] += windowed[i] * windowed[i - lag];
+        }
+        if (r[0] == 0.0) return lpc;
+
+        // Levinson-Durbin.
+        double a[33] = {};
+        double error = r[0];
+        for (uint32_t i = 1; i <= order; ++i) {
+            double k = r[i];
+            for (uint32_t j = 1; j < i; ++j) k -= a[j] * r[i - j];
+            k /= error;
+            double tmp[33];
+            for (uint32_t j = 1; j < i; ++j) tmp[j] = a[j] - k * a[i - j];
+            for (uint32_t j = 1; j < i; ++j) a[j] = tmp[j];
+            a[i] = k;
+            error *= 1.0 - k * k;
+            if (error <= 0.0) return lpc;
+        }
+
+        // Like the reference encoder, 16 bit keeps the sum in 32 bits so decoders can use the fast path.
+        const int precision = bits <= 17 ? 32 - bits - 3 : 14;
+        double cmax = 0.0;
+        for (uint32_t j = 1; j <= order; ++j) cmax = std::max(cmax, std::fabs(a[j]));
+        int exponent;
+        std::frexp(cmax, &exponent);
+        int shift = std::max(0, std::min(15, precision - 1 - exponent));
+        int32_t limit = (1 << (precision - 1)) - 1;
+
+        lpc.type = 31 + order;
+        lpc.order = order;
+        lpc.precision = precision;
+        lpc.shift = shift;
+        lpc.coefs.resize(order);
+        for (uint32_t j = 0; j < order; ++j) {
+            lpc.coefs[j] = static_cast<int32_t>(std::max<long>(-limit, std::min<long>(limit, std::lround(a[j + 1] * (1 << shift)))));
+        }
+
+        lpc.residual.resize(n - order);
+        for (size_t i = order; i < n; ++i) {
+            int64_t sum = 0;
+            for (uint32_t j = 0; j < order; ++j) sum += static_cast<int64_t>(lpc.coefs[j]) * x[i - 1 - j];
+            lpc.residual[i - order] = x[i] - (sum >> shift);
+        }
+        lpc.bits = 8 + order * bits + 4 + 5 + order * precision + ResidualBits(lpc.residual, n, order, bits);
+        return lpc;
+    }
+
+    static uint64_t ZigZag(int64_t v) {
+        return v >= 0 ? static_cast<uint64_t>(v) << 1 : (static_cast<uint64_t>(-v) << 1) - 1;
+    }
+
+    static int MaxParameter(int bits) {
+        return bits > 16 ? 30 : 14;
+    }
+
+    // Best Rice parameter for a run of residuals, estimated from their sum.
+    static int RiceParameter(const int64_t* residual, size_t count, int bits, size_t* cost) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < count; ++i) sum += ZigZag(residual[i]);
+        int best = 0;
+        size_t bestCost = SIZE_MAX;
+        for (int k = 0; k <= MaxParameter(bits); ++k) {
+            size_t c = count * (k + 1) + static_cast<size_t>(sum >> k);
+            if (c < bestCost) {
+                bestCost = c;
+                best = k;
+            }
+        }
+        *cost = bestCost;
+        return best;
+    }
+
+    static int PartitionOrder(size_t blockSize, uint32_t order) {
+        int p = 0;
+        while (p < 6 && (blockSize % (size_t(2) << p)) == 0 && (blockSize >> (p + 1)) > order) ++p;
+        return p;
+    }
+
+    static size_t ResidualBits(const std::vector<int64_t>& residual, size_t blockSize, uint32_t order, int bits) {
+        int partitionOrder = PartitionOrder(blockSize, order);
+        size_t partitionSize = blockSize >> partitionOrder;
+        size_t total = 2 + 4;
+        size_t offset = 0;
+        for (size_t p = 0; p < (size_t(1) << partitionOrder); ++p) {
+            size_t count = p == 0 ? partitionSize - order : partitionSize;
+            size_t cost;
+            RiceParameter(residual.data() + offset, count, bits, &cost);
+            total += (bits > 16 ? 5 : 4) + cost;
+            offset += count;
+        }
+        return total;
+    }
+
+    static void WriteSubframe(BitWriter& out, const std::vector<int32_t>& x, int bits) {
+        Candidate c = Best(x, bits);
+        out.Write(0, 1);
+        out.Write(c.type, 6);
+        out.Write(0, 1);
+
+        if (c.type == 0) {
+            out.WriteSigned(x[0], bits);
+            return;
+        }
+        if (c.type == 1) {
+            for (int32_t v : x) out.WriteSigned(v, bits);
+            return;
+        }
+
+        for (uint32_t i = 0; i < c.order; ++i) out.WriteSigned(x[i], bits);
+        if (c.type >= 32) {
+            out.Write(c.precision - 1, 4);
+            out.WriteSigned(c.shift, 5);
+            for (int32_t coef : c.coefs) out.WriteSigned(coef, c.precision);
+        }
+
+        int method = bits > 16 ? 1 : 0;
+        int partitionOrder = PartitionOrder(x.size(), c.order);
+        size_t partitionSize = x.size() >> partitionOrder;
+        out.Write(method, 2);
+        out.Write(partitionOrder, 4);
+        size_t offset = 0;
+        for (size_t p = 0; p < (size_t(1) << partitionOrder); ++p) {
+            size_t count = p == 0 ? partitionSize - c.order : partitionSize;
+            size_t cost;
+            int k = RiceParameter(c.residual.data() + offset, count, bits, &cost);
+            out.Write(k, method == 0 ? 4 : 5);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t u = ZigZag(c.residual[offset + i]);
+                out.WriteUnary(static_cast<uint32_t>(u >> k));
+                out.Write(u & ((uint64_t(1) << k) - 1), k);
+            }
+            offset += count;
+        }
+    }
+};
@@ -0,0 +1,494 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mapped_file.hpp>
+#include <sound_source.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+inline int count_leading_zeros64(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return 63 - static_cast<int>(index);
+#else
+    return __builtin_clzll(value);
+#endif
+}
+
+inline uint64_t byte_swap64(uint64_t value) {
+#if defined(_MSC_VER)
+    return _byteswap_uint64(value);
+#else
+    return __builtin_bswap64(value);
+#endif
+}
+
+// MSB first bit reader over memory. Reading past the end gives zeros and sets Overrun, so
+// a truncated file can't read out of bounds.
+class BitReader {
+public:
+    void Reset(const uint8_t* data, size_t size, size_t offset = 0) {
+        this->data = data;
+        this->size = size;
+        next = offset;
+        cache = 0;
+        bits = 0;
+    }
+
+    uint32_t Read(int count) {
+        if (count == 0) return 0;
+        if (bits < count) Refill();
+        uint32_t value = static_cast<uint32_t>(cache >> (64 - count));
+        cache <<= count;
+        bits -= count;
+        return value;
+    }
+
+    int32_t ReadSigned(int count) {
+        if (count == 0) return 0;
+        uint32_t value = Read(count);
+        return static_cast<int32_t>(value << (32 - count)) >> (32 - count);
+    }
+
+    // Counts zero bits up to the next 1, which is consumed.
+    uint32_t ReadUnary() {
+        uint32_t zeros = 0;
+        while (true) {
+            if (cache != 0) {
+                int lz = count_leading_zeros64(cache);
+                cache <<= lz + 1;
+                bits -= lz + 1;
+                return zeros + lz;
+            }
+            zeros += bits;
+            bits = 0;
+            if (Overrun()) return zeros;
+            Refill();
+        }
+    }
+
+    // Rice coded residual, zigzag mapped back to signed.
+    int32_t ReadRice(int parameter) {
+        uint32_t value;
+        if (bits < 32) Refill();
+
+        // Nearly every value fits in what's already cached.
+        int lz = cache != 0 ? count_leading_zeros64(cache) : 64;
+        if (lz + 1 + parameter <= bits) {
+            cache <<= lz + 1;
+            uint32_t low = parameter ? static_cast<uint32_t>(cache >> (64 - parameter)) : 0;
+            cache <<= parameter;
+            bits -= lz + 1 + parameter;
+            value = (static_cast<uint32_t>(lz) << parameter) | low;
+        } else {
+            value = (ReadUnary() << parameter) | Read(parameter);
+        }
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    void AlignToByte() {
+        int drop = bits & 7;
+        cache <<= drop;
+        bits -= drop;
+    }
+
+    // Bytes consumed so far, after AlignToByte.
+    size_t BytePosition() const {
+        return next - static_cast<size_t>(bits / 8);
+    }
+
+    bool Overrun() const {
+        return next * 8 - bits > size * 8;
+    }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t next = 0;
+    uint64_t cache = 0;
+    int bits = 0;
+
+    void Refill() {
+        // Loads 8 bytes at once away from the end and keeps the whole ones.
+        if (next + 8 <= size) {
+            uint64_t word;
+            std::memcpy(&word, data + next, 8);
+            cache |= byte_swap64(word) >> bits;
+            int bytes = (63 - bits) >> 3;
+            next += bytes;
+            bits += bytes * 8;
+            cache &= ~(~uint64_t(0) >> bits);
+            return;
+        }
+
+        while (bits <= 56) {
+            uint64_t byte = next < size ? data[next] : 0;
+            cache |= byte << (56 - bits);
+            ++next;
+            bits += 8;
+        }
+    }
+};
+
+// Native FLAC decoder, reads frames straight out of a memory mapping. Handles every subframe
+// type and stereo mode at up to 24 bits, anything else fails Open so the caller can fall back.
+class FlacSource : public SoundSource {
+public:
+    bool Open(const char* path) {
+        if (!file.Open(path)) return false;
+
+        const uint8_t* p = file.Data();
+        size_t size = file.Size();
+        size_t pos = 0;
+
+        // Some taggers put an ID3v2 tag in front of the stream.
+        if (size >= 10 && std::memcmp(p, "ID3", 3) == 0) {
+            pos = 10 + ((p[6] & 0x7F) << 21 | (p[7] & 0x7F) << 14 | (p[8] & 0x7F) << 7 | (p[9] & 0x7F));
+        }
+        if (pos + 4 > size || std::memcmp(p + pos, "fLaC", 4) != 0) return false;
+        pos += 4;
+
+        bool haveInfo = false;
+        while (pos + 4 <= size) {
+            bool last = (p[pos] & 0x80) != 0;
+            int type = p[pos] & 0x7F;
+            size_t length = (p[pos + 1] << 16) | (p[pos + 2] << 8) | p[pos + 3];
+            pos += 4;
+            if (pos + length > size) return false;
+
+            if (type == 0 && length >= 34) {
+                const uint8_t* info = p + pos;
+                maxBlockSize = (info[2] << 8) | info[3];
+                sampleRate = (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+                channels = ((info[12] >> 1) & 0x07) + 1;
+                bitsPerSample = (((info[12] & 0x01) << 4) | (info[13] >> 4)) + 1;
+                haveInfo = true;
+            }
+
+            pos += length;
+            if (last) break;
+        }
+
+        if (!haveInfo || sampleRate == 0 || maxBlockSize == 0 || bitsPerSample < 4 || bitsPerSample > 24) return false;
+
+        frameStart = pos;
+        scale = 1.0f / static_cast<float>(1u << (bitsPerSample - 1));
+        channelSamples.assign(channels, std::vector<int32_t>(maxBlockSize));
+        return true;
+    }
+
+    int SampleRate() const override {
+        return sampleRate;
+    }
+
+    int Channels() const override {
+        return channels;
+    }
+
+    size_t Read(float* out, size_t frames) override {
+        size_t written = 0;
+        while (written < frames) {
+            if (blockPosition == blockFrames) {
+                if (finished || !NextFrame()) {
+                    finished = true;
+                    break;
+                }
+            }
+
+            size_t count = std::min(frames - written, blockFrames - blockPosition);
+            float* dst = out + written * channels;
+            for (int c = 0; c < channels; ++c) {
+                const int32_t* src = channelSamples[c].data() + blockPosition;
+                for (size_t i = 0; i < count; ++i) dst[i * channels + c] = src[i] * scale;
+            }
+            blockPosition += count;
+            written += count;
+        }
+
+        if (frameStart - released >= RELEASE_BYTES) {
+            file.Release(released, frameStart - released);
+            released = frameStart;
+        }
+        return written;
+    }
+
+private:
+    static constexpr size_t RELEASE_BYTES = 1 << 20;
+
+    MappedFile file;
+    BitReader reader;
+    int sampleRate = 0;
+    int channels = 0;
+    int bitsPerSample = 0;
+    size_t maxBlockSize = 0;
+    float scale = 0.0f;
+
+    size_t frameStart = 0;
+    size_t released = 0;
+    bool finished = false;
+
+    std::vector<std::vector<int32_t>> channelSamples;
+    size_t blockFrames = 0;
+    size_t blockPosition = 0;
+
+    // Decodes the frame at frameStart. A corrupt frame skips ahead to the next sync code.
+    bool NextFrame() {
+        while (frameStart + 2 <= file.Size()) {
+            if (DecodeFrame()) return true;
+            if (!Resync()) return false;
+        }
+        return false;
+    }
+
+    bool Resync() {
+        const uint8_t* p = file.Data();
+        for (size_t pos = frameStart + 1; pos + 1 < file.Size(); ++pos) {
+            if (p[pos] == 0xFF && (p[pos + 1] & 0xFE) == 0xF8) {
+                frameStart = pos;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static uint8_t Crc8(const uint8_t* data, size_t size) {
+        uint8_t crc = 0;
+        for (size_t i = 0; i < size; ++i) {
+            crc ^= data[i];
+            for (int b = 0; b < 8; ++b) crc = (crc & 0x80) ? static_cast<uint8_t>((crc << 1) ^ 0x07) : static_cast<uint8_t>(crc << 1);
+        }
+        return crc;
+    }
+
+    bool DecodeFrame() {
+        const uint8_t* p = file.Data();
+        reader.Reset(p, file.Size(), frameStart);
+
+        if (reader.Read(14) != 0x3FFE) return false;
+        reader.Read(2);
+        uint32_t blockCode = reader.Read(4);
+        uint32_t rateCode = reader.Read(4);
+        uint32_t assignment = reader.Read(4);
+        uint32_t sizeCode = reader.Read(3);
+        reader.Read(1);
+
+        // Frame or sample number, UTF-8 style, only its length matters here. A variable blocksize
+        // stream's sample number can take 36 bits, a 0xFE lead and six more bytes.
+        uint32_t lead = reader.Read(8);
+        int extra = 0;
+        while (extra < 8 && (lead & (0x80 >> extra))) ++extra;
+        if (extra == 1 || extra == 8) return false;
+        for (int i = 1; i < extra; ++i) reader.Read(8);
+
+        size_t blockSize = 0;
+        if (blockCode == 1) blockSize = 192;
+        else if (blockCode >= 2 && blockCode <= 5) blockSize = 576u << (blockCode - 2);
+        else if (blockCode == 6) blockSize = reader.Read(8) + 1;
+        else if (blockCode == 7) blockSize = reader.Read(16) + 1;
+        else if (blockCode >= 8) blockSize = 256u << (blockCode - 8);
+        else return false;
+
+        if (rateCode == 12) reader.Read(8);
+        else if (rateCode == 13 || rateCode == 14) reader.Read(16);
+        else if (rateCode == 15) return false;
+
+        reader.AlignToByte();
+        size_t headerBytes = reader.BytePosition() - frameStart;
+        if (reader.Read(8) != Crc8(p + frameStart, headerBytes)) return false;
+
+        static const int SIZES[8] = {0, 8, 12, 0, 16, 20, 24, 0};
+        int bits = sizeCode == 0 ? bitsPerSample : SIZES[sizeCode];
+        if (bits != bitsPerSample || blockSize > maxBlockSize) return false;
+
+        int frameChannels = assignment < 8 ? static_cast<int>(assignment) + 1 : 2;
+        if (assignment > 10 || frameChannels != channels) return false;
+
+        for (int c = 0; c < channels; ++c) {
+            // The side channel needs one more bit.
+            bool side = (assignment == 8 && c == 1) || (assignment == 9 && c == 0) || (assignment == 10 && c == 1);
+            if (!DecodeSubframe(channelSamples[c].data(), blockSize, bits + (side ? 1 : 0))) return false;
+        }
+
+        reader.AlignToByte();
+        reader.Read(16);
+        if (reader.Overrun()) return false;
+
+        uint32_t* a = channels == 2 ? reinterpret_cast<uint32_t*>(channelSamples[0].data()) : nullptr;
+        uint32_t* b = channels == 2 ? reinterpret_cast<uint32_t*>(channelSamples[1].data()) : nullptr;
+        if (assignment == 8) {
+            for (size_t i = 0; i < blockSize; ++i) b[i] = a[i] - b[i];
+        } else if (assignment == 9) {
+            for (size_t i = 0; i < blockSize; ++i) a[i] += b[i];
+        } else if (assignment == 10) {
+            for (size_t i = 0; i < blockSize; ++i) {
+                uint32_t mid = (a[i] << 1) | (b[i] & 1);
+                uint32_t side = b[i];
+                a[i] = static_cast<uint32_t>(static_cast<int32_t>(mid + side) >> 1);
+                b[i] = static_cast<uint32_t>(static_cast<int32_t>(mid - side) >> 1);
+            }
+        }
+
+        frameStart = reader.BytePosition();
+        blockFrames = blockSize;
+        blockPosition = 0;
+        return true;
+    }
+
+    bool DecodeSubframe(int32_t* out, size_t blockSize, int bits) {
+        if (reader.Read(1) != 0) return false;
+        uint32_t type = reader.Read(6);
+
+        int wasted = 0;
+        if (reader.Read(1)) wasted = static_cast<int>(reader.ReadUnary()) + 1;
+        if (wasted >= bits) return false;
+        bits -= wasted;
+
+        if (type == 0) {
+            int32_t value = reader.ReadSigned(bits);
+            std::fill(out, out + blockSize, value);
+        } else if (type == 1) {
+            for (size_t i = 0; i < blockSize; ++i) out[i] = reader.ReadSigned(bits);
+        } else if (type >= 8 && type <= 12) {
+            if (!DecodeFixed(out, blockSize, bits, type - 8)) return false;
+        } else if (type >= 32) {
+            if (!DecodeLpc(out, blockSize, bits, type - 31)) return false;
+        } else {
+            return false;
+        }
+
+        if (wasted) {
+            for (size_t i = 0; i < blockSize; ++i) out[i] = static_cast<int32_t>(static_cast<uint32_t>(out[i]) << wasted);
+        }
+        return !reader.Overrun();
+    }
+
+    bool DecodeFixed(int32_t* out, size_t blockSize, int bits, uint32_t order) {
+        if (order > blockSize) return false;
+        for (uint32_t i = 0; i < order; ++i) out[i] = reader.ReadSigned(bits);
+        if (!DecodeResidual(out, blockSize, order)) return false;
+
+        // Unsigned so a corrupt frame wraps instead of overflowing.
+        uint32_t* u = reinterpret_cast<uint32_t*>(out);
+        switch (order) {
+        case 1:
+            for (size_t i = 1; i < blockSize; ++i) u[i] += u[i - 1];
+            break;
+        case 2:
+            for (size_t i = 2; i < blockSize; ++i) u[i] += 2 * u[i - 1] - u[i - 2];
+            break;
+        case 3:
+            for (size_t i = 3; i < blockSize; ++i) u[i] += 3 * (u[i - 1] - u[i - 2]) + u[i - 3];
+            break;
+        case 4:
+            for (size_t i = 4; i < blockSize; ++i) u[i] += 4 * (u[i - 1] + u[i - 3]) - 6 * u[i - 2] - u[i - 4];
+            break;
+        }
+        return true;
+    }
+
+    bool DecodeLpc(int32_t* out, size_t blockSize, int bits, uint32_t order) {
+        if (order > blockSize) return false;
+        for (uint32_t i = 0; i < order; ++i) out[i] = reader.ReadSigned(bits);
+
+        int precision = static_cast<int>(reader.Read(4)) + 1;
+        int shift = reader.ReadSigned(5);
+        if (precision == 16 || shift < 0) return false;
+
+        int32_t coefs[32];
+        for (uint32_t i = 0; i < order; ++i) coefs[i] = reader.ReadSigned(precision);
+        if (!DecodeResidual(out, blockSize, order)) return false;
+
+        // Same rule as libFLAC, if the sum can't overflow 32 bits there's no need for 64.
+        int orderBits = 0;
+        while ((1u << (orderBits + 1)) <= order) ++orderBits;
+        if (bits + precision + orderBits <= 32) PredictLpc<uint32_t>(out, blockSize, coefs, order, shift);
+        else PredictLpc<int64_t>(out, blockSize, coefs, order, shift);
+        return true;
+    }
+
+    // The prediction is added unsigned so a corrupt frame wraps instead of overflowing.
+    template <typename Sum>
+    static void AddPrediction(int32_t& sample, Sum sum, int shift) {
+        int32_t predicted = static_cast<int32_t>(static_cast<typename std::make_signed<Sum>::type>(sum) >> shift);
+        sample = static_cast<int32_t>(static_cast<uint32_t>(sample) + static_cast<uint32_t>(predicted));
+    }
+
+    template <typename Sum, size_t... J>
+    static Sum Dot(const int32_t* coefs, const int32_t* history, std::index_sequence<J...>) {
+        return ((static_cast<Sum>(coefs[J]) * history[-1 - static_cast<int>(J)]) + ...);
+    }
+
+    // Fixed order versions are unrolled whatever the optimization level, which is worth about
+    // 4x on the one loop that can't be vectorized. 12 is the highest order the reference
+    // encoder uses.
+    template <typename Sum, uint32_t ORDER>
+    static void PredictLpcOrder(int32_t* out, size_t blockSize, const int32_t* coefs, int shift) {
+        for (size_t i = ORDER; i < blockSize; ++i) {
+            AddPrediction(out[i], Dot<Sum>(coefs, out + i, std::make_index_sequence<ORDER>()), shift);
+        }
+    }
+
+    template <typename Sum>
+    static void PredictLpc(int32_t* out, size_t blockSize, const int32_t* coefs, uint32_t order, int shift) {
+        switch (order) {
+        case 1: return PredictLpcOrder<Sum, 1>(out, blockSize, coefs, shift);
+        case 2: return PredictLpcOrder<Sum, 2>(out, blockSize, coefs, shift);
+        case 3: return PredictLpcOrder<Sum, 3>(out, blockSize, coefs, shift);
+        case 4: return PredictLpcOrder<Sum, 4>(out, blockSize, coefs, shift);
+        case 5: return PredictLpcOrder<Sum, 5>(out, blockSize, coefs, shift);
+        case 6: return PredictLpcOrder<Sum, 6>(out, blockSize, coefs, shift);
+        case 7: return PredictLpcOrder<Sum, 7>(out, blockSize, coefs, shift);
+        case 8: return PredictLpcOrder<Sum, 8>(out, blockSize, coefs, shift);
+        case 9: return PredictLpcOrder<Sum, 9>(out, blockSize, coefs, shift);
+        case 10: return PredictLpcOrder<Sum, 10>(out, blockSize, coefs, shift);
+        case 11: return PredictLpcOrder<Sum, 11>(out, blockSize, coefs, shift);
+        case 12: return PredictLpcOrder<Sum, 12>(out, blockSize, coefs, shift);
+        }
+
+        for (size_t i = order; i < blockSize; ++i) {
+            Sum sum = 0;
+            for (uint32_t j = 0; j < order; ++j) sum += static_cast<Sum>(coefs[j]) * out[i - 1 - j];
+            AddPrediction(out[i], sum, shift);
+        }
+    }
+
+    // Writes the residual into out[order..blockSize), prediction then adds onto it in place.
+    bool DecodeResidual(int32_t* out, size_t blockSize, uint32_t order) {
+        uint32_t method = reader.Read(2);
+        if (method > 1) return false;
+        int parameterBits = method == 0 ? 4 : 5;
+        uint32_t escape = method == 0 ? 15 : 31;
+
+        uint32_t partitionOrder = reader.Read(4);
+        size_t partitions = size_t(1) << partitionOrder;
+        size_t partitionSize = blockSize >> partitionOrder;
+        if (partitionSize << partitionOrder != blockSize || partitionSize < order) return false;
+
+        // A local copy, otherwise every store to out could alias the reader's state and the
+        // compiler has to reload it for each sample.
+        BitReader bits = reader;
+        size_t i = order;
+        for (size_t partition = 0; partition < partitions; ++partition) {
+            size_t end = (partition + 1) * partitionSize;
+            uint32_t parameter = bits.Read(parameterBits);
+            if (parameter == escape) {
+                int raw = static_cast<int>(bits.Read(5));
+                for (; i < end; ++i) out[i] = bits.ReadSigned(raw);
+            } else {
+                for (; i < end; ++i) out[i] = bits.ReadRice(static_cast<int>(parameter));
+            }
+            if (bits.Overrun()) return false;
+        }
+        reader = bits;
+        return true;
+    }
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+#include <ring.hpp>
+
+// Connects a channel's capture loop to one output's render loop so neither ever waits on the
+// other. Capture pushes whole frames as they come in, render pulls what its device has room for.
+//
+// Playback starts once the target is buffered. Running dry while the device still needs frames
+// plays silence, counts one underrun and waits for the target again. Input that doesn't fit is
+// dropped as it comes in and counts as an overrun, and when more than twice the target has piled
+// up (capture's clock running fast, or render stalled) render skips the oldest frames back down to
+// the target, also an overrun. After Pause render plays out what's left and goes idle without it
+// counting as an underrun.
+class JitterBuffer {
+public:
+    struct Pulled {
+        // Frames written to out, real ones first and then any silence.
+        size_t frames = 0;
+        size_t played = 0;
+        size_t skipped = 0;
+        bool underrun = false;
+    };
+
+    // Not thread safe, only call while neither side is running.
+    void Configure(int frameChannels, size_t targetFrames, size_t capacityFrames) {
+        channels = std::max(frameChannels, 1);
+        ring.Reset(capacityFrames * channels);
+        SetTarget(targetFrames);
+        paused.store(false, std::memory_order_relaxed);
+        playing = false;
+    }
+
+    size_t CapacityFrames() const {
+        return ring.Capacity() / channels;
+    }
+
+    // Either side, applies from the next Pull. At most half the capacity so skipping has room.
+    void SetTarget(size_t frames) {
+        target.store(std::min(std::max<size_t>(frames, 1), CapacityFrames() / 2), std::memory_order_relaxed);
+    }
+
+    size_t Target() const {
+        return target.load(std::memory_order_relaxed);
+    }
+
+    // Frames buffered. Exact on the consumer, at worst a little high anywhere else.
+    size_t Fill() const {
+        return ring.Available() / channels;
+    }
+
+    // Producer. Queues count frames scaled by gain and returns how many didn't fit and were dropped.
+    size_t Push(const float* frames, size_t count, float gain = 1.0f) {
+        paused.store(false, std::memory_order_relaxed);
+        size_t fits = std::min(count, ring.Space() / channels);
+        ring.Write(frames, fits * channels, gain);
+        return count - fits;
+    }
+
+    // Producer. No more input for now.
+    void Pause() {
+        paused.store(true, std::memory_order_relaxed);
+    }
+
+    bool Paused() const {
+        return paused.load(std::memory_order_relaxed);
+    }
+
+    // Consumer. Whether a stopped device has enough to start on.
+    bool Ready() const {
+        size_t fill = Fill();
+        return fill >= Target() || (Paused() && fill > 0);
+    }
+
+    // Consumer. Paused and played out.
+    bool Idle() const {
+        return Paused() && Fill() == 0;
+    }
+
+    // Consumer. Drops up to count of the oldest frames to take latency out, returns how many.
+    size_t Skip(size_t count) {
+        return ring.Skip(std::min(count, Fill()) * channels) / channels;
+    }
+
+    // Consumer. Reads up to count frames into out, padding with silence to minimum if there aren't
+    // that many, which is what the device needs to get to its next period.
+    Pulled Pull(float* out, size_t count, size_t minimum) {
+        Pulled pulled;
+        minimum = std::min(minimum, count);
+        size_t goal = Target();
+        size_t fill = Fill();
+        if (fill > goal * 2) {
+            pulled.skipped = fill - goal;
+            ring.Skip(pulled.skipped * channels);
+            fill = goal;
+        }
+
+        bool input = !Paused();
+        if (!playing && (fill >= goal || (!input && fill > 0))) playing = true;
+        if (playing) {
+            pulled.played = std::min(count, fill);
+            ring.Read(out, pulled.played * channels);
+            if (pulled.played < minimum) {
+                playing = false;
+                pulled.underrun = input;
+            }
+        }
+
+        pulled.frames = std::max(pulled.played, minimum);
+        std::fill(out + pulled.played * channels, out + pulled.frames * channels, 0.0f);
+        return pulled;
+    }
+
+private:
+    SpscRing<float> ring;
+    int channels = 1;
+    std::atomic<size_t> target{1};
+    std::atomic<bool> paused{false};
+    // Consumer only.
+    bool playing = false;
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+// Finds the smallest buffer level a stream runs at without running dry. It starts at the minimum,
+// grows by two steps on every xrun and, after a stretch of clean periods with processing headroom
+// to spare, tries one step lower. Going back down to a level that ran dry waits longer each time
+// a step down runs dry again, so the level settles just above the last one that didn't hold and
+// only rarely tries it again. Holding at that level for the whole wait means the machine got
+// better, and the steps below it go at the normal pace again.
+//
+// Driven once per device period from one thread, no locks or allocation.
+class LatencyTuner {
+public:
+    // Levels and step in frames. settle is how many clean periods to run before stepping down.
+    void Configure(size_t minimumFrames, size_t maximumFrames, size_t stepFrames, uint32_t settlePeriods) {
+        minimum = std::max<size_t>(minimumFrames, 1);
+        maximum = std::max(maximumFrames, minimum);
+        step = std::max<size_t>(stepFrames, 1);
+        settle = std::max<uint32_t>(settlePeriods, 1);
+        patience = settle;
+        level = minimum;
+        failed = 0;
+        clean = 0;
+        sinceShrink = UINT32_MAX;
+        grows = 0;
+        shrinks = 0;
+    }
+
+    // Once per period. xrun: the stream ran dry since the last call. busy: there isn't enough
+    // processing headroom to risk going lower. True if the level changed.
+    bool Update(bool xrun, bool busy) {
+        if (sinceShrink < UINT32_MAX) ++sinceShrink;
+        if (xrun) {
+            // Running dry again where it did before, or soon after stepping down.
+            if (level <= failed || sinceShrink < patience) patience = std::min(patience * 2, settle * MAX_BACKOFF);
+            failed = level;
+            clean = 0;
+            size_t grown = std::min(level + step * 2, maximum);
+            if (grown == level) return false;
+            level = grown;
+            ++grows;
+            return true;
+        }
+
+        if (busy || level == minimum) {
+            clean = 0;
+            return false;
+        }
+        size_t lower = level > minimum + step ? level - step : minimum;
+        if (++clean < (lower <= failed ? patience : settle)) return false;
+
+        // Having held at a level that ran dry before, the machine has got better.
+        if (level <= failed) failed = 0;
+        clean = 0;
+        sinceShrink = 0;
+        level = lower;
+        ++shrinks;
+        return true;
+    }
+
+    size_t Level() const {
+        return level;
+    }
+
+    uint64_t Grows() const {
+        return grows;
+    }
+
+    uint64_t Shrinks() const {
+        return shrinks;
+    }
+
+private:
+    // Longest wait before retrying a level that ran dry, as a multiple of settle.
+    static constexpr uint32_t MAX_BACKOFF = 8;
+
+    size_t minimum = 1;
+    size_t maximum = 1;
+    size_t step = 1;
+    size_t level = 1;
+    // The last level that ran dry.
+    size_t failed = 0;
+    uint32_t settle = 1;
+    uint32_t patience = 1;
+    uint32_t clean = 0;
+    uint32_t sinceShrink = UINT32_MAX;
+    uint64_t grows = 0;
+    uint64_t shrinks = 0;
+};
+
+// Tunes how much audio one output holds between capture and the speaker, in its device buffer and
+// its jitter buffer together. Running dry adds latency on its own: the device plays silence for
+// the gap and, after an underrun, the jitter buffer fills to its target again before playing. So
+// this only decides how much to refill to and when to take latency back out.
+//
+// The margin is how close the stream may get to running dry at its lowest point, just before the
+// render thread tops the device up: the device's own queue must not run out, and with what the
+// jitter buffer holds it must cover another period. A LatencyTuner grows it on xruns and steps it
+// down after clean running. Every TRIM_SECONDS, when the lowest point stayed above the margin the
+// whole time, up to a step of the oldest audio above it is skipped to bring latency back down.
+// Nothing steps down while the channel's processing takes more than BUSY of a packet's time.
+class AdaptiveLatency {
+public:
+    static constexpr float BUSY = 0.75f;
+    // How often latency may be trimmed back to the margin.
+    static constexpr double TRIM_SECONDS = 2.0;
+    // Clean running before the margin steps down, longer so a rare stall is seen before it's
+    // given up on.
+    static constexpr double SETTLE_SECONDS = 10.0;
+
+    // Starts aggressive, an eighth of a period of margin, and moves it half a period at a time.
+    void Configure(size_t periodFrames, size_t maxFrames, int sampleRate) {
+        period = std::max<size_t>(periodFrames, 1);
+        step = std::max<size_t>(period / 2, 1);
+        window = std::max<uint32_t>(static_cast<uint32_t>(TRIM_SECONDS * sampleRate / period), 1);
+        margin.Configure(period / 8, maxFrames, step, static_cast<uint32_t>(SETTLE_SECONDS * sampleRate / period));
+        lowest = SIZE_MAX;
+        armed = true;
+        counted = 0;
+        trimmed = 0;
+    }
+
+    // Once per device period, before topping the device up. padding: frames queued in the device,
+    // fill: frames in the jitter buffer. xrun: either ran dry since the last call. load: the
+    // channel's processing time over its packet time. Returns how many of the oldest frames to skip.
+    size_t Period(size_t padding, size_t fill, bool xrun, float load) {
+        bool busy = load > BUSY;
+        // Each gap it runs dry for adds to latency by itself, so a burst of xruns only grows the
+        // margin once, until a window runs clean again.
+        margin.Update(xrun && armed, busy || xrun);
+        if (xrun) armed = false;
+        if (xrun || busy) {
+            lowest = SIZE_MAX;
+            counted = 0;
+            return 0;
+        }
+
+        size_t headroom = std::min(padding, padding + fill > period ? padding + fill - period : 0);
+        lowest = std::min(lowest, headroom);
+        if (++counted < window) return 0;
+
+        size_t skip = lowest > margin.Level() ? std::min(lowest - margin.Level(), step) : 0;
+        armed = true;
+        lowest = SIZE_MAX;
+        counted = 0;
+        trimmed += skip;
+        return skip;
+    }
+
+    // What the jitter buffer fills to before playing, a period to hand the device plus the margin.
+    size_t Target() const {
+        return period + margin.Level();
+    }
+
+    size_t Margin() const {
+        return margin.Level();
+    }
+
+    uint64_t Changes() const {
+        return margin.Grows() + margin.Shrinks();
+    }
+
+    // Frames skipped to bring latency down, in total.
+    uint64_t Trimmed() const {
+        return trimmed;
+    }
+
+private:
+    LatencyTuner margin;
+    size_t period = 1;
+    size_t step = 1;
+    uint32_t window = 1;
+    size_t lowest = SIZE_MAX;
+    // An xrun grows the margin.
+    bool armed = true;
+    uint32_t counted = 0;
+    uint64_t trimmed = 0;
+};
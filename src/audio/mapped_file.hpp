@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file. Pages are only read in when touched, so opening is the
+// same cost whatever the size of the file.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // path is UTF-8.
+    bool Open(const char* path) {
+        Close();
+#ifdef _WIN32
+        int size = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+        if (size <= 0) return false;
+        std::wstring wide(size, 0);
+        MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide[0], size);
+
+        file = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            Close();
+            return false;
+        }
+
+        mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping) {
+            Close();
+            return false;
+        }
+
+        view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view) {
+            Close();
+            return false;
+        }
+        length = static_cast<size_t>(fileSize.QuadPart);
+#else
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            Close();
+            return false;
+        }
+
+        void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            Close();
+            return false;
+        }
+        view = mapped;
+        length = static_cast<size_t>(st.st_size);
+        // Playback reads front to back.
+        madvise(view, length, MADV_SEQUENTIAL);
+#endif
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view) munmap(view, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        view = nullptr;
+        length = 0;
+    }
+
+    // Hint that [offset, offset + bytes) won't be read again, so long files played front to back
+    // don't keep every page they've touched in the working set.
+    void Release(size_t offset, size_t bytes) {
+        if (!view || offset >= length) return;
+        bytes = std::min(bytes, length - offset);
+#ifdef _WIN32
+        // Unlocking pages that aren't locked drops them from the working set.
+        VirtualUnlock(const_cast<uint8_t*>(Data()) + offset, bytes);
+#else
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t start = (offset + page - 1) / page * page;
+        size_t end = (offset + bytes) / page * page;
+        if (end > start) madvise(static_cast<uint8_t*>(view) + start, end - start, MADV_DONTNEED);
+#endif
+    }
+
+    const uint8_t* Data() const {
+        return static_cast<const uint8_t*>(view);
+    }
+
+    size_t Size() const {
+        return length;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+    const void* view = nullptr;
+#else
+    int fd = -1;
+    void* view = nullptr;
+#endif
+    size_t length = 0;
+};
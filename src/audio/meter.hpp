@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Loudness reported for signals with nothing measurable in them.
+constexpr float SILENT_LUFS = -200.0f;
+
+// ITU-R BS.1770 K-weighting: a high shelf followed by a high pass, with coefficients worked out
+// for any sample rate the same way libebur128 does.
+class KWeighting {
+public:
+    void Configure(int sampleRate, int channels) {
+        state.assign(channels, {});
+        weights.assign(channels, 1.0);
+        // Surround channels of a 5.1 layout count +1.5 dB.
+        if (channels == 6) weights[4] = weights[5] = 1.41;
+
+        double pi = 3.14159265358979323846;
+        double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+        double k = std::tan(pi * f0 / sampleRate);
+        double vh = std::pow(10.0, gain / 20.0);
+        double vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1.0 + k / q + k * k;
+        shelf = {(vh + vb * k / q + k * k) / a0, 2.0 * (k * k - vh) / a0, (vh - vb * k / q + k * k) / a0,
+                 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+
+        f0 = 38.13547087602444;
+        q = 0.5003270373238773;
+        k = std::tan(pi * f0 / sampleRate);
+        a0 = 1.0 + k / q + k * k;
+        highPass = {1.0, -2.0, 1.0, 2.0 * (k * k - 1.0) / a0, (1.0 - k / q + k * k) / a0};
+    }
+
+    // Channel weighted energy of one interleaved frame after K-weighting.
+    double Frame(const float* frame, float gain = 1.0f) {
+        double energy = 0.0;
+        for (size_t c = 0; c < state.size(); ++c) {
+            double x = Filter(shelf, state[c].shelf, frame[c] * static_cast<double>(gain));
+            x = Filter(highPass, state[c].highPass, x);
+            energy += weights[c] * x * x;
+        }
+        return energy;
+    }
+
+    static double Lufs(double meanEnergy) {
+        return meanEnergy > 0.0 ? -0.691 + 10.0 * std::log10(meanEnergy) : SILENT_LUFS;
+    }
+
+    static double Energy(double lufs) {
+        return std::pow(10.0, (lufs + 0.691) / 10.0);
+    }
+
+private:
+    struct Coefficients {
+        double b0, b1, b2, a1, a2;
+    };
+
+    struct State {
+        double z1 = 0.0, z2 = 0.0;
+    };
+
+    struct ChannelState {
+        State shelf, highPass;
+    };
+
+    Coefficients shelf{}, highPass{};
+    std::vector<ChannelState> state;
+    std::vector<double> weights;
+
+    static double Filter(const Coefficients& co, State& s, double x) {
+        double y = co.b0 * x + s.z1;
+        s.z1 = co.b1 * x - co.a1 * y + s.z2;
+        s.z2 = co.b2 * x - co.a2 * y;
+        return y;
+    }
+};
+
+struct MeterLevels {
+    float peak = 0.0f;
+    float rms = 0.0f;
+    // EBU R128 momentary (400ms) and short-term (3s) loudness in LUFS.
+    float momentary = SILENT_LUFS;
+    float shortTerm = SILENT_LUFS;
+    uint64_t updatedNs = 0;
+};
+
+// Latest MeterLevels of one audio thread behind a sequence lock. The writer never waits or
+// uses a locked instruction, readers retry if they raced a write so the fields they get are
+// always from the same buffer.
+class LevelSnapshot {
+public:
+    // Only the owning audio thread calls this.
+    void Publish(const MeterLevels& levels) {
+        uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        peak.store(levels.peak, std::memory_order_relaxed);
+        rms.store(levels.rms, std::memory_order_relaxed);
+        momentary.store(levels.momentary, std::memory_order_relaxed);
+        shortTerm.store(levels.shortTerm, std::memory_order_relaxed);
+        updatedNs.store(levels.updatedNs, std::memory_order_relaxed);
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    // A write takes a few stores, so this only loops while the writer is preempted mid write.
+    MeterLevels Read() const {
+        MeterLevels levels;
+        while (true) {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            levels.peak = peak.load(std::memory_order_relaxed);
+            levels.rms = rms.load(std::memory_order_relaxed);
+            levels.momentary = momentary.load(std::memory_order_relaxed);
+            levels.shortTerm = shortTerm.load(std::memory_order_relaxed);
+            levels.updatedNs = updatedNs.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (!(before & 1) && sequence.load(std::memory_order_relaxed) == before) return levels;
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<float> peak{0.0f};
+    std::atomic<float> rms{0.0f};
+    std::atomic<float> momentary{SILENT_LUFS};
+    std::atomic<float> shortTerm{SILENT_LUFS};
+    std::atomic<uint64_t> updatedNs{0};
+};
+
+// Channel strip metering, run by the audio thread on every buffer it renders. Peak falls back
+// at 20 dB/s after a hit, RMS is averaged over about 300ms, and loudness is tracked in 100ms
+// segments like LoudnessMeter so momentary and short-term are sums over the last 4 and 30.
+class LevelMeter {
+public:
+    static constexpr double PEAK_FALL_DB_PER_SECOND = 20.0;
+    static constexpr double RMS_SECONDS = 0.3;
+    static constexpr size_t MOMENTARY_SEGMENTS = 4;
+    static constexpr size_t SHORT_TERM_SEGMENTS = 30;
+
+    void Configure(int sampleRate, int channels) {
+        this->sampleRate = sampleRate;
+        this->channels = channels;
+        weighting.Configure(sampleRate, channels);
+        segmentFrames = std::max(1, sampleRate / 10);
+        segmentPosition = 0;
+        segmentEnergy = 0.0;
+        segments.assign(SHORT_TERM_SEGMENTS, 0.0);
+        segmentCount = 0;
+        nextSegment = 0;
+        levels = MeterLevels();
+        meanSquare = 0.0;
+    }
+
+    // samples is interleaved in the configured channel count and scaled by gain before metering.
+    void Process(const float* samples, size_t frames, float gain, uint64_t nowNs, LevelSnapshot& out) {
+        if (frames == 0 || channels <= 0) return;
+
+        float peak = 0.0f;
+        double squares = 0.0;
+        for (size_t f = 0; f < frames; ++f) {
+            const float* frame = samples + f * channels;
+            for (int c = 0; c < channels; ++c) {
+                float v = frame[c] * gain;
+                peak = std::max(peak, std::fabs(v));
+                squares += static_cast<double>(v) * v;
+            }
+
+            segmentEnergy += weighting.Frame(frame, gain);
+            if (++segmentPosition == segmentFrames) EndSegment();
+        }
+
+        Update(frames, peak, squares / (static_cast<double>(frames) * channels), nowNs, out);
+    }
+
+    // Advances the meter over frames of silence without looking at any samples, for buffers the
+    // loop skips while its input is quiet.
+    void Silence(size_t frames, uint64_t nowNs, LevelSnapshot& out) {
+        if (channels <= 0) return;
+
+        size_t left = frames;
+        while (left > 0) {
+            size_t step = std::min(left, static_cast<size_t>(segmentFrames - segmentPosition));
+            segmentPosition += static_cast<int>(step);
+            left -= step;
+            if (segmentPosition == segmentFrames) EndSegment();
+        }
+        Update(frames, 0.0f, 0.0, nowNs, out);
+    }
+
+private:
+    int sampleRate = 0;
+    int channels = 0;
+    KWeighting weighting;
+    int segmentFrames = 1;
+    int segmentPosition = 0;
+    double segmentEnergy = 0.0;
+    std::vector<double> segments;
+    size_t segmentCount = 0;
+    size_t nextSegment = 0;
+    double meanSquare = 0.0;
+    MeterLevels levels;
+
+    void EndSegment() {
+        segments[nextSegment] = segmentEnergy / segmentFrames;
+        nextSegment = (nextSegment + 1) % SHORT_TERM_SEGMENTS;
+        segmentCount = std::min(segmentCount + 1, SHORT_TERM_SEGMENTS);
+        segmentEnergy = 0.0;
+        segmentPosition = 0;
+    }
+
+    // Mean energy of the last count segments, or of as many as there are so far.
+    double Window(size_t count) const {
+        count = std::min(count, segmentCount);
+        if (count == 0) return 0.0;
+        double sum = 0.0;
+        for (size_t i = 1; i <= count; ++i) sum += segments[(nextSegment + SHORT_TERM_SEGMENTS - i) % SHORT_TERM_SEGMENTS];
+        return sum / count;
+    }
+
+    void Update(size_t frames, float peak, double bufferMeanSquare, uint64_t nowNs, LevelSnapshot& out) {
+        double seconds = static_cast<double>(frames) / sampleRate;
+        float fallen = levels.peak * static_cast<float>(std::pow(10.0, -PEAK_FALL_DB_PER_SECOND * seconds / 20.0));
+        levels.peak = std::max(peak, fallen);
+
+        meanSquare += (bufferMeanSquare - meanSquare) * (1.0 - std::exp(-seconds / RMS_SECONDS));
+        levels.rms = static_cast<float>(std::sqrt(meanSquare));
+
+        levels.momentary = static_cast<float>(KWeighting::Lufs(Window(MOMENTARY_SEGMENTS)));
+        levels.shortTerm = static_cast<float>(KWeighting::Lufs(Window(SHORT_TERM_SEGMENTS)));
+        levels.updatedNs = nowNs;
+        out.Publish(levels);
+    }
+};
@@ -1,23 +1,299 @@
 use std::{
-    ffi::{CStr, CString, c_char}, fs, sync::atomic::{AtomicBool, Ordering}, thread
+    collections::HashMap, ffi::{CStr, CString, c_char}, fs
 };
 
+use serde::Serialize;
+
 use crate::files::{self, Channel};
 
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct ChannelStatsSnapshot {
+    name: [c_char; 64],
+    packets: u64,
+    underruns: u64,
+    overruns: u64,
+    discontinuities: u64,
+    timestamp_errors: u64,
+    process_p50_ns: u64,
+    process_p99_ns: u64,
+    process_max_ns: u64,
+    interval_p50_ns: u64,
+    interval_p99_ns: u64,
+    interval_max_ns: u64,
+    occupancy_p50_frames: u64,
+    occupancy_max_frames: u64,
+    jitter_p50_ns: u64,
+    jitter_max_ns: u64,
+    jitter_target_ns: u64,
+    latency_ns: u64,
+}
+
+#[repr(C)]
+struct ChannelConfig {
+    name: *const c_char,
+    input: *const c_char,
+    device: bool,
+    low_latency: bool,
+    adaptive: bool,
+    volume: f32,
+    outputs: *const *const c_char,
+    gains: *const f32,
+    output_count: usize,
+    chain: *const c_char,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct ChannelStateSnapshot {
+    name: [c_char; 64],
+    state: i32,
+    restarts: u64,
+    updates: u64,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct ChannelLatency {
+    pub(crate) name: String,
+    pub(crate) packets: u64,
+    pub(crate) underruns: u64,
+    pub(crate) overruns: u64,
+    pub(crate) discontinuities: u64,
+    pub(crate) process_p50: f32,
+    pub(crate) process_p99: f32,
+    pub(crate) process_max: f32,
+    pub(crate) interval_p50: f32,
+    pub(crate) interval_p99: f32,
+    pub(crate) interval_max: f32,
+    pub(crate) occupancy_p50: u64,
+    pub(crate) occupancy_max: u64,
+    pub(crate) jitter_p50: f32,
+    pub(crate) jitter_max: f32,
+    pub(crate) jitter_target: f32,
+    pub(crate) latency: f32,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct ChannelLevelSnapshot {
+    name: [c_char; 64],
+    peak: f32,
+    rms: f32,
+    momentary_lufs: f32,
+    short_term_lufs: f32,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct ChannelLevel {
+    pub(crate) peak: f32,
+    pub(crate) rms: f32,
+    pub(crate) momentary: f32,
+    pub(crate) short_term: f32,
+}
+
+const SPECTRUM_BANDS: usize = 64;
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct ChannelSpectrumSnapshot {
+    name: [c_char; 64],
+    frame: u64,
+    bands: [f32; SPECTRUM_BANDS],
+    peaks: [f32; SPECTRUM_BANDS],
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct ChannelSpectrum {
+    pub(crate) frame: u64,
+    pub(crate) bands: Vec<f32>,
+    pub(crate) peaks: Vec<f32>,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct BlockCostSnapshot {
+    name: [c_char; 32],
+    buffers: u64,
+    avg_ns: u64,
+    max_ns: u64,
+    load_percent: f64,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct BlockLoad {
+    pub(crate) name: String,
+    pub(crate) avg: f32,
+    pub(crate) max: f32,
+    pub(crate) load: f32,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct SoundCacheStats {
+    hits: u64,
+    misses: u64,
+    evictions: u64,
+    entries: u64,
+    bytes: u64,
+    budget_bytes: u64,
+    pcm_bytes: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct SoundAnalysisInfo {
+    duration: f64,
+    peak: f32,
+    loudness: f32,
+    trim_start: f64,
+    trim_end: f64,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct SfxInfo {
+    pub(crate) duration: f64,
+    pub(crate) peak: f32,
+    pub(crate) loudness: f32,
+    pub(crate) trim_start: f64,
+    pub(crate) trim_end: f64,
+    pub(crate) waveform: Vec<[f32; 2]>,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct SfxCache {
+    pub(crate) hits: u64,
+    pub(crate) misses: u64,
+    pub(crate) evictions: u64,
+    pub(crate) sounds: u64,
+    pub(crate) used: f32,
+    pub(crate) budget: f32,
+    pub(crate) decoded: f32,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct RecordingInfo {
+    id: u64,
+    source: [c_char; 64],
+    frames: u64,
+    bytes: u64,
+    overflows: u64,
+    failed: bool,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct Recording {
+    pub(crate) id: u64,
+    pub(crate) source: String,
+    pub(crate) frames: u64,
+    pub(crate) bytes: u64,
+    pub(crate) overflows: u64,
+    pub(crate) failed: bool,
+}
+
+impl From<&RecordingInfo> for Recording {
+    fn from(info: &RecordingInfo) -> Self {
+        Recording {
+            id: info.id,
+            source: unsafe { CStr::from_ptr(info.source.as_ptr()) }.to_string_lossy().into_owned(),
+            frames: info.frames,
+            bytes: info.bytes,
+            overflows: info.overflows,
+            failed: info.failed,
+        }
+    }
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct ReplayExportInfo {
+    id: u64,
+    source: [c_char; 64],
+    frames: u64,
+    total_frames: u64,
+    done: bool,
+    failed: bool,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct ReplayExport {
+    pub(crate) id: u64,
+    pub(crate) source: String,
+    pub(crate) progress: f32,
+    pub(crate) done: bool,
+    pub(crate) failed: bool,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct ReplayStats {
+    sources: u64,
+    chunks: u64,
+    bytes: u64,
+    seconds: f64,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct ReplayMemory {
+    pub(crate) sources: u64,
+    pub(crate) used: f32,
+    pub(crate) seconds: f64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy, Default)]
+struct TraceSummary {
+    events: u64,
+    dropped: u64,
+    threads: u64,
+}
+
+#[derive(Default, Clone, Serialize, Debug)]
+pub(crate) struct Trace {
+    pub(crate) events: u64,
+    pub(crate) dropped: u64,
+    pub(crate) threads: u64,
+}
+
+const MAX_STATS_CHANNELS: usize = 64;
+const MAX_RECORDINGS: usize = 64;
+const MAX_CHAIN_BLOCKS: usize = 32;
+
 #[link(name = "audio")]
 unsafe extern "C" {
-    static stop_audio: AtomicBool;
-
     fn get_outputs(len: *mut usize) -> *const *const c_char;
     fn get_inputs(len: *mut usize) -> *const *const c_char;
     fn get_apps(len: *mut usize) -> *const *const c_char;
     fn play_sound(file: *const c_char, device_name: *const c_char, low_latency: bool);
-    fn device_to_device(input: *const c_char, output: *const c_char, low_latency: bool, channel_name: *const c_char, path: *const c_char);
-    fn app_to_device(input: *const c_char, output: *const c_char, low_latency: bool, channel_name: *const c_char);
-    fn insert_volume(key: *const c_char, value: f32);
-    fn reset_volume();
-    fn get_volume(name: *const c_char, get: bool, device: bool) -> *const c_char;
-    fn free_cstr(ptr: *const c_char);
+    fn stop_all_sounds(fade_ms: u32);
+    fn sync_channels(configs: *const ChannelConfig, count: usize);
+    fn restart_channels();
+    fn set_channel_volume(name: *const c_char, volume: f32);
+    fn get_channel_states(out: *mut ChannelStateSnapshot, max: usize) -> usize;
+    fn set_jitter_target(ms: f32);
+    fn get_channel_stats(out: *mut ChannelStatsSnapshot, max: usize) -> usize;
+    fn reset_channel_stats();
+    fn get_channel_levels(out: *mut ChannelLevelSnapshot, max: usize) -> usize;
+    fn set_spectrum_enabled(enabled: bool);
+    fn get_channel_spectra(out: *mut ChannelSpectrumSnapshot, max: usize) -> usize;
+    fn get_block_costs(channel_name: *const c_char, out: *mut BlockCostSnapshot, max: usize) -> usize;
+    fn set_sound_cache_budget(bytes: usize);
+    fn set_sound_cache_compression(enabled: bool);
+    fn get_sound_cache_stats(out: *mut SoundCacheStats);
+    fn preload_sounds(files: *const *const c_char, count: usize, device_name: *const c_char);
+    fn analyze_sounds(files: *const *const c_char, count: usize, index_path: *const c_char);
+    fn get_sound_analysis(file: *const c_char, out: *mut SoundAnalysisInfo) -> bool;
+    fn get_sound_waveform(file: *const c_char, out: *mut f32, max_points: usize) -> usize;
+    fn set_sound_normalization(enabled: bool, target_lufs: f32);
+    fn start_recording(source: *const c_char, output: bool, path: *const c_char, format: i32, bits: i32) -> u64;
+    fn stop_recording(id: u64, out: *mut RecordingInfo) -> bool;
+    fn get_recordings(out: *mut RecordingInfo, max: usize) -> usize;
+    fn set_replay(enabled: bool, seconds: f64, budget_bytes: usize, output_device: *const c_char);
+    fn export_replay(source: *const c_char, output: bool, path: *const c_char, format: i32, bits: i32, seconds: f64) -> u64;
+    fn get_replay_exports(out: *mut ReplayExportInfo, max: usize) -> usize;
+    fn get_replay_stats(out: *mut ReplayStats);
+    fn start_trace(path: *const c_char) -> bool;
+    fn stop_trace(out: *mut TraceSummary) -> bool;
 }
 
 fn get_blocks(channel_name: String) -> String {
@@ -47,17 +323,15 @@ fn get_blocks(channel_name: String) -> String {
         let block_type = b.get("type").unwrap().as_str().unwrap_or("");
         parsed = format!("{}{}", parsed, block_type);
 
-        if let Some(time) = b.get("time") {
-            parsed = format!("{} time={}", parsed, time.as_i64().unwrap_or(0).to_string());
-        }
-        if let Some(intensity) = b.get("intensity") {
-            parsed = format!("{} intensity={}", parsed, intensity.as_i64().unwrap_or(0).to_string());
-        }
-        if let Some(amount) = b.get("amount") {
-            parsed = format!("{} amount={}", parsed, amount.as_i64().unwrap_or(0).to_string());
+        for key in ["time", "intensity", "amount", "threshold", "attack", "release", "hold", "semitones", "formant"] {
+            if let Some(value) = b.get(key) {
+                parsed = format!("{} {}={}", parsed, key, value.as_f64().unwrap_or(0.0));
+            }
         }
-        if let Some(threshold) = b.get("threshold") {
-            parsed = format!("{} threshold={}", parsed, threshold.as_i64().unwrap_or(0).to_string());
+        // Tokens are split on whitespace, so a bus name can't have any.
+        if let Some(bus) = b.get("bus").and_then(|v| v.as_str()) {
+            let bus: String = bus.trim().chars().map(|c| if c.is_whitespace() { '_' } else { c }).collect();
+            parsed = format!("{} bus={}", parsed, bus);
         }
 
         parsed = format!("{}\n", parsed);
@@ -113,6 +387,10 @@ pub(crate) fn play_sfx(file_path: &str, low_latency: bool) {
     unsafe {play_sound(file.as_ptr(), device, low_latency);}
 }
 
+pub(crate) fn stop_sfx(fade_ms: u32) {
+    unsafe {stop_all_sounds(fade_ms);}
+}
+
 pub(crate) fn apps() -> Vec<String> {
     unsafe {
         let mut len: usize = 0;
@@ -128,119 +406,418 @@ pub(crate) fn apps() -> Vec<String> {
     }
 }
 
-fn manage_device(input_device_name: String, output_device_name: String, low_latency: bool, channel_name: String) {
-    let input_cstr: Option<CString> = match input_device_name.is_empty() {
-        true => None,
-        false => Some(CString::new(input_device_name).unwrap())
-    };
-    let output_cstr: Option<CString> = match output_device_name.is_empty() {
-        true => None,
-        false => Some(CString::new(output_device_name).unwrap())
-    };
-    let name_cstr: CString = CString::new(channel_name.clone()).unwrap();
-    let path_cstr: CString = CString::new(get_blocks(channel_name)).unwrap();
-
-    let input: *const i8 = input_cstr.as_ref().map_or(std::ptr::null(), |cstr| cstr.as_ptr());
-    let output: *const i8 = output_cstr.as_ref().map_or(std::ptr::null(), |cstr| cstr.as_ptr());
-    let name: *const i8 = name_cstr.as_ptr();
-    let path: *const i8 = path_cstr.as_ptr();
+/// Device names and gains for the FFI, the output in settings if the channel has no routes.
+struct Outputs {
+    names: Vec<CString>,
+    pointers: Vec<*const c_char>,
+    gains: Vec<f32>,
+}
 
-    unsafe {device_to_device(input, output, low_latency, name, path)};
+impl Outputs {
+    fn new(routes: &[files::Route], fallback: String) -> Outputs {
+        let routes: Vec<files::Route> = if routes.is_empty() {
+            vec![files::Route { device: fallback, gain: 1.0 }]
+        } else {
+            routes.to_vec()
+        };
+        let names: Vec<CString> = routes.iter().map(|r| CString::new(r.device.clone()).unwrap_or_default()).collect();
+        let pointers: Vec<*const c_char> = names.iter().map(|n| n.as_ptr()).collect();
+        let gains: Vec<f32> = routes.iter().map(|r| r.gain).collect();
+        Outputs { names, pointers, gains }
+    }
 }
 
-fn manage_app(app_name: String, output_device_name: String, low_latency: bool, channel_name: String) {
-    let input_cstr: CString = CString::new(app_name).unwrap();
-    let output_cstr: Option<CString> = match output_device_name.is_empty() {
-        true => None,
-        false => Some(CString::new(output_device_name).unwrap())
-    };
-    let name_cstr: CString = CString::new(channel_name).unwrap();
+/// A channel with everything the engine needs kept alive for the FFI call.
+struct OwnedChannel {
+    name: CString,
+    input: CString,
+    chain: CString,
+    outputs: Outputs,
+    device: bool,
+    low_latency: bool,
+    adaptive: bool,
+    volume: f32,
+}
 
-    let input: *const i8 = input_cstr.as_ptr();
-    let output: *const i8 = output_cstr.as_ref().map_or(std::ptr::null(), |cstr| cstr.as_ptr());
-    let name: *const i8 = name_cstr.as_ptr();
+impl OwnedChannel {
+    fn new(channel: &Channel, fallback: &str, adaptive: bool) -> OwnedChannel {
+        OwnedChannel {
+            name: CString::new(channel.name.clone()).unwrap_or_default(),
+            input: CString::new(channel.device.clone()).unwrap_or_default(),
+            // App channels have no chain.
+            chain: CString::new(if channel.deviceorapp { get_blocks(channel.name.clone()) } else { String::new() }).unwrap_or_default(),
+            outputs: Outputs::new(&channel.outputs, fallback.to_string()),
+            device: channel.deviceorapp,
+            low_latency: channel.lowlatency,
+            adaptive,
+            volume: channel.volume,
+        }
+    }
 
-    unsafe {app_to_device(input, output, low_latency, name)};
+    fn config(&self) -> ChannelConfig {
+        ChannelConfig {
+            name: self.name.as_ptr(),
+            input: self.input.as_ptr(),
+            device: self.device,
+            low_latency: self.low_latency,
+            adaptive: self.adaptive,
+            volume: self.volume,
+            outputs: self.outputs.pointers.as_ptr(),
+            gains: self.outputs.gains.as_ptr(),
+            output_count: self.outputs.names.len(),
+            chain: self.chain.as_ptr(),
+        }
+    }
 }
 
 pub(crate) fn set_volume(channel_name: String, volume: f32) {
     let name_cstr = CString::new(channel_name).unwrap();
 
-    let name: *const i8 = name_cstr.as_ptr();
+    unsafe { set_channel_volume(name_cstr.as_ptr(), volume); }
+}
+
+#[derive(Serialize)]
+pub(crate) struct ChannelRunState {
+    name: String,
+    state: &'static str,
+    restarts: u64,
+    updates: u64,
+}
+
+/// What the engine is doing with each channel, and how often it restarted or live-updated it.
+pub(crate) fn channel_states() -> Vec<ChannelRunState> {
+    let mut snapshots: Vec<ChannelStateSnapshot> = vec![ChannelStateSnapshot { name: [0; 64], state: 0, restarts: 0, updates: 0 }; 64];
+    let count: usize = unsafe { get_channel_states(snapshots.as_mut_ptr(), snapshots.len()) };
+
+    snapshots[..count].iter().map(|s| ChannelRunState {
+        name: unsafe { CStr::from_ptr(s.name.as_ptr()) }.to_string_lossy().into_owned(),
+        state: match s.state {
+            0 => "starting",
+            1 => "running",
+            2 => "stopping",
+            3 => "stopped",
+            _ => "failed",
+        },
+        restarts: s.restarts,
+        updates: s.updates,
+    }).collect()
+}
 
-    unsafe { insert_volume(name, volume); }
+fn ns_to_ms(ns: u64) -> f32 {
+    ns as f32 / 1_000_000.0
 }
 
-pub(crate) fn get_volume_parsed(name: String, get: bool, device: bool) -> String {
-    let name_cstr = CString::new(name).unwrap();
+pub(crate) fn channel_stats() -> Vec<ChannelLatency> {
+    let mut snapshots: Vec<ChannelStatsSnapshot> = Vec::with_capacity(MAX_STATS_CHANNELS);
 
     unsafe {
-        let vol = get_volume(name_cstr.as_ptr(), get, device);
-        let string_volume: String = CStr::from_ptr(vol).to_string_lossy().into_owned();
-        free_cstr(vol);
-        string_volume
+        let len: usize = get_channel_stats(snapshots.as_mut_ptr(), MAX_STATS_CHANNELS);
+        snapshots.set_len(len.min(MAX_STATS_CHANNELS));
     }
+
+    snapshots.iter()
+        .map(|s| ChannelLatency {
+            name: unsafe { CStr::from_ptr(s.name.as_ptr()) }.to_string_lossy().into_owned(),
+            packets: s.packets,
+            underruns: s.underruns,
+            overruns: s.overruns,
+            discontinuities: s.discontinuities,
+            process_p50: ns_to_ms(s.process_p50_ns),
+            process_p99: ns_to_ms(s.process_p99_ns),
+            process_max: ns_to_ms(s.process_max_ns),
+            interval_p50: ns_to_ms(s.interval_p50_ns),
+            interval_p99: ns_to_ms(s.interval_p99_ns),
+            interval_max: ns_to_ms(s.interval_max_ns),
+            occupancy_p50: s.occupancy_p50_frames,
+            occupancy_max: s.occupancy_max_frames,
+            jitter_p50: ns_to_ms(s.jitter_p50_ns),
+            jitter_max: ns_to_ms(s.jitter_max_ns),
+            jitter_target: ns_to_ms(s.jitter_target_ns),
+            latency: ns_to_ms(s.latency_ns),
+        })
+        .collect()
 }
 
-pub(crate) fn start() {
-    if unsafe {stop_audio.load(Ordering::SeqCst) == false} {
-        println!("Audio threads already running");
-        println!("Please restart audio threads instead.");
-        return;
+pub(crate) fn channel_levels() -> HashMap<String, ChannelLevel> {
+    let mut snapshots: Vec<ChannelLevelSnapshot> = Vec::with_capacity(MAX_STATS_CHANNELS);
+
+    unsafe {
+        let len: usize = get_channel_levels(snapshots.as_mut_ptr(), MAX_STATS_CHANNELS);
+        snapshots.set_len(len.min(MAX_STATS_CHANNELS));
     }
 
+    snapshots.iter()
+        .map(|s| (
+            unsafe { CStr::from_ptr(s.name.as_ptr()) }.to_string_lossy().into_owned(),
+            ChannelLevel {
+                peak: s.peak,
+                rms: s.rms,
+                momentary: s.momentary_lufs,
+                short_term: s.short_term_lufs,
+            },
+        ))
+        .collect()
+}
+
+pub(crate) fn set_spectrum(enabled: bool) {
+    unsafe { set_spectrum_enabled(enabled); }
+}
+
+pub(crate) fn channel_spectra() -> HashMap<String, ChannelSpectrum> {
+    let mut snapshots: Vec<ChannelSpectrumSnapshot> = Vec::with_capacity(MAX_STATS_CHANNELS);
+
     unsafe {
-        stop_audio.store(false, Ordering::SeqCst);
+        let len: usize = get_channel_spectra(snapshots.as_mut_ptr(), MAX_STATS_CHANNELS);
+        snapshots.set_len(len.min(MAX_STATS_CHANNELS));
     }
 
-    let channels: Vec<Channel> = files::get_channels();
+    snapshots.iter()
+        .map(|s| (
+            unsafe { CStr::from_ptr(s.name.as_ptr()) }.to_string_lossy().into_owned(),
+            ChannelSpectrum {
+                frame: s.frame,
+                bands: s.bands.to_vec(),
+                peaks: s.peaks.to_vec(),
+            },
+        ))
+        .collect()
+}
 
-    if channels.is_empty() {
-        println!("No threads to create");
-        return;
+/// Records a channel, or with output what a device plays, into the recordings folder. format is
+/// "wav" or "flac". Returns the recording id, None if it couldn't be started.
+pub(crate) fn start_record(source: &str, output: bool, format: &str, bits: i32) -> Option<u64> {
+    let dir = files::recordings_base();
+    if let Err(e) = fs::create_dir_all(&dir) {
+        eprintln!("Failed to create recordings folder: {}", e);
+        return None;
     }
 
-    for channel in channels {
-        let thread_name: String = channel.name.clone();
-        if let Err(e) = thread::Builder::new()
-            .name(thread_name.clone())
-            .spawn(move || {
-                unsafe {
-                    let channel_cstr = CString::new(channel.name.clone()).unwrap();
+    let (code, path) = recording_path(&dir, source, format, "");
+    let c_source: CString = CString::new(source).ok()?;
+    let c_path: CString = CString::new(path).ok()?;
+    let id: u64 = unsafe { start_recording(c_source.as_ptr(), output, c_path.as_ptr(), code, bits) };
+    if id == 0 { None } else { Some(id) }
+}
 
-                    let channel_name: *const i8 = channel_cstr.as_ptr();
+/// The format code and a file in dir named after source and the time.
+fn recording_path(dir: &std::path::Path, source: &str, format: &str, suffix: &str) -> (i32, String) {
+    let (code, extension) = if format == "flac" { (1, "flac") } else { (0, "wav") };
+    let stem: String = match source {
+        "" => "output".to_string(),
+        s => s.chars().map(|c| if c.is_alphanumeric() || c == '-' { c } else { '_' }).collect(),
+    };
+    let time = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH).map(|d| d.as_secs()).unwrap_or(0);
+    (code, dir.join(format!("{}-{}{}.{}", stem, time, suffix, extension)).to_string_lossy().to_string())
+}
 
-                    insert_volume(channel_name, channel.volume);
-                }
+/// Keeps the last minutes of every channel and the output in memory, 0 turns it off.
+pub(crate) fn configure_replay(minutes: u32, budget_megabytes: u32, output: &str) {
+    let c_output: CString = CString::new(output).unwrap_or_default();
+    unsafe { set_replay(minutes > 0, minutes as f64 * 60.0, budget_megabytes as usize * 1024 * 1024, c_output.as_ptr()); }
+}
 
-                if channel.deviceorapp {
-                    manage_device(channel.device, files::get_settings().output, channel.lowlatency, channel.name);
-                } else {
-                    manage_app(channel.device, files::get_settings().output, channel.lowlatency, channel.name);
-                }
-            }) {
-            eprintln!("Failed to spawn audio thread \"{}\": {}", thread_name, e);
-        }
+/// Saves the last seconds of a channel, or with output what the device played, next to the
+/// recordings. Returns the export id, None if there's no history for it.
+pub(crate) fn save_replay(source: &str, output: bool, format: &str, bits: i32, seconds: f64) -> Option<u64> {
+    let dir = files::recordings_base();
+    if let Err(e) = fs::create_dir_all(&dir) {
+        eprintln!("Failed to create recordings folder: {}", e);
+        return None;
     }
 
-    println!("Created audio threads");
+    let (code, path) = recording_path(&dir, source, format, "-replay");
+    let c_source: CString = CString::new(source).ok()?;
+    let c_path: CString = CString::new(path).ok()?;
+    let id: u64 = unsafe { export_replay(c_source.as_ptr(), output, c_path.as_ptr(), code, bits, seconds) };
+    if id == 0 { None } else { Some(id) }
 }
 
-pub(crate) fn restart() {
-    thread::Builder::new()
-        .name("audio_restart".to_string())
-        .spawn(|| {
-            println!("Restarting audio threads");
+pub(crate) fn replay_exports() -> Vec<ReplayExport> {
+    let mut infos: Vec<ReplayExportInfo> = Vec::with_capacity(MAX_RECORDINGS);
+
+    unsafe {
+        let len: usize = get_replay_exports(infos.as_mut_ptr(), MAX_RECORDINGS);
+        infos.set_len(len.min(MAX_RECORDINGS));
+    }
 
-            unsafe {
-                reset_volume();
+    infos.iter()
+        .map(|e| ReplayExport {
+            id: e.id,
+            source: unsafe { CStr::from_ptr(e.source.as_ptr()) }.to_string_lossy().into_owned(),
+            progress: if e.total_frames > 0 { e.frames as f32 / e.total_frames as f32 } else { 1.0 },
+            done: e.done,
+            failed: e.failed,
+        })
+        .collect()
+}
 
-                stop_audio.store(true, Ordering::SeqCst);
-            }
+pub(crate) fn replay_memory() -> ReplayMemory {
+    let mut stats: ReplayStats = ReplayStats::default();
+    unsafe { get_replay_stats(&mut stats); }
+
+    ReplayMemory {
+        sources: stats.sources,
+        used: stats.bytes as f32 / (1024.0 * 1024.0),
+        seconds: stats.seconds,
+    }
+}
+
+/// Starts tracing every audio thread to a Chrome trace file under Traces, returns its path.
+pub(crate) fn begin_trace() -> Option<String> {
+    let dir = files::traces_base();
+    if let Err(e) = fs::create_dir_all(&dir) {
+        eprintln!("Failed to create traces folder: {}", e);
+        return None;
+    }
+
+    let time = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH).map(|d| d.as_secs()).unwrap_or(0);
+    let path: String = dir.join(format!("trace-{}.json", time)).to_string_lossy().to_string();
+    let c_path: CString = CString::new(path.clone()).ok()?;
+    if unsafe { start_trace(c_path.as_ptr()) } { Some(path) } else { None }
+}
+
+pub(crate) fn end_trace() -> Option<Trace> {
+    let mut summary: TraceSummary = TraceSummary::default();
+    if !unsafe { stop_trace(&mut summary) } {
+        return None;
+    }
+    Some(Trace { events: summary.events, dropped: summary.dropped, threads: summary.threads })
+}
+
+pub(crate) fn stop_record(id: u64) -> Option<Recording> {
+    let mut info: RecordingInfo = RecordingInfo { id: 0, source: [0; 64], frames: 0, bytes: 0, overflows: 0, failed: false };
+    let stopped: bool = unsafe { stop_recording(id, &mut info) };
+    if info.id == 0 && !stopped {
+        return None;
+    }
+    Some(Recording::from(&info))
+}
+
+pub(crate) fn recordings() -> Vec<Recording> {
+    let mut infos: Vec<RecordingInfo> = Vec::with_capacity(MAX_RECORDINGS);
+
+    unsafe {
+        let len: usize = get_recordings(infos.as_mut_ptr(), MAX_RECORDINGS);
+        infos.set_len(len.min(MAX_RECORDINGS));
+    }
+
+    infos.iter().map(Recording::from).collect()
+}
+
+pub(crate) fn block_costs(channel_name: String) -> Vec<BlockLoad> {
+    let name_cstr: CString = CString::new(channel_name).unwrap();
+    let mut snapshots: Vec<BlockCostSnapshot> = Vec::with_capacity(MAX_CHAIN_BLOCKS);
 
-            std::thread::sleep(std::time::Duration::from_millis(500));
-            
-            start();
+    unsafe {
+        let len: usize = get_block_costs(name_cstr.as_ptr(), snapshots.as_mut_ptr(), MAX_CHAIN_BLOCKS);
+        snapshots.set_len(len.min(MAX_CHAIN_BLOCKS));
+    }
+
+    snapshots.iter()
+        .map(|s| BlockLoad {
+            name: unsafe { CStr::from_ptr(s.name.as_ptr()) }.to_string_lossy().into_owned(),
+            avg: ns_to_ms(s.avg_ns),
+            max: ns_to_ms(s.max_ns),
+            load: s.load_percent as f32,
         })
-        .expect("Failed to spawn audio restart thread");
+        .collect()
+}
+
+pub(crate) fn clear_channel_stats() {
+    unsafe { reset_channel_stats(); }
+}
+
+pub(crate) fn set_sfx_cache_budget(megabytes: u32) {
+    unsafe { set_sound_cache_budget(megabytes as usize * 1024 * 1024); }
+}
+
+pub(crate) fn set_sfx_compression(enabled: bool) {
+    unsafe { set_sound_cache_compression(enabled); }
+}
+
+pub(crate) fn preload_sfx(file_paths: Vec<String>) {
+    let output: String = files::get_settings().output;
+    let c_device: CString = CString::new(output).unwrap_or_default();
+
+    let c_files: Vec<CString> = file_paths.into_iter().filter_map(|p| CString::new(p).ok()).collect();
+    let ptrs: Vec<*const c_char> = c_files.iter().map(|c| c.as_ptr()).collect();
+
+    unsafe { preload_sounds(ptrs.as_ptr(), ptrs.len(), c_device.as_ptr()); }
+}
+
+pub(crate) fn analyze_sfx(file_paths: Vec<String>) {
+    let index: String = files::app_base().join("soundboard.idx").to_string_lossy().to_string();
+    let c_index: CString = CString::new(index).unwrap_or_default();
+
+    let c_files: Vec<CString> = file_paths.into_iter().filter_map(|p| CString::new(p).ok()).collect();
+    let ptrs: Vec<*const c_char> = c_files.iter().map(|c| c.as_ptr()).collect();
+
+    unsafe { analyze_sounds(ptrs.as_ptr(), ptrs.len(), c_index.as_ptr()); }
+}
+
+pub(crate) fn sfx_info(file_path: &str, points: usize) -> Option<SfxInfo> {
+    let file: CString = CString::new(file_path).ok()?;
+    let mut info: SoundAnalysisInfo = SoundAnalysisInfo::default();
+    if !unsafe { get_sound_analysis(file.as_ptr(), &mut info) } {
+        return None;
+    }
+
+    let mut waveform: Vec<f32> = vec![0.0; points * 2];
+    let count: usize = unsafe { get_sound_waveform(file.as_ptr(), waveform.as_mut_ptr(), points) };
+
+    Some(SfxInfo {
+        duration: info.duration,
+        peak: info.peak,
+        loudness: info.loudness,
+        trim_start: info.trim_start,
+        trim_end: info.trim_end,
+        waveform: waveform[..count * 2].chunks(2).map(|p| [p[0], p[1]]).collect(),
+    })
+}
+
+pub(crate) fn set_jitter(ms: u32) {
+    unsafe { set_jitter_target(ms as f32); }
+}
+
+pub(crate) fn set_sfx_normalization(enabled: bool) {
+    unsafe { set_sound_normalization(enabled, -16.0); }
+}
+
+pub(crate) fn sfx_cache_stats() -> SfxCache {
+    let mut stats: SoundCacheStats = SoundCacheStats::default();
+    unsafe { get_sound_cache_stats(&mut stats); }
+
+    SfxCache {
+        hits: stats.hits,
+        misses: stats.misses,
+        evictions: stats.evictions,
+        sounds: stats.entries,
+        used: stats.bytes as f32 / (1024.0 * 1024.0),
+        budget: stats.budget_bytes as f32 / (1024.0 * 1024.0),
+        decoded: stats.pcm_bytes as f32 / (1024.0 * 1024.0),
+    }
+}
+
+pub(crate) fn start() {
+    let settings = files::get_settings();
+    configure_replay(settings.replay, settings.replaycache, &settings.output);
+    set_jitter(settings.jitter);
+
+    sync();
+}
+
+/// Brings the running channels in line with the saved ones. Channels that didn't change keep
+/// streaming, new chains and outputs are swapped into running ones and only a new input restarts.
+pub(crate) fn sync() {
+    let settings = files::get_settings();
+    let channels: Vec<OwnedChannel> = files::get_channels().iter().map(|c| OwnedChannel::new(c, &settings.output, settings.adaptive)).collect();
+    let configs: Vec<ChannelConfig> = channels.iter().map(|c| c.config()).collect();
+
+    unsafe { sync_channels(configs.as_ptr(), configs.len()); }
+}
+
+/// Stops and starts every channel, for when a device got into a bad state.
+pub(crate) fn restart() {
+    println!("Restarting audio threads");
+    unsafe { restart_channels(); }
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <fast_math.hpp>
+#include <fft.hpp>
+
+// Phase vocoder pitch shift with identity phase locking, for voice changing. Each frame's peaks
+// are moved up or down by the pitch ratio along with the bins around them, the peaks get their
+// phase advanced at their shifted frequency and every other bin keeps its offset from its peak,
+// which keeps the partials of a voice coherent instead of smearing them. The formant control moves the spectral
+// envelope separately, 0 keeps the voice's own formants whatever the pitch, setting it to the same
+// value as the pitch moves them along with it. Everything is allocated up front.
+class PitchShifter {
+public:
+    static constexpr size_t FRAME = 1024;
+    static constexpr size_t HOP = FRAME / 4;
+    // Half width in bins of the moving average the spectral envelope is taken with.
+    static constexpr size_t ENVELOPE_BINS = 6;
+
+    PitchShifter() {
+        fft.Configure(FRAME);
+        window.resize(FRAME);
+        for (size_t i = 0; i < FRAME; ++i) {
+            window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * PI * static_cast<double>(i) / FRAME));
+        }
+        // Hann in and out at a quarter frame hop overlaps to 1.5.
+        scale = 1.0f / 1.5f;
+
+        input.resize(FRAME);
+        output.resize(FRAME);
+        accum.resize(FRAME);
+        frame.resize(FRAME);
+        for (auto* bins : {&re, &im, &lastRe, &lastIm, &outRe, &outIm, &magnitude, &envelope, &rotateRe, &rotateIm}) {
+            bins->resize(BINS);
+        }
+        region.resize(BINS);
+        offset.resize(BINS);
+        peaks.reserve(BINS);
+        sums.resize(BINS + 1);
+        Reset();
+    }
+
+    void SetShift(double semitones, double formant) {
+        ratio = static_cast<float>(std::pow(2.0, semitones / 12.0));
+        formantRatio = static_cast<float>(std::pow(2.0, formant / 12.0));
+        formantScale = 1.0f / formantRatio;
+    }
+
+    // Input to output delay in samples. A sample is done once the last of the four frames over it
+    // has been added, which is a whole frame after it came in.
+    static constexpr size_t LatencySamples() {
+        return FRAME;
+    }
+
+    void Reset() {
+        std::fill(input.begin(), input.end(), 0.0f);
+        std::fill(output.begin(), output.end(), 0.0f);
+        std::fill(accum.begin(), accum.end(), 0.0f);
+        std::fill(lastRe.begin(), lastRe.end(), 0.0f);
+        std::fill(lastIm.begin(), lastIm.end(), 0.0f);
+        std::fill(outRe.begin(), outRe.end(), 0.0f);
+        std::fill(outIm.begin(), outIm.end(), 0.0f);
+        fill = FRAME - HOP;
+        first = true;
+    }
+
+    // Shifts count samples in place.
+    void Process(float* samples, size_t count) {
+        while (count > 0) {
+            size_t n = std::min(count, FRAME - fill);
+            std::memcpy(input.data() + fill, samples, n * sizeof(float));
+            std::memcpy(samples, output.data() + fill - (FRAME - HOP), n * sizeof(float));
+            fill += n;
+            samples += n;
+            count -= n;
+
+            if (fill == FRAME) {
+                Frame();
+                std::memmove(input.data(), input.data() + HOP, (FRAME - HOP) * sizeof(float));
+                std::memcpy(output.data(), accum.data(), HOP * sizeof(float));
+                std::memmove(accum.data(), accum.data() + HOP, (FRAME - HOP) * sizeof(float));
+                std::fill(accum.end() - HOP, accum.end(), 0.0f);
+                fill = FRAME - HOP;
+            }
+        }
+    }
+
+private:
+    static constexpr size_t BINS = FRAME / 2 + 1;
+    static constexpr double PI = 3.14159265358979323846;
+    static constexpr float TWO_PI = static_cast<float>(2.0 * PI);
+
+    RealFft fft;
+    std::vector<float> window;
+    float scale = 1.0f;
+    float ratio = 1.0f;
+    float formantRatio = 1.0f;
+    float formantScale = 1.0f;
+
+    std::vector<float> input, output, accum, frame;
+    std::vector<float> re, im, lastRe, lastIm, outRe, outIm, magnitude, envelope, rotateRe, rotateIm;
+    std::vector<uint32_t> region;
+    // Bins each peak's region moves by, indexed by the peak.
+    std::vector<int> offset;
+    std::vector<uint32_t> peaks;
+    std::vector<double> sums;
+    size_t fill = 0;
+    bool first = true;
+
+    static float wrap(float angle) {
+        return angle - TWO_PI * std::floor((angle + TWO_PI * 0.5f) / TWO_PI);
+    }
+
+    void Frame() {
+        for (size_t i = 0; i < FRAME; ++i) frame[i] = input[i] * window[i];
+        fft.Forward(frame.data(), re.data(), im.data());
+        for (size_t k = 0; k < BINS; ++k) magnitude[k] = re[k] * re[k] + im[k] * im[k];
+        fastmath::sqrt(magnitude.data(), magnitude.data(), BINS);
+
+        Envelope();
+        Peaks();
+        for (uint32_t p : peaks) offset[p] = static_cast<int>(std::lround(p * ratio)) - static_cast<int>(p);
+
+        // A bin's new phase is its peak's new phase plus the offset it had from the peak, which is
+        // the bin times a rotation worked out once per peak: from the peak's phase now to where the
+        // bin it lands on was last frame, advanced by its shifted frequency over the hop.
+        const bool shifted = ratio != 1.0f;
+        if (shifted) {
+            const float binAngle = TWO_PI / FRAME;
+            for (uint32_t p : peaks) {
+                size_t target = p + offset[p];
+                float last = target < BINS ? std::sqrt(outRe[target] * outRe[target] + outIm[target] * outIm[target]) : 0.0f;
+                if (first || magnitude[p] <= 0.0f || last <= 0.0f) {
+                    rotateRe[p] = 1.0f;
+                    rotateIm[p] = 0.0f;
+                    continue;
+                }
+
+                // True frequency from how far the phase moved over the hop, in radians per hop.
+                float moved = std::atan2(im[p] * lastRe[p] - re[p] * lastIm[p], re[p] * lastRe[p] + im[p] * lastIm[p]);
+                float expected = binAngle * p * HOP;
+                float advance = (expected + wrap(moved - expected)) * ratio;
+                float ar = std::cos(advance), ai = std::sin(advance);
+
+                // last bin's phase plus the advance, minus the peak's phase now.
+                float sr = (outRe[target] * ar - outIm[target] * ai) / last;
+                float si = (outRe[target] * ai + outIm[target] * ar) / last;
+                float pr = re[p] / magnitude[p], pi = -im[p] / magnitude[p];
+                rotateRe[p] = sr * pr - si * pi;
+                rotateIm[p] = sr * pi + si * pr;
+            }
+        }
+        std::copy(re.begin(), re.end(), lastRe.begin());
+        std::copy(im.begin(), im.end(), lastIm.begin());
+
+        // Each peak's region moves as a whole so the peak keeps its shape, regions that end up
+        // overlapping going down add up and gaps between them going up stay empty.
+        std::fill(outRe.begin(), outRe.end(), 0.0f);
+        std::fill(outIm.begin(), outIm.end(), 0.0f);
+        for (size_t source = 0; source < BINS; ++source) {
+            uint32_t p = region[source];
+            long target = static_cast<long>(source) + offset[p];
+            if (target < 0 || target >= static_cast<long>(BINS)) continue;
+
+            float gain = 1.0f;
+            if (shifted || formantRatio != 1.0f) {
+                size_t formantSource = std::min(static_cast<size_t>(target * formantScale + 0.5f), BINS - 1);
+                gain = std::min(envelope[formantSource] / std::max(envelope[source], 1.0e-9f), 10.0f);
+            }
+
+            float r = re[source] * gain, i = im[source] * gain;
+            if (shifted) {
+                outRe[target] += r * rotateRe[p] - i * rotateIm[p];
+                outIm[target] += r * rotateIm[p] + i * rotateRe[p];
+            } else {
+                outRe[target] += r;
+                outIm[target] += i;
+            }
+        }
+        first = false;
+
+        fft.Inverse(outRe.data(), outIm.data(), frame.data());
+        for (size_t i = 0; i < FRAME; ++i) accum[i] += frame[i] * window[i] * scale;
+    }
+
+    // Moving average of the magnitudes, a rough spectral envelope that follows the formants but
+    // not the harmonics of a voice.
+    void Envelope() {
+        sums[0] = 0.0;
+        for (size_t k = 0; k < BINS; ++k) sums[k + 1] = sums[k] + magnitude[k];
+        for (size_t k = 0; k < BINS; ++k) {
+            size_t lo = k > ENVELOPE_BINS ? k - ENVELOPE_BINS : 0;
+            size_t hi = std::min(BINS, k + ENVELOPE_BINS + 1);
+            envelope[k] = static_cast<float>((sums[hi] - sums[lo]) / static_cast<double>(hi - lo));
+        }
+    }
+
+    // Bins louder than the two on either side, and for every bin the peak whose region it's in.
+    // Regions split halfway between neighbouring peaks.
+    void Peaks() {
+        peaks.clear();
+        for (size_t k = 2; k + 2 < BINS; ++k) {
+            float m = magnitude[k];
+            if (m > magnitude[k - 1] && m > magnitude[k - 2] && m >= magnitude[k + 1] && m >= magnitude[k + 2]) {
+                peaks.push_back(static_cast<uint32_t>(k));
+            }
+        }
+        if (peaks.empty()) peaks.push_back(0);
+
+        size_t next = 0;
+        for (size_t k = 0; k < BINS; ++k) {
+            while (next + 1 < peaks.size() && k > (peaks[next] + peaks[next + 1]) / 2) ++next;
+            region[k] = peaks[next];
+        }
+    }
+};
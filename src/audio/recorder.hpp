@@ -0,0 +1,548 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <flac_encoder.hpp>
+#include <ring.hpp>
+
+enum class RecordFormat : int32_t { Wav = 0, Flac = 1 };
+
+// One recording as the UI sees it.
+struct RecordingInfo {
+    uint64_t id;
+    char source[64];
+    uint64_t frames;
+    uint64_t bytes;
+    // Buffers the audio thread dropped because the writer fell behind.
+    uint64_t overflows;
+    bool failed;
+};
+
+// Writes a file front to back in whole CHUNK_BYTES at CHUNK_BYTES aligned offsets, unbuffered
+// so each one goes to the OS as a single large write. Only the tail and the header rewrite at
+// the end are smaller.
+class ChunkedFile {
+public:
+    static constexpr size_t CHUNK_BYTES = 256 * 1024;
+
+    bool Open(const std::string& path) {
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        file.open(std::filesystem::u8path(path), std::ios::binary | std::ios::trunc);
+        pending.reserve(CHUNK_BYTES * 2);
+        return file.is_open();
+    }
+
+    void Append(const uint8_t* data, size_t size) {
+        pending.insert(pending.end(), data, data + size);
+        size_t whole = pending.size() / CHUNK_BYTES * CHUNK_BYTES;
+        if (whole == 0) return;
+        Put(pending.data(), whole);
+        pending.erase(pending.begin(), pending.begin() + whole);
+    }
+
+    // Writes what's left and puts header over the start of the file.
+    bool Finish(const std::vector<uint8_t>& header) {
+        Put(pending.data(), pending.size());
+        pending.clear();
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(header.data()), static_cast<std::streamsize>(header.size()));
+        file.close();
+        return !failed && !file.fail();
+    }
+
+    uint64_t Bytes() const {
+        return written + pending.size();
+    }
+
+    bool Failed() const {
+        return failed;
+    }
+
+private:
+    std::ofstream file;
+    std::vector<uint8_t> pending;
+    uint64_t written = 0;
+    bool failed = false;
+
+    void Put(const uint8_t* data, size_t size) {
+        if (failed || size == 0) return;
+        file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+        failed = file.fail();
+        written += size;
+    }
+};
+
+// Turns float frames into file bytes. Header() is written first with nothing known and again
+// over the top once the stream is done, so it has to come out the same size both times.
+class RecordEncoder {
+public:
+    // Audio starts here in every format so the chunked writes line up with it.
+    static constexpr size_t HEADER_BYTES = 4096;
+
+    virtual ~RecordEncoder() = default;
+    virtual std::vector<uint8_t> Header() = 0;
+    virtual void Encode(const float* samples, size_t frames, std::vector<uint8_t>& out) = 0;
+    virtual void Flush(std::vector<uint8_t>& out) {}
+};
+
+// PCM 16/24 or float 32. The header reserves room for an RF64 ds64 chunk in a JUNK chunk so a
+// recording past 4 GB can be turned into RF64 without moving the audio.
+class WavEncoder : public RecordEncoder {
+public:
+    WavEncoder(int sampleRate, int channels, int bits) : sampleRate(sampleRate), channels(channels), bits(bits) {}
+
+    std::vector<uint8_t> Header() override {
+        uint64_t riffBytes = HEADER_BYTES - 8 + dataBytes;
+        bool rf64 = riffBytes > UINT32_MAX;
+        std::vector<uint8_t> out;
+        out.reserve(HEADER_BYTES);
+
+        Tag(out, rf64 ? "RF64" : "RIFF");
+        U32(out, rf64 ? UINT32_MAX : static_cast<uint32_t>(riffBytes));
+        Tag(out, "WAVE");
+
+        Tag(out, rf64 ? "ds64" : "JUNK");
+        U32(out, 28);
+        U64(out, rf64 ? riffBytes : 0);
+        U64(out, rf64 ? dataBytes : 0);
+        U64(out, rf64 ? dataBytes / FrameBytes() : 0);
+        U32(out, 0);
+
+        Tag(out, "fmt ");
+        U32(out, 16);
+        U16(out, bits == 32 ? 3 : 1);
+        U16(out, static_cast<uint16_t>(channels));
+        U32(out, static_cast<uint32_t>(sampleRate));
+        U32(out, static_cast<uint32_t>(sampleRate * FrameBytes()));
+        U16(out, static_cast<uint16_t>(FrameBytes()));
+        U16(out, static_cast<uint16_t>(bits));
+
+        // Pads the header out so the data chunk ends it.
+        uint32_t padding = static_cast<uint32_t>(HEADER_BYTES - out.size() - 8 - 8);
+        Tag(out, "JUNK");
+        U32(out, padding);
+        out.resize(HEADER_BYTES - 8, 0);
+
+        Tag(out, "data");
+        U32(out, rf64 ? UINT32_MAX : static_cast<uint32_t>(dataBytes));
+        return out;
+    }
+
+    void Encode(const float* samples, size_t frames, std::vector<uint8_t>& out) override {
+        size_t count = frames * channels;
+        size_t start = out.size();
+        out.resize(start + count * (bits / 8));
+        uint8_t* dst = out.data() + start;
+
+        if (bits == 32) {
+            std::memcpy(dst, samples, count * 4);
+        } else if (bits == 24) {
+            for (size_t i = 0; i < count; ++i) {
+                int32_t v = Quantize(samples[i], 8388607.0f);
+                dst[i * 3] = static_cast<uint8_t>(v);
+                dst[i * 3 + 1] = static_cast<uint8_t>(v >> 8);
+                dst[i * 3 + 2] = static_cast<uint8_t>(v >> 16);
+            }
+        } else {
+            for (size_t i = 0; i < count; ++i) {
+                int32_t v = Quantize(samples[i], 32767.0f);
+                dst[i * 2] = static_cast<uint8_t>(v);
+                dst[i * 2 + 1] = static_cast<uint8_t>(v >> 8);
+            }
+        }
+        dataBytes += count * (bits / 8);
+    }
+
+private:
+    int sampleRate;
+    int channels;
+    int bits;
+    uint64_t dataBytes = 0;
+
+    size_t FrameBytes() const {
+        return static_cast<size_t>(channels) * (bits / 8);
+    }
+
+    static int32_t Quantize(float v, float scale) {
+        return static_cast<int32_t>(std::lrint(std::max(-1.0f, std::min(1.0f, v)) * scale));
+    }
+
+    static void Tag(std::vector<uint8_t>& out, const char* tag) {
+        out.insert(out.end(), tag, tag + 4);
+    }
+
+    static void U16(std::vector<uint8_t>& out, uint16_t v) {
+        out.push_back(static_cast<uint8_t>(v));
+        out.push_back(static_cast<uint8_t>(v >> 8));
+    }
+
+    static void U32(std::vector<uint8_t>& out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+
+    static void U64(std::vector<uint8_t>& out, uint64_t v) {
+        for (int i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+};
+
+// 16 or 24 bit FLAC, a FlacEncoder block at a time.
+class FlacRecordEncoder : public RecordEncoder {
+public:
+    FlacRecordEncoder(int sampleRate, int channels, int bits) : channels(channels), bits(bits) {
+        encoder.Configure(sampleRate, channels, bits);
+        block.reserve(FlacEncoder::BLOCK_SIZE * channels);
+    }
+
+    std::vector<uint8_t> Header() override {
+        return encoder.Header(HEADER_BYTES);
+    }
+
+    void Encode(const float* samples, size_t frames, std::vector<uint8_t>& out) override {
+        float scale = static_cast<float>((1 << (bits - 1)) - 1);
+        for (size_t i = 0; i < frames * channels; ++i) {
+            block.push_back(static_cast<int32_t>(std::lrint(std::max(-1.0f, std::min(1.0f, samples[i])) * scale)));
+            if (block.size() == FlacEncoder::BLOCK_SIZE * channels) {
+                encoder.Encode(block.data(), FlacEncoder::BLOCK_SIZE, out);
+                block.clear();
+            }
+        }
+    }
+
+    void Flush(std::vector<uint8_t>& out) override {
+        if (!block.empty()) encoder.Encode(block.data(), block.size() / channels, out);
+        block.clear();
+    }
+
+private:
+    FlacEncoder encoder;
+    int channels;
+    int bits;
+    std::vector<int32_t> block;
+};
+
+// The encoder for format, null if bits isn't 16, 24 or 32 (float, WAV only).
+inline std::unique_ptr<RecordEncoder> make_record_encoder(RecordFormat format, int sampleRate, int channels, int bits) {
+    if (bits != 16 && bits != 24 && !(bits == 32 && format == RecordFormat::Wav)) return nullptr;
+    if (format == RecordFormat::Flac) return std::make_unique<FlacRecordEncoder>(sampleRate, channels, bits);
+    return std::make_unique<WavEncoder>(sampleRate, channels, bits);
+}
+
+// The part of a recording the audio thread touches: a preallocated ring it copies frames into,
+// and a count of buffers it had to drop because the ring was full.
+class RecordTap {
+public:
+    RecordTap(size_t frames, int channels) : channels(channels), ring(frames * channels) {}
+
+    // Audio thread. Whole buffers or nothing, so a drop never leaves the channels out of step.
+    // Null samples push silence.
+    void Push(const float* samples, size_t frames, float gain) {
+        size_t count = frames * channels;
+        if (ring.Space() < count) {
+            overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        if (samples) {
+            ring.Write(samples, count, gain);
+        } else {
+            ring.Fill(count);
+        }
+    }
+
+    int channels;
+    SpscRing<float> ring;
+    std::atomic<uint64_t> overflows{0};
+};
+
+// Where a loop offers its audio for recording, one per running loop. Writing costs one relaxed
+// load while nothing records it, and a fence and a ring copy per recording while something does.
+class RecordPoint {
+public:
+    static constexpr size_t SLOTS = 4;
+
+    RecordPoint(const char* name, int sampleRate, int channels) : name(name), sampleRate(sampleRate), channels(channels) {}
+
+    const std::string name;
+    const int sampleRate;
+    const int channels;
+
+    // Audio thread, samples interleaved in channels and scaled by gain on the way in.
+    void Write(const float* samples, size_t frames, float gain = 1.0f) {
+        if (attached.load(std::memory_order_relaxed) == 0) return;
+
+        // Tells Detach a write is in progress, it waits for it to end before the tap can go.
+        uint32_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (auto& slot : slots) {
+            if (RecordTap* tap = slot.load(std::memory_order_acquire)) tap->Push(samples, frames, gain);
+        }
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    // Audio thread, for buffers the loop skips while silent so the recording keeps its timing.
+    void Silence(size_t frames) {
+        Write(nullptr, frames);
+    }
+
+    bool Attach(RecordTap* tap) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (!slot.load(std::memory_order_relaxed)) {
+                slot.store(tap, std::memory_order_release);
+                attached.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Once this returns the audio thread won't touch tap again.
+    void Detach(RecordTap* tap) {
+        if (!tap) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (slot.load(std::memory_order_relaxed) == tap) {
+                slot.store(nullptr, std::memory_order_seq_cst);
+                attached.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t s = sequence.load(std::memory_order_acquire);
+        if (s & 1) {
+            while (sequence.load(std::memory_order_acquire) == s) std::this_thread::yield();
+        }
+    }
+
+    size_t Attached() const {
+        return attached.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::mutex mutex;
+    std::atomic<RecordTap*> slots[SLOTS] = {};
+    std::atomic<size_t> attached{0};
+    std::atomic<uint32_t> sequence{0};
+};
+
+// Every recording and one writer thread that drains their taps into files. Recording stops
+// when asked to or when the loop it records ends, the writer then writes out what's left and
+// fixes up the header.
+class Recorder {
+public:
+    static constexpr double RING_SECONDS = 2.0;
+    static constexpr int DRAIN_MS = 50;
+
+    explicit Recorder(std::function<void()> on_start = {}) : onStart(std::move(on_start)) {}
+
+    ~Recorder() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    // Called when a loop starts, the point stays valid until Unregister.
+    std::shared_ptr<RecordPoint> Register(const char* name, int sampleRate, int channels) {
+        auto point = std::make_shared<RecordPoint>(name, sampleRate, channels);
+        std::lock_guard<std::mutex> lock(mutex);
+        points.push_back(point);
+        return point;
+    }
+
+    // Stops every recording of the point, the writer finishes them in the background.
+    void Unregister(const std::shared_ptr<RecordPoint>& point) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            points.erase(std::remove(points.begin(), points.end(), point), points.end());
+            for (auto& recording : recordings) {
+                if (recording->point == point) Detach(*recording);
+            }
+        }
+        wake.notify_all();
+    }
+
+    // Starts recording the running loop called source into path. bits is 16, 24 or 32 (float,
+    // WAV only). Returns the recording id, 0 if there's no such loop or the file can't be made.
+    uint64_t Start(const char* source, const char* path, RecordFormat format, int bits) {
+        if (!source || !path) return 0;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<RecordPoint> point;
+        for (auto& candidate : points) {
+            if (candidate->name == source) point = candidate;
+        }
+        if (!point) return 0;
+
+        auto recording = std::make_shared<Recording>();
+        recording->id = nextId++;
+        recording->point = point;
+        recording->tap = std::make_unique<RecordTap>(static_cast<size_t>(point->sampleRate * RING_SECONDS), point->channels);
+        recording->encoder = make_record_encoder(format, point->sampleRate, point->channels, bits);
+        if (!recording->encoder) return 0;
+
+        // Attached before the file is created, so a point with no free slot leaves nothing on disk.
+        if (!point->Attach(recording->tap.get())) return 0;
+        if (!recording->file.Open(path)) {
+            point->Detach(recording->tap.get());
+            return 0;
+        }
+        std::vector<uint8_t> header = recording->encoder->Header();
+        recording->file.Append(header.data(), header.size());
+        recordings.push_back(recording);
+        if (!thread.joinable()) thread = std::thread([this]() { Run(); });
+        return recording->id;
+    }
+
+    // Stops the recording and waits for the writer to finish its file. False if there's no
+    // such recording or the file couldn't be written.
+    bool Stop(uint64_t id, RecordingInfo* out = nullptr) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = std::find_if(recordings.begin(), recordings.end(), [&](auto& r) { return r->id == id; });
+        if (it == recordings.end()) return false;
+        std::shared_ptr<Recording> recording = *it;
+        Detach(*recording);
+        wake.notify_all();
+        finished.wait(lock, [&]() { return recording->done; });
+        if (out) *out = Info(*recording);
+        return !recording->failed;
+    }
+
+    size_t List(RecordingInfo* out, size_t max) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t written = 0;
+        for (auto& recording : recordings) {
+            if (written >= max) break;
+            out[written++] = Info(*recording);
+        }
+        return written;
+    }
+
+private:
+    struct Recording {
+        uint64_t id = 0;
+        std::shared_ptr<RecordPoint> point;
+        std::unique_ptr<RecordTap> tap;
+        std::unique_ptr<RecordEncoder> encoder;
+        ChunkedFile file;
+        std::vector<float> scratch;
+        std::vector<uint8_t> encoded;
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> bytes{0};
+        // Under the recorder's mutex.
+        bool detached = false;
+        bool done = false;
+        bool failed = false;
+    };
+
+    std::function<void()> onStart;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    std::thread thread;
+    bool stopping = false;
+    uint64_t nextId = 1;
+    std::vector<std::shared_ptr<RecordPoint>> points;
+    std::vector<std::shared_ptr<Recording>> recordings;
+
+    static RecordingInfo Info(const Recording& recording) {
+        RecordingInfo info{};
+        info.id = recording.id;
+        std::strncpy(info.source, recording.point->name.c_str(), sizeof(info.source) - 1);
+        info.frames = recording.frames.load(std::memory_order_relaxed);
+        info.bytes = recording.bytes.load(std::memory_order_relaxed);
+        info.overflows = recording.tap->overflows.load(std::memory_order_relaxed);
+        info.failed = recording.failed;
+        return info;
+    }
+
+    // With mutex held.
+    static void Detach(Recording& recording) {
+        if (recording.detached) return;
+        recording.point->Detach(recording.tap.get());
+        recording.detached = true;
+    }
+
+    // Writer thread, moves everything in the tap into the file.
+    static void Drain(Recording& recording) {
+        const size_t CHUNK_FRAMES = 4096;
+        int channels = recording.tap->channels;
+        recording.scratch.resize(CHUNK_FRAMES * channels);
+        while (size_t count = recording.tap->ring.Read(recording.scratch.data(), recording.scratch.size())) {
+            size_t frames = count / channels;
+            recording.encoded.clear();
+            recording.encoder->Encode(recording.scratch.data(), frames, recording.encoded);
+            recording.file.Append(recording.encoded.data(), recording.encoded.size());
+            recording.frames.fetch_add(frames, std::memory_order_relaxed);
+        }
+        recording.bytes.store(recording.file.Bytes(), std::memory_order_relaxed);
+    }
+
+    static bool Finish(Recording& recording) {
+        Drain(recording);
+        recording.encoded.clear();
+        recording.encoder->Flush(recording.encoded);
+        recording.file.Append(recording.encoded.data(), recording.encoded.size());
+        recording.bytes.store(recording.file.Bytes(), std::memory_order_relaxed);
+        return recording.file.Finish(recording.encoder->Header());
+    }
+
+    void Run() {
+        if (onStart) onStart();
+
+        std::vector<std::shared_ptr<Recording>> current;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(DRAIN_MS));
+                wake.wait(lock, [this]() { return stopping || !recordings.empty(); });
+                if (stopping) {
+                    for (auto& recording : recordings) Detach(*recording);
+                }
+                current = recordings;
+            }
+
+            // A recording is only detached under the mutex, so once seen detached here the
+            // audio thread is done with it and the last drain gets everything.
+            for (auto& recording : current) {
+                bool last;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    last = recording->detached;
+                }
+                if (!last) {
+                    Drain(*recording);
+                    continue;
+                }
+
+                bool ok = Finish(*recording);
+                std::lock_guard<std::mutex> lock(mutex);
+                recording->failed = !ok;
+                recording->done = true;
+                recordings.erase(std::remove(recordings.begin(), recordings.end(), recording), recordings.end());
+            }
+            current.clear();
+            finished.notify_all();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping && recordings.empty()) return;
+        }
+    }
+};
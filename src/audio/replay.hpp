@@ -0,0 +1,438 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <adpcm.hpp>
+#include <recorder.hpp>
+
+// One replay export as the UI sees it.
+struct ReplayExportInfo {
+    uint64_t id;
+    char source[64];
+    uint64_t frames;
+    uint64_t total_frames;
+    bool done;
+    bool failed;
+};
+
+struct ReplayStats {
+    uint64_t sources;
+    uint64_t chunks;
+    uint64_t bytes;
+    // The longest history any source holds.
+    double seconds;
+};
+
+// The last few minutes of every RecordPoint, kept in memory as ADPCM chunks so a clip can be
+// saved after the fact. The loops only pay for a RecordTap push, a background thread moves the
+// taps into chunks and drops what's too old or over the memory budget, and exports decode a
+// snapshot of the chunks into a file on a thread of their own.
+class ReplayBuffer {
+public:
+    // About 0.7s at 48kHz, what a source's history grows and shrinks by.
+    static constexpr size_t CHUNK_FRAMES = 16 * AdpcmClip::BLOCK_FRAMES;
+    static constexpr int DRAIN_MS = 250;
+    static constexpr size_t MAX_FINISHED_EXPORTS = 16;
+
+    explicit ReplayBuffer(std::function<void()> on_start = {}) : onStart(std::move(on_start)) {}
+
+    ~ReplayBuffer() {
+        Configure(false, 0.0, 0);
+        {
+            std::lock_guard<std::mutex> lock(exportMutex);
+            exportStopping = true;
+        }
+        exportWake.notify_all();
+        if (exportThread.joinable()) exportThread.join();
+    }
+
+    ReplayBuffer(const ReplayBuffer&) = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    // Starts or stops keeping history. Disabling drops everything kept so far.
+    void Configure(bool enabled, double seconds, size_t budgetBytes) {
+        std::thread finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            historySeconds = seconds;
+            budget = budgetBytes;
+            if (enabled != this->enabled) {
+                this->enabled = enabled;
+                for (auto& source : sources) {
+                    if (enabled) {
+                        Attach(*source);
+                    } else if (source->point) {
+                        source->point->Detach(source->tap.get());
+                    }
+                }
+                if (!enabled) {
+                    for (auto& source : sources) Clear(*source);
+                    sources.erase(std::remove_if(sources.begin(), sources.end(), [](auto& s) { return !s->point; }), sources.end());
+                }
+            }
+            if (enabled && !thread.joinable()) thread = std::thread([this]() { Run(); });
+            if (!enabled) std::swap(finished, thread);
+        }
+        wake.notify_all();
+        if (finished.joinable()) finished.join();
+    }
+
+    // Called when a loop starts. History carries on across restarts of a source with the same
+    // name and format.
+    void Add(const std::shared_ptr<RecordPoint>& point) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Source* source = nullptr;
+        for (auto& candidate : sources) {
+            if (candidate->name == point->name) source = candidate.get();
+        }
+        if (source && source->point) {
+            source->point->Detach(source->tap.get());
+            source->point.reset();
+        }
+        if (source && (source->sampleRate != point->sampleRate || source->channels != point->channels)) {
+            Clear(*source);
+            source->tap.reset();
+        }
+        if (!source) {
+            sources.push_back(std::make_unique<Source>());
+            source = sources.back().get();
+            source->name = point->name;
+        }
+        source->sampleRate = point->sampleRate;
+        source->channels = point->channels;
+        source->point = point;
+        if (enabled) Attach(*source);
+    }
+
+    // Called when a loop ends, its history stays until it ages out.
+    void Remove(const std::shared_ptr<RecordPoint>& point) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& source : sources) {
+            if (source->point != point) continue;
+            point->Detach(source->tap.get());
+            source->point.reset();
+            source->removedNs = NowNs();
+        }
+    }
+
+    // One pass of what the background thread does, public for the bench.
+    void Drain() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& source : sources) Drain(*source, false);
+        Prune();
+    }
+
+    // Saves the last seconds of source to path on the export thread. Returns the export id, 0
+    // if there's no history for source or the format isn't valid.
+    uint64_t Export(const char* source, const char* path, RecordFormat format, int bits, double seconds) {
+        if (!source || !path) return 0;
+
+        auto job = std::make_shared<ExportJob>();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Source* found = nullptr;
+            for (auto& candidate : sources) {
+                if (candidate->name == source) found = candidate.get();
+            }
+            if (!found) return 0;
+
+            // What's still in the tap or short of a chunk is the most recent audio, so take it too.
+            Drain(*found, true);
+            if (found->chunks.empty()) return 0;
+
+            job->encoder = make_record_encoder(format, found->sampleRate, found->channels, bits);
+            if (!job->encoder) return 0;
+            job->channels = found->channels;
+
+            size_t wanted = static_cast<size_t>(std::max(0.0, seconds) * found->sampleRate);
+            size_t frames = 0;
+            auto first = found->chunks.end();
+            while (first != found->chunks.begin() && frames < wanted) {
+                --first;
+                frames += first->frames;
+            }
+            job->chunks.assign(first, found->chunks.end());
+            job->skip = frames > wanted ? frames - wanted : 0;
+            job->total = frames - job->skip;
+        }
+        job->path = path;
+
+        std::lock_guard<std::mutex> lock(exportMutex);
+        job->id = nextExportId++;
+        job->info = ReplayExportInfo{};
+        job->info.id = job->id;
+        std::strncpy(job->info.source, source, sizeof(job->info.source) - 1);
+        job->info.total_frames = job->total;
+        exports.push_back(job);
+        queue.push_back(job);
+        if (!exportThread.joinable()) exportThread = std::thread([this]() { RunExports(); });
+        exportWake.notify_all();
+        return job->id;
+    }
+
+    size_t Exports(ReplayExportInfo* out, size_t max) {
+        std::lock_guard<std::mutex> lock(exportMutex);
+        size_t written = 0;
+        for (auto& job : exports) {
+            if (written >= max) break;
+            out[written] = job->info;
+            out[written++].frames = job->frames.load(std::memory_order_relaxed);
+        }
+        return written;
+    }
+
+    ReplayStats Stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        ReplayStats stats{};
+        stats.bytes = bytes;
+        for (auto& source : sources) {
+            stats.sources++;
+            stats.chunks += source->chunks.size();
+            if (source->sampleRate > 0)
+                stats.seconds = std::max(stats.seconds, static_cast<double>(source->frames) / source->sampleRate);
+        }
+        return stats;
+    }
+
+private:
+    // Null clip is a chunk of silence, which is most of a quiet channel and costs nothing.
+    struct Chunk {
+        std::shared_ptr<const AdpcmClip> clip;
+        size_t frames = 0;
+        int64_t endNs = 0;
+    };
+
+    struct Source {
+        std::string name;
+        int sampleRate = 0;
+        int channels = 0;
+        std::shared_ptr<RecordPoint> point;
+        std::unique_ptr<RecordTap> tap;
+        std::vector<float> pending;
+        std::deque<Chunk> chunks;
+        size_t frames = 0;
+        size_t bytes = 0;
+        int64_t removedNs = 0;
+    };
+
+    struct ExportJob {
+        uint64_t id = 0;
+        std::string path;
+        std::vector<Chunk> chunks;
+        size_t skip = 0;
+        size_t total = 0;
+        int channels = 0;
+        std::unique_ptr<RecordEncoder> encoder;
+        std::atomic<uint64_t> frames{0};
+        // Under exportMutex.
+        ReplayExportInfo info;
+    };
+
+    std::function<void()> onStart;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    bool enabled = false;
+    double historySeconds = 0.0;
+    size_t budget = 0;
+    size_t bytes = 0;
+    std::vector<std::unique_ptr<Source>> sources;
+
+    std::mutex exportMutex;
+    std::condition_variable exportWake;
+    std::thread exportThread;
+    bool exportStopping = false;
+    uint64_t nextExportId = 1;
+    std::vector<std::shared_ptr<ExportJob>> exports;
+    std::deque<std::shared_ptr<ExportJob>> queue;
+
+    static int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static size_t ChunkBytes(const Chunk& chunk) {
+        return sizeof(Chunk) + (chunk.clip ? chunk.clip->Bytes() + sizeof(AdpcmClip) : 0);
+    }
+
+    // Everything below runs with mutex held.
+    void Attach(Source& source) {
+        if (!source.point) return;
+        if (!source.tap) {
+            source.tap = std::make_unique<RecordTap>(static_cast<size_t>(source.sampleRate * Recorder::RING_SECONDS), source.channels);
+            source.pending.reserve(CHUNK_FRAMES * 2 * source.channels);
+        }
+        source.point->Attach(source.tap.get());
+    }
+
+    void Clear(Source& source) {
+        bytes -= source.bytes;
+        source.bytes = 0;
+        source.frames = 0;
+        source.chunks.clear();
+        source.pending.clear();
+        if (source.tap) source.tap->ring.Skip(source.tap->ring.Available());
+    }
+
+    // Moves the tap into chunks, with flush also what's short of a whole chunk.
+    void Drain(Source& source, bool flush) {
+        if (!source.tap) return;
+        size_t channels = source.channels;
+        size_t available = source.tap->ring.Available();
+        if (available) {
+            size_t start = source.pending.size();
+            source.pending.resize(start + available);
+            source.tap->ring.Read(source.pending.data() + start, available);
+        }
+
+        size_t chunkSamples = CHUNK_FRAMES * channels;
+        size_t offset = 0;
+        while (source.pending.size() - offset >= chunkSamples || (flush && source.pending.size() > offset)) {
+            size_t count = std::min(chunkSamples, source.pending.size() - offset);
+            Store(source, source.pending.data() + offset, count / channels);
+            offset += count;
+        }
+        source.pending.erase(source.pending.begin(), source.pending.begin() + offset);
+    }
+
+    void Store(Source& source, const float* samples, size_t frames) {
+        Chunk chunk;
+        chunk.frames = frames;
+        chunk.endNs = NowNs();
+        // Below half an ADPCM step it would decode to zero anyway.
+        const float* end = samples + frames * source.channels;
+        bool silent = std::all_of(samples, end, [](float v) { return std::fabs(v) < 0.5f / 32768.0f; });
+        if (!silent) chunk.clip = std::make_shared<const AdpcmClip>(AdpcmClip::Encode(samples, frames, source.channels));
+
+        size_t size = ChunkBytes(chunk);
+        source.chunks.push_back(std::move(chunk));
+        source.frames += frames;
+        source.bytes += size;
+        bytes += size;
+    }
+
+    void PopFront(Source& source) {
+        size_t size = ChunkBytes(source.chunks.front());
+        source.frames -= source.chunks.front().frames;
+        source.bytes -= size;
+        bytes -= size;
+        source.chunks.pop_front();
+    }
+
+    void Prune() {
+        int64_t now = NowNs();
+        int64_t keepNs = static_cast<int64_t>(historySeconds * 1e9);
+
+        // Sources whose loop is gone have nothing newer coming, so they age out as a whole.
+        sources.erase(std::remove_if(sources.begin(), sources.end(), [&](auto& source) {
+            if (source->point || now - source->removedNs < keepNs || (source->tap && source->tap->ring.Available())) return false;
+            bytes -= source->bytes;
+            return true;
+        }), sources.end());
+
+        for (auto& source : sources) {
+            size_t keepFrames = static_cast<size_t>(historySeconds * source->sampleRate);
+            while (!source->chunks.empty() && source->frames - source->chunks.front().frames >= keepFrames) PopFront(*source);
+        }
+
+        // Over budget, drop the oldest chunk of any source until it fits.
+        while (bytes > budget) {
+            Source* oldest = nullptr;
+            for (auto& source : sources) {
+                if (!source->chunks.empty() && (!oldest || source->chunks.front().endNs < oldest->chunks.front().endNs))
+                    oldest = source.get();
+            }
+            if (!oldest) break;
+            PopFront(*oldest);
+        }
+    }
+
+    void Run() {
+        if (onStart) onStart();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (enabled) {
+            wake.wait_for(lock, std::chrono::milliseconds(DRAIN_MS));
+            if (!enabled) break;
+            for (auto& source : sources) Drain(*source, false);
+            Prune();
+        }
+    }
+
+    static bool Write(ExportJob& job) {
+        ChunkedFile file;
+        if (!file.Open(job.path)) return false;
+        std::vector<uint8_t> encoded = job.encoder->Header();
+        file.Append(encoded.data(), encoded.size());
+
+        size_t channels = job.channels;
+        std::vector<float> block(AdpcmClip::BLOCK_FRAMES * channels);
+        size_t skip = job.skip;
+        auto put = [&](const float* samples, size_t frames) {
+            size_t skipped = std::min(skip, frames);
+            skip -= skipped;
+            if (frames == skipped) return;
+            encoded.clear();
+            job.encoder->Encode(samples + skipped * channels, frames - skipped, encoded);
+            file.Append(encoded.data(), encoded.size());
+            job.frames.fetch_add(frames - skipped, std::memory_order_relaxed);
+        };
+
+        for (const Chunk& chunk : job.chunks) {
+            if (!chunk.clip) {
+                std::fill(block.begin(), block.end(), 0.0f);
+                for (size_t done = 0; done < chunk.frames; done += AdpcmClip::BLOCK_FRAMES)
+                    put(block.data(), std::min(AdpcmClip::BLOCK_FRAMES, chunk.frames - done));
+                continue;
+            }
+            for (size_t b = 0; b < chunk.clip->BlockCount(); ++b) put(block.data(), chunk.clip->DecodeBlock(b, block.data()));
+        }
+
+        encoded.clear();
+        job.encoder->Flush(encoded);
+        file.Append(encoded.data(), encoded.size());
+        return file.Finish(job.encoder->Header());
+    }
+
+    void RunExports() {
+        if (onStart) onStart();
+
+        std::unique_lock<std::mutex> lock(exportMutex);
+        while (true) {
+            exportWake.wait(lock, [this]() { return exportStopping || !queue.empty(); });
+            if (queue.empty()) return;
+            std::shared_ptr<ExportJob> job = queue.front();
+            queue.pop_front();
+
+            lock.unlock();
+            bool ok = Write(*job);
+            job->chunks.clear();
+            lock.lock();
+
+            job->info.done = true;
+            job->info.failed = !ok;
+            // Keep the newest finished exports around for the UI.
+            size_t finished = std::count_if(exports.begin(), exports.end(), [](auto& j) { return j->info.done; });
+            for (auto it = exports.begin(); finished > MAX_FINISHED_EXPORTS && it != exports.end();) {
+                if ((*it)->info.done) {
+                    it = exports.erase(it);
+                    --finished;
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Single producer, single consumer ring of samples. Neither side blocks or allocates, so the
+// consumer can be a render thread. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity = 0) {
+        Reset(capacity);
+    }
+
+    // Not thread safe, only call while neither side is running.
+    void Reset(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        buffer.assign(size, T());
+        mask = size - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    size_t Capacity() const {
+        return buffer.size();
+    }
+
+    // Items ready to read, call from the consumer.
+    size_t Available() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+
+    // Free room, call from the producer.
+    size_t Space() const {
+        return buffer.size() - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+    }
+
+    // Writes as much of data as fits and returns how much that was.
+    size_t Write(const T* data, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = buffer.size() - (h - tail.load(std::memory_order_acquire));
+        if (count > free) count = free;
+
+        for (size_t i = 0; i < count; ++i) buffer[(h + i) & mask] = data[i];
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // Same as Write, scaling every item by gain on the way in.
+    size_t Write(const T* data, size_t count, T gain) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = buffer.size() - (h - tail.load(std::memory_order_acquire));
+        if (count > free) count = free;
+
+        for (size_t i = 0; i < count; ++i) buffer[(h + i) & mask] = data[i] * gain;
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    // Writes count copies of value, as much as fits.
+    size_t Fill(size_t count, T value = T()) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t free = buffer.size() - (h - tail.load(std::memory_order_acquire));
+        if (count > free) count = free;
+
+        for (size_t i = 0; i < count; ++i) buffer[(h + i) & mask] = value;
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t Read(T* out, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t ready = head.load(std::memory_order_acquire) - t;
+        if (count > ready) count = ready;
+
+        for (size_t i = 0; i < count; ++i) out[i] = buffer[(t + i) & mask];
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    // Drops everything readable, call from the consumer.
+    size_t Skip(size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t ready = head.load(std::memory_order_acquire) - t;
+        if (count > ready) count = ready;
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    std::vector<T> buffer;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+// Bounded multi producer, single consumer queue (Vyukov's array queue). Push never blocks or
+// allocates and fails when full.
+template <typename T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool Push(const T& value) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Moves the value out, so the queue doesn't keep anything it owns alive.
+    bool Pop(T& value) {
+        size_t pos = dequeuePos;
+        Cell& cell = cells[pos & mask];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1) < 0) return false;
+
+        value = std::move(cell.value);
+        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+        dequeuePos = pos + 1;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueuePos{0};
+    alignas(64) size_t dequeuePos = 0;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <telemetry.hpp>
+
+// A named bus one channel publishes its post-chain audio to, once per buffer, for blocks in other
+// channels to key off. One writer, any number of readers, nothing on either side locks: the peak
+// is a single atomic and the audio sits behind a sequence counter readers retry on.
+class SidechainBus {
+public:
+    static constexpr size_t MAX_SAMPLES = 8192;
+    // A publisher that hasn't written for this long is treated as silent, so a channel that
+    // stopped mid-sentence doesn't hold everything keyed off it down.
+    static constexpr uint64_t STALE_NS = 100000000;
+
+    // Writer side. Buffers longer than MAX_SAMPLES publish their first MAX_SAMPLES.
+    void Publish(const float* samples, size_t count) {
+        count = std::min(count, MAX_SAMPLES);
+        float level = 0.0f;
+        for (size_t i = 0; i < count; ++i) level = std::max(level, std::fabs(samples[i]));
+
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < count; ++i) audio[i].store(samples[i], std::memory_order_relaxed);
+        length.store(static_cast<uint32_t>(count), std::memory_order_relaxed);
+        sequence.store(seq + 2, std::memory_order_release);
+
+        peak.store(level, std::memory_order_relaxed);
+        published.store(now_ns(), std::memory_order_relaxed);
+    }
+
+    // Writer side, when the publisher goes away.
+    void Clear() {
+        peak.store(0.0f, std::memory_order_relaxed);
+        published.store(0, std::memory_order_relaxed);
+    }
+
+    // Peak of the last buffer published, 0 if it's stale. now is now_ns(), taken once per buffer.
+    float Envelope(uint64_t now) const {
+        uint64_t at = published.load(std::memory_order_relaxed);
+        if (at == 0 || (now > at && now - at > STALE_NS)) return 0.0f;
+        return peak.load(std::memory_order_relaxed);
+    }
+
+    // Copies the last buffer published into out, returns how many samples it had. Returns 0 if
+    // it's stale or the writer kept overwriting it while this read.
+    size_t Read(float* out, size_t max, uint64_t now) const {
+        uint64_t at = published.load(std::memory_order_relaxed);
+        if (at == 0 || (now > at && now - at > STALE_NS)) return 0;
+
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            uint32_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            size_t count = std::min<size_t>(length.load(std::memory_order_relaxed), max);
+            for (size_t i = 0; i < count; ++i) out[i] = audio[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) return count;
+        }
+        return 0;
+    }
+
+private:
+    friend class SidechainBuses;
+
+    std::atomic<uint32_t> sequence{0};
+    std::atomic<uint32_t> length{0};
+    std::atomic<float> peak{0.0f};
+    std::atomic<uint64_t> published{0};
+    std::atomic<float> audio[MAX_SAMPLES] = {};
+    // Under the registry's mutex.
+    bool claimed = false;
+};
+
+// Buses by name. Only looked up while a chain is built, never from the render path.
+class SidechainBuses {
+public:
+    static SidechainBuses& Instance() {
+        static SidechainBuses buses;
+        return buses;
+    }
+
+    // For readers, made on first use so a reader can come up before its publisher.
+    std::shared_ptr<SidechainBus> Get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return Find(name);
+    }
+
+    // For the one writer a bus can have, null if another chain already publishes to it.
+    std::shared_ptr<SidechainBus> Claim(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<SidechainBus> bus = Find(name);
+        if (bus->claimed) return nullptr;
+        bus->claimed = true;
+        return bus;
+    }
+
+    void Release(const std::shared_ptr<SidechainBus>& bus) {
+        if (!bus) return;
+        bus->Clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        bus->claimed = false;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<SidechainBus>> buses;
+
+    std::shared_ptr<SidechainBus> Find(const std::string& name) {
+        for (auto it = buses.begin(); it != buses.end();) {
+            it = it->second.expired() ? buses.erase(it) : std::next(it);
+        }
+        std::shared_ptr<SidechainBus> bus = buses[name].lock();
+        if (!bus) {
+            bus = std::make_shared<SidechainBus>();
+            buses[name] = bus;
+        }
+        return bus;
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <adpcm.hpp>
+
+// A whole sound already resampled and remapped to a device's rate and channel count. Either
+// samples holds float frames, or they were compressed into compressed and samples is empty.
+struct RenderedSound {
+    std::vector<float> samples;
+    AdpcmClip compressed;
+    size_t frames = 0;
+    int channels = 0;
+
+    bool IsCompressed() const {
+        return samples.empty() && compressed.Frames() > 0;
+    }
+
+    size_t Bytes() const {
+        return samples.size() * sizeof(float) + compressed.Bytes();
+    }
+
+    // What the sound would take as float frames.
+    size_t PcmBytes() const {
+        return frames * channels * sizeof(float);
+    }
+};
+
+struct SoundCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t entries;
+    uint64_t bytes;
+    uint64_t budget_bytes;
+    uint64_t pcm_bytes;
+};
+
+// LRU of rendered sounds. The key has the file's mtime and the device layout in it, so an edited
+// file or a different output device never gets a stale buffer. Sounds are handed out as shared
+// pointers, so evicting one that is still playing only drops the cache's reference.
+class SoundCache {
+public:
+    static std::string Key(const std::string& path, int64_t mtime, uint32_t rate, uint16_t channels) {
+        return path + "|" + std::to_string(mtime) + "|" + std::to_string(rate) + "|" + std::to_string(channels);
+    }
+
+    // Only lookups made for playback count towards hits and misses, not preloading.
+    std::shared_ptr<const RenderedSound> Get(const std::string& key, bool count = true) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            if (count) ++misses;
+            return nullptr;
+        }
+
+        if (count) ++hits;
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+    }
+
+    void Put(const std::string& key, std::shared_ptr<const RenderedSound> sound) {
+        if (!sound) return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (sound->Bytes() > budget) return;
+
+        auto it = index.find(key);
+        if (it != index.end()) {
+            bytes -= it->second->second->Bytes();
+            pcmBytes -= it->second->second->PcmBytes();
+            entries.erase(it->second);
+            index.erase(it);
+        }
+
+        entries.emplace_front(key, std::move(sound));
+        index[key] = entries.begin();
+        bytes += entries.front().second->Bytes();
+        pcmBytes += entries.front().second->PcmBytes();
+        Evict();
+    }
+
+    void SetBudget(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = budget_bytes;
+        Evict();
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+        bytes = 0;
+        pcmBytes = 0;
+        hits = misses = evictions = 0;
+    }
+
+    SoundCacheStats Stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return {hits, misses, evictions, static_cast<uint64_t>(entries.size()), static_cast<uint64_t>(bytes), static_cast<uint64_t>(budget),
+                static_cast<uint64_t>(pcmBytes)};
+    }
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const RenderedSound>>;
+
+    std::mutex mutex;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    size_t pcmBytes = 0;
+    size_t budget = 256ull * 1024 * 1024;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+
+    void Evict() {
+        while (bytes > budget && !entries.empty()) {
+            bytes -= entries.back().second->Bytes();
+            pcmBytes -= entries.back().second->PcmBytes();
+            index.erase(entries.back().first);
+            entries.pop_back();
+            ++evictions;
+        }
+    }
+};
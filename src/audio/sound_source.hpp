@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dsp.hpp>
+#include <mapped_file.hpp>
+
+// Something that decodes a sound file a piece at a time into interleaved float frames.
+class SoundSource {
+public:
+    virtual ~SoundSource() = default;
+
+    virtual int SampleRate() const = 0;
+    virtual int Channels() const = 0;
+
+    // Reads up to frames frames into out, returns how many were read, 0 once the file is done.
+    virtual size_t Read(float* out, size_t frames) = 0;
+};
+
+struct WavInfo {
+    SampleEncoding encoding = SampleEncoding::S16;
+    int channels = 0;
+    int sampleRate = 0;
+    size_t frameBytes = 0;
+    const uint8_t* data = nullptr;
+    uint64_t dataBytes = 0;
+};
+
+inline uint16_t read_u16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline uint32_t read_u32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t read_u64(const uint8_t* p) {
+    return static_cast<uint64_t>(read_u32(p)) | (static_cast<uint64_t>(read_u32(p + 4)) << 32);
+}
+
+// Finds the format and sample data of a RIFF/RF64 WAV in memory. Handles PCM 8/16/24/32 bit,
+// float 32/64 and WAVE_FORMAT_EXTENSIBLE with either of those, anything else returns false.
+inline bool parse_wav(const uint8_t* file, size_t size, WavInfo& info) {
+    if (size < 12 || std::memcmp(file + 8, "WAVE", 4) != 0) return false;
+
+    bool rf64 = std::memcmp(file, "RF64", 4) == 0 || std::memcmp(file, "BW64", 4) == 0;
+    if (!rf64 && std::memcmp(file, "RIFF", 4) != 0) return false;
+
+    uint64_t rf64DataBytes = 0;
+    bool haveFormat = false;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const uint8_t* chunk = file + pos;
+        uint64_t chunkSize = read_u32(chunk + 4);
+        const uint8_t* body = chunk + 8;
+        size_t bodyAvailable = size - pos - 8;
+
+        if (std::memcmp(chunk, "ds64", 4) == 0 && chunkSize >= 16 && bodyAvailable >= 16) {
+            rf64DataBytes = read_u64(body + 8);
+        } else if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && bodyAvailable >= 16) {
+            uint16_t formatTag = read_u16(body);
+            uint16_t channels = read_u16(body + 2);
+            uint32_t sampleRate = read_u32(body + 4);
+            uint16_t blockAlign = read_u16(body + 12);
+            uint16_t bits = read_u16(body + 14);
+
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format tag in the first two bytes of SubFormat.
+            if (formatTag == 0xFFFE) {
+                if (chunkSize < 40 || bodyAvailable < 40) return false;
+                formatTag = read_u16(body + 24);
+            }
+
+            if (formatTag == 1 && bits == 8) info.encoding = SampleEncoding::U8;
+            else if (formatTag == 1 && bits == 16) info.encoding = SampleEncoding::S16;
+            else if (formatTag == 1 && bits == 24) info.encoding = SampleEncoding::S24;
+            else if (formatTag == 1 && bits == 32) info.encoding = SampleEncoding::S32;
+            else if (formatTag == 3 && bits == 32) info.encoding = SampleEncoding::F32;
+            else if (formatTag == 3 && bits == 64) info.encoding = SampleEncoding::F64;
+            else return false;
+
+            if (channels == 0 || sampleRate == 0) return false;
+            info.channels = channels;
+            info.sampleRate = static_cast<int>(sampleRate);
+            info.frameBytes = channels * encoding_bytes(info.encoding);
+            if (blockAlign != info.frameBytes) return false;
+            haveFormat = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat) return false;
+            if (rf64 && chunkSize == 0xFFFFFFFF) chunkSize = rf64DataBytes;
+
+            // Recorders that were cut off leave a size that runs past the end of the file.
+            info.data = body;
+            info.dataBytes = std::min<uint64_t>(chunkSize, bodyAvailable);
+            info.dataBytes -= info.dataBytes % info.frameBytes;
+            return true;
+        }
+
+        pos += 8 + static_cast<size_t>(std::min<uint64_t>(chunkSize + (chunkSize & 1), bodyAvailable));
+    }
+    return false;
+}
+
+// Plays a WAV straight out of a memory mapping, converting a block at a time into the caller's
+// buffer with no copy of the file in between.
+class WavSource : public SoundSource {
+public:
+    bool Open(const char* path) {
+        return file.Open(path) && parse_wav(file.Data(), file.Size(), info);
+    }
+
+    int SampleRate() const override {
+        return info.sampleRate;
+    }
+
+    int Channels() const override {
+        return info.channels;
+    }
+
+    size_t Read(float* out, size_t frames) override {
+        uint64_t remaining = info.dataBytes / info.frameBytes - position;
+        if (frames > remaining) frames = static_cast<size_t>(remaining);
+        if (frames == 0) return 0;
+
+        decode_samples(info.data + position * info.frameBytes, info.encoding, out, frames * info.channels);
+        position += frames;
+
+        size_t consumed = static_cast<size_t>(info.data - file.Data() + position * info.frameBytes);
+        if (consumed - released >= RELEASE_BYTES) {
+            file.Release(released, consumed - released);
+            released = consumed;
+        }
+        return frames;
+    }
+
+    uint64_t Frames() const {
+        return info.dataBytes / info.frameBytes;
+    }
+
+private:
+    static constexpr size_t RELEASE_BYTES = 1 << 20;
+
+    MappedFile file;
+    WavInfo info;
+    uint64_t position = 0;
+    size_t released = 0;
+};
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <dsp.hpp>
+#include <ring.hpp>
+#include <sound_source.hpp>
+#include <trace.hpp>
+
+// Plays a SoundSource without decoding it all first. A StreamDecoder decodes, resamples and
+// remaps CHUNK_FRAMES at a time into a bounded ring that the render thread reads from, so memory
+// use doesn't depend on the file's length and playback can start after the first chunk.
+class SoundStream {
+public:
+    static constexpr size_t CHUNK_FRAMES = 4096;
+
+    // on_complete gets the whole converted sound if it finished within keep_frames, for caching.
+    SoundStream(std::unique_ptr<SoundSource> source, int dstRate, int dstChannels, size_t ringFrames,
+                size_t keepFrames = 0, std::function<void(std::vector<float>&&)> onComplete = {})
+        : source(std::move(source)), dstChannels(dstChannels), onComplete(std::move(onComplete)),
+          keepFrames(keepFrames), keeping(keepFrames > 0 && this->onComplete) {
+        ring.Reset(std::max(ringFrames, CHUNK_FRAMES * 2) * dstChannels);
+        resampler.Configure(this->source->Channels(), this->source->SampleRate(), dstRate);
+        decoded.resize(CHUNK_FRAMES * this->source->Channels());
+    }
+
+    SoundStream(const SoundStream&) = delete;
+    SoundStream& operator=(const SoundStream&) = delete;
+
+    // Any thread, never blocks. The decoder stops and lets go of the stream on its next pass.
+    void Stop() {
+        stopping.store(true, std::memory_order_release);
+    }
+
+    bool Stopped() const {
+        return stopping.load(std::memory_order_acquire);
+    }
+
+    // Waits up to timeout for the first chunk, true if there is something to play.
+    bool WaitReady(std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (ring.Available() == 0 && !done.load(std::memory_order_acquire)) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        return ring.Available() > 0;
+    }
+
+    // Render side, never blocks. Returns frames copied, which can be short if decoding fell behind.
+    size_t Read(float* out, size_t frames) {
+        size_t samples = ring.Read(out, frames * dstChannels);
+        return samples / dstChannels;
+    }
+
+    size_t BufferedFrames() const {
+        return ring.Available() / dstChannels;
+    }
+
+    // True once the decoder has finished and everything it produced has been read.
+    bool Finished() const {
+        return done.load(std::memory_order_acquire) && ring.Available() == 0;
+    }
+
+    // Nothing more will be decoded, whether it got to the end or was stopped.
+    bool Done() const {
+        return done.load(std::memory_order_acquire);
+    }
+
+    // Decoder only. Decodes a chunk once the last one is all in the ring and queues as much of it
+    // as fits. False if there was nothing to do, the ring being full or decoding over.
+    bool Decode() {
+        if (done.load(std::memory_order_relaxed)) return false;
+        if (Stopped()) {
+            Finish(false);
+            return false;
+        }
+
+        bool decodedChunk = false;
+        if (written == remapped.size()) {
+            TraceSpan span("decode");
+            size_t frames = source->Read(decoded.data(), CHUNK_FRAMES);
+            if (frames == 0) {
+                Finish(true);
+                return true;
+            }
+
+            int srcChannels = source->Channels();
+            size_t outFrames = resampler.Process(decoded.data(), frames, resampled);
+            remapped.resize(outFrames * dstChannels);
+            remap_channels_into(resampled.data(), outFrames, srcChannels, dstChannels, remapped.data());
+            written = 0;
+            decodedChunk = true;
+
+            if (keeping) {
+                if (kept.size() + remapped.size() > keepFrames * dstChannels) {
+                    keeping = false;
+                    std::vector<float>().swap(kept);
+                } else {
+                    kept.insert(kept.end(), remapped.begin(), remapped.end());
+                }
+            }
+        }
+
+        size_t queued = ring.Write(remapped.data() + written, remapped.size() - written);
+        written += queued;
+        return decodedChunk || queued > 0;
+    }
+
+private:
+    std::unique_ptr<SoundSource> source;
+    int dstChannels;
+    std::function<void(std::vector<float>&&)> onComplete;
+    size_t keepFrames;
+    bool keeping;
+
+    SpscRing<float> ring;
+    LinearResampler resampler;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> done{false};
+
+    // Decoder only.
+    std::vector<float> decoded;
+    std::vector<float> resampled;
+    std::vector<float> remapped;
+    std::vector<float> kept;
+    size_t written = 0;
+
+    void Finish(bool complete) {
+        source.reset();
+        done.store(true, std::memory_order_release);
+        if (complete && keeping) onComplete(std::move(kept));
+        std::vector<float>().swap(decoded);
+        std::vector<float>().swap(resampled);
+        std::vector<float>().swap(remapped);
+        std::vector<float>().swap(kept);
+    }
+};
+
+// A fixed set of threads that decode every SoundStream, so starting one never creates a thread.
+// Each thread takes new streams from its own lock free queue and moves all of its streams along
+// a chunk at a time, sleeping while every ring is full. A stream is let go of, and so freed, on
+// its decoder thread once it has been stopped, never by whoever stopped it.
+class StreamDecoder {
+public:
+    // Per thread, streams waiting to be picked up.
+    static constexpr size_t QUEUE_SIZE = 64;
+    // How long a thread whose rings are all full waits before trying again.
+    static constexpr std::chrono::milliseconds FULL_WAIT{2};
+    // How often a thread holding only finished streams looks for ones stopped since. Stop is a
+    // single store from the render thread and doesn't wake anyone, this is when they're freed.
+    static constexpr std::chrono::milliseconds STOPPED_WAIT{250};
+
+    explicit StreamDecoder(size_t threads, std::function<void()> on_start = {}, std::function<void()> on_stop = {}) {
+        if (threads == 0) threads = 1;
+        for (size_t i = 0; i < threads; ++i) workers.push_back(std::make_unique<Worker>());
+        for (auto& worker : workers) {
+            Worker* w = worker.get();
+            w->thread = std::thread([this, w, on_start, on_stop]() {
+                if (on_start) on_start();
+                Run(*w);
+                if (on_stop) on_stop();
+            });
+        }
+    }
+
+    ~StreamDecoder() {
+        for (auto& worker : workers) {
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                worker->stopping = true;
+            }
+            worker->wake.notify_all();
+        }
+        for (auto& worker : workers) worker->thread.join();
+    }
+
+    StreamDecoder(const StreamDecoder&) = delete;
+    StreamDecoder& operator=(const StreamDecoder&) = delete;
+
+    // Any thread. Queues the stream without allocating or waiting on decoding, false if every
+    // thread's queue is full. The lock only wakes a sleeping thread, nothing holds it for long.
+    bool Add(std::shared_ptr<SoundStream> stream) {
+        size_t first = next.fetch_add(1, std::memory_order_relaxed);
+        for (size_t i = 0; i < workers.size(); ++i) {
+            Worker& worker = *workers[(first + i) % workers.size()];
+            if (!worker.incoming.Push(stream)) continue;
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.pending = true;
+            }
+            worker.wake.notify_one();
+            return true;
+        }
+        return false;
+    }
+
+    size_t Size() const {
+        return workers.size();
+    }
+
+private:
+    struct Worker {
+        MpscQueue<std::shared_ptr<SoundStream>> incoming{QUEUE_SIZE};
+        std::mutex mutex;
+        std::condition_variable wake;
+        // Under mutex.
+        bool pending = false;
+        bool stopping = false;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> next{0};
+
+    void Run(Worker& worker) {
+        TraceThread trace("stream decoder");
+        std::vector<std::shared_ptr<SoundStream>> streams;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                if (worker.stopping) return;
+                worker.pending = false;
+            }
+            std::shared_ptr<SoundStream> added;
+            while (worker.incoming.Pop(added)) streams.push_back(std::move(added));
+
+            bool busy = false;
+            bool filling = false;
+            for (auto& stream : streams) {
+                busy = stream->Decode() || busy;
+                filling = filling || !stream->Done();
+            }
+            streams.erase(std::remove_if(streams.begin(), streams.end(), [](const std::shared_ptr<SoundStream>& stream) {
+                return stream->Stopped() && stream->Done();
+            }), streams.end());
+            if (busy) continue;
+
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            auto woken = [&] { return worker.stopping || worker.pending; };
+            if (streams.empty()) {
+                worker.wake.wait(lock, woken);
+            } else {
+                // Only a stream with more to decode needs its ring topped up soon.
+                TraceSpan span("sleep");
+                worker.wake.wait_for(lock, filling ? FULL_WAIT : STOPPED_WAIT, woken);
+            }
+        }
+    }
+};
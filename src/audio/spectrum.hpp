@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fast_math.hpp>
+#include <fft.hpp>
+#include <ring.hpp>
+
+constexpr size_t SPECTRUM_BANDS = 64;
+constexpr float SPECTRUM_FLOOR_DB = -100.0f;
+
+// Plain layout handed across the FFI, mirrored by ChannelSpectrumSnapshot in audio/mod.rs.
+// frame goes up by one every time the bands change, so a spectrogram adds a column per step.
+struct ChannelSpectrumSnapshot {
+    char name[64];
+    uint64_t frame;
+    float bands[SPECTRUM_BANDS];
+    float peaks[SPECTRUM_BANDS];
+};
+
+// The audio thread's end of one channel's analyzer: a ring it copies rendered buffers into.
+// Writes never wait, whatever doesn't fit while the analyzer is behind is dropped.
+class SpectrumTap {
+public:
+    SpectrumTap(const char* name, int sampleRate, int channels, const std::atomic<bool>& enabled)
+        : name(name), sampleRate(sampleRate), channels(channels), enabled(enabled),
+          ring(static_cast<size_t>(sampleRate / 4) * channels) {}
+
+    void Write(const float* samples, size_t frames) {
+        if (!enabled.load(std::memory_order_relaxed)) return;
+        ring.Write(samples, frames * channels);
+    }
+
+private:
+    friend class SpectrumProcessor;
+    friend class SpectrumAnalyzer;
+
+    std::string name;
+    int sampleRate;
+    int channels;
+    const std::atomic<bool>& enabled;
+    SpscRing<float> ring;
+
+    // Everything below belongs to the analysis thread, except published which is under the
+    // analyzer's mutex.
+    std::vector<float> scratch;
+    std::vector<float> history;
+    size_t historyPosition = 0;
+    std::vector<uint32_t> bandStart, bandEnd;
+    std::vector<float> level, peak, peakAge;
+    ChannelSpectrumSnapshot published{};
+};
+
+// Turns a tap's samples into log spaced bands. Each Analyze drains the ring, runs one Hann
+// windowed FFT over the newest SIZE frames if any audio arrived, then applies release and peak
+// hold per band. Not thread safe, SpectrumAnalyzer runs one on its own thread.
+class SpectrumProcessor {
+public:
+    static constexpr size_t SIZE = 2048;
+    static constexpr float MIN_HZ = 20.0f;
+    static constexpr float MAX_HZ = 20000.0f;
+    static constexpr float RELEASE_DB_PER_SECOND = 48.0f;
+    static constexpr float PEAK_HOLD_SECONDS = 1.0f;
+    static constexpr float PEAK_FALL_DB_PER_SECOND = 20.0f;
+
+    SpectrumProcessor() {
+        fft.Configure(SIZE);
+        window.resize(SIZE);
+        double sum = 0.0;
+        for (size_t i = 0; i < SIZE; ++i) {
+            window[i] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * 3.14159265358979323846 * i / SIZE));
+            sum += window[i];
+        }
+        // A full scale sine reads 0 dB: a bin holds amplitude * sum / 2.
+        scale = static_cast<float>(4.0 / (sum * sum));
+        windowed.resize(SIZE);
+        power.resize(SIZE / 2 + 1);
+    }
+
+    // Sets up a new tap's history and band edges, before anything analyzes it.
+    static void Prepare(SpectrumTap& tap) {
+        tap.history.assign(SIZE, 0.0f);
+        tap.level.assign(SPECTRUM_BANDS, SPECTRUM_FLOOR_DB);
+        tap.peak.assign(SPECTRUM_BANDS, SPECTRUM_FLOOR_DB);
+        tap.peakAge.assign(SPECTRUM_BANDS, 0.0f);
+        std::strncpy(tap.published.name, tap.name.c_str(), sizeof(tap.published.name) - 1);
+        std::fill(std::begin(tap.published.bands), std::end(tap.published.bands), SPECTRUM_FLOOR_DB);
+        std::fill(std::begin(tap.published.peaks), std::end(tap.published.peaks), SPECTRUM_FLOOR_DB);
+
+        // Log spaced from MIN_HZ up to MAX_HZ or Nyquist. Bands narrower than a bin at the low
+        // end just use the bin their centre falls in.
+        tap.bandStart.resize(SPECTRUM_BANDS);
+        tap.bandEnd.resize(SPECTRUM_BANDS);
+        float top = std::min(MAX_HZ, tap.sampleRate * 0.5f);
+        float binHz = static_cast<float>(tap.sampleRate) / SIZE;
+        for (size_t b = 0; b < SPECTRUM_BANDS; ++b) {
+            float low = MIN_HZ * std::pow(top / MIN_HZ, static_cast<float>(b) / SPECTRUM_BANDS);
+            float high = MIN_HZ * std::pow(top / MIN_HZ, static_cast<float>(b + 1) / SPECTRUM_BANDS);
+            uint32_t first = static_cast<uint32_t>(std::ceil(low / binHz));
+            uint32_t last = static_cast<uint32_t>(std::ceil(high / binHz));
+            if (last <= first) {
+                first = static_cast<uint32_t>(std::lround(std::sqrt(low * high) / binHz));
+                last = first + 1;
+            }
+            tap.bandStart[b] = std::min<uint32_t>(first, SIZE / 2);
+            tap.bandEnd[b] = std::min<uint32_t>(last, SIZE / 2 + 1);
+        }
+    }
+
+    // seconds since the last call, for the release and peak fall.
+    void Analyze(SpectrumTap& tap, float seconds) {
+        bool fresh = Drain(tap);
+        if (fresh) {
+            size_t start = tap.historyPosition;
+            for (size_t i = 0; i < SIZE; ++i) windowed[i] = tap.history[(start + i) % SIZE] * window[i];
+            fft.Power(windowed.data(), power.data());
+        }
+
+        float release = RELEASE_DB_PER_SECOND * seconds;
+        float fall = PEAK_FALL_DB_PER_SECOND * seconds;
+        for (size_t b = 0; b < SPECTRUM_BANDS; ++b) {
+            float db = SPECTRUM_FLOOR_DB;
+            if (fresh) {
+                float strongest = 0.0f;
+                for (uint32_t k = tap.bandStart[b]; k < tap.bandEnd[b]; ++k) strongest = std::max(strongest, power[k]);
+                db = std::max(SPECTRUM_FLOOR_DB, 0.5f * fastmath::gain_to_db(strongest * scale + 1e-20f));
+            }
+            tap.level[b] = std::max(db, tap.level[b] - release);
+
+            if (tap.level[b] >= tap.peak[b]) {
+                tap.peak[b] = tap.level[b];
+                tap.peakAge[b] = 0.0f;
+            } else if ((tap.peakAge[b] += seconds) > PEAK_HOLD_SECONDS) {
+                tap.peak[b] = std::max(tap.level[b], tap.peak[b] - fall);
+            }
+        }
+    }
+
+private:
+    RealFft fft;
+    std::vector<float> window, windowed, power;
+    float scale = 1.0f;
+
+    // Moves whatever the audio thread wrote into the tap's mono history, false if nothing had.
+    static bool Drain(SpectrumTap& tap) {
+        size_t available = tap.ring.Available();
+        if (available == 0) return false;
+
+        // Only the newest SIZE frames matter.
+        size_t keep = std::min(available, SIZE * tap.channels) / tap.channels * tap.channels;
+        tap.ring.Skip(available - keep);
+        tap.scratch.resize(keep);
+        tap.ring.Read(tap.scratch.data(), keep);
+
+        float gain = 1.0f / tap.channels;
+        for (size_t f = 0; f < keep / tap.channels; ++f) {
+            float sum = 0.0f;
+            for (int c = 0; c < tap.channels; ++c) sum += tap.scratch[f * tap.channels + c];
+            tap.history[tap.historyPosition] = sum * gain;
+            tap.historyPosition = (tap.historyPosition + 1) % SIZE;
+        }
+        return keep > 0;
+    }
+};
+
+// One low priority thread that runs a SpectrumProcessor over every tap at the UI frame rate.
+// It only runs while enabled, and taps drop their writes while it isn't.
+class SpectrumAnalyzer {
+public:
+    static constexpr int RATE_HZ = 60;
+
+    explicit SpectrumAnalyzer(std::function<void()> on_start = {}) : onStart(std::move(on_start)) {}
+
+    ~SpectrumAnalyzer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    SpectrumAnalyzer(const SpectrumAnalyzer&) = delete;
+    SpectrumAnalyzer& operator=(const SpectrumAnalyzer&) = delete;
+
+    // Called when a loop starts, the tap stays valid until Unregister.
+    std::shared_ptr<SpectrumTap> Register(const char* name, int sampleRate, int channels) {
+        auto tap = std::make_shared<SpectrumTap>(name, sampleRate, channels, enabled);
+        SpectrumProcessor::Prepare(*tap);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        taps.push_back(tap);
+        return tap;
+    }
+
+    void Unregister(const std::shared_ptr<SpectrumTap>& tap) {
+        std::lock_guard<std::mutex> lock(mutex);
+        taps.erase(std::remove(taps.begin(), taps.end(), tap), taps.end());
+    }
+
+    void SetEnabled(bool on) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            enabled.store(on, std::memory_order_relaxed);
+            if (on && !thread.joinable()) thread = std::thread([this]() { Run(); });
+        }
+        wake.notify_all();
+    }
+
+    size_t Snapshot(ChannelSpectrumSnapshot* out, size_t max) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t written = 0;
+        for (auto& tap : taps) {
+            if (written >= max) break;
+            out[written++] = tap->published;
+        }
+        return written;
+    }
+
+private:
+    std::function<void()> onStart;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    bool stopping = false;
+    std::atomic<bool> enabled{false};
+    std::vector<std::shared_ptr<SpectrumTap>> taps;
+    SpectrumProcessor processor;
+
+    void Run() {
+        if (onStart) onStart();
+
+        auto last = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<SpectrumTap>> current;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait_for(lock, std::chrono::milliseconds(1000 / RATE_HZ));
+                if (stopping) return;
+                if (!enabled.load(std::memory_order_relaxed)) {
+                    wake.wait(lock, [this]() { return stopping || enabled.load(std::memory_order_relaxed); });
+                    if (stopping) return;
+                    last = std::chrono::steady_clock::now();
+                }
+                current = taps;
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            float seconds = std::chrono::duration<float>(now - last).count();
+            last = now;
+            for (auto& tap : current) {
+                processor.Analyze(*tap, seconds);
+
+                std::lock_guard<std::mutex> lock(mutex);
+                tap->published.frame++;
+                std::copy(tap->level.begin(), tap->level.end(), tap->published.bands);
+                std::copy(tap->peak.begin(), tap->peak.end(), tap->published.peaks);
+            }
+            current.clear();
+        }
+    }
+};
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <memory>
+
+#include <meter.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VICE_HAS_TSC 1
+#endif
+
+inline int highest_bit(uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanReverse64(&index, value);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+inline uint64_t now_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Cheapest timestamp we can take per block. On x86 this is the TSC, everywhere else steady_clock.
+// Ticks are converted to nanoseconds against steady_clock, measured from the first call.
+class CycleClock {
+public:
+    static uint64_t Now() {
+#ifdef VICE_HAS_TSC
+        return __rdtsc();
+#else
+        return now_ns();
+#endif
+    }
+
+    static double TicksPerNs() {
+        const Origin& origin = GetOrigin();
+        uint64_t elapsed_ns = now_ns() - origin.ns;
+        if (elapsed_ns < 1000000) return 1.0;
+        return static_cast<double>(Now() - origin.ticks) / static_cast<double>(elapsed_ns);
+    }
+
+    static uint64_t ToNs(uint64_t ticks) {
+        return static_cast<uint64_t>(static_cast<double>(ticks) / TicksPerNs());
+    }
+
+    // Pins the calibration origin, call once early so later conversions have a long baseline.
+    static void Start() {
+        GetOrigin();
+    }
+
+private:
+    struct Origin {
+        uint64_t ticks;
+        uint64_t ns;
+    };
+
+    static const Origin& GetOrigin() {
+        static const Origin origin{Now(), now_ns()};
+        return origin;
+    }
+};
+
+// Per-block timing is on by default, it costs two timestamps per block per buffer.
+inline std::atomic<bool> block_profiling{true};
+
+// Cost of one block in a chain. Only the owning audio thread writes, so plain loads and
+// stores are enough and no locked instructions end up on the audio path.
+struct BlockCost {
+    std::atomic<const char*> name{""};
+    std::atomic<uint64_t> ticks{0};
+    std::atomic<uint64_t> max_ticks{0};
+    std::atomic<uint64_t> buffers{0};
+
+    void Add(uint64_t elapsed) {
+        ticks.store(ticks.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+        buffers.store(buffers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (elapsed > max_ticks.load(std::memory_order_relaxed)) max_ticks.store(elapsed, std::memory_order_relaxed);
+    }
+
+    void Clear() {
+        ticks.store(0, std::memory_order_relaxed);
+        max_ticks.store(0, std::memory_order_relaxed);
+        buffers.store(0, std::memory_order_relaxed);
+    }
+};
+
+// Log-linear histogram in the style of HdrHistogram. Values below 16 get their own bucket,
+// every power of two above that is split into 16 sub-buckets, so any value is reported
+// within ~6% of what was recorded. Each histogram has one writer, so recording is relaxed loads
+// and stores with no locked instructions, and the UI can read while the audio thread writes.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BITS = 4;
+    static constexpr int SUB_COUNT = 1 << SUB_BITS;
+    static constexpr int MAX_EXPONENT = 40;
+    static constexpr int BUCKETS = SUB_COUNT + (MAX_EXPONENT - SUB_BITS) * SUB_COUNT;
+
+    // Writer only.
+    void Record(uint64_t value) {
+        std::atomic<uint32_t>& count = counts[BucketFor(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total.store(total.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (value > max.load(std::memory_order_relaxed)) max.store(value, std::memory_order_relaxed);
+    }
+
+    // Upper bound of the bucket holding the given percentile (0-100).
+    uint64_t Percentile(double percentile) const {
+        uint64_t count = total.load(std::memory_order_relaxed);
+        if (count == 0) return 0;
+
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count) + 0.5);
+        if (target < 1) target = 1;
+
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= target) {
+                return std::min(BucketValue(i), Max());
+            }
+        }
+        return Max();
+    }
+
+    uint64_t Max() const {
+        return max.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const {
+        return total.load(std::memory_order_relaxed);
+    }
+
+    void Clear() {
+        for (auto& count : counts) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        total.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    static int BucketFor(uint64_t value) {
+        if (value < SUB_COUNT) return static_cast<int>(value);
+
+        int exponent = highest_bit(value);
+        if (exponent >= MAX_EXPONENT) return BUCKETS - 1;
+
+        int sub = static_cast<int>((value >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+        return SUB_COUNT + (exponent - SUB_BITS) * SUB_COUNT + sub;
+    }
+
+    static uint64_t BucketValue(int bucket) {
+        if (bucket < SUB_COUNT) return static_cast<uint64_t>(bucket);
+
+        int exponent = (bucket - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+        uint64_t sub = static_cast<uint64_t>((bucket - SUB_COUNT) % SUB_COUNT);
+        return ((SUB_COUNT + sub + 1) << (exponent - SUB_BITS)) - 1;
+    }
+
+private:
+    std::atomic<uint32_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> max{0};
+};
+
+struct ChannelStats {
+    static constexpr size_t MAX_BLOCKS = 32;
+
+    LatencyHistogram process_ns;
+    LatencyHistogram interval_ns;
+    LatencyHistogram occupancy_frames;
+    // How much the first output's jitter buffer held each time its device asked for more.
+    LatencyHistogram jitter_ns;
+    std::atomic<uint64_t> jitter_target_ns{0};
+    // What the first output held, device and jitter buffer, right after it last topped the device up.
+    std::atomic<uint64_t> latency_ns{0};
+    // Processing time over packet time, the recent peak.
+    std::atomic<float> load{0.0f};
+
+    // The capture loop's, like process_ns and interval_ns. occupancy_frames and jitter_ns are the
+    // first output's.
+    std::atomic<uint64_t> packets{0};
+    // Shared by the capture loop and every output, so these take a locked add, only on a glitch.
+    std::atomic<uint64_t> underruns{0};
+    std::atomic<uint64_t> overruns{0};
+    std::atomic<uint64_t> discontinuities{0};
+    std::atomic<uint64_t> timestamp_errors{0};
+
+    BlockCost blocks[MAX_BLOCKS];
+    std::atomic<uint32_t> block_count{0};
+
+    // Written by the audio thread's LevelMeter only, so Clear leaves it alone.
+    LevelSnapshot levels;
+
+    // Bumped to ask for a reset while the channel runs. The capture loop and the first output
+    // each clear what they write once they see it change, so nothing is cleared under a writer.
+    std::atomic<uint32_t> resets{0};
+
+    // Only while nothing writes to it.
+    void Clear() {
+        ClearCapture();
+        ClearRender();
+    }
+
+    void RequestClear() {
+        resets.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Capture loop.
+    void ClearCapture() {
+        process_ns.Clear();
+        interval_ns.Clear();
+        packets.store(0, std::memory_order_relaxed);
+        underruns.store(0, std::memory_order_relaxed);
+        overruns.store(0, std::memory_order_relaxed);
+        discontinuities.store(0, std::memory_order_relaxed);
+        timestamp_errors.store(0, std::memory_order_relaxed);
+        for (auto& block : blocks) {
+            block.Clear();
+        }
+    }
+
+    // First output's render thread.
+    void ClearRender() {
+        occupancy_frames.Clear();
+        jitter_ns.Clear();
+    }
+};
+
+// Times one pass of an audio loop: Wake() when a packet arrives, Done() when it has been written out.
+class LoopTimer {
+public:
+    explicit LoopTimer(ChannelStats* s) : stats(s), resets(s->resets.load(std::memory_order_relaxed)) {}
+
+    void Wake() {
+        uint32_t requested = stats->resets.load(std::memory_order_relaxed);
+        if (requested != resets) {
+            resets = requested;
+            stats->ClearCapture();
+        }
+
+        wake = now_ns();
+        interval = last_wake != 0 ? wake - last_wake : 0;
+        if (interval) stats->interval_ns.Record(interval);
+        last_wake = wake;
+    }
+
+    void Done() {
+        uint64_t elapsed = now_ns() - wake;
+        stats->process_ns.Record(elapsed);
+        stats->packets.store(stats->packets.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (interval) {
+            peak = std::max(static_cast<float>(elapsed) / interval, peak * LOAD_DECAY);
+            stats->load.store(peak, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    // Per packet, the peak halves in about 70.
+    static constexpr float LOAD_DECAY = 0.99f;
+
+    ChannelStats* stats;
+    uint32_t resets;
+    uint64_t wake = 0;
+    uint64_t last_wake = 0;
+    uint64_t interval = 0;
+    float peak = 0.0f;
+};
+
+// Plain layout handed across the FFI, mirrored by ChannelStatsSnapshot in audio/mod.rs.
+struct ChannelStatsSnapshot {
+    char name[64];
+    uint64_t packets;
+    uint64_t underruns;
+    uint64_t overruns;
+    uint64_t discontinuities;
+    uint64_t timestamp_errors;
+    uint64_t process_p50_ns;
+    uint64_t process_p99_ns;
+    uint64_t process_max_ns;
+    uint64_t interval_p50_ns;
+    uint64_t interval_p99_ns;
+    uint64_t interval_max_ns;
+    uint64_t occupancy_p50_frames;
+    uint64_t occupancy_max_frames;
+    uint64_t jitter_p50_ns;
+    uint64_t jitter_max_ns;
+    uint64_t jitter_target_ns;
+    uint64_t latency_ns;
+};
+
+// Mirrored by ChannelLevelSnapshot in audio/mod.rs.
+struct ChannelLevelSnapshot {
+    char name[64];
+    float peak;
+    float rms;
+    float momentary_lufs;
+    float short_term_lufs;
+};
+
+struct BlockCostSnapshot {
+    char name[32];
+    uint64_t buffers;
+    uint64_t avg_ns;
+    uint64_t max_ns;
+    double load_percent;
+};
+
+// Fixed set of slots so the audio threads keep a stable pointer. A loop claims a slot by channel
+// name when it starts and frees it when it ends, a second loop under a name still running shares
+// the first one's. A freed slot is cleared and reused by whichever channel starts next.
+class StatsRegistry {
+public:
+    static constexpr size_t MAX_CHANNELS = 64;
+
+    ChannelStats* Register(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        Slot* free_slot = nullptr;
+        for (auto& slot : slots) {
+            if (slot.users > 0 && std::strncmp(slot.name, name, sizeof(slot.name) - 1) == 0) {
+                ++slot.users;
+                return slot.stats.get();
+            }
+            if (slot.users == 0 && !free_slot) free_slot = &slot;
+        }
+
+        if (!free_slot) return &overflow;
+
+        if (!free_slot->stats) free_slot->stats = std::make_unique<ChannelStats>();
+        free_slot->stats->Clear();
+        std::snprintf(free_slot->name, sizeof(free_slot->name), "%s", name);
+        free_slot->users = 1;
+        return free_slot->stats.get();
+    }
+
+    void Unregister(ChannelStats* stats) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (slot.users > 0 && slot.stats.get() == stats) --slot.users;
+        }
+    }
+
+    size_t Snapshot(ChannelStatsSnapshot* out, size_t max) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        size_t written = 0;
+        for (auto& slot : slots) {
+            if (slot.users == 0 || written >= max) continue;
+
+            const ChannelStats& s = *slot.stats;
+            ChannelStatsSnapshot& snap = out[written++];
+            std::memset(&snap, 0, sizeof(snap));
+            std::snprintf(snap.name, sizeof(snap.name), "%.*s", static_cast<int>(sizeof(snap.name) - 1), slot.name);
+            snap.packets = s.packets.load(std::memory_order_relaxed);
+            snap.underruns = s.underruns.load(std::memory_order_relaxed);
+            snap.overruns = s.overruns.load(std::memory_order_relaxed);
+            snap.discontinuities = s.discontinuities.load(std::memory_order_relaxed);
+            snap.timestamp_errors = s.timestamp_errors.load(std::memory_order_relaxed);
+            snap.process_p50_ns = s.process_ns.Percentile(50.0);
+            snap.process_p99_ns = s.process_ns.Percentile(99.0);
+            snap.process_max_ns = s.process_ns.Max();
+            snap.interval_p50_ns = s.interval_ns.Percentile(50.0);
+            snap.interval_p99_ns = s.interval_ns.Percentile(99.0);
+            snap.interval_max_ns = s.interval_ns.Max();
+            snap.occupancy_p50_frames = s.occupancy_frames.Percentile(50.0);
+            snap.occupancy_max_frames = s.occupancy_frames.Max();
+            snap.jitter_p50_ns = s.jitter_ns.Percentile(50.0);
+            snap.jitter_max_ns = s.jitter_ns.Max();
+            snap.jitter_target_ns = s.jitter_target_ns.load(std::memory_order_relaxed);
+            snap.latency_ns = s.latency_ns.load(std::memory_order_relaxed);
+        }
+        return written;
+    }
+
+    // Current levels of every running channel. A channel that hasn't published for stale_ns
+    // (its input stopped delivering packets) reads as silent.
+    size_t Levels(ChannelLevelSnapshot* out, size_t max, uint64_t stale_ns) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        uint64_t now = now_ns();
+        size_t written = 0;
+        for (auto& slot : slots) {
+            if (slot.users == 0 || written >= max) continue;
+
+            MeterLevels levels = slot.stats->levels.Read();
+            if (now - std::min(now, levels.updatedNs) > stale_ns) levels = MeterLevels();
+
+            ChannelLevelSnapshot& snap = out[written++];
+            std::memset(&snap, 0, sizeof(snap));
+            std::snprintf(snap.name, sizeof(snap.name), "%.*s", static_cast<int>(sizeof(snap.name) - 1), slot.name);
+            snap.peak = levels.peak;
+            snap.rms = levels.rms;
+            snap.momentary_lufs = levels.momentary;
+            snap.short_term_lufs = levels.shortTerm;
+        }
+        return written;
+    }
+
+    // Per-block cost for one channel, load is the block's average time as a share of the buffer period.
+    size_t BlockCosts(const char* name, BlockCostSnapshot* out, size_t max) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        for (auto& slot : slots) {
+            if (slot.users == 0 || std::strncmp(slot.name, name, sizeof(slot.name) - 1) != 0) continue;
+
+            const ChannelStats& s = *slot.stats;
+            double period_ns = static_cast<double>(s.interval_ns.Percentile(50.0));
+            size_t count = std::min<size_t>(s.block_count.load(std::memory_order_relaxed), std::min(max, ChannelStats::MAX_BLOCKS));
+
+            for (size_t i = 0; i < count; ++i) {
+                const BlockCost& cost = s.blocks[i];
+                BlockCostSnapshot& snap = out[i];
+                std::memset(&snap, 0, sizeof(snap));
+                std::snprintf(snap.name, sizeof(snap.name), "%s", cost.name.load(std::memory_order_relaxed));
+
+                snap.buffers = cost.buffers.load(std::memory_order_relaxed);
+                uint64_t ticks = cost.ticks.load(std::memory_order_relaxed);
+                snap.avg_ns = snap.buffers ? CycleClock::ToNs(ticks / snap.buffers) : 0;
+                snap.max_ns = CycleClock::ToNs(cost.max_ticks.load(std::memory_order_relaxed));
+                snap.load_percent = period_ns > 0.0 ? static_cast<double>(snap.avg_ns) / period_ns * 100.0 : 0.0;
+            }
+            return count;
+        }
+        return 0;
+    }
+
+    // Running channels clear on their audio threads, free slots are cleared when next claimed.
+    void ClearAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& slot : slots) {
+            if (slot.users > 0) slot.stats->RequestClear();
+        }
+        overflow.RequestClear();
+    }
+
+private:
+    struct Slot {
+        char name[64] = {};
+        // Loops running under this name, 0 is free.
+        int users = 0;
+        std::unique_ptr<ChannelStats> stats;
+    };
+
+    std::mutex mutex;
+    Slot slots[MAX_CHANNELS];
+    // Shared by every channel past MAX_CHANNELS, so its single-writer counts can drop updates.
+    ChannelStats overflow;
+};
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ring.hpp>
+#include <telemetry.hpp>
+
+// Off by default. While off a span costs one relaxed load.
+inline std::atomic<bool> tracing{false};
+
+// A span in CycleClock ticks. name has to outlive the trace, in practice it's a literal.
+struct TraceEvent {
+    const char* name = nullptr;
+    uint64_t start = 0;
+    uint64_t end = 0;
+};
+
+struct TraceSummary {
+    uint64_t events;
+    uint64_t dropped;
+    uint64_t threads;
+};
+
+// One thread's events. Only the owning thread writes and only the collector reads, so the ring
+// is a plain SPSC ring. It's allocated when the first trace starts, threads never traced don't
+// have one.
+class TraceBuffer {
+public:
+    static constexpr size_t CAPACITY = 8192;
+
+    TraceBuffer(const char* name, uint32_t tid) : tid(tid) {
+        std::strncpy(this->name, name ? name : "", sizeof(this->name) - 1);
+    }
+
+    ~TraceBuffer() {
+        delete ring.load(std::memory_order_relaxed);
+    }
+
+    char name[64] = {};
+    const uint32_t tid;
+
+    // Owning thread. A full ring drops the event and counts it.
+    void Add(const char* event, uint64_t start, uint64_t end) {
+        SpscRing<TraceEvent>* events = ring.load(std::memory_order_acquire);
+        if (!events) return;
+        TraceEvent e{event, start, end};
+        if (events->Write(&e, 1) == 0) dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+private:
+    friend class TraceCollector;
+
+    std::atomic<SpscRing<TraceEvent>*> ring{nullptr};
+    std::atomic<uint64_t> dropped{0};
+    // Under the collector's mutex.
+    bool retired = false;
+    bool named = false;
+    uint64_t droppedBefore = 0;
+};
+
+inline thread_local TraceBuffer* trace_buffer = nullptr;
+
+inline void trace_event(const char* name, uint64_t start, uint64_t end) {
+    if (TraceBuffer* buffer = trace_buffer) buffer->Add(name, start, end);
+}
+
+// Times the enclosing scope on this thread's trace buffer while tracing is on.
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name(name), start(tracing.load(std::memory_order_relaxed) ? CycleClock::Now() : 0) {}
+
+    ~TraceSpan() {
+        if (start) trace_event(name, start, CycleClock::Now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+// Collects every thread's events into a Chrome trace JSON file, which chrome://tracing and
+// ui.perfetto.dev both open. A thread only shows up once it has registered with TraceThread.
+class TraceCollector {
+public:
+    static constexpr int FLUSH_MS = 50;
+
+    static TraceCollector& Instance() {
+        static TraceCollector collector;
+        return collector;
+    }
+
+    ~TraceCollector() {
+        Stop(nullptr);
+    }
+
+    std::shared_ptr<TraceBuffer> Register(const char* name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto buffer = std::make_shared<TraceBuffer>(name, nextTid++);
+        if (active) buffer->ring.store(new SpscRing<TraceEvent>(TraceBuffer::CAPACITY), std::memory_order_release);
+        buffers.push_back(buffer);
+        return buffer;
+    }
+
+    // The thread is done with buffer, it's freed once what's left in it has been written.
+    void Retire(const std::shared_ptr<TraceBuffer>& buffer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->retired = true;
+        if (!active) buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer), buffers.end());
+    }
+
+    // Starts writing a trace to path, false if one is already running or the file can't be made.
+    bool Start(const char* path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (active || !path) return false;
+        file.open(std::filesystem::u8path(path), std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return false;
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Vice audio\"}}";
+
+        CycleClock::Start();
+        origin = CycleClock::Now();
+        summary = TraceSummary{};
+        for (auto& buffer : buffers) {
+            buffer->named = false;
+            buffer->droppedBefore = buffer->dropped.load(std::memory_order_relaxed);
+            if (!buffer->ring.load(std::memory_order_relaxed))
+                buffer->ring.store(new SpscRing<TraceEvent>(TraceBuffer::CAPACITY), std::memory_order_release);
+        }
+        active = true;
+        stopping = false;
+        tracing.store(true, std::memory_order_relaxed);
+        thread = std::thread([this]() { Run(); });
+        return true;
+    }
+
+    // Stops tracing, writes out what's left and closes the file. False if no trace was running.
+    bool Stop(TraceSummary* out) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!active || stopping) return false;
+            tracing.store(false, std::memory_order_relaxed);
+            stopping = true;
+        }
+        wake.notify_all();
+        thread.join();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        Flush();
+        file << "\n]}\n";
+        file.close();
+
+        for (auto& buffer : buffers) summary.dropped += buffer->dropped.load(std::memory_order_relaxed) - buffer->droppedBefore;
+        // Live threads keep their ring for the next trace.
+        active = false;
+        if (out) *out = summary;
+        return true;
+    }
+
+    bool Active() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return active;
+    }
+
+private:
+    TraceCollector() = default;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+    bool active = false;
+    bool stopping = false;
+    uint32_t nextTid = 1;
+    std::vector<std::shared_ptr<TraceBuffer>> buffers;
+
+    std::ofstream file;
+    uint64_t origin = 0;
+    TraceSummary summary{};
+    std::vector<TraceEvent> scratch = std::vector<TraceEvent>(TraceBuffer::CAPACITY);
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            wake.wait_for(lock, std::chrono::milliseconds(FLUSH_MS));
+            if (stopping) break;
+            Flush();
+        }
+    }
+
+    static void WriteEscaped(std::ofstream& out, const char* s) {
+        for (; *s; ++s) {
+            unsigned char c = static_cast<unsigned char>(*s);
+            if (c == '"' || c == '\\') {
+                out << '\\' << *s;
+            } else if (c < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out << escaped;
+            } else {
+                out << *s;
+            }
+        }
+    }
+
+    // With mutex held.
+    void Flush() {
+        double ticksPerUs = CycleClock::TicksPerNs() * 1000.0;
+        char line[256];
+        for (auto& buffer : buffers) {
+            SpscRing<TraceEvent>* ring = buffer->ring.load(std::memory_order_relaxed);
+            if (!ring) continue;
+            if (!buffer->named) {
+                file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":\"";
+                WriteEscaped(file, buffer->name);
+                file << "\"}}";
+                buffer->named = true;
+                summary.threads++;
+            }
+
+            while (size_t count = ring->Read(scratch.data(), scratch.size())) {
+                for (size_t i = 0; i < count; ++i) {
+                    const TraceEvent& e = scratch[i];
+                    if (e.start < origin) continue;
+                    double ts = (e.start - origin) / ticksPerUs;
+                    double dur = e.end > e.start ? (e.end - e.start) / ticksPerUs : 0.0;
+                    std::snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"cat\":\"audio\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                                  e.name, ts, dur, buffer->tid);
+                    file << line;
+                    summary.events++;
+                }
+            }
+        }
+
+        // Drained for the last time, a retired thread won't write again.
+        buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [this](auto& b) {
+            if (b->retired) summary.dropped += b->dropped.load(std::memory_order_relaxed) - b->droppedBefore;
+            return b->retired;
+        }), buffers.end());
+    }
+};
+
+// Registers the calling thread under name for as long as it's in scope, put it at the top of a
+// thread's function.
+class TraceThread {
+public:
+    explicit TraceThread(const char* name) : buffer(TraceCollector::Instance().Register(name)) {
+        previous = trace_buffer;
+        trace_buffer = buffer.get();
+    }
+
+    ~TraceThread() {
+        trace_buffer = previous;
+        TraceCollector::Instance().Retire(buffer);
+    }
+
+    TraceThread(const TraceThread&) = delete;
+    TraceThread& operator=(const TraceThread&) = delete;
+
+private:
+    std::shared_ptr<TraceBuffer> buffer;
+    TraceBuffer* previous = nullptr;
+};
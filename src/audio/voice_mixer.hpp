@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <sound_cache.hpp>
+#include <sound_stream.hpp>
+
+// Anything a voice can play, already at the mixer's rate and channel count.
+class VoiceSource {
+public:
+    virtual ~VoiceSource() = default;
+
+    // Returns frames read, short reads are fine as long as Finished is false.
+    virtual size_t Read(float* out, size_t frames) = 0;
+    virtual bool Finished() const = 0;
+};
+
+class BufferVoiceSource : public VoiceSource {
+public:
+    explicit BufferVoiceSource(std::shared_ptr<const RenderedSound> sound) : sound(std::move(sound)) {}
+
+    size_t Read(float* out, size_t frames) override {
+        frames = std::min(frames, sound->frames - position);
+        std::memcpy(out, sound->samples.data() + position * sound->channels, frames * sound->channels * sizeof(float));
+        position += frames;
+        return frames;
+    }
+
+    bool Finished() const override {
+        return position >= sound->frames;
+    }
+
+private:
+    std::shared_ptr<const RenderedSound> sound;
+    size_t position = 0;
+};
+
+// Plays a compressed sound, decoding one block at a time into a buffer owned by the voice.
+class AdpcmVoiceSource : public VoiceSource {
+public:
+    explicit AdpcmVoiceSource(std::shared_ptr<const RenderedSound> sound)
+        : sound(std::move(sound)), block(AdpcmClip::BLOCK_FRAMES * this->sound->channels) {}
+
+    size_t Read(float* out, size_t frames) override {
+        const AdpcmClip& clip = sound->compressed;
+        int channels = sound->channels;
+        size_t written = 0;
+        while (written < frames) {
+            if (blockPosition == blockFrames) {
+                if (nextBlock >= clip.BlockCount()) break;
+                blockFrames = clip.DecodeBlock(nextBlock++, block.data());
+                blockPosition = 0;
+            }
+
+            size_t count = std::min(frames - written, blockFrames - blockPosition);
+            std::memcpy(out + written * channels, block.data() + blockPosition * channels, count * channels * sizeof(float));
+            blockPosition += count;
+            written += count;
+        }
+        return written;
+    }
+
+    bool Finished() const override {
+        return nextBlock >= sound->compressed.BlockCount() && blockPosition == blockFrames;
+    }
+
+private:
+    std::shared_ptr<const RenderedSound> sound;
+    std::vector<float> block;
+    size_t nextBlock = 0;
+    size_t blockFrames = 0;
+    size_t blockPosition = 0;
+};
+
+inline std::unique_ptr<VoiceSource> make_sound_voice(std::shared_ptr<const RenderedSound> sound) {
+    if (sound->IsCompressed()) return std::make_unique<AdpcmVoiceSource>(std::move(sound));
+    return std::make_unique<BufferVoiceSource>(std::move(sound));
+}
+
+// Plays a stream its StreamDecoder is filling. Freeing the voice only stops the stream, the
+// decoder holds the last reference and frees it on its own thread.
+class StreamVoiceSource : public VoiceSource {
+public:
+    explicit StreamVoiceSource(std::shared_ptr<SoundStream> stream) : stream(std::move(stream)) {}
+
+    ~StreamVoiceSource() override {
+        stream->Stop();
+    }
+
+    size_t Read(float* out, size_t frames) override {
+        return stream->Read(out, frames);
+    }
+
+    bool Finished() const override {
+        return stream->Finished();
+    }
+
+private:
+    std::shared_ptr<SoundStream> stream;
+};
+
+struct VoiceParams {
+    float gain;
+    uint32_t fade_in_ms;
+    // Used when the voice is stopped, choked or stolen. 0 uses a short declick fade.
+    uint32_t fade_out_ms;
+    // Starting a voice fades out every other voice in the same group, 0 is no group.
+    uint32_t group;
+};
+
+// Mixes up to a fixed number of voices into one stream. Play/Stop can be called from any thread
+// and only push a command, the render thread picks them up at the start of the next Mix.
+class VoiceMixer {
+public:
+    // Extra slots for voices fading out after being stolen or choked, so those don't count
+    // against the polyphony.
+    static constexpr size_t RELEASE_SLOTS = 8;
+    static constexpr uint32_t DECLICK_MS = 5;
+
+    explicit VoiceMixer(size_t polyphony = 32, size_t queueSize = 256)
+        : polyphony(std::max<size_t>(polyphony, 1)), commands(queueSize), voices(this->polyphony + RELEASE_SLOTS) {
+        retired.reserve(voices.size() + queueSize);
+    }
+
+    ~VoiceMixer() {
+        for (auto& voice : voices) delete voice.source;
+        Command command;
+        while (commands.Pop(command)) delete command.source;
+        FreeRetired();
+    }
+
+    VoiceMixer(const VoiceMixer&) = delete;
+    VoiceMixer& operator=(const VoiceMixer&) = delete;
+
+    // Call before rendering starts. maxFrames is the most Mix will be asked for at once.
+    void Configure(int sampleRate, int channels, size_t maxFrames) {
+        this->sampleRate = sampleRate;
+        this->channels = channels;
+        scratch.assign(maxFrames * channels, 0.0f);
+    }
+
+    // Returns the voice id, or 0 if the command queue is full (the source is dropped then).
+    uint64_t Play(std::unique_ptr<VoiceSource> source, const VoiceParams& params) {
+        Command command;
+        command.type = Command::PLAY;
+        command.id = nextId.fetch_add(1, std::memory_order_relaxed);
+        command.source = source.get();
+        command.params = params;
+        if (!commands.Push(command)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        source.release();
+        return command.id;
+    }
+
+    bool Stop(uint64_t id, uint32_t fadeMs) {
+        Command command;
+        command.type = Command::STOP;
+        command.id = id;
+        command.params.fade_out_ms = fadeMs;
+        return commands.Push(command);
+    }
+
+    bool StopAll(uint32_t fadeMs) {
+        Command command;
+        command.type = Command::STOP_ALL;
+        command.params.fade_out_ms = fadeMs;
+        return commands.Push(command);
+    }
+
+    // Render thread. Overwrites out with frames of mixed audio.
+    void Mix(float* out, size_t frames) {
+        ApplyCommands();
+        std::fill(out, out + frames * channels, 0.0f);
+        frames = std::min(frames, scratch.size() / channels);
+
+        for (auto& voice : voices) {
+            if (!voice.source) continue;
+
+            size_t read = voice.source->Read(scratch.data(), frames);
+            const float* in = scratch.data();
+            for (size_t f = 0; f < read; ++f) {
+                float level = voice.gain * voice.env;
+                for (int c = 0; c < channels; ++c) out[f * channels + c] += in[f * channels + c] * level;
+
+                voice.env += voice.envStep;
+                if (voice.env >= 1.0f && voice.envStep > 0.0f) {
+                    voice.env = 1.0f;
+                    voice.envStep = 0.0f;
+                } else if (voice.env <= 0.0f && voice.releasing) {
+                    voice.env = 0.0f;
+                    break;
+                }
+            }
+
+            if ((voice.releasing && voice.env <= 0.0f) || (read < frames && voice.source->Finished())) Retire(voice);
+        }
+    }
+
+    // Render thread, after the mixed buffer has been handed to the device. Sources are freed
+    // here so Mix never does, and none of them waits on anything: a stream only asks its decoder
+    // to let go of it.
+    void FreeRetired() {
+        for (VoiceSource* source : retired) delete source;
+        retired.clear();
+    }
+
+    // Render thread. True when nothing is playing and nothing is queued.
+    bool Idle() {
+        ApplyCommands();
+        for (auto& voice : voices) {
+            if (voice.source) return false;
+        }
+        return true;
+    }
+
+    size_t ActiveVoices() const {
+        size_t count = 0;
+        for (auto& voice : voices) {
+            if (voice.source) ++count;
+        }
+        return count;
+    }
+
+    uint64_t Stolen() const {
+        return stolen.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Dropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Command {
+        enum Type { PLAY, STOP, STOP_ALL } type = PLAY;
+        uint64_t id = 0;
+        VoiceSource* source = nullptr;
+        VoiceParams params{1.0f, 0, 0, 0};
+    };
+
+    struct Voice {
+        VoiceSource* source = nullptr;
+        uint64_t id = 0;
+        uint32_t group = 0;
+        uint32_t fadeOutFrames = 0;
+        float gain = 1.0f;
+        float env = 1.0f;
+        float envStep = 0.0f;
+        bool releasing = false;
+    };
+
+    size_t polyphony;
+    MpscQueue<Command> commands;
+    std::vector<Voice> voices;
+    std::vector<VoiceSource*> retired;
+    std::vector<float> scratch;
+    int sampleRate = 48000;
+    int channels = 2;
+    // Shared by every mixer so an id is enough to find a voice.
+    static inline std::atomic<uint64_t> nextId{1};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> dropped{0};
+
+    uint32_t MsToFrames(uint32_t ms) const {
+        return static_cast<uint32_t>(static_cast<uint64_t>(ms) * sampleRate / 1000);
+    }
+
+    void Retire(Voice& voice) {
+        retired.push_back(voice.source);
+        voice = Voice();
+    }
+
+    void Release(Voice& voice, uint32_t frames) {
+        if (frames == 0) frames = MsToFrames(DECLICK_MS);
+        voice.releasing = true;
+        voice.envStep = -std::max(voice.env, 1.0e-3f) / std::max<uint32_t>(frames, 1);
+    }
+
+    void ApplyCommands() {
+        Command command;
+        while (commands.Pop(command)) {
+            if (command.type == Command::PLAY) {
+                Start(command);
+            } else {
+                for (auto& voice : voices) {
+                    if (voice.source && !voice.releasing && (command.type == Command::STOP_ALL || voice.id == command.id)) {
+                        Release(voice, MsToFrames(command.params.fade_out_ms));
+                    }
+                }
+            }
+        }
+    }
+
+    void Start(const Command& command) {
+        size_t playing = 0;
+        Voice* oldest = nullptr;
+        for (auto& voice : voices) {
+            if (!voice.source || voice.releasing) continue;
+            if (command.params.group != 0 && voice.group == command.params.group) {
+                Release(voice, voice.fadeOutFrames);
+                continue;
+            }
+            ++playing;
+            if (!oldest || voice.id < oldest->id) oldest = &voice;
+        }
+
+        if (playing >= polyphony && oldest) {
+            Release(*oldest, MsToFrames(DECLICK_MS));
+            stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // No free slot means every release slot is busy too, cut the quietest one short.
+        Voice* slot = nullptr;
+        for (auto& voice : voices) {
+            if (!voice.source) {
+                slot = &voice;
+                break;
+            }
+            if (voice.releasing && (!slot || voice.env < slot->env)) slot = &voice;
+        }
+        if (slot->source) Retire(*slot);
+
+        slot->source = command.source;
+        slot->id = command.id;
+        slot->group = command.params.group;
+        slot->gain = command.params.gain;
+        slot->fadeOutFrames = MsToFrames(command.params.fade_out_ms);
+        uint32_t fadeIn = MsToFrames(command.params.fade_in_ms);
+        slot->env = fadeIn ? 0.0f : 1.0f;
+        slot->envStep = fadeIn ? 1.0f / fadeIn : 0.0f;
+        slot->releasing = false;
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <trace.hpp>
+
+// Fixed set of background threads for work that shouldn't hold up the UI or the audio loops,
+// like decoding sounds ahead of time. on_start/on_stop run on each worker, e.g. for COM setup.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads, std::function<void()> on_start = {}, std::function<void()> on_stop = {}) {
+        if (threads == 0) threads = 1;
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this, on_start, on_stop]() {
+                if (on_start) on_start();
+                Run();
+                if (on_stop) on_stop();
+            });
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Safe to call from inside a task.
+    void Submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Blocks until every submitted task has finished. Don't call from inside a task.
+    void Wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this]() { return tasks.empty() && running == 0; });
+    }
+
+    size_t Size() const {
+        return workers.size();
+    }
+
+    // One less than the core count so a busy pool leaves a core for the audio threads.
+    static size_t DefaultThreads() {
+        size_t cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 1;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    size_t running = 0;
+    bool stopping = false;
+
+    void Run() {
+        TraceThread trace("worker");
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+                ++running;
+            }
+
+            {
+                TraceSpan span("task");
+                task();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --running;
+                if (tasks.empty() && running == 0) idle.notify_all();
+            }
+        }
+    }
+};
@@ -21,6 +21,13 @@ pub(crate) struct SoundboardSFX {
     pub(crate) lowlatency: bool
 }
 
+/// One of the devices a channel plays to. An empty device is the default output.
+#[derive(Debug, Deserialize, Serialize, PartialEq, Clone, Default)]
+pub(crate) struct Route {
+    pub(crate) device: String,
+    pub(crate) gain: f32
+}
+
 #[derive(Debug, Deserialize, Serialize, PartialEq, Clone, Default)]
 pub(crate) struct Channel {
     pub(crate) name: String,
@@ -29,7 +36,9 @@ pub(crate) struct Channel {
     pub(crate) device: String,
     pub(crate) deviceorapp: bool,
     pub(crate) lowlatency: bool,
-    pub(crate) volume: f32
+    pub(crate) volume: f32,
+    /// Empty plays to the output in settings.
+    pub(crate) outputs: Vec<Route>
 }
 
 #[derive(Deserialize, Serialize, PartialEq, Clone)]
@@ -39,7 +48,14 @@ pub(crate) struct Settings {
     pub(crate) light: bool,
     pub(crate) monitor: bool,
     pub(crate) peaks: bool,
-    pub(crate) startup: bool
+    pub(crate) startup: bool,
+    pub(crate) sfxcache: u32,
+    pub(crate) sfxcompress: bool,
+    pub(crate) sfxnormalize: bool,
+    pub(crate) replay: u32,
+    pub(crate) replaycache: u32,
+    pub(crate) jitter: u32,
+    pub(crate) adaptive: bool
 }
 
 #[derive(Deserialize, Serialize)]
@@ -57,7 +73,7 @@ impl Default for File {
 
 impl Default for Settings {
     fn default() -> Self {
-        Settings { output: "".to_string(), scale: 1.0, light: false, monitor: true, peaks: true, startup: false }
+        Settings { output: "".to_string(), scale: 1.0, light: false, monitor: true, peaks: true, startup: false, sfxcache: 256, sfxcompress: false, sfxnormalize: false, replay: 0, replaycache: 256, jitter: 0, adaptive: false }
     }
 }
 
@@ -83,6 +99,14 @@ pub(crate) fn blocks_base() -> PathBuf {
     app_base().join("Blocks")
 }
 
+pub(crate) fn recordings_base() -> PathBuf {
+    app_base().join("Recordings")
+}
+
+pub(crate) fn traces_base() -> PathBuf {
+    app_base().join("Traces")
+}
+
 fn settings_json() -> PathBuf {
     app_base().join("settings.json")
 }
@@ -164,6 +188,34 @@ pub(crate) fn fix_settings(broken: Value) -> Settings {
         settings.startup = startup;
     }
 
+    if let Some(sfxcache) = broken.get("sfxcache").and_then(|v| v.as_u64()) {
+        settings.sfxcache = sfxcache.min(8192) as u32;
+    }
+
+    if let Some(sfxcompress) = broken.get("sfxcompress").and_then(|v| v.as_bool()) {
+        settings.sfxcompress = sfxcompress;
+    }
+
+    if let Some(sfxnormalize) = broken.get("sfxnormalize").and_then(|v| v.as_bool()) {
+        settings.sfxnormalize = sfxnormalize;
+    }
+
+    if let Some(replay) = broken.get("replay").and_then(|v| v.as_u64()) {
+        settings.replay = replay.min(60) as u32;
+    }
+
+    if let Some(replaycache) = broken.get("replaycache").and_then(|v| v.as_u64()) {
+        settings.replaycache = replaycache.min(8192) as u32;
+    }
+
+    if let Some(jitter) = broken.get("jitter").and_then(|v| v.as_u64()) {
+        settings.jitter = jitter.min(500) as u32;
+    }
+
+    if let Some(adaptive) = broken.get("adaptive").and_then(|v| v.as_bool()) {
+        settings.adaptive = adaptive;
+    }
+
     settings
 }
 
@@ -266,6 +318,15 @@ pub(crate) fn fix_channel(broken: Value) -> Channel {
         channel.volume = volume as f32;
     }
 
+    if let Some(outputs) = broken.get("outputs").and_then(|v| v.as_array()) {
+        for output in outputs {
+            if let Some(device) = output.get("device").and_then(|v| v.as_str()) {
+                let gain = output.get("gain").and_then(|v| v.as_f64()).unwrap_or(1.0);
+                channel.outputs.push(Route { device: device.to_string(), gain: gain.clamp(0.0, 4.0) as f32 });
+            }
+        }
+    }
+
     channel
 }
 
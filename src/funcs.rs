@@ -3,18 +3,18 @@ use std::{net::TcpStream, time::Duration, fs};
 use rfd::{MessageDialog, MessageDialogResult};
 use serde::Deserialize;
 
-use crate::files::{self, Channel, Settings, SoundboardSFX};
+use crate::files::{self, Channel, Route, Settings, SoundboardSFX};
 use crate::audio::{self};
 use crate::performance;
 
 static SFX_EXTENTIONS: [&str; 6] = ["wav", "mp3", "wma", "aac", "m4a", "flac"];
 
 pub(crate) fn new_channel(color: [u8; 3], icon: String, name: String, deviceapps: String, device: bool, low: bool) -> Result<(), String> {
-    let channel: Channel = Channel{name, icon, color, device: deviceapps, deviceorapp: device, lowlatency: low, volume: 1.0};
+    let channel: Channel = Channel{name, icon, color, device: deviceapps, deviceorapp: device, lowlatency: low, volume: 1.0, outputs: vec![]};
     let mut channels: Vec<Channel> = files::get_channels();
 
     channels.push(channel);
-    return files::save_channels(channels).map(|_| audio::restart());
+    return files::save_channels(channels).map(|_| audio::sync());
 }
 
 pub(crate) fn new_sound(color: [u8; 3], icon: String, name: String, sound: String, low: bool) -> Result<(), String> {
@@ -39,20 +39,21 @@ pub(crate) fn new_sound(color: [u8; 3], icon: String, name: String, sound: Strin
     let sfx: SoundboardSFX = SoundboardSFX{name, icon, color, lowlatency: low};
 
     sfxs.push(sfx);
-    return files::save_soundboard(sfxs);
+    return files::save_soundboard(sfxs).map(|_| analyze_soundboard());
 }
 
 pub(crate) fn edit_channel(color: [u8; 3], icon: String, name: String, deviceapps: String, device: bool, oldname: String, low: bool) -> Result<(), String> {
     let mut channels: Vec<Channel> = files::get_channels();
 
     if let Some(pos) = channels.iter().position(|c: &Channel| c.name == oldname) {
-        channels[pos] = Channel{name, icon, color, device: deviceapps, deviceorapp: device, lowlatency: low, volume: 1.0};
+        let outputs: Vec<Route> = channels[pos].outputs.clone();
+        channels[pos] = Channel{name, icon, color, device: deviceapps, deviceorapp: device, lowlatency: low, volume: 1.0, outputs};
     } else {
         eprintln!("Channel \"{}\" not found", oldname);
         return Err(format!("Channel \"{}\" not found", oldname));
     }
     
-    return files::save_channels(channels).map(|_| audio::restart());
+    return files::save_channels(channels).map(|_| audio::sync());
 }
 
 pub(crate) fn edit_soundboard(color: [u8; 3], icon: String, name: String, oldname: String, low: bool) -> Result<(), String> {
@@ -78,7 +79,7 @@ pub(crate) fn delete_channel(name: String) -> Result<(), String> {
         return Err(format!("Channel \"{}\" not found", name));
     }
     
-    return files::save_channels(channels).map(|_| audio::restart());
+    return files::save_channels(channels).map(|_| audio::sync());
 }
 
 pub(crate) fn delete_sound(name: String) -> Result<(), String> {
@@ -137,7 +138,7 @@ pub(crate) fn save_settings(output: String, scale: f32, light: bool, monitor: bo
     settings.peaks = peaks;
     settings.startup = startup;
 
-    files::save_settings(settings).map(|_| {audio::restart(); performance::change_bool(monitor); files::manage_startup()})
+    files::save_settings(settings).map(|_| {audio::sync(); performance::change_bool(monitor); files::manage_startup(); preload_soundboard()})
 }
 
 pub(crate) fn get_performance() -> String {
@@ -169,30 +170,144 @@ pub(crate) fn set_volume(name: String, volume: f32) {
     files::save_channels(channels).unwrap_or_else(|e| eprintln!("Error saving channels: {}", e));
 }
 
+/// Plays the channel to every device in outputs at its own gain, from one capture and one chain.
+/// An empty list goes back to the output in settings.
+pub(crate) fn set_channel_outputs(name: String, outputs: Vec<Route>) -> Result<(), String> {
+    let mut channels: Vec<Channel> = files::get_channels();
+
+    if let Some(pos) = channels.iter().position(|c: &Channel| c.name == name) {
+        channels[pos].outputs = outputs;
+    } else {
+        eprintln!("Channel \"{}\" not found", name);
+        return Err(format!("Channel \"{}\" not found", name));
+    }
+
+    return files::save_channels(channels).map(|_| audio::sync());
+}
+
 pub(crate) fn get_outputs() -> Vec<String> {
     audio::outputs()
 }
 
-pub(crate) fn play_sound(name: String, low: bool) {
-    let mut path: String = "".to_owned();
+fn sfx_path(name: &str) -> Option<String> {
     for ext in SFX_EXTENTIONS {
-        let filename = format!("{}.{}", files::sfx_base().join(&name).to_str().unwrap_or(&name), ext);
+        let filename = format!("{}.{}", files::sfx_base().join(name).to_str().unwrap_or(name), ext);
         if fs::metadata(&filename).is_ok() {
-            path = filename;
-            break;
+            return Some(filename);
         }
     }
+    None
+}
 
-    if path == "" {
-        eprintln!("Failed to get soundeffect file for soundeffect \"{}\"", name);
-        return;
-    }
+pub(crate) fn play_sound(name: String, low: bool) {
+    let path: String = match sfx_path(&name) {
+        Some(p) => p,
+        None => {
+            eprintln!("Failed to get soundeffect file for soundeffect \"{}\"", name);
+            return;
+        }
+    };
 
     audio::play_sfx(&path, low);
 }
 
-pub(crate) fn get_volume(name: String, get: bool, device: bool) -> String {
-    audio::get_volume_parsed(name, get, device)
+pub(crate) fn stop_sounds() {
+    audio::stop_sfx(50);
+}
+
+pub(crate) fn preload_soundboard() {
+    let settings: Settings = files::get_settings();
+    audio::set_sfx_cache_budget(settings.sfxcache);
+    audio::set_sfx_compression(settings.sfxcompress);
+    audio::set_sfx_normalization(settings.sfxnormalize);
+
+    let paths: Vec<String> = files::get_soundboard().iter().filter_map(|sfx| sfx_path(&sfx.name)).collect();
+    audio::analyze_sfx(paths.clone());
+    if !paths.is_empty() {
+        audio::preload_sfx(paths);
+    }
+}
+
+fn analyze_soundboard() {
+    let paths: Vec<String> = files::get_soundboard().iter().filter_map(|sfx| sfx_path(&sfx.name)).collect();
+    audio::analyze_sfx(paths);
+}
+
+pub(crate) fn get_sound_info(name: String, points: usize) -> Option<audio::SfxInfo> {
+    audio::sfx_info(&sfx_path(&name)?, points)
+}
+
+pub(crate) fn get_spectra() -> String {
+    serde_json::to_string(&audio::channel_spectra()).unwrap_or_else(|_| "{}".to_string())
+}
+
+pub(crate) fn set_spectrum(enabled: bool) {
+    audio::set_spectrum(enabled);
+}
+
+pub(crate) fn get_levels() -> String {
+    serde_json::to_string(&audio::channel_levels()).unwrap_or_else(|_| "{}".to_string())
+}
+
+pub(crate) fn start_recording(source: String, output: bool, format: String, bits: i32) -> Option<u64> {
+    audio::start_record(&source, output, &format, bits)
+}
+
+pub(crate) fn stop_recording(id: u64) -> String {
+    serde_json::to_string(&audio::stop_record(id)).unwrap_or_else(|_| "null".to_string())
+}
+
+pub(crate) fn get_recordings() -> String {
+    serde_json::to_string(&audio::recordings()).unwrap_or_else(|_| "[]".to_string())
+}
+
+pub(crate) fn set_replay(minutes: u32) -> Result<(), String> {
+    let mut settings: Settings = files::get_settings();
+    settings.replay = minutes.min(60);
+    let (replay, replaycache, output) = (settings.replay, settings.replaycache, settings.output.clone());
+    files::save_settings(settings).map(|_| audio::configure_replay(replay, replaycache, &output))
+}
+
+pub(crate) fn set_jitter(ms: u32) -> Result<(), String> {
+    let mut settings: Settings = files::get_settings();
+    settings.jitter = ms.min(500);
+    let jitter = settings.jitter;
+    files::save_settings(settings).map(|_| audio::set_jitter(jitter))
+}
+
+/// Adaptive channels restart with their outputs tuning their own latency.
+pub(crate) fn set_adaptive(enabled: bool) -> Result<(), String> {
+    let mut settings: Settings = files::get_settings();
+    settings.adaptive = enabled;
+    files::save_settings(settings).map(|_| audio::sync())
+}
+
+pub(crate) fn save_replay(source: String, output: bool, format: String, bits: i32, seconds: f64) -> Option<u64> {
+    audio::save_replay(&source, output, &format, bits, seconds)
+}
+
+pub(crate) fn get_replay_exports() -> String {
+    serde_json::to_string(&audio::replay_exports()).unwrap_or_else(|_| "[]".to_string())
+}
+
+pub(crate) fn get_replay_memory() -> String {
+    serde_json::to_string(&audio::replay_memory()).unwrap_or_else(|_| "{}".to_string())
+}
+
+pub(crate) fn start_trace() -> Option<String> {
+    audio::begin_trace()
+}
+
+pub(crate) fn stop_trace() -> String {
+    serde_json::to_string(&audio::end_trace()).unwrap_or_else(|_| "null".to_string())
+}
+
+pub(crate) fn get_block_costs(item: String) -> String {
+    serde_json::to_string(&audio::block_costs(item)).unwrap_or_else(|_| "[]".to_string())
+}
+
+pub(crate) fn get_channel_states() -> String {
+    serde_json::to_string(&audio::channel_states()).unwrap_or_else(|_| "[]".to_string())
 }
 
 pub(crate) fn uninstall() -> Result<String, String> {
@@ -299,7 +414,7 @@ pub(crate) fn save_blocks(item: String, blocks: String) {
         return;
     }
 
-    audio::restart();
+    audio::sync();
 }
 
 pub(crate) fn load_blocks(item: String) -> String {
@@ -193,6 +193,20 @@ fn handle_ipc(cmd: &str, args: serde_json::Value) -> serde_json::Value {
                 funcs::set_volume(name.to_string(), volume as f32);
             }
         }
+    } else if cmd == "set_channel_outputs" {
+        if let Some(name) = args.get("name").and_then(|v| v.as_str()) {
+            if let Some(outputs) = args.get("outputs").and_then(|v| v.as_array()) {
+                let routes = outputs.iter()
+                    .filter_map(|o| {
+                        let device = o.get("device").and_then(|v| v.as_str())?;
+                        let gain = o.get("gain").and_then(|v| v.as_f64()).unwrap_or(1.0);
+                        Some(files::Route { device: device.to_string(), gain: gain.clamp(0.0, 4.0) as f32 })
+                    })
+                    .collect();
+                let res = funcs::set_channel_outputs(name.to_string(), routes);
+                return json!({"result": res});
+            }
+        }
     } else if cmd == "get_outputs" {
         let outputs = funcs::get_outputs();
         return json!({"result": outputs});
@@ -202,15 +216,76 @@ fn handle_ipc(cmd: &str, args: serde_json::Value) -> serde_json::Value {
                 funcs::play_sound(name.to_string(), low);
             }
         }
-    } else if cmd == "get_volume" {
+    } else if cmd == "stop_sounds" {
+        funcs::stop_sounds();
+    } else if cmd == "get_sound_info" {
         if let Some(name) = args.get("name").and_then(|v| v.as_str()) {
-            if let Some(get) = args.get("get").and_then(|v| v.as_bool()) {
-                if let Some(device) = args.get("device").and_then(|v| v.as_bool()) {
-                    let volume = funcs::get_volume(name.to_string(), get, device);
-                    return json!({"result": volume});
-                }
-            }
+            let points = args.get("points").and_then(|v| v.as_u64()).unwrap_or(256).min(4096) as usize;
+            let res = funcs::get_sound_info(name.to_string(), points);
+            return json!({"result": res});
         }
+    } else if cmd == "get_spectra" {
+        let spectra = funcs::get_spectra();
+        return json!({"result": spectra});
+    } else if cmd == "set_spectrum" {
+        if let Some(enabled) = args.get("enabled").and_then(|v| v.as_bool()) {
+            funcs::set_spectrum(enabled);
+        }
+    } else if cmd == "get_levels" {
+        let levels = funcs::get_levels();
+        return json!({"result": levels});
+    } else if cmd == "start_recording" {
+        if let Some(source) = args.get("source").and_then(|v| v.as_str()) {
+            let output = args.get("output").and_then(|v| v.as_bool()).unwrap_or(false);
+            let format = args.get("format").and_then(|v| v.as_str()).unwrap_or("wav");
+            let bits = args.get("bits").and_then(|v| v.as_i64()).unwrap_or(24) as i32;
+            let res = funcs::start_recording(source.to_string(), output, format.to_string(), bits);
+            return json!({"result": res});
+        }
+    } else if cmd == "stop_recording" {
+        if let Some(id) = args.get("id").and_then(|v| v.as_u64()) {
+            let res = funcs::stop_recording(id);
+            return json!({"result": res});
+        }
+    } else if cmd == "get_recordings" {
+        let recordings = funcs::get_recordings();
+        return json!({"result": recordings});
+    } else if cmd == "set_replay" {
+        if let Some(minutes) = args.get("minutes").and_then(|v| v.as_u64()) {
+            let res = funcs::set_replay(minutes as u32);
+            return json!({"result": res});
+        }
+    } else if cmd == "set_jitter" {
+        if let Some(ms) = args.get("ms").and_then(|v| v.as_u64()) {
+            let res = funcs::set_jitter(ms as u32);
+            return json!({"result": res});
+        }
+    } else if cmd == "set_adaptive" {
+        if let Some(enabled) = args.get("enabled").and_then(|v| v.as_bool()) {
+            let res = funcs::set_adaptive(enabled);
+            return json!({"result": res});
+        }
+    } else if cmd == "save_replay" {
+        if let Some(source) = args.get("source").and_then(|v| v.as_str()) {
+            let output = args.get("output").and_then(|v| v.as_bool()).unwrap_or(false);
+            let format = args.get("format").and_then(|v| v.as_str()).unwrap_or("wav");
+            let bits = args.get("bits").and_then(|v| v.as_i64()).unwrap_or(16) as i32;
+            let seconds = args.get("seconds").and_then(|v| v.as_f64()).unwrap_or(30.0);
+            let res = funcs::save_replay(source.to_string(), output, format.to_string(), bits, seconds);
+            return json!({"result": res});
+        }
+    } else if cmd == "get_replay_exports" {
+        let exports = funcs::get_replay_exports();
+        return json!({"result": exports});
+    } else if cmd == "get_replay_memory" {
+        let memory = funcs::get_replay_memory();
+        return json!({"result": memory});
+    } else if cmd == "start_trace" {
+        let path = funcs::start_trace();
+        return json!({"result": path});
+    } else if cmd == "stop_trace" {
+        let summary = funcs::stop_trace();
+        return json!({"result": summary});
     } else if cmd == "uninstall" {
         let res = funcs::uninstall();
         return json!({"result": res});
@@ -228,6 +303,14 @@ fn handle_ipc(cmd: &str, args: serde_json::Value) -> serde_json::Value {
             let res = funcs::load_blocks(item.to_string());
             return json!({"result": res});
         }
+    } else if cmd == "get_block_costs" {
+        if let Some(item) = args.get("item").and_then(|v| v.as_str()) {
+            let res = funcs::get_block_costs(item.to_string());
+            return json!({"result": res});
+        }
+    } else if cmd == "get_channel_states" {
+        let res = funcs::get_channel_states();
+        return json!({"result": res});
     } else if cmd == "flutter_print" {
         if let Some(text) = args.get("text").and_then(|v| v.as_str()) {
             println!("{}", text);
@@ -387,6 +470,7 @@ pub fn run() {
 
     files::create_files();
     audio::start();
+    funcs::preload_soundboard();
     performance::start();
 
     let (tx, rx) = std::sync::mpsc::channel();
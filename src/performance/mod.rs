@@ -7,6 +7,7 @@ use std::{
 use once_cell::sync::Lazy;
 use serde::Serialize;
 
+use crate::audio::{self, ChannelLatency, SfxCache};
 use crate::files;
 
 #[derive(Default, Clone, Serialize, Debug)]
@@ -14,6 +15,8 @@ pub(crate) struct Data {
     pub(crate) system: HashMap<String, Vec<f32>>,
     pub(crate) app: HashMap<String, Vec<f32>>,
     pub(crate) general: HashMap<String, f32>,
+    pub(crate) channels: Vec<ChannelLatency>,
+    pub(crate) sfx_cache: SfxCache,
 }
 
 #[link(name = "performance")]
@@ -66,7 +69,10 @@ fn run_loop() {
 }
 
 pub(crate) fn get_data() -> Data {
-    PERFORMANCE.lock().unwrap().clone()
+    let mut data: Data = PERFORMANCE.lock().unwrap().clone();
+    data.channels = audio::channel_stats();
+    data.sfx_cache = audio::sfx_cache_stats();
+    data
 }
 
 pub(crate) fn clear_data() {
@@ -74,6 +80,8 @@ pub(crate) fn clear_data() {
     per.system.clear();
     per.app.clear();
     per.general.clear();
+
+    audio::clear_channel_stats();
 }
 
 pub(crate) fn start() {